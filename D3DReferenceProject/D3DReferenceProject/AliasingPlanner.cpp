@@ -0,0 +1,81 @@
+#include "AliasingPlanner.h"
+#include <cassert>
+
+uint64_t AlignOffset(uint64_t offset, uint64_t alignment)
+{
+	return (offset + (alignment - 1)) & ~(alignment - 1);
+}
+
+bool LifetimesOverlap(const TransientResource& a, const TransientResource& b)
+{
+	return a.firstUse <= b.lastUse && b.firstUse <= a.lastUse;
+}
+
+AliasingReport AliasingPlanner::Plan(TransientResource* resources, uint32_t numResources, uint32_t* scratch)
+{
+	AliasingReport report;
+	report.numResources = numResources;
+
+	uint32_t* order = scratch; // Resource indices, largest first
+	uint32_t* placed = scratch + numResources; // Resource indices already placed, sorted by offset
+	uint32_t numPlaced = 0;
+
+	// Sort by size; plans are a few dozen resources at most, so insertion sort is plenty (and keeps ties in declaration order)
+	for (uint32_t i = 0; i < numResources; i++)
+	{
+		assert(("Transient resource alignments must be powers of two", (resources[i].alignment & (resources[i].alignment - 1)) == 0));
+		assert(("Transient resource used before it's created", resources[i].firstUse <= resources[i].lastUse));
+
+		uint32_t j = i;
+		while (j > 0 && resources[order[j - 1]].bytes < resources[i].bytes)
+		{
+			order[j] = order[j - 1];
+			j--;
+		}
+		order[j] = i;
+
+		report.naiveBytes += AlignOffset(resources[i].bytes, resources[i].alignment);
+	}
+
+	for (uint32_t i = 0; i < numResources; i++)
+	{
+		TransientResource& resrc = resources[order[i]];
+
+		// Walk placed resources in offset order, skipping past each one alive at the same time as [resrc], until a gap opens up that's big enough
+		uint64_t offset = 0;
+		for (uint32_t j = 0; j < numPlaced; j++)
+		{
+			const TransientResource& other = resources[placed[j]];
+			if (!LifetimesOverlap(resrc, other))
+			{
+				continue;
+			}
+
+			const uint64_t candidate = AlignOffset(offset, resrc.alignment);
+			if (candidate + resrc.bytes <= other.heapOffset)
+			{
+				break;
+			}
+
+			const uint64_t otherEnd = other.heapOffset + other.bytes;
+			offset = (otherEnd > offset) ? otherEnd : offset;
+		}
+		resrc.heapOffset = AlignOffset(offset, resrc.alignment);
+
+		const uint64_t resrcEnd = resrc.heapOffset + resrc.bytes;
+		report.heapBytes = (resrcEnd > report.heapBytes) ? resrcEnd : report.heapBytes;
+
+		// Keep [placed] sorted by offset
+		uint32_t j = numPlaced;
+		while (j > 0 && resources[placed[j - 1]].heapOffset > resrc.heapOffset)
+		{
+			placed[j] = placed[j - 1];
+			j--;
+		}
+		placed[j] = order[i];
+		numPlaced++;
+	}
+
+	report.savedBytes = (report.naiveBytes > report.heapBytes) ? report.naiveBytes - report.heapBytes : 0;
+	return report;
+}
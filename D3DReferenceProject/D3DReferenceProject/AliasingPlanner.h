@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+// Memory aliasing planner for transient (single-frame, few-pass) resources
+// Takes each resource's size and lifetime (first & last use, in whatever step units the caller likes - the render graph uses its compiled levels) and
+// packs them into one shared heap, so resources that are never alive at the same time land on the same bytes
+// Placement is greedy-by-size first-fit: the largest resources go down first, then each later one takes the lowest offset that doesn't collide with
+// anything already placed & alive over an overlapping range of steps
+// Pure CPU - nothing here touches D3D, so plans can be built (and checked) without a device
+
+struct TransientResource
+{
+	// Inputs
+	uint64_t bytes = 0;
+	uint32_t alignment = 1; // Power of two
+	uint32_t firstUse = 0; // Inclusive
+	uint32_t lastUse = 0; // Inclusive
+
+	// Output
+	uint64_t heapOffset = 0;
+};
+
+struct AliasingReport
+{
+	uint64_t naiveBytes = 0; // One dedicated allocation per resource
+	uint64_t heapBytes = 0; // Size of the shared heap after packing
+	uint64_t savedBytes = 0;
+	uint32_t numResources = 0;
+};
+
+class AliasingPlanner
+{
+	public:
+		// Fills in [heapOffset] for each of [resources]
+		// [scratch] needs room for 2 * [numResources] entries
+		static AliasingReport Plan(TransientResource* resources, uint32_t numResources, uint32_t* scratch);
+};
@@ -0,0 +1,120 @@
+#include "CommandBuffer.h"
+#include "Memory.h"
+#include <cstring>
+#include <cstdlib>
+
+void CommandBuffer::Init(uint32_t streamBytes)
+{
+	stream = Memory::AllocateArray<char>(streamBytes, record_alignment, MEM_TAGS::PIPELINE);
+	capacityBytes = streamBytes;
+	usedBytes = 0;
+}
+
+void* CommandBuffer::Push(CMD_TYPES type, uint8_t stage, uint16_t count, uint32_t payloadBytes)
+{
+	const uint32_t recordBytes = (sizeof(CommandHeader) + payloadBytes + (record_alignment - 1)) & ~(record_alignment - 1);
+	if (recordBytes > capacityBytes - usedBytes)
+	{
+		// Hard error, same as Memory; the stream block is packed in with everything else from the arena, so writing past it would trample that
+		assert(("Command buffer full; raise its capacity", false));
+		std::abort();
+	}
+
+	CommandHeader* header = reinterpret_cast<CommandHeader*>(stream + usedBytes);
+	header->type = type;
+	header->stage = stage;
+	header->count = count;
+	header->sizeBytes = recordBytes;
+
+	usedBytes += recordBytes;
+	return header + 1;
+}
+
+void CommandBuffer::EncodeStageTables(const BindingTable& bindings)
+{
+	for (uint8_t stageNdx = 0; stageNdx < 3; stageNdx++)
+	{
+		const BindingTable::StageTable& stage = bindings.stages[stageNdx];
+		if (stage.numSRVs > 0)
+		{
+			void* payload = Push(CMD_TYPES::SET_SRVS, stageNdx, static_cast<uint16_t>(stage.numSRVs), stage.numSRVs * sizeof(D3DHandle));
+			memcpy(payload, stage.srvs, stage.numSRVs * sizeof(D3DHandle));
+		}
+
+		if (stage.numCBuffers > 0)
+		{
+			void* payload = Push(CMD_TYPES::SET_CBUFFERS, stageNdx, static_cast<uint16_t>(stage.numCBuffers), stage.numCBuffers * sizeof(D3DHandle));
+			memcpy(payload, stage.cbuffers, stage.numCBuffers * sizeof(D3DHandle));
+		}
+	}
+}
+
+void CommandBuffer::EncodeDraw(const DrawJob& job, const DrawGeometry& geometry)
+{
+	const BindingTable& bindings = job.bindingTable;
+	assert(("Direct write to back-buffer expected, but render-target view provided", !(job.directToBackbuf && bindings.numRTVs > 0)));
+
+	// Outputs first, so anything about to be read through an SRV is already unbound from the output-merger
+	if (job.directToBackbuf)
+	{
+		Push(CMD_TYPES::SET_BACKBUFFER, 0, 0, 0);
+	}
+	else if (bindings.numRTVs > 0 || bindings.hasDSV)
+	{
+		CmdSetTargets* targets = reinterpret_cast<CmdSetTargets*>(Push(CMD_TYPES::SET_TARGETS, 0, static_cast<uint16_t>(bindings.numRTVs),
+																		sizeof(CmdSetTargets) + bindings.numRTVs * sizeof(D3DHandle)));
+		targets->dsv = bindings.dsv;
+		targets->hasDSV = bindings.hasDSV ? 1 : 0;
+		memcpy(targets + 1, bindings.rtvs, bindings.numRTVs * sizeof(D3DHandle));
+	}
+
+	EncodeStageTables(bindings);
+
+	CmdSetGeometry* buffers = reinterpret_cast<CmdSetGeometry*>(Push(CMD_TYPES::SET_GEOMETRY, 0, 0, sizeof(CmdSetGeometry)));
+	buffers->vbuffer = geometry.vbuffer;
+	buffers->ibuffer = geometry.ibuffer;
+	buffers->instances = geometry.hasInstances ? geometry.instances : D3DHandle{};
+	buffers->vbufferOffset = geometry.vbufferOffset;
+	buffers->ibufferOffset = geometry.ibufferOffset;
+	buffers->hasInstances = geometry.hasInstances ? 1 : 0;
+	buffers->is2D = job.is2D ? 1 : 0;
+
+	CmdSetShaders* shaders = reinterpret_cast<CmdSetShaders*>(Push(CMD_TYPES::SET_SHADERS, 0, 0, sizeof(CmdSetShaders)));
+	shaders->vs = job.vs.index;
+	shaders->ps = job.ps.index;
+
+	for (uint32_t i = 0; i < geometry.numBatches; i++)
+	{
+		CmdDrawIndexed* draw = reinterpret_cast<CmdDrawIndexed*>(Push(CMD_TYPES::DRAW_INDEXED, 0, 0, sizeof(CmdDrawIndexed)));
+		draw->batch = geometry.batches[i];
+	}
+}
+
+void CommandBuffer::EncodeConstantRange(SHADER_TYPES stage, uint32_t slot, const UploadAllocation& constants)
+{
+	assert(("Constant ranges start on 256-byte boundaries", (constants.offset % 256) == 0));
+	CmdSetConstantRange* range = reinterpret_cast<CmdSetConstantRange*>(Push(CMD_TYPES::SET_CONSTANT_RANGE, static_cast<uint8_t>(stage), static_cast<uint16_t>(slot), sizeof(CmdSetConstantRange)));
+	range->buffer = constants.buffer;
+	range->firstConstant = constants.offset / 16;
+	range->numConstants = ((constants.numBytes + 255) / 256) * 16;
+}
+
+void CommandBuffer::EncodeDispatch(const DispatchJob& job)
+{
+	const BindingTable& bindings = job.bindingTable;
+	if (bindings.numUAVs > 0)
+	{
+		void* payload = Push(CMD_TYPES::SET_UAVS, static_cast<uint8_t>(SHADER_TYPES::CS), static_cast<uint16_t>(bindings.numUAVs), bindings.numUAVs * sizeof(D3DHandle));
+		memcpy(payload, bindings.uavs, bindings.numUAVs * sizeof(D3DHandle));
+	}
+
+	EncodeStageTables(bindings);
+
+	CmdSetComputeShader* shader = reinterpret_cast<CmdSetComputeShader*>(Push(CMD_TYPES::SET_COMPUTE_SHADER, 0, 0, sizeof(CmdSetComputeShader)));
+	shader->cs = job.cs.index;
+
+	CmdDispatch* dispatch = reinterpret_cast<CmdDispatch*>(Push(CMD_TYPES::DISPATCH, 0, 0, sizeof(CmdDispatch)));
+	dispatch->x = job.dispatchX;
+	dispatch->y = job.dispatchY;
+	dispatch->z = job.dispatchZ;
+}
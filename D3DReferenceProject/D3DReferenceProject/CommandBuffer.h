@@ -0,0 +1,125 @@
+#pragma once
+
+#include "ShadingJobs.h"
+
+// Compact, linear encoding of a frame's GPU work
+// Jobs are flattened into a tightly packed stream of variable-length records (header + payload), so the backend walks one contiguous block
+// of memory instead of chasing jobs (each several KB of mostly-empty binding arrays) & unpacking them into 20-odd call arguments
+// Bindings are copied inline, one record per non-empty slot table, so a draw only pays for the slots it actually uses
+// Each buffer owns a fixed block from Memory & rewinds it on Reset(), so encoding never allocates; overflowing that block is a hard error
+// Buffers are single-writer, but separate buffers can be recorded from separate threads & executed back-to-back
+// Nothing in a recorded stream refers back to the jobs it was built from, so a stream can be replayed unchanged for as long as its jobs hold
+// Resources are recorded by handle & resolved to views at decode, so replaying a stream after one of its resources was released trips the
+// stale-handle check rather than binding a dangling view
+
+enum class CMD_TYPES : uint8_t
+{
+	SET_SHADERS, // VS & PS
+	SET_COMPUTE_SHADER,
+	SET_GEOMETRY, // Vertex, index & instance buffers, input layout
+	SET_SRVS, // One shader stage's SRV table (as resource handles)
+	SET_CBUFFERS, // One shader stage's constant-buffer table (as buffer handles)
+	SET_CONSTANT_RANGE, // One constant-buffer slot, bound to a range of an upload ring (count is the slot)
+	SET_UAVS, // As resource handles
+	SET_TARGETS, // Render-targets + depth-stencil
+	SET_BACKBUFFER, // Back-buffer + the default depth-stencil
+	DRAW_INDEXED, // Always instanced; plain draws are one instance
+	DISPATCH
+};
+
+// Every record starts with one of these; payloads follow immediately & records stay 8-byte aligned
+struct CommandHeader
+{
+	CMD_TYPES type;
+	uint8_t stage; // SHADER_TYPES for per-stage records
+	uint16_t count; // Array length for variable-length records
+	uint32_t sizeBytes; // Header + payload, so the decoder can always skip ahead
+};
+
+struct CmdSetShaders
+{
+	uint16_t vs;
+	uint16_t ps;
+};
+
+struct CmdSetComputeShader
+{
+	uint16_t cs;
+};
+
+struct CmdSetGeometry
+{
+	D3DHandle vbuffer;
+	D3DHandle ibuffer;
+	D3DHandle instances;
+	uint32_t vbufferOffset;
+	uint32_t ibufferOffset;
+	uint8_t hasInstances;
+	uint8_t is2D;
+};
+
+struct CmdSetConstantRange
+{
+	D3DHandle buffer;
+	uint32_t firstConstant; // In 16-byte constants, always a multiple of 16
+	uint32_t numConstants; // Also a multiple of 16
+};
+
+struct CmdSetTargets
+{
+	D3DHandle dsv;
+	uint8_t hasDSV;
+	// D3DHandle rtvs[header.count] follows
+};
+
+struct CmdDrawIndexed
+{
+	InstanceBatch batch;
+};
+
+// Everything a draw pass reads geometry from: shared vertex/index buffers, an optional per-instance stream, & one instanced draw per batch
+// [batches] only needs to live until EncodeDraw() returns
+struct DrawGeometry
+{
+	D3DHandle vbuffer;
+	D3DHandle ibuffer;
+	D3DHandle instances;
+	uint32_t vbufferOffset = 0; // Bytes; non-zero for geometry streamed through an upload ring
+	uint32_t ibufferOffset = 0;
+	bool hasInstances = false;
+	const InstanceBatch* batches = nullptr;
+	uint32_t numBatches = 0;
+};
+
+struct CmdDispatch
+{
+	uint32_t x, y, z;
+};
+
+class CommandBuffer
+{
+	char* stream = nullptr;
+	uint32_t capacityBytes = 0;
+	uint32_t usedBytes = 0;
+
+	void* Push(CMD_TYPES type, uint8_t stage, uint16_t count, uint32_t payloadBytes);
+	void EncodeStageTables(const BindingTable& bindings);
+
+	public:
+		static constexpr uint32_t record_alignment = 8;
+
+		void Init(uint32_t streamBytes);
+		void Reset() { usedBytes = 0; }
+
+		// Bindings & geometry are set once, followed by one draw per batch
+		void EncodeDraw(const DrawJob& job, const DrawGeometry& geometry);
+		void EncodeDispatch(const DispatchJob& job);
+
+		// Binds [constants] (from D3DWrapper::AllocateConstants()) to cbuffer [slot] of [stage], overriding whatever the job's own bindings put
+		// there; encode after the draw/dispatch setting up the stage & before the draws reading it. Needs a D3D11.1 runtime
+		void EncodeConstantRange(SHADER_TYPES stage, uint32_t slot, const UploadAllocation& constants);
+
+		const char* Begin() const { return stream; }
+		const char* End() const { return stream + usedBytes; }
+		uint32_t UsedBytes() const { return usedBytes; }
+};
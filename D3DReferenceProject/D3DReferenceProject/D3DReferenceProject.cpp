@@ -2,6 +2,8 @@
 //
 
 #include "D3DReferenceProject.h"
+#include <chrono>
+#include <thread>
 
 #define MAX_LOADSTRING 100
 
@@ -21,6 +23,8 @@ constexpr uint32_t windowHeight = 1080;
 
 HWND windowHandle = NULL;
 
+constexpr auto simulationStep = std::chrono::microseconds(8333); // ~120Hz
+
 int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
                      _In_opt_ HINSTANCE hPrevInstance,
                      _In_ LPWSTR    lpCmdLine,
@@ -47,6 +51,13 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
     // (really trashy linear allocator)
     Memory::Init();
 
+    // Zone rings for every thread the scheduler can know about (compiled out of release builds); before the workers start, so they can name themselves
+    Profiler::Init(1 + TaskScheduler::max_workers + TaskScheduler::max_attached_threads);
+    Profiler::NameThread("Main");
+
+    // Start worker threads (one per core, besides this one)
+    TaskScheduler::Init();
+
     // Initialize API wrapper
     D3DWrapper::Init(windowHandle, windowWidth, windowHeight, false);
 
@@ -64,25 +75,64 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
     // Initialize rendering pipeline
     Pipeline::Init(&scene, 1);
 
+    // Rendering moves to its own thread from here on; this thread keeps messages & simulation
+    Pipeline::StartRenderThread();
+
     // Main message loop:
-    while (GetMessage(&msg, nullptr, 0, 0))
+    // Messages are drained without blocking so the scene keeps updating at a fixed rate; every update publishes a snapshot for the renderer
+    bool running = true;
+    auto nextStep = std::chrono::steady_clock::now();
+    while (running)
     {
-        // Issue GPU work
-        Pipeline::PushFrame(0);
+        while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+        {
+            if (msg.message == WM_QUIT)
+            {
+                running = false;
+            }
 
-        if (!TranslateAccelerator(msg.hwnd, hAccelTable, &msg))
+            if (!TranslateAccelerator(msg.hwnd, hAccelTable, &msg))
+            {
+                TranslateMessage(&msg);
+                DispatchMessage(&msg);
+            }
+        }
+
+        scene.Update();
+
+        FrameSnapshot& snapshot = Pipeline::WriteSnapshot();
+        snapshot.sceneID = 0;
+        scene.WriteSnapshot(snapshot);
+        Pipeline::PublishSnapshot();
+
+        // Simulation paces itself on its own clock, never on the renderer; if an update overran, don't try to catch up
+        nextStep += simulationStep;
+        const auto now = std::chrono::steady_clock::now();
+        if (nextStep < now)
         {
-            TranslateMessage(&msg);
-            DispatchMessage(&msg);
+            nextStep = now;
         }
+        std::this_thread::sleep_until(nextStep);
     }
 
+    Pipeline::StopRenderThread();
+
     // De-initialize pipeline
     Pipeline::DeInit();
 
     // De-initialize the API wrapper
     D3DWrapper::DeInit();
 
+    // Stop worker threads
+    TaskScheduler::DeInit();
+
+    // Write out recent CPU zones, then drop the rings (debug builds only)
+    Profiler::ExportChromeTrace("profile.json");
+    Profiler::DeInit();
+
+    // Write out allocation stats & the recent allocation trace (debug builds only)
+    Memory::DumpTelemetry("memory_telemetry.txt");
+
     // De-initialize memory manager
     Memory::DeInit();
 
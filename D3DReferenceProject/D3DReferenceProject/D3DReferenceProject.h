@@ -5,4 +5,6 @@
 #include <stdint.h>
 #include "D3DWrapper.h"
 #include "Pipeline.h"
-#include "Memory.h"
\ No newline at end of file
+#include "Memory.h"
+#include "TaskScheduler.h"
+#include "Profiler.h"
\ No newline at end of file
@@ -80,11 +80,18 @@ struct D3DResource
 
 		// Not a real DirectX restriction, but writing GPU-resident textures or buffers after initialization through Map/Unmap is very slow, as is storing heavier resources in shared/CPU memory
 		// (as with D3D11_USAGE_DYNAMIC)
-		// So we want to enforce that the only resources with explicit CPU_WRITE allowed are constant buffers
+		// So we want to enforce that the only resources with explicit CPU_WRITE allowed are constant buffers, plus vertex buffers for per-instance
+		// streams (small, & rewritten every frame anyway)
 		// (STAGING resources implicitly have CPU read/write access)
 		if (access == RESRC_ACCESS_TYPES::CPU_WRITE)
 		{
-			assert(isCBuffer);
+			assert(isCBuffer || isVertex);
+		}
+
+		// Partial updates are buffer-only, and cbuffers can only be replaced whole
+		if (access == RESRC_ACCESS_TYPES::CPU_UPDATE)
+		{
+			assert(is_buffer && !isCBuffer);
 		}
 
 		// Verify format
@@ -1,8 +1,22 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 #include <DirectXMath.h>
 
+// FNV-1a; used to content-address meshes & shader bytecode
+inline uint64_t HashBytes(const void* data, size_t numBytes)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < numBytes; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
 enum class RESOURCE_TYPES
 {
 	TEXTURE,
@@ -14,6 +28,8 @@ enum class RESRC_ACCESS_TYPES
 {
 	CPU_WRITE, // With Map/Unmap, CPU_READ is possible but unsupported (inefficient compared to copies through a staging resource)
 	GPU_ONLY, // Most performant for most resources, except constant buffers
+	CPU_UPDATE, // GPU-resident like GPU_ONLY, but patched piecewise from the CPU through UpdateBufferRange(); for big buffers where only a few elements change each frame
+				// (Map() could only rewrite them whole). Not for cbuffers, since D3D11.0 can't update part of one
 	STAGING // Special resource equally accessible from CPU and GPU, but only through copies; used for efficient resource downloads & uploads
 			// More specifically, the only writes from CPU to GPU allowed for staging resources are copy operations. Staging resources implicitly support CPU read & write accesses.
 };
@@ -66,17 +82,27 @@ enum class SHADER_TYPES
 	CS
 };
 
+// Resources are looked up through a generational slot map (HandleTable.h); shaders are never released, so their handles keep generation zero
 struct D3DHandle
 {
-
 	uint16_t index;
+	uint16_t generation;
 	D3D_OBJ_TYPES objType;
 };
 
+// A slice of one of D3DWrapper's per-frame upload rings; write through [cpu] before the frame's commands execute
+struct UploadAllocation
+{
+	void* cpu;
+	uint32_t offset; // Bytes from the start of [buffer]
+	uint32_t numBytes;
+	D3DHandle buffer;
+};
+
 struct Vertex3D
 {
 	DirectX::XMFLOAT4 pos; // W is unused
-	DirectX::XMFLOAT4 mat; // UVs in x,y, material ID in z, model ID in w
+	DirectX::XMFLOAT4 mat; // UVs in x,y, material ID in z, w is unused (instances carry their own identity, through the instance stream)
 	DirectX::XMFLOAT4 normals; // W is unused
 
 	// Vertices are aligned to 16-byte boundaries!
@@ -117,6 +143,16 @@ struct SQT_Transform
 	DirectX::XMFLOAT4 ts; // scale in w, translation in XYZ
 };
 
+// One instanced draw: [numInstances] copies of the mesh spanning indices [firstIndex, firstIndex + numIndices), with per-instance data
+// read from element [firstInstance] onward in the instance stream
+struct InstanceBatch
+{
+	uint32_t firstIndex;
+	uint32_t numIndices;
+	uint32_t firstInstance;
+	uint32_t numInstances;
+};
+
 enum MATERIAL_TYPES
 {
 	DIFFUSE, // Lambert
@@ -125,7 +161,4 @@ enum MATERIAL_TYPES
 	SPECULAR_TRANSLUCENT // Needs GI to implement
 };
 
-// DirectX::XMMATRIX SQT_to_Matrix()
-// {
-//
-// }
+// SQT -> matrix conversion (and the rest of the transform math) lives in SQTBatch.h, eight transforms at a time
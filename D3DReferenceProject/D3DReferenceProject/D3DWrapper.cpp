@@ -1,6 +1,16 @@
 #include "D3DWrapper.h"
+#include "CommandBuffer.h"
+#include "DestructionQueue.h"
+#include "HandleTable.h"
 #include "Memory.h"
+#include "Profiler.h"
+#include "TaskScheduler.h"
+#include "UploadQueue.h"
+#include "UploadRing.h"
 #include <cassert>
+#include <cstring>
+#include <cstdlib>
+#include <d3d11_1.h>
 #include <wrl/client.h>
 
 #include <iostream>
@@ -10,8 +20,7 @@
 template<typename T>
 struct ComPtr : public Microsoft::WRL::ComPtr<T> {};
 
-// Big huge slotmap(?) of generic resources
-// Assumes we won't have more than 256 resources bound at once
+// Generic resources, one handle table per resource type
 template<typename D3DResrcType>
 struct ResrcGeneric
 {
@@ -30,17 +39,58 @@ struct ResrcGeneric
 		dsv.Reset();
 	}
 
+	// Hands every live object (resource first, then views) over to the caller, leaving the slot empty; returns how many were written to [out]
+	uint32_t Detach(IUnknown** out)
+	{
+		IUnknown* objects[] = { resrc.Detach(), srv.Detach(), uav.Detach(), rtv.Detach(), dsv.Detach() };
+		uint32_t numObjects = 0;
+		for (IUnknown* object : objects)
+		{
+			if (object != nullptr)
+			{
+				out[numObjects++] = object;
+			}
+		}
+		return numObjects;
+	}
+
 	// Pretty sure I need more context here...will find out as I go
 };
 
-constexpr uint32_t numResrcSlots = 64;
-ResrcGeneric<ID3D11Texture2D> textures[numResrcSlots] = {};
-ResrcGeneric<ID3D11Buffer> buffers[numResrcSlots] = {};
-ResrcGeneric<ID3D11Texture3D> volumes[numResrcSlots] = {};
+// Tables still grow past these (from any thread); reserving just keeps that out of the first frames
+constexpr uint32_t reserved_texture_slots = 256;
+constexpr uint32_t reserved_buffer_slots = 1024;
+constexpr uint32_t reserved_volume_slots = 64;
+HandleTable<ResrcGeneric<ID3D11Texture2D>> textures;
+HandleTable<ResrcGeneric<ID3D11Buffer>> buffers;
+HandleTable<ResrcGeneric<ID3D11Texture3D>> volumes;
+
+// Stale handles assert, and resolve to an empty slot (null views) in release builds
+template<typename D3DResrcType>
+ResrcGeneric<D3DResrcType>& ResolveResrc(HandleTable<ResrcGeneric<D3DResrcType>>& table, D3DHandle handle)
+{
+	static ResrcGeneric<D3DResrcType> null_resrc;
+	ResrcGeneric<D3DResrcType>* resrc = table.Resolve(handle.index, handle.generation);
+	assert(("Stale or invalid resource handle", resrc != nullptr));
+	return (resrc != nullptr) ? *resrc : null_resrc;
+}
+
+// Running out of handles is a hard error (like running out of Memory); the table already spans every index a handle can carry
+template<typename D3DResrcType>
+D3DHandle AllocateResrc(HandleTable<ResrcGeneric<D3DResrcType>>& table, D3D_OBJ_TYPES objType, ResrcGeneric<D3DResrcType>** outResrc)
+{
+	D3DHandle handle = {};
+	const uint32_t index = table.Allocate(handle.generation);
+	if (index == table.null_slot)
+	{
+		std::abort(); // HandleTable::Allocate() has already asserted
+	}
 
-uint32_t nextTextureSlot = 0;
-uint32_t nextBufferSlot = 0;
-uint32_t nextVolumeSlot = 0;
+	handle.index = static_cast<uint16_t>(index);
+	handle.objType = objType;
+	*outResrc = &table.AtSlot(handle.index);
+	return handle;
+}
 
 constexpr uint32_t numShaderSlots = 16;
 ComPtr<ID3D11VertexShader> vtShaders[numShaderSlots] = {};
@@ -65,13 +115,19 @@ ComPtr<ID3D11DepthStencilState> dsState;
 ComPtr<ID3D11InputLayout> ilayout3D;
 ComPtr<ID3D11InputLayout> ilayout2D;
 
+ComPtr<ID3D11DeviceContext> deferredContexts[D3DWrapper::max_deferred_contexts];
+ComPtr<ID3D11DeviceContext1> deferredContexts1[D3DWrapper::max_deferred_contexts]; // Same contexts again, if the runtime is 11.1
+ComPtr<ID3D11CommandList> commandLists[D3DWrapper::max_deferred_contexts];
+uint32_t numDeferredContexts = 0;
+
 // Standard input element layouts, matching the standard vertex formats in D3DUtils.h
-// We aren't using multiple vertex slots, and we aren't using API instancing, so we can ignore those fields here
-D3D11_INPUT_ELEMENT_DESC vertex_inputs[3] =
+// 3D geometry reads per-instance model indices from slot 1 (transforms themselves live in a buffer the vertex shader indexes); 2D geometry isn't instanced
+D3D11_INPUT_ELEMENT_DESC vertex_inputs[4] =
 {
   { "POSITION", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
   { "TEXCOORD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-  { "TEXCOORD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 }
+  { "TEXCOORD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+  { "TEXCOORD", 2, DXGI_FORMAT_R32_UINT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 }
 };
 
 D3D11_INPUT_ELEMENT_DESC vertex_inputs_2D[3] =
@@ -80,9 +136,68 @@ D3D11_INPUT_ELEMENT_DESC vertex_inputs_2D[3] =
 };
 
 bool using_vsync = false;
+D3D11_VIEWPORT viewport = {};
+
+// Frame fences
+// One event query per frame in flight, ended right after each Present(); a frame has retired once its query signals
+// If queries aren't available we fall back to counting frames, & trust DXGI's frame latency (3 by default) to keep the GPU within
+// max_frames_in_flight of us
+ComPtr<ID3D11Query> frameQueries[D3DWrapper::max_frames_in_flight];
+bool frameQueriesAvailable = false;
+std::atomic<uint64_t> currentFrame = 0;
+std::atomic<uint64_t> retiredFrames = 0; // Frames [0, retiredFrames) are done on the GPU
+
+// Released resources wait here until the frame they were released in retires
+constexpr uint32_t destruction_queue_entries = 4096;
+DestructionQueue destructionQueue;
+
+// Per-frame upload rings (see D3DWrapper.h)
+// Each ring is mapped at most once per frame, on its first allocation, & unmapped as soon as commands start executing
+struct DynamicRing
+{
+	D3DHandle buffer = {};
+	UploadRing ring;
+	char* mapped = nullptr;
+	bool everMapped = false; // The very first map discards, so the driver never has to check for a pending read
+};
+
+constexpr uint32_t constant_ring_bytes = 4 * 1024 * 1024;
+constexpr uint32_t streaming_ring_bytes = 16 * 1024 * 1024;
+constexpr uint32_t constant_range_alignment = 256; // *SSetConstantBuffers1() takes offsets in units of 16 constants
+DynamicRing constantRing;
+DynamicRing streamingRing;
+ComPtr<ID3D11DeviceContext1> context1; // Only if the runtime is 11.1; constant ranges need it
+
+// Staged uploads (see D3DWrapper.h)
+// One staging buffer per frame in flight, each only refilled once the frame that last copied out of it has retired
+constexpr uint32_t upload_budget_bytes = 4 * 1024 * 1024; // Per frame; also the size of each staging buffer
+constexpr uint32_t max_queued_uploads = 8192;
+constexpr uint64_t max_queued_upload_bytes = 64ull * 1024ull * 1024ull;
+UploadQueue uploadQueue;
+D3DHandle uploadStaging[D3DWrapper::max_frames_in_flight] = {};
+uint64_t uploadStagingFrames[D3DWrapper::max_frames_in_flight] = {}; // Frame each staging buffer was last packed in, plus one (zero if never)
+UploadCopy* uploadCopies = nullptr;
+
+// Fixed-function state every context starts from; set once on the immediate context, at the start of every deferred recording, & again on
+// the immediate context after executing command lists (which reset it to defaults)
+void ApplyBaseState(ID3D11DeviceContext* ctx)
+{
+	ctx->RSSetState(rsState.Get());
+	ctx->OMSetBlendState(blendState.Get(), NULL, 1);
+	ctx->OMSetDepthStencilState(dsState.Get(), 0);
+
+	// Set the topology expected for our geometry (triangle strip)
+	// This may cause headaches for geometry processing...
+	ctx->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	ctx->RSSetViewports(1, &viewport);
+}
 
 void D3DWrapper::Init(HWND hwnd, uint32_t window_width, uint32_t window_height, bool vsync)
 {
+	textures.Reserve(reserved_texture_slots);
+	buffers.Reserve(reserved_buffer_slots);
+	volumes.Reserve(reserved_volume_slots);
+
 	// Describe the swap-chain we want to create
 	DXGI_SWAP_CHAIN_DESC swapChainDesc = {};
 
@@ -174,8 +289,6 @@ void D3DWrapper::Init(HWND hwnd, uint32_t window_width, uint32_t window_height,
 	hr = device->CreateRasterizerState(&rasterDesc, &rsState);
 	assert(SUCCEEDED(hr));
 
-	context->RSSetState(rsState.Get());
-
 	D3D11_BLEND_DESC blendDesc = {};
 	blendDesc.AlphaToCoverageEnable = FALSE;
 	blendDesc.IndependentBlendEnable = FALSE;
@@ -184,8 +297,6 @@ void D3DWrapper::Init(HWND hwnd, uint32_t window_width, uint32_t window_height,
 	hr = device->CreateBlendState(&blendDesc, &blendState);
 	assert(SUCCEEDED(hr));
 
-	context->OMSetBlendState(blendState.Get(), NULL, 1);
-
 	D3D11_DEPTH_STENCIL_DESC dsDesc = {};
 	dsDesc.DepthEnable = TRUE;
 	dsDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL; // We don't want/need selective depth writes atm
@@ -194,34 +305,73 @@ void D3DWrapper::Init(HWND hwnd, uint32_t window_width, uint32_t window_height,
 	hr = device->CreateDepthStencilState(&dsDesc, &dsState);
 	assert(SUCCEEDED(hr));
 
-	context->OMSetDepthStencilState(dsState.Get(), 0);
+	// Define a viewport for rasterization
+	viewport.TopLeftX = 0;
+	viewport.TopLeftY = 0;
+	viewport.Width = window_width;
+	viewport.Height = window_height;
+	viewport.MinDepth = 0.0f;
+	viewport.MaxDepth = 0.9f;
+
+	ApplyBaseState(context.Get());
+
+	D3D11_QUERY_DESC queryDesc = {};
+	queryDesc.Query = D3D11_QUERY_EVENT;
+	frameQueriesAvailable = true;
+	for (uint32_t i = 0; i < max_frames_in_flight; i++)
+	{
+		frameQueriesAvailable = frameQueriesAvailable && SUCCEEDED(device->CreateQuery(&queryDesc, frameQueries[i].ReleaseAndGetAddressOf()));
+	}
+	destructionQueue.Init(destruction_queue_entries);
 
-	// Set the topology expected for our geometry (triangle strip)
-	// This may cause headaches for geometry processing...
-	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	// Constant ranges need cbuffer offsets & NO_OVERWRITE maps on dynamic cbuffers, both 11.1 features; the streaming ring works anywhere
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	if (SUCCEEDED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) &&
+		options.ConstantBufferOffsetting && options.MapNoOverwriteOnDynamicConstantBuffer &&
+		SUCCEEDED(context->QueryInterface(__uuidof(ID3D11DeviceContext1), reinterpret_cast<void**>(context1.ReleaseAndGetAddressOf()))))
+	{
+		constantRing.buffer = CreateBuffer(constant_ring_bytes / 16, DXGI_FORMAT_UNKNOWN, RESRC_ACCESS_TYPES::CPU_WRITE, RESRC_VIEWS::CONSTANT_BUFFER, false, nullptr, constant_ring_bytes);
+		constantRing.ring.Init(constant_ring_bytes);
+	}
+	else
+	{
+		OutputDebugStringA("No D3D11.1 constant-buffer offsetting; constant upload ranges are unavailable\n");
+	}
 
-	// Define a viewport for rasterization
-	D3D11_VIEWPORT vp = {};
-	vp.TopLeftX = 0;
-	vp.TopLeftY = 0;
-	vp.Width = window_width;
-	vp.Height = window_height;
-	vp.MinDepth = 0.0f;
-	vp.MaxDepth = 0.9f;
-	context->RSSetViewports(1, &vp);
+	streamingRing.buffer = CreateBuffer(streaming_ring_bytes / 4, DXGI_FORMAT_UNKNOWN, RESRC_ACCESS_TYPES::CPU_WRITE,
+										static_cast<RESRC_VIEWS>(RESRC_VIEWS::VERTEX | RESRC_VIEWS::INDEX), false, nullptr, streaming_ring_bytes);
+	streamingRing.ring.Init(streaming_ring_bytes);
+
+	uploadQueue.Init(max_queued_uploads, max_queued_upload_bytes);
+	uploadCopies = Memory::AllocateArray<UploadCopy>(UploadQueue::max_pieces_per_pack, alignof(UploadCopy), MEM_TAGS::PIPELINE);
+	for (uint32_t i = 0; i < max_frames_in_flight; i++)
+	{
+		uploadStaging[i] = CreateBuffer(upload_budget_bytes, DXGI_FORMAT_UNKNOWN, RESRC_ACCESS_TYPES::STAGING, RESRC_VIEWS::VIEWS_UNSPECIFIED, false, nullptr, upload_budget_bytes);
+		uploadStagingFrames[i] = 0;
+	}
 
 	using_vsync = vsync;
 }
 
 void D3DWrapper::DeInit()
 {
-	for (uint32_t i = 0; i < numResrcSlots; i++)
+	UnmapUploadRings();
+	constantRing = DynamicRing();
+	streamingRing = DynamicRing();
+	context1.Reset();
+	uploadQueue.DeInit();
+
+	// Nothing is in flight past this point, so whatever's still parked can go
+	destructionQueue.Flush();
+	for (uint32_t i = 0; i < max_frames_in_flight; i++)
 	{
-		textures[i].Reset();
-		buffers[i].Reset();
-		volumes[i].Reset();
+		frameQueries[i].Reset();
 	}
 
+	for (uint32_t i = 0; i < textures.Capacity(); i++) textures.AtSlot(i).Reset();
+	for (uint32_t i = 0; i < buffers.Capacity(); i++) buffers.AtSlot(i).Reset();
+	for (uint32_t i = 0; i < volumes.Capacity(); i++) volumes.AtSlot(i).Reset();
+
 	for (uint32_t i = 0; i < numShaderSlots; i++)
 	{
 		vtShaders[i].Reset();
@@ -229,6 +379,14 @@ void D3DWrapper::DeInit()
 		computeShaders[i].Reset();
 	}
 
+	for (uint32_t i = 0; i < numDeferredContexts; i++)
+	{
+		commandLists[i].Reset();
+		deferredContexts1[i].Reset();
+		deferredContexts[i].Reset();
+	}
+	numDeferredContexts = 0;
+
 	swapchain.Reset();
 	context.Reset();
 	device.Reset();
@@ -262,6 +420,10 @@ D3D11_USAGE ResolveUsage(RESRC_ACCESS_TYPES access, RESRC_VIEWS composed_views)
 	{
 		return D3D11_USAGE_DYNAMIC;
 	}
+	if (access == RESRC_ACCESS_TYPES::CPU_UPDATE)
+	{
+		return D3D11_USAGE_DEFAULT; // UpdateSubresource() needs DEFAULT, & rules out IMMUTABLE
+	}
 	if (access == RESRC_ACCESS_TYPES::GPU_ONLY)
 	{
 		if (composed_views & RESRC_VIEWS::GENERIC_READONLY)
@@ -287,7 +449,7 @@ UINT ResolveCPUAccess(RESRC_ACCESS_TYPES access)
 	{
 		return D3D11_CPU_ACCESS_WRITE;
 	}
-	else// if (access == RESRC_ACCESS_TYPES::GPU_ONLY)
+	else// if (access == RESRC_ACCESS_TYPES::GPU_ONLY || access == RESRC_ACCESS_TYPES::CPU_UPDATE)
 	{
 		return NULL;
 	}
@@ -316,7 +478,9 @@ D3DHandle D3DWrapper::CreateTexture(uint32_t width, uint32_t height, DXGI_FORMAT
 	subresrc.SysMemSlicePitch = NULL;
 
 	// Create texture
-	ResrcGeneric<ID3D11Texture2D>& texture = textures[nextTextureSlot];
+	ResrcGeneric<ID3D11Texture2D>* slot = nullptr;
+	const D3DHandle handle = AllocateResrc(textures, D3D_OBJ_TYPES::TEXTURE, &slot);
+	ResrcGeneric<ID3D11Texture2D>& texture = *slot;
 	HRESULT hr = device->CreateTexture2D(&desc, init_data != nullptr ? &subresrc : nullptr, texture.resrc.ReleaseAndGetAddressOf());
 	assert(SUCCEEDED(hr));
 
@@ -362,10 +526,6 @@ D3DHandle D3DWrapper::CreateTexture(uint32_t width, uint32_t height, DXGI_FORMAT
 		assert(SUCCEEDED(hr));
 	}
 
-	D3DHandle handle = {};
-	handle.index = nextTextureSlot;
-	handle.objType = D3D_OBJ_TYPES::TEXTURE;
-	nextTextureSlot++;
 	return handle;
 }
 
@@ -398,8 +558,10 @@ D3DHandle D3DWrapper::CreateBuffer(uint32_t num_elements, DXGI_FORMAT format, RE
 	subresrc.SysMemPitch = data_footprint_bytes;
 	subresrc.SysMemSlicePitch = NULL;
 
-	// Create texture
-	ResrcGeneric<ID3D11Buffer>& buffer = buffers[nextBufferSlot];
+	// Create buffer
+	ResrcGeneric<ID3D11Buffer>* slot = nullptr;
+	const D3DHandle handle = AllocateResrc(buffers, D3D_OBJ_TYPES::BUFFER, &slot);
+	ResrcGeneric<ID3D11Buffer>& buffer = *slot;
 	HRESULT hr = device->CreateBuffer(&desc, init_data != nullptr ? &subresrc : nullptr, buffer.resrc.ReleaseAndGetAddressOf());
 	assert(SUCCEEDED(hr));
 
@@ -432,10 +594,6 @@ D3DHandle D3DWrapper::CreateBuffer(uint32_t num_elements, DXGI_FORMAT format, RE
 	// Constant buffers, vertex buffers, and index buffers just work(tm) without a view
 	// (totally not janky and inconsistent at all nope)
 
-	D3DHandle handle = {};
-	handle.index = nextBufferSlot;
-	handle.objType = D3D_OBJ_TYPES::BUFFER;
-	nextBufferSlot++;
 	return handle;
 }
 
@@ -459,8 +617,10 @@ D3DHandle D3DWrapper::CreateVolume(uint32_t width, uint32_t height, uint32_t dep
 	subresrc.SysMemPitch = data_footprint_bytes / (depth * height);
 	subresrc.SysMemSlicePitch = data_footprint_bytes / depth;
 
-	// Create texture
-	ResrcGeneric<ID3D11Texture3D>& volume = volumes[nextTextureSlot];
+	// Create volume
+	ResrcGeneric<ID3D11Texture3D>* slot = nullptr;
+	const D3DHandle handle = AllocateResrc(volumes, D3D_OBJ_TYPES::VOLUME, &slot);
+	ResrcGeneric<ID3D11Texture3D>& volume = *slot;
 	HRESULT hr = device->CreateTexture3D(&desc, init_data != nullptr ? &subresrc : nullptr, volume.resrc.ReleaseAndGetAddressOf());
 	assert(SUCCEEDED(hr));
 
@@ -486,362 +646,1099 @@ D3DHandle D3DWrapper::CreateVolume(uint32_t width, uint32_t height, uint32_t dep
 		assert(SUCCEEDED(hr));
 	}
 
-	D3DHandle handle = {};
-	handle.index = nextVolumeSlot;
-	handle.objType = D3D_OBJ_TYPES::VOLUME;
-	nextVolumeSlot++;
 	return handle;
 }
 
-void D3DWrapper::ClearResrc(D3DHandle handle)
+// Retiring bumps the generation before anything else, so new resolves fail from here on; the slot itself isn't written at all (its pointers are
+// copied out, not detached) & stays out of reuse until the destruction queue recycles it, so a decode that resolved the handle before it went
+// stale keeps reading the same views rather than a half-detached slot or its next owner's
+template<typename D3DResrcType>
+void RetireResrc(HandleTable<ResrcGeneric<D3DResrcType>>& table, D3DHandle handle, DestructionQueue::OnRetired recycle)
 {
-	if (handle.objType == D3D_OBJ_TYPES::TEXTURE)
+	if (!table.Retire(handle.index, handle.generation))
 	{
-		textures[handle.index].Reset();
+		return; // Stale handle; Retire() has already asserted
 	}
 
+	ResrcGeneric<D3DResrcType>& resrc = table.AtSlot(handle.index);
+	IUnknown* objects[] = { resrc.resrc.Get(), resrc.srv.Get(), resrc.uav.Get(), resrc.rtv.Get(), resrc.dsv.Get() };
+	destructionQueue.Park(objects, DestructionQueue::max_objects_per_entry, currentFrame.load(std::memory_order_acquire), recycle, handle.index);
+}
+
+// Runs from Collect() (render thread) once the slot's objects are released; the slot's pointers just need dropping, not releasing again
+template<typename D3DResrcType>
+void RecycleResrc(HandleTable<ResrcGeneric<D3DResrcType>>& table, uint32_t index)
+{
+	IUnknown* released[DestructionQueue::max_objects_per_entry];
+	table.AtSlot(index).Detach(released);
+	table.Recycle(index);
+}
+
+void D3DWrapper::ClearResrc(D3DHandle handle)
+{
+	// The resource & its views are parked until the GPU retires the current frame (anything recorded up to now can still reference them); the
+	// slot comes back for reuse, under a new generation, along with them
 	if (handle.objType == D3D_OBJ_TYPES::TEXTURE)
 	{
-		textures[handle.index].Reset();
+		RetireResrc(textures, handle, [](uint32_t index) { RecycleResrc(textures, index); });
 	}
-
-	if (handle.objType == D3D_OBJ_TYPES::TEXTURE)
+	else if (handle.objType == D3D_OBJ_TYPES::BUFFER)
 	{
-		textures[handle.index].Reset();
+		RetireResrc(buffers, handle, [](uint32_t index) { RecycleResrc(buffers, index); });
+	}
+	else if (handle.objType == D3D_OBJ_TYPES::VOLUME)
+	{
+		RetireResrc(volumes, handle, [](uint32_t index) { RecycleResrc(volumes, index); });
+	}
+	else
+	{
+		assert(("Only textures, buffers & volumes can be cleared", false));
 	}
 }
 
 bool resolved3DInputs = false;
 bool resolved2DInputs = false;
 
-struct ShaderBuilder
+// Shader cache
+// Bytecode is keyed by content hash & size, so every job naming the same (or byte-identical) .cso shares one shader object & slot; paths
+// already seen skip the file read as well
+// Bytecode is only kept while it's being loaded, so matches against shaders from the same batch are confirmed byte-for-byte, & matches
+// against older ones rest on the hash & size
+constexpr uint32_t numShaderTypes = 3;
+constexpr uint32_t numShaderPaths = 32;
+
+struct ShaderCacheEntry
 {
-	char* data = nullptr;
-	uint64_t size = 0;
-	ShaderBuilder(const char* path, SHADER_TYPES type)
-	{
-		// Resolve shader size, allocate temp storage
-		size = std::filesystem::file_size(path);
-		data = (char*)malloc(size);
+	uint64_t hash = 0; // Bytecode or path, depending on the table
+	uint64_t size = 0; // Bytecode entries only
+	const char* data = nullptr; // Bytecode entries only, & only while the bytecode is still loaded
+	uint16_t slot = 0;
+};
 
-		// Open a stream to the shader & copy it into temp storage
-		std::ifstream strm(path, std::ios::in | std::ios::binary);
-		strm.read(data, size);
-		strm.close();
+ShaderCacheEntry shaderContents[numShaderTypes][numShaderSlots] = {};
+ShaderCacheEntry shaderPaths[numShaderTypes][numShaderPaths] = {};
+uint32_t numShaderPathsCached[numShaderTypes] = {};
 
-		// Shader creation
-		if (type == SHADER_TYPES::VS)
-		{
-			HRESULT hr = device->CreateVertexShader(data, size, nullptr, vtShaders[nextVtShaderSlot].ReleaseAndGetAddressOf());
-			assert(SUCCEEDED(hr));
-		}
-		else if (type == SHADER_TYPES::PS)
+uint32_t* NextShaderSlot(SHADER_TYPES type)
+{
+	uint32_t* nextSlots[numShaderTypes] = { &nextVtShaderSlot, &nextPxShaderSlot, &nextComputeShaderSlot };
+	return nextSlots[static_cast<uint32_t>(type)];
+}
+
+bool FindCachedShader(const ShaderCacheEntry* table, uint32_t numEntries, uint64_t hash, uint16_t* out_slot)
+{
+	for (uint32_t i = 0; i < numEntries; i++)
+	{
+		if (table[i].hash == hash)
 		{
-			HRESULT hr = device->CreatePixelShader(data, size, nullptr, pxShaders[nextPxShaderSlot].ReleaseAndGetAddressOf());
-			assert(SUCCEEDED(hr));
+			*out_slot = table[i].slot;
+			return true;
 		}
-		else if (type == SHADER_TYPES::CS)
+	}
+	return false;
+}
+
+bool FindShaderContents(SHADER_TYPES type, uint64_t contentHash, const char* data, uint64_t size, uint16_t* out_slot)
+{
+	const ShaderCacheEntry* table = shaderContents[static_cast<uint32_t>(type)];
+	const uint32_t numEntries = *NextShaderSlot(type);
+	for (uint32_t i = 0; i < numEntries; i++)
+	{
+		const ShaderCacheEntry& entry = table[i];
+		if (entry.hash == contentHash && entry.size == size && (entry.data == nullptr || memcmp(entry.data, data, size) == 0))
 		{
-			HRESULT hr = device->CreateComputeShader(data, size, nullptr, computeShaders[nextComputeShaderSlot].ReleaseAndGetAddressOf());
-			assert(SUCCEEDED(hr));
+			*out_slot = entry.slot;
+			return true;
 		}
 	}
+	return false;
+}
+
+bool FindShaderPath(SHADER_TYPES type, uint64_t pathHash, uint16_t* out_slot)
+{
+	const uint32_t t = static_cast<uint32_t>(type);
+	return FindCachedShader(shaderPaths[t], numShaderPathsCached[t], pathHash, out_slot);
+}
+
+// Reserves the next slot of [type] for new bytecode; [data] has to stay loaded until ForgetShaderContents()
+uint16_t AddShaderContents(SHADER_TYPES type, uint64_t contentHash, const char* data, uint64_t size)
+{
+	uint32_t& nextSlot = *NextShaderSlot(type);
+	assert(("Out of shader slots", nextSlot < numShaderSlots));
+
+	ShaderCacheEntry& entry = shaderContents[static_cast<uint32_t>(type)][nextSlot];
+	entry.hash = contentHash;
+	entry.size = size;
+	entry.data = data;
+	entry.slot = static_cast<uint16_t>(nextSlot);
+	return static_cast<uint16_t>(nextSlot++);
+}
+
+// Called before freeing the bytecode behind [slot]; later matches fall back to the hash & size
+void ForgetShaderContents(SHADER_TYPES type, uint16_t slot)
+{
+	shaderContents[static_cast<uint32_t>(type)][slot].data = nullptr;
+}
 
-	~ShaderBuilder()
+void AddShaderPath(SHADER_TYPES type, uint64_t pathHash, uint16_t slot)
+{
+	const uint32_t t = static_cast<uint32_t>(type);
+	uint16_t existing = 0;
+	if (numShaderPathsCached[t] == numShaderPaths || FindCachedShader(shaderPaths[t], numShaderPathsCached[t], pathHash, &existing))
 	{
-		free(data);
+		return; // Path table full; the path just misses (and re-reads) next time, contents still dedupe
 	}
+
+	shaderPaths[t][numShaderPathsCached[t]].hash = pathHash;
+	shaderPaths[t][numShaderPathsCached[t]].slot = slot;
+	numShaderPathsCached[t]++;
+}
+
+D3DHandle ShaderHandle(SHADER_TYPES type, uint16_t slot)
+{
+	const D3D_OBJ_TYPES objTypes[numShaderTypes] = { D3D_OBJ_TYPES::VERTEX_SHADER, D3D_OBJ_TYPES::PIXEL_SHADER, D3D_OBJ_TYPES::COMPUTE_SHADER };
+
+	D3DHandle handle = {};
+	handle.index = slot;
+	handle.objType = objTypes[static_cast<uint32_t>(type)];
+	return handle;
+}
+
+// One shader's bytecode on its way through the cache
+// Storage comes from Memory on the main thread; reading, hashing & creation only touch the blob itself, so they can run anywhere
+struct ShaderBlob
+{
+	const char* path = nullptr;
+	SHADER_TYPES type = SHADER_TYPES::VS;
+	bool is2D = false;
+
+	char* data = nullptr;
+	uint64_t size = 0;
+	uint64_t pathHash = 0;
+	uint64_t contentHash = 0;
+
+	bool loaded = false; // False when the path was already cached & there was nothing to read
+	bool create = false; // Set for bytecode the cache hasn't seen yet
+	uint16_t slot = 0;
 };
 
-D3DHandle D3DWrapper::CreateVertShader(const char* path, bool is2D)
+void AllocateShaderBlob(ShaderBlob& blob)
 {
-	ShaderBuilder vs(path, SHADER_TYPES::VS);
+	blob.size = std::filesystem::file_size(blob.path);
+	blob.data = Memory::AllocateArray<char>(static_cast<uint32_t>(blob.size), 4, MEM_TAGS::PIPELINE);
+	blob.loaded = true;
+}
+
+void ReadShaderBlob(ShaderBlob& blob)
+{
+	std::ifstream strm(blob.path, std::ios::in | std::ios::binary);
+	strm.read(blob.data, blob.size);
+	strm.close();
+
+	blob.contentHash = HashBytes(blob.data, blob.size);
+}
+
+void CreateShaderObject(const ShaderBlob& blob)
+{
+	HRESULT hr = E_FAIL;
+	if (blob.type == SHADER_TYPES::VS)
+	{
+		hr = device->CreateVertexShader(blob.data, blob.size, nullptr, vtShaders[blob.slot].ReleaseAndGetAddressOf());
+	}
+	else if (blob.type == SHADER_TYPES::PS)
+	{
+		hr = device->CreatePixelShader(blob.data, blob.size, nullptr, pxShaders[blob.slot].ReleaseAndGetAddressOf());
+	}
+	else if (blob.type == SHADER_TYPES::CS)
+	{
+		hr = device->CreateComputeShader(blob.data, blob.size, nullptr, computeShaders[blob.slot].ReleaseAndGetAddressOf());
+	}
+	assert(SUCCEEDED(hr));
+}
 
-	// Construct input layouts
-	//////////////////////////
+// Input layouts are validated against vertex shader bytecode, so the first vertex shader of each kind builds its layout
+bool NeedsInputLayout(const ShaderBlob& blob)
+{
+	return blob.type == SHADER_TYPES::VS && !(blob.is2D ? resolved2DInputs : resolved3DInputs);
+}
 
-	if (!resolved3DInputs && !is2D)
+void ResolveInputLayout(const ShaderBlob& vs)
+{
+	if (!vs.is2D)
 	{
-		HRESULT hr = device->CreateInputLayout(vertex_inputs, 3, vs.data, vs.size, ilayout3D.ReleaseAndGetAddressOf());
+		HRESULT hr = device->CreateInputLayout(vertex_inputs, 4, vs.data, vs.size, ilayout3D.ReleaseAndGetAddressOf());
 		assert(SUCCEEDED(hr));
 
 		resolved3DInputs = true;
 	}
-
-	if (!resolved2DInputs && is2D)
+	else
 	{
 		HRESULT hr = device->CreateInputLayout(vertex_inputs_2D, 1, vs.data, vs.size, ilayout2D.ReleaseAndGetAddressOf());
 		assert(SUCCEEDED(hr));
 
 		resolved2DInputs = true;
 	}
+}
 
-	D3DHandle handle = {};
-	handle.index = nextVtShaderSlot;
-	handle.objType = D3D_OBJ_TYPES::VERTEX_SHADER;
-	nextVtShaderSlot++;
-	return handle;
+// Cache lookup for a blob that's been read: reuse matching bytecode, or reserve a slot for new bytecode
+void ResolveShaderSlot(ShaderBlob& blob)
+{
+	blob.create = !FindShaderContents(blob.type, blob.contentHash, blob.data, blob.size, &blob.slot);
+	if (blob.create)
+	{
+		blob.slot = AddShaderContents(blob.type, blob.contentHash, blob.data, blob.size);
+	}
+	AddShaderPath(blob.type, blob.pathHash, blob.slot);
 }
 
-D3DHandle D3DWrapper::CreatePixelShader(const char* path)
+D3DHandle CreateShader(const char* path, SHADER_TYPES type, bool is2D)
 {
-	ShaderBuilder ps(path, SHADER_TYPES::PS);
+	ShaderBlob blob;
+	blob.path = path;
+	blob.type = type;
+	blob.is2D = is2D;
+	blob.pathHash = HashBytes(path, strlen(path));
+
+	// Known path; no need to even open the file (unless it's the first vertex shader of its kind & we still need its bytecode for a layout)
+	if (!NeedsInputLayout(blob) && FindShaderPath(type, blob.pathHash, &blob.slot))
+	{
+		return ShaderHandle(type, blob.slot);
+	}
 
-	D3DHandle handle = {};
-	handle.index = nextPxShaderSlot;
-	handle.objType = D3D_OBJ_TYPES::PIXEL_SHADER;
-	nextPxShaderSlot++;
-	return handle;
+	AllocateShaderBlob(blob);
+	ReadShaderBlob(blob);
+	ResolveShaderSlot(blob);
+	if (blob.create)
+	{
+		CreateShaderObject(blob);
+	}
+
+	if (NeedsInputLayout(blob))
+	{
+		ResolveInputLayout(blob);
+	}
+
+	if (blob.create)
+	{
+		ForgetShaderContents(type, blob.slot);
+	}
+	Memory::FreeToAddress(blob.data);
+	return ShaderHandle(type, blob.slot);
+}
+
+D3DHandle D3DWrapper::CreateVertShader(const char* path, bool is2D)
+{
+	return CreateShader(path, SHADER_TYPES::VS, is2D);
+}
+
+D3DHandle D3DWrapper::CreatePixelShader(const char* path)
+{
+	return CreateShader(path, SHADER_TYPES::PS, false);
 }
 
 D3DHandle D3DWrapper::CreateComputeShader(const char* path)
 {
-	ShaderBuilder cs(path, SHADER_TYPES::CS);
+	return CreateShader(path, SHADER_TYPES::CS, false);
+}
 
-	D3DHandle handle = {};
-	handle.index = nextComputeShaderSlot;
-	handle.objType = D3D_OBJ_TYPES::COMPUTE_SHADER;
-	nextComputeShaderSlot++;
-	return handle;
+void ReadShaderBlobs(uint32_t begin, uint32_t end, void* blobs)
+{
+	for (uint32_t i = begin; i < end; i++)
+	{
+		ShaderBlob& blob = static_cast<ShaderBlob*>(blobs)[i];
+		if (blob.loaded)
+		{
+			ReadShaderBlob(blob);
+		}
+	}
+}
+
+void CreateShaderObjects(uint32_t begin, uint32_t end, void* blobs)
+{
+	for (uint32_t i = begin; i < end; i++)
+	{
+		const ShaderBlob& blob = static_cast<ShaderBlob*>(blobs)[i];
+		if (blob.create)
+		{
+			CreateShaderObject(blob);
+		}
+	}
 }
 
-void SearchForResources(uint32_t start, D3DHandle* resources, RESRC_VIEWS* resrcBindings, SHADER_TYPES* bindFor, uint32_t numResources, RESRC_VIEWS viewSearching,
-						D3DHandle*& out_matchingResources, bool*& out_bindState, uint32_t& out_matchCtr)
+void D3DWrapper::PreloadShaders(const ShaderRequest* requests, uint32_t numRequests)
 {
-	uint32_t matchCtr = 0;
-	for (uint32_t k = start; k < numResources; k++)
+	PROFILE_FUNCTION(); // Preload timing comes from this zone
+
+	// Main thread: size & allocate every blob not already cached (Memory is single-threaded)
+	ShaderBlob* blobs = Memory::AllocateArray<ShaderBlob>(numRequests, 8, MEM_TAGS::PIPELINE);
+	for (uint32_t i = 0; i < numRequests; i++)
+	{
+		ShaderBlob& blob = blobs[i];
+		blob = ShaderBlob();
+		blob.path = requests[i].path;
+		blob.type = requests[i].type;
+		blob.is2D = requests[i].is2D;
+		blob.pathHash = HashBytes(blob.path, strlen(blob.path));
+		if (NeedsInputLayout(blob) || !FindShaderPath(blob.type, blob.pathHash, &blob.slot))
+		{
+			AllocateShaderBlob(blob);
+		}
+	}
+
+	// Workers: file reads & hashing
+	TaskScheduler::ParallelFor(0, numRequests, ReadShaderBlobs, blobs);
+
+	// Main thread: dedupe against the cache & within the batch, in request order, so slots come out the same as creating one at a time
+	for (uint32_t i = 0; i < numRequests; i++)
+	{
+		if (blobs[i].loaded)
+		{
+			ResolveShaderSlot(blobs[i]);
+		}
+	}
+
+	// Workers: device creation
+	TaskScheduler::ParallelFor(0, numRequests, CreateShaderObjects, blobs);
+
+	for (uint32_t i = 0; i < numRequests; i++)
 	{
-		if (resrcBindings[k] == viewSearching && bindFor[k] == bindFor[start])
+		if (blobs[i].loaded && NeedsInputLayout(blobs[i]))
 		{
-			out_matchingResources[matchCtr] = resources[k];
-			out_bindState[k] = true;
-			matchCtr++;
+			ResolveInputLayout(blobs[i]);
 		}
+
+		if (blobs[i].create)
+		{
+			ForgetShaderContents(blobs[i].type, blobs[i].slot);
+		}
+	}
+
+	Memory::FreeToAddress(blobs);
+}
+
+// Every view a bindable resource offers (null where it has none)
+struct ResolvedViews
+{
+	ID3D11ShaderResourceView* srv = nullptr;
+	ID3D11UnorderedAccessView* uav = nullptr;
+	ID3D11RenderTargetView* rtv = nullptr;
+	ID3D11DepthStencilView* dsv = nullptr;
+	ID3D11Buffer* cbuffer = nullptr;
+};
+
+// Resolves views from whichever slot array [resrc] lives in; stale handles assert & come back empty
+ResolvedViews ResolveViews(D3DHandle resrc)
+{
+	ResolvedViews views;
+	if (resrc.objType == D3D_OBJ_TYPES::TEXTURE)
+	{
+		const ResrcGeneric<ID3D11Texture2D>& texture = ResolveResrc(textures, resrc);
+		views.srv = texture.srv.Get();
+		views.uav = texture.uav.Get();
+		views.rtv = texture.rtv.Get();
+		views.dsv = texture.dsv.Get();
+	}
+	else if (resrc.objType == D3D_OBJ_TYPES::BUFFER)
+	{
+		const ResrcGeneric<ID3D11Buffer>& buffer = ResolveResrc(buffers, resrc);
+		views.srv = buffer.srv.Get();
+		views.uav = buffer.uav.Get();
+		views.cbuffer = buffer.resrc.Get();
+	}
+	else if (resrc.objType == D3D_OBJ_TYPES::VOLUME)
+	{
+		const ResrcGeneric<ID3D11Texture3D>& volume = ResolveResrc(volumes, resrc);
+		views.srv = volume.srv.Get();
+		views.uav = volume.uav.Get();
+	}
+	else
+	{
+		assert(("Only textures, buffers & volumes can be bound to shaders", false));
+	}
+	return views;
+}
+
+void D3DWrapper::AddBinding(BindingTable& table, D3DHandle resrc, RESRC_VIEWS bindAs, SHADER_TYPES bindFor)
+{
+	// Views are only resolved here to check they exist; the table keeps [resrc] itself
+	const ResolvedViews views = ResolveViews(resrc);
+
+	// Append to the matching slot table
+	BindingTable::StageTable& stage = table.stages[static_cast<uint32_t>(bindFor)];
+	switch (bindAs)
+	{
+		case UNORDERED_GPU_WRITES:
+			assert(("FL11.0 only supports UAVs in compute shaders", bindFor == SHADER_TYPES::CS));
+			assert(("Resource bound as a UAV without an unordered-access view", views.uav != nullptr));
+			assert(("Too many UAVs bound for one dispatch", table.numUAVs < BindingTable::max_uavs));
+			table.uavs[table.numUAVs] = resrc;
+			table.numUAVs++;
+			break;
+
+		case GENERIC_READONLY:
+			assert(("Resource bound as an SRV without a shader-resource view", views.srv != nullptr));
+			assert(("Too many SRVs bound for one shader stage", stage.numSRVs < BindingTable::max_srvs));
+			stage.srvs[stage.numSRVs] = resrc;
+			stage.numSRVs++;
+			break;
+
+		case CONSTANT_BUFFER:
+			assert(("Only buffers can be bound as constant buffers", views.cbuffer != nullptr));
+			assert(("Too many constant buffers bound for one shader stage", stage.numCBuffers < BindingTable::max_cbuffers));
+			stage.cbuffers[stage.numCBuffers] = resrc;
+			stage.numCBuffers++;
+			break;
+
+		case RENDER_TARGET:
+			assert(("Render-targets can't be boound for compute shader dispatch - prefer a UAV (GPU_UNORDERED_WRITES)", bindFor != SHADER_TYPES::CS));
+			assert(("Resource bound as a render-target without a render-target view", views.rtv != nullptr));
+			assert(("Too many render-targets bound for one draw", table.numRTVs < BindingTable::max_rtvs));
+			table.rtvs[table.numRTVs] = resrc;
+			table.numRTVs++;
+			break;
+
+		case DEPTH_STENCIL:
+			assert(("Depth-stencils can't be boound for compute shader dispatch - prefer a UAV (GPU_UNORDERED_WRITES)", bindFor != SHADER_TYPES::CS));
+			assert(("Resource bound as a depth-stencil without a depth-stencil view", views.dsv != nullptr));
+			assert(("Only one depth buffer can be bound for each draw", !table.hasDSV));
+			table.dsv = resrc;
+			table.hasDSV = true;
+			break;
+
+		default:
+			assert(("Invalid/unsupported resource binding", false));
+			break;
+	}
+}
+
+// Shadow copy of a context's pipeline state, so binds matching what's already set can be skipped
+// Each group carries a [valid] flag rather than relying on nullptr, since we can't know what's bound after an invalidation
+// The runtime silently unbinds SRVs whose resources get bound for output (RTV/DSV/UAV), so any change to outputs also invalidates the SRV shadows
+// (rebinding a few SRVs is cheap; binding a stale shadow would be a nasty bug)
+struct ShadowState
+{
+	ID3D11InputLayout* inputLayout = nullptr;
+	bool inputLayoutValid = false;
+	ID3D11Buffer* vbuffer = nullptr;
+	UINT vbufStride = 0;
+	UINT vbufOffset = 0;
+	bool vbufValid = false;
+	ID3D11Buffer* ibuffer = nullptr;
+	UINT ibufOffset = 0;
+	bool ibufValid = false;
+	ID3D11Buffer* instances = nullptr;
+	bool instancesValid = false;
+
+	ID3D11VertexShader* vs = nullptr;
+	ID3D11PixelShader* ps = nullptr;
+	ID3D11ComputeShader* cs = nullptr;
+	bool vsValid = false;
+	bool psValid = false;
+	bool csValid = false;
+
+	ID3D11RenderTargetView* rtvs[BindingTable::max_rtvs] = {};
+	uint32_t numRTVs = 0;
+	ID3D11DepthStencilView* dsv = nullptr;
+	bool omValid = false;
+
+	ID3D11UnorderedAccessView* uavs[BindingTable::max_uavs] = {};
+	bool uavsValid = false;
+
+	ID3D11ShaderResourceView* srvs[3][BindingTable::max_srvs] = {}; // Indexed by SHADER_TYPES
+	bool srvsValid[3] = {};
+	ID3D11Buffer* cbuffers[3][BindingTable::max_cbuffers] = {};
+	bool cbuffersValid[3] = {};
+};
+
+// Everything the decoder tracks per context; the immediate context has one, and so does each deferred context
+struct ContextState
+{
+	ShadowState shadow;
+	D3DWrapper::StateCacheStats stats;
+};
+
+ContextState immediateState;
+ContextState deferredStates[D3DWrapper::max_deferred_contexts];
+D3DWrapper::StateCacheStats lastFrameStateStats;
+
+void D3DWrapper::InvalidateStateCache()
+{
+	immediateState.shadow = ShadowState();
+}
+
+D3DWrapper::StateCacheStats D3DWrapper::LastFrameStateCacheStats()
+{
+	return lastFrameStateStats;
+}
+
+// Returns true (and updates the shadow) if [value] needs to be sent to the context
+template<typename StateType>
+bool ShadowCompare(D3DWrapper::StateCacheStats& stats, StateType& shadowValue, bool& shadowValid, StateType value)
+{
+	if (shadowValid && shadowValue == value)
+	{
+		stats.skipped++;
+		return false;
+	}
+
+	shadowValue = value;
+	shadowValid = true;
+	stats.issued++;
+	return true;
+}
+
+// Same again for runs of slots, starting at zero
+template<typename ViewType>
+bool ShadowCompareSlots(D3DWrapper::StateCacheStats& stats, ViewType** shadowSlots, bool& shadowValid, ViewType* const* slots, uint32_t numSlots)
+{
+	bool matches = shadowValid;
+	for (uint32_t i = 0; i < numSlots && matches; i++)
+	{
+		matches = (shadowSlots[i] == slots[i]);
+	}
+
+	if (matches)
+	{
+		stats.skipped++;
+		return false;
+	}
+
+	// Slots past [numSlots] keep whatever they held before, same as the context
+	for (uint32_t i = 0; i < numSlots; i++)
+	{
+		shadowSlots[i] = slots[i];
+	}
+	shadowValid = true;
+	stats.issued++;
+	return true;
+}
+
+void InvalidateSRVShadows(ShadowState& shadow)
+{
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		shadow.srvsValid[i] = false;
+	}
+}
+
+void BindRenderTargets(ID3D11DeviceContext* ctx, ContextState& state, uint32_t numRTVs, ID3D11RenderTargetView* const* rtvs, ID3D11DepthStencilView* dsv)
+{
+	ShadowState& shadow = state.shadow;
+	bool matches = shadow.omValid && shadow.numRTVs == numRTVs && shadow.dsv == dsv;
+	for (uint32_t i = 0; i < numRTVs && matches; i++)
+	{
+		matches = (shadow.rtvs[i] == rtvs[i]);
+	}
+
+	if (matches)
+	{
+		state.stats.skipped++;
+		return;
+	}
+
+	for (uint32_t i = 0; i < numRTVs; i++)
+	{
+		shadow.rtvs[i] = rtvs[i];
 	}
-	out_matchCtr = matchCtr;
+	shadow.numRTVs = numRTVs;
+	shadow.dsv = dsv;
+	shadow.omValid = true;
+	state.stats.issued++;
+
+	ctx->OMSetRenderTargets(numRTVs, numRTVs > 0 ? rtvs : nullptr, dsv);
+	InvalidateSRVShadows(shadow);
 }
 
-template<typename viewType>
-struct BindableViewList
+// Decodes a command stream straight into context calls; each record is checked against the shadow state first
+// Per-frame binding is one handle lookup per recorded slot, then a copy of the slot table into the context (when it differs from what's there
+// already); no searching, no scratch memory
+// Touches nothing but [ctx] & [state] (plus read-only resource/shader slots), so separate contexts can be decoded from separate threads
+// [ctx1] is the same context through its 11.1 interface, for constant ranges (null on 11.0 runtimes)
+void DecodeCommands(ID3D11DeviceContext* ctx, ID3D11DeviceContext1* ctx1, ContextState& state, const CommandBuffer& cmds)
 {
-	viewType** views = nullptr;
-	BindableViewList(uint32_t numViews, D3DHandle* handles)
+	PROFILE_FUNCTION();
+
+	ShadowState& shadow = state.shadow;
+	const char* cursor = cmds.Begin();
+	const char* end = cmds.End();
+	while (cursor < end)
 	{
-		views = Memory::AllocateArray<viewType*>(numViews);
-		for (uint32_t k = 0; k < numViews; k++)
+		const CommandHeader& header = *reinterpret_cast<const CommandHeader*>(cursor);
+		const void* payload = &header + 1;
+		switch (header.type)
 		{
-			if (std::is_same_v<viewType, ID3D11UnorderedAccessView>)
+			case CMD_TYPES::SET_BACKBUFFER:
+				BindRenderTargets(ctx, state, 1, backBufView.GetAddressOf(), ResolveResrc(textures, starterDepthBuffer).dsv.Get());
+				break;
+
+			case CMD_TYPES::SET_TARGETS:
 			{
-				views[k] = reinterpret_cast<viewType*>(textures[handles[k].index].uav.Get());
+				const CmdSetTargets& targets = *reinterpret_cast<const CmdSetTargets*>(payload);
+				const D3DHandle* handles = reinterpret_cast<const D3DHandle*>(&targets + 1);
+				ID3D11RenderTargetView* rtvs[BindingTable::max_rtvs];
+				for (uint32_t i = 0; i < header.count; i++)
+				{
+					rtvs[i] = ResolveViews(handles[i]).rtv;
+				}
+				BindRenderTargets(ctx, state, header.count, rtvs, targets.hasDSV ? ResolveViews(targets.dsv).dsv : nullptr);
+				break;
 			}
-			else if (std::is_same_v<viewType, ID3D11ShaderResourceView>)
+
+			case CMD_TYPES::SET_SRVS:
 			{
-				views[k] = reinterpret_cast<viewType*>(textures[handles[k].index].srv.Get());
+				const D3DHandle* handles = reinterpret_cast<const D3DHandle*>(payload);
+				ID3D11ShaderResourceView* srvs[BindingTable::max_srvs];
+				for (uint32_t i = 0; i < header.count; i++)
+				{
+					srvs[i] = ResolveViews(handles[i]).srv;
+				}
+
+				if (ShadowCompareSlots(state.stats, shadow.srvs[header.stage], shadow.srvsValid[header.stage], srvs, header.count))
+				{
+					if (header.stage == static_cast<uint8_t>(SHADER_TYPES::VS)) ctx->VSSetShaderResources(0, header.count, srvs);
+					else if (header.stage == static_cast<uint8_t>(SHADER_TYPES::PS)) ctx->PSSetShaderResources(0, header.count, srvs);
+					else ctx->CSSetShaderResources(0, header.count, srvs);
+				}
+				break;
 			}
-			else if (std::is_same_v<viewType, ID3D11RenderTargetView>)
+
+			case CMD_TYPES::SET_CBUFFERS:
 			{
-				views[k] = reinterpret_cast<viewType*>(textures[handles[k].index].rtv.Get());
+				const D3DHandle* handles = reinterpret_cast<const D3DHandle*>(payload);
+				ID3D11Buffer* cbuffers[BindingTable::max_cbuffers];
+				for (uint32_t i = 0; i < header.count; i++)
+				{
+					cbuffers[i] = ResolveResrc(buffers, handles[i]).resrc.Get();
+				}
+
+				if (ShadowCompareSlots(state.stats, shadow.cbuffers[header.stage], shadow.cbuffersValid[header.stage], cbuffers, header.count))
+				{
+					if (header.stage == static_cast<uint8_t>(SHADER_TYPES::VS)) ctx->VSSetConstantBuffers(0, header.count, cbuffers);
+					else if (header.stage == static_cast<uint8_t>(SHADER_TYPES::PS)) ctx->PSSetConstantBuffers(0, header.count, cbuffers);
+					else ctx->CSSetConstantBuffers(0, header.count, cbuffers);
+				}
+				break;
 			}
-			else if (std::is_same_v<viewType, ID3D11DepthStencilView>)
+
+			case CMD_TYPES::SET_CONSTANT_RANGE:
 			{
-				views[k] = reinterpret_cast<viewType*>(textures[handles[k].index].dsv.Get());
+				assert(("Constant ranges need a D3D11.1 runtime", ctx1 != nullptr));
+				const CmdSetConstantRange& range = *reinterpret_cast<const CmdSetConstantRange*>(payload);
+				ID3D11Buffer* cbuffer = ResolveResrc(buffers, range.buffer).resrc.Get();
+				if (header.stage == static_cast<uint8_t>(SHADER_TYPES::VS)) ctx1->VSSetConstantBuffers1(header.count, 1, &cbuffer, &range.firstConstant, &range.numConstants);
+				else if (header.stage == static_cast<uint8_t>(SHADER_TYPES::PS)) ctx1->PSSetConstantBuffers1(header.count, 1, &cbuffer, &range.firstConstant, &range.numConstants);
+				else ctx1->CSSetConstantBuffers1(header.count, 1, &cbuffer, &range.firstConstant, &range.numConstants);
+
+				// The shadow only knows buffers, not ranges within them, so it can't vouch for this stage's cbuffers anymore
+				shadow.cbuffersValid[header.stage] = false;
+				state.stats.issued++;
+				break;
 			}
-			else // if (std::is_same_v<viewType, ID3D11Buffer>)
+
+			case CMD_TYPES::SET_UAVS:
 			{
-				views[k] = reinterpret_cast<viewType*>(textures[handles[k].index].resrc.Get());
+				const D3DHandle* handles = reinterpret_cast<const D3DHandle*>(payload);
+				ID3D11UnorderedAccessView* uavs[BindingTable::max_uavs];
+				for (uint32_t i = 0; i < header.count; i++)
+				{
+					uavs[i] = ResolveViews(handles[i]).uav;
+				}
+
+				if (ShadowCompareSlots(state.stats, shadow.uavs, shadow.uavsValid, uavs, header.count))
+				{
+					ctx->CSSetUnorderedAccessViews(0, header.count, uavs, nullptr);
+					InvalidateSRVShadows(shadow);
+				}
+				break;
 			}
-		}
-	}
 
-	~BindableViewList()
-	{
-		Memory::FreeToAddress(views);
-	}
-};
+			case CMD_TYPES::SET_GEOMETRY:
+			{
+				const CmdSetGeometry& geometry = *reinterpret_cast<const CmdSetGeometry*>(payload);
+				ID3D11InputLayout* ilayout = geometry.is2D ? ilayout2D.Get() : ilayout3D.Get();
+				if (ShadowCompare(state.stats, shadow.inputLayout, shadow.inputLayoutValid, ilayout)) ctx->IASetInputLayout(ilayout);
+
+				uint32_t vbufOffs = geometry.vbufferOffset;
+				uint32_t vbufStride = geometry.is2D ? sizeof(Vertex2D) : sizeof(Vertex3D);
+				ID3D11Buffer* vbuf = ResolveResrc(buffers, geometry.vbuffer).resrc.Get();
+				if (!shadow.vbufValid || shadow.vbuffer != vbuf || shadow.vbufStride != vbufStride || shadow.vbufOffset != vbufOffs)
+				{
+					ctx->IASetVertexBuffers(0, 1, &vbuf, &vbufStride, &vbufOffs);
+					shadow.vbuffer = vbuf;
+					shadow.vbufStride = vbufStride;
+					shadow.vbufOffset = vbufOffs;
+					shadow.vbufValid = true;
+					state.stats.issued++;
+				}
+				else
+				{
+					state.stats.skipped++;
+				}
+
+				ID3D11Buffer* ibuf = ResolveResrc(buffers, geometry.ibuffer).resrc.Get();
+				if (!shadow.ibufValid || shadow.ibuffer != ibuf || shadow.ibufOffset != geometry.ibufferOffset)
+				{
+					ctx->IASetIndexBuffer(ibuf, DXGI_FORMAT_R32_UINT, geometry.ibufferOffset);
+					shadow.ibuffer = ibuf;
+					shadow.ibufOffset = geometry.ibufferOffset;
+					shadow.ibufValid = true;
+					state.stats.issued++;
+				}
+				else
+				{
+					state.stats.skipped++;
+				}
+
+				// Geometry without instance data leaves slot 1 alone; its input layout never reads it
+				if (geometry.hasInstances && ShadowCompare(state.stats, shadow.instances, shadow.instancesValid, ResolveResrc(buffers, geometry.instances).resrc.Get()))
+				{
+					const uint32_t instanceStride = sizeof(uint32_t);
+					const uint32_t instanceOffs = 0;
+					ctx->IASetVertexBuffers(1, 1, &shadow.instances, &instanceStride, &instanceOffs);
+				}
+				break;
+			}
 
-void BindResources(D3DHandle* resources, RESRC_VIEWS* resrcBindings, SHADER_TYPES* bindFor, uint32_t numResources)
-{
-	bool* resource_bound = Memory::AllocateArray<bool>(numResources);
-	for (uint32_t i = 0; i < numResources; i++)
-	{
-		if (!resource_bound[i])
-		{
-			// Scan all views equal to [resrcBindings[i]] into a local buffer and bind together for fewer state changes; flag the selected textures/bindings
+			case CMD_TYPES::SET_SHADERS:
+			{
+				const CmdSetShaders& shaders = *reinterpret_cast<const CmdSetShaders*>(payload);
+				if (ShadowCompare(state.stats, shadow.vs, shadow.vsValid, vtShaders[shaders.vs].Get())) ctx->VSSetShader(shadow.vs, nullptr, 0);
+				if (ShadowCompare(state.stats, shadow.ps, shadow.psValid, pxShaders[shaders.ps].Get())) ctx->PSSetShader(shadow.ps, nullptr, 0);
+				break;
+			}
 
-			D3DHandle* matchingResources = Memory::AllocateArray<D3DHandle>(numResources - i);
-			uint32_t matchCtr = 0;
+			case CMD_TYPES::SET_COMPUTE_SHADER:
+			{
+				const CmdSetComputeShader& shader = *reinterpret_cast<const CmdSetComputeShader*>(payload);
+				if (ShadowCompare(state.stats, shadow.cs, shadow.csValid, computeShaders[shader.cs].Get())) ctx->CSSetShader(shadow.cs, nullptr, 0);
+				break;
+			}
 
-			SearchForResources(i, resources, resrcBindings, bindFor, numResources, resrcBindings[i], matchingResources, resource_bound, matchCtr);
+			case CMD_TYPES::DRAW_INDEXED:
+			{
+				const InstanceBatch& batch = reinterpret_cast<const CmdDrawIndexed*>(payload)->batch;
+				ctx->DrawIndexedInstanced(batch.numIndices, batch.numInstances, batch.firstIndex, 0, batch.firstInstance);
+				break;
+			}
 
-			// Choose an appropriate binding for the current view type & requested shader stage
-			// (could fill this in now but spent enough time already, and I'd immediately think of smoething else afterward ^_^')
-			SHADER_TYPES stage = bindFor[i];
-			switch (resrcBindings[i])
+			case CMD_TYPES::DISPATCH:
 			{
-				case UNORDERED_GPU_WRITES:
-					if (stage == SHADER_TYPES::VS || stage == SHADER_TYPES::PS)
-					{
-						assert(("FL11.0 only supports UAVs in compute shaders", false));
-					}
-					else
-					{
-						BindableViewList<ID3D11UnorderedAccessView> bindings(matchCtr, matchingResources);
-						context->CSSetUnorderedAccessViews(0, matchCtr, bindings.views, nullptr);
-					}
-					break;
-
-				case GENERIC_READONLY:
-					if (stage == SHADER_TYPES::VS)
-					{
-						BindableViewList<ID3D11ShaderResourceView> bindings(matchCtr, matchingResources);
-						context->VSSetShaderResources(0, matchCtr, bindings.views);
-					}
-					else if (stage == SHADER_TYPES::PS)
-					{
-						BindableViewList<ID3D11ShaderResourceView> bindings(matchCtr, matchingResources);
-						context->PSSetShaderResources(0, matchCtr, bindings.views);
-					}
-					else // if (stage == SHADER_TYPES::CS)
-					{
-						BindableViewList<ID3D11ShaderResourceView> bindings(matchCtr, matchingResources);
-						context->CSSetShaderResources(0, matchCtr, bindings.views);
-					}
-					break;
-
-				case CONSTANT_BUFFER:
-					if (stage == SHADER_TYPES::VS)
-					{
-						BindableViewList<ID3D11Buffer> bindings(matchCtr, matchingResources);
-						context->VSSetConstantBuffers(0, matchCtr, bindings.views);
-					}
-					else if (stage == SHADER_TYPES::PS)
-					{
-						BindableViewList<ID3D11Buffer> bindings(matchCtr, matchingResources);
-						context->PSSetConstantBuffers(0, matchCtr, bindings.views);
-					}
-					else // if (stage == SHADER_TYPES::CS)
-					{
-						BindableViewList<ID3D11Buffer> bindings(matchCtr, matchingResources);
-						context->CSSetConstantBuffers(0, matchCtr, bindings.views);
-					}
-					break;
-
-				case RENDER_TARGET:
-				case DEPTH_STENCIL:
-					if (resrcBindings[i] == RENDER_TARGET)
-					{
-						assert(("Render-targets can't be boound for compute shader dispatch - prefer a UAV (GPU_UNORDERED_WRITES)", stage != SHADER_TYPES::CS));
-
-						// Resolve RTV bindlist
-						BindableViewList<ID3D11RenderTargetView> rtvBindings(matchCtr, matchingResources);
-
-						uint32_t numDepthBuffers = 0;
-						D3DHandle* depthResources = Memory::AllocateArray<D3DHandle>(numResources - i);
-						SearchForResources(i, resources, resrcBindings, bindFor, numResources, DEPTH_STENCIL, depthResources, resource_bound, numDepthBuffers);
-
-						if (numDepthBuffers > 0)
-						{
-							assert(("Only one depth buffer can be bound for each draw", false));
-							context->OMSetRenderTargets(matchCtr, rtvBindings.views, textures[depthResources[0].index].dsv.Get());
-						}
-						else
-						{
-							context->OMSetRenderTargets(matchCtr, rtvBindings.views, nullptr);
-						}
-
-						Memory::FreeToAddress(depthResources);
-					}
-					else
-					{
-						assert(("Depth-stencils can't be boound for compute shader dispatch - prefer a UAV (GPU_UNORDERED_WRITES)", stage != SHADER_TYPES::CS));
-
-						// Resolve DSV bindlist
-						BindableViewList<ID3D11DepthStencilView> depthBindings(matchCtr, matchingResources);
-
-						uint32_t numRTVs = 0;
-						D3DHandle* rtvResources = Memory::AllocateArray<D3DHandle>(numResources - i);
-						SearchForResources(i, resources, resrcBindings, bindFor, numResources, RENDER_TARGET, rtvResources, resource_bound, numRTVs);
-
-						BindableViewList<ID3D11RenderTargetView> rtvBindings(numRTVs, rtvResources);
-
-						if (numRTVs > 0)
-						{
-							assert(("Only one depth buffer can be bound for each draw", false));
-							context->OMSetRenderTargets(matchCtr, rtvBindings.views, depthBindings.views[0]);
-						}
-						else
-						{
-							context->OMSetRenderTargets(matchCtr, nullptr, depthBindings.views[0]);
-						}
-
-						Memory::FreeToAddress(rtvResources);
-					}
-					break;
-
-				default:
-					assert(("Invalid/unsupported resource binding", false));
-					break;
+				const CmdDispatch& dispatch = *reinterpret_cast<const CmdDispatch*>(payload);
+				ctx->Dispatch(dispatch.x, dispatch.y, dispatch.z);
+				break;
 			}
 
-			// Free memory laon
-			Memory::FreeToAddress(matchingResources);
+			default:
+				assert(("Unknown command in command buffer", false));
+				break;
 		}
+
+		cursor += header.sizeBytes;
 	}
-	Memory::FreeToAddress(resource_bound);
 }
 
-void D3DWrapper::SubmitDraw(D3DHandle* draw_textures, RESRC_VIEWS* textureBindings, SHADER_TYPES* bindTexturesFor, uint32_t numTextures,
-							D3DHandle* draw_buffers, RESRC_VIEWS* bufferBindings, SHADER_TYPES* bindBuffersFor, uint32_t numBuffers,
-							D3DHandle* draw_volumes, RESRC_VIEWS* volumeBindings, SHADER_TYPES* bindVolumesFor, uint32_t numVolumes,
-							D3DHandle VS, D3DHandle PS, bool directToBackbuf, bool is2D, D3DHandle vbuffer, D3DHandle ibuffer, uint32_t numNdces)
+void D3DWrapper::UpdateBuffer(D3DHandle handle, const void* data, uint32_t numBytes)
 {
-#ifdef _DEBUG
-	for (uint32_t i = 0; i < numTextures; i++)
+	assert(("Only buffers can be updated through UpdateBuffer()", handle.objType == D3D_OBJ_TYPES::BUFFER));
+
+	// Whole-buffer rewrites, so the driver can hand us fresh memory instead of waiting for the GPU to finish with the old contents
+	ID3D11Buffer* buffer = ResolveResrc(buffers, handle).resrc.Get();
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	HRESULT hr = context->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+	assert(SUCCEEDED(hr));
+	memcpy(mapped.pData, data, numBytes);
+	context->Unmap(buffer, 0);
+}
+
+void D3DWrapper::UpdateBufferRange(D3DHandle handle, const void* data, uint32_t firstByte, uint32_t numBytes)
+{
+	assert(("Only buffers can be updated through UpdateBufferRange()", handle.objType == D3D_OBJ_TYPES::BUFFER));
+
+	// Only the boxed bytes are copied; the rest of the buffer stays resident & untouched
+	const D3D11_BOX box = { firstByte, 0, 0, firstByte + numBytes, 1, 1 };
+	context->UpdateSubresource(ResolveResrc(buffers, handle).resrc.Get(), 0, &box, data, 0, 0);
+}
+
+void D3DWrapper::ExecuteCommands(const CommandBuffer& cmds)
+{
+	UnmapUploadRings();
+	DecodeCommands(context.Get(), context1.Get(), immediateState, cmds);
+}
+
+void D3DWrapper::InitDeferredContexts(uint32_t numContexts)
+{
+	assert(("Too many deferred contexts requested", numContexts <= max_deferred_contexts));
+
+	// Drivers without native command lists still work (the runtime emulates them), but recording buys much less; worth knowing when profiling
+	D3D11_FEATURE_DATA_THREADING threading = {};
+	HRESULT hr = device->CheckFeatureSupport(D3D11_FEATURE_THREADING, &threading, sizeof(threading));
+	if (SUCCEEDED(hr) && !threading.DriverCommandLists)
 	{
-		assert(("Direct write to back-buffer expected, but render-target view provided to D3DWrapper::SubmitDraw", !(directToBackbuf && textureBindings[i] == RENDER_TARGET)));
+		OutputDebugStringA("Driver has no native command-list support; deferred contexts will be emulated by the runtime\n");
 	}
-#endif
 
-	BindResources(draw_textures, textureBindings, bindTexturesFor, numTextures);
-
-	if (directToBackbuf)
+	for (uint32_t i = numDeferredContexts; i < numContexts; i++)
 	{
-		context->OMSetRenderTargets(1, backBufView.GetAddressOf(), textures[starterDepthBuffer.index].dsv.Get());
+		hr = device->CreateDeferredContext(0, &deferredContexts[i]);
+		assert(SUCCEEDED(hr));
+
+		if (context1.Get() != nullptr)
+		{
+			hr = deferredContexts[i]->QueryInterface(__uuidof(ID3D11DeviceContext1), reinterpret_cast<void**>(deferredContexts1[i].ReleaseAndGetAddressOf()));
+			assert(SUCCEEDED(hr));
+		}
 	}
+	numDeferredContexts = (numContexts > numDeferredContexts) ? numContexts : numDeferredContexts;
+}
+
+void D3DWrapper::RecordCommandList(uint32_t contextNdx, const CommandBuffer& cmds)
+{
+	PROFILE_FUNCTION();
 
-	uint32_t vbufOffs = 0;
-	uint32_t vbufStride = is2D ? sizeof(Vertex2D) : sizeof(Vertex3D);
-	context->IASetInputLayout(is2D ? ilayout2D.Get() : ilayout3D.Get());
-	context->IASetVertexBuffers(0, 1, buffers[vbuffer.index].resrc.GetAddressOf(), &vbufStride, &vbufOffs);
-	context->IASetIndexBuffer(buffers[ibuffer.index].resrc.Get(), DXGI_FORMAT_R32_UINT, 0);
+	assert(("Recording into a deferred context that hasn't been created", contextNdx < numDeferredContexts));
+	ID3D11DeviceContext* ctx = deferredContexts[contextNdx].Get();
+	ContextState& state = deferredStates[contextNdx];
 
-	context->VSSetShader(vtShaders[VS.index].Get(), nullptr, 0);
-	context->PSSetShader(pxShaders[PS.index].Get(), nullptr, 0);
-	context->DrawIndexed(numNdces, 0, 0);
+	// Deferred contexts start every list from default state, & FinishCommandList() clears it again
+	state.shadow = ShadowState();
+	state.stats = StateCacheStats();
+	ApplyBaseState(ctx);
+
+	DecodeCommands(ctx, deferredContexts1[contextNdx].Get(), state, cmds);
+
+	commandLists[contextNdx].Reset();
+	HRESULT hr = ctx->FinishCommandList(FALSE, &commandLists[contextNdx]);
+	assert(SUCCEEDED(hr));
 }
 
-void D3DWrapper::SubmitDispatch(D3DHandle* dispatch_textures, RESRC_VIEWS* textureBindings, uint32_t numTextures,
-								D3DHandle* dispatch_buffers, RESRC_VIEWS* bufferBindings, uint32_t numBuffers,
-								D3DHandle* dispatch_volumes, RESRC_VIEWS* volumeBindings, uint32_t numVolumes,
-								D3DHandle CS, uint32_t dispatchX, uint32_t dispatchY, uint32_t dispatchZ)
+void D3DWrapper::ExecuteCommandList(uint32_t contextNdx)
 {
-	SHADER_TYPES shaderType = SHADER_TYPES::CS;
-	BindResources(dispatch_textures, textureBindings, &shaderType, numTextures);
+	PROFILE_FUNCTION();
+
+	assert(("No command list recorded for this context", contextNdx < numDeferredContexts && commandLists[contextNdx].Get() != nullptr));
 
-	context->CSSetShader(computeShaders[CS.index].Get(), nullptr, 0);
-	context->Dispatch(dispatchX, dispatchY, dispatchZ);
+	// Not asking the runtime to restore our state afterward (it's expensive), so the immediate context comes back in its default state
+	UnmapUploadRings();
+	context->ExecuteCommandList(commandLists[contextNdx].Get(), FALSE);
+	ApplyBaseState(context.Get());
+	InvalidateStateCache();
+
+	immediateState.stats.issued += deferredStates[contextNdx].stats.issued;
+	immediateState.stats.skipped += deferredStates[contextNdx].stats.skipped;
 }
 
 void D3DWrapper::PrepareBackbuf()
 {
+	PROFILE_FUNCTION();
+
 	// Clear the back-buffer & depth-buffer
 	const FLOAT debug_red[4] = { 0.75, 0.25, 0.125, 1 };
 	context->ClearRenderTargetView(backBufView.Get(), debug_red);
-	context->ClearDepthStencilView(textures[starterDepthBuffer.index].dsv.Get(), D3D11_CLEAR_FLAG::D3D11_CLEAR_DEPTH, 1.0f, 0); // Highest possible depth, since our comparison function is LESS and we can't draw things closer than 0 (duh)
+	context->ClearDepthStencilView(ResolveResrc(textures, starterDepthBuffer).dsv.Get(), D3D11_CLEAR_FLAG::D3D11_CLEAR_DEPTH, 1.0f, 0); // Highest possible depth, since our comparison function is LESS and we can't draw things closer than 0 (duh)
+}
+
+bool FrameQuerySignalled(uint64_t frame, bool flush)
+{
+	BOOL done = FALSE;
+	const HRESULT hr = context->GetData(frameQueries[frame % D3DWrapper::max_frames_in_flight].Get(), &done, sizeof(BOOL), flush ? 0 : D3D11_ASYNC_GETDATA_DONOTFLUSH);
+	return (hr == S_OK) && done;
+}
+
+// Advances [retiredFrames] past every submitted frame whose query has signalled; with [block], keeps flushing & polling until [waitFor]
+// has retired as well
+void PollFrameQueries(bool block, uint64_t waitFor)
+{
+	const uint64_t submitted = currentFrame.load(std::memory_order_relaxed);
+	uint64_t retired = retiredFrames.load(std::memory_order_relaxed);
+	while (retired < submitted)
+	{
+		const bool mustWait = block && retired <= waitFor;
+		if (FrameQuerySignalled(retired, mustWait))
+		{
+			retired++;
+		}
+		else if (!mustWait)
+		{
+			break;
+		}
+	}
+	retiredFrames.store(retired, std::memory_order_release);
+}
+
+void RetireFrames()
+{
+	const uint64_t frame = currentFrame.load(std::memory_order_relaxed);
+	constantRing.ring.EndFrame(frame);
+	streamingRing.ring.EndFrame(frame);
+
+	if (frameQueriesAvailable)
+	{
+		// Reusing a query that hasn't signalled would lose track of its frame, so wait that frame out first; DXGI's own frame latency
+		// means we almost never get here
+		if (frame >= D3DWrapper::max_frames_in_flight)
+		{
+			PollFrameQueries(true, frame - D3DWrapper::max_frames_in_flight);
+		}
+
+		context->End(frameQueries[frame % D3DWrapper::max_frames_in_flight].Get());
+		currentFrame.store(frame + 1, std::memory_order_release);
+		PollFrameQueries(false, 0);
+	}
+	else
+	{
+		currentFrame.store(frame + 1, std::memory_order_release);
+		retiredFrames.store((frame + 1 > D3DWrapper::max_frames_in_flight) ? (frame + 1 - D3DWrapper::max_frames_in_flight) : 0, std::memory_order_release);
+	}
+
+	const uint64_t retired = retiredFrames.load(std::memory_order_relaxed);
+	constantRing.ring.Retire(retired);
+	streamingRing.ring.Retire(retired);
+	destructionQueue.Collect(retired);
 }
 
 void D3DWrapper::Present()
 {
+	PROFILE_FUNCTION();
+
+	UnmapUploadRings();
 	swapchain->Present(using_vsync ? 4 : 0, // If vsync, try to synchronize for at least 4 frames (I suspect d3d11.1-3 have cleaner interfaces than this but api upgrade scary)
 					   using_vsync ? 0 : DXGI_PRESENT_ALLOW_TEARING); // Allow tearing if no vsync
+
+	// Flip-model presents unbind the back-buffer, so nothing we remember about the output-merger holds across frames; simplest to start every
+	// frame from a clean slate
+	InvalidateStateCache();
+	lastFrameStateStats = immediateState.stats;
+	immediateState.stats = StateCacheStats();
+
+	RetireFrames();
+}
+
+uint64_t D3DWrapper::CurrentFrame()
+{
+	return currentFrame.load(std::memory_order_acquire);
+}
+
+uint64_t D3DWrapper::RetiredFrames()
+{
+	return retiredFrames.load(std::memory_order_acquire);
+}
+
+UploadAllocation AllocateFromRing(DynamicRing& ring, uint32_t numBytes, uint32_t alignment)
+{
+	uint32_t offset = 0;
+	if (!ring.ring.Allocate(numBytes, alignment, offset))
+	{
+		// Everything left is still in flight; wait for the oldest frame holding space to retire. Rings are sized so this only happens when
+		// the GPU falls badly behind, but it can't help if the current frame alone fills the ring
+		const uint64_t oldest = ring.ring.OldestPendingFrame();
+		assert(("Upload ring too small for one frame's uploads; raise its size", frameQueriesAvailable && oldest < currentFrame.load(std::memory_order_relaxed)));
+		PollFrameQueries(true, oldest);
+		ring.ring.Retire(retiredFrames.load(std::memory_order_relaxed));
+
+		const bool allocated = ring.ring.Allocate(numBytes, alignment, offset);
+		assert(("Upload ring allocation failed after waiting on the GPU", allocated));
+	}
+
+	if (ring.mapped == nullptr)
+	{
+		D3D11_MAPPED_SUBRESOURCE mapped = {};
+		const HRESULT hr = context->Map(ResolveResrc(buffers, ring.buffer).resrc.Get(), 0, ring.everMapped ? D3D11_MAP_WRITE_NO_OVERWRITE : D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+		assert(SUCCEEDED(hr));
+		ring.mapped = reinterpret_cast<char*>(mapped.pData);
+		ring.everMapped = true;
+	}
+
+	UploadAllocation alloc = {};
+	alloc.cpu = ring.mapped + offset;
+	alloc.offset = offset;
+	alloc.numBytes = numBytes;
+	alloc.buffer = ring.buffer;
+	return alloc;
+}
+
+UploadAllocation D3DWrapper::AllocateConstants(uint32_t numBytes)
+{
+	assert(("Constant ranges need a D3D11.1 runtime", ConstantRingAvailable()));
+
+	// Ranges are bound in whole blocks of 16 constants, so round up & keep the padding out of anyone else's range
+	const uint32_t paddedBytes = (numBytes + (constant_range_alignment - 1)) & ~(constant_range_alignment - 1);
+	UploadAllocation alloc = AllocateFromRing(constantRing, paddedBytes, constant_range_alignment);
+	alloc.numBytes = numBytes;
+	return alloc;
+}
+
+UploadAllocation D3DWrapper::AllocateStreaming(uint32_t numBytes, uint32_t alignment)
+{
+	return AllocateFromRing(streamingRing, numBytes, alignment);
+}
+
+bool D3DWrapper::ConstantRingAvailable()
+{
+	return context1.Get() != nullptr;
+}
+
+bool D3DWrapper::QueueUpload(D3DHandle dest, uint32_t destOffset, const void* data, uint32_t numBytes)
+{
+#ifdef _DEBUG
+	D3D11_BUFFER_DESC desc = {};
+	ResolveResrc(buffers, dest).resrc->GetDesc(&desc);
+	assert(("Uploads need DEFAULT-usage destinations (GPU_ONLY without GENERIC_READONLY, or CPU_UPDATE)", desc.Usage == D3D11_USAGE_DEFAULT));
+	assert(("Upload runs past the end of its destination", destOffset + numBytes <= desc.ByteWidth));
+#endif
+	return uploadQueue.Enqueue(dest, destOffset, data, numBytes);
+}
+
+void D3DWrapper::FlushUploads()
+{
+	PROFILE_FUNCTION();
+
+	const uint64_t frame = currentFrame.load(std::memory_order_relaxed);
+	const uint32_t stagingNdx = frame % max_frames_in_flight;
+	if (uploadQueue.NumQueued() == 0 || uploadStagingFrames[stagingNdx] == frame + 1)
+	{
+		return;
+	}
+
+	// The GPU may still be copying out of this staging buffer; mapping it would wait, so leave everything queued for another frame instead
+	if (uploadStagingFrames[stagingNdx] != 0 && uploadStagingFrames[stagingNdx] > RetiredFrames())
+	{
+		return;
+	}
+
+	ID3D11Buffer* staging = ResolveResrc(buffers, uploadStaging[stagingNdx]).resrc.Get();
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	HRESULT hr = context->Map(staging, 0, D3D11_MAP_WRITE, 0, &mapped);
+	assert(SUCCEEDED(hr));
+	const uint32_t numCopies = uploadQueue.Pack(reinterpret_cast<char*>(mapped.pData), upload_budget_bytes, uploadCopies);
+	context->Unmap(staging, 0);
+
+	for (uint32_t i = 0; i < numCopies; i++)
+	{
+		// Destinations released after their uploads were queued just drop them
+		const UploadCopy& copy = uploadCopies[i];
+		ResrcGeneric<ID3D11Buffer>* dest = buffers.Resolve(copy.dest.index, copy.dest.generation);
+		if (dest == nullptr)
+		{
+			continue;
+		}
+
+		const D3D11_BOX box = { copy.stagingOffset, 0, 0, copy.stagingOffset + copy.numBytes, 1, 1 };
+		context->CopySubresourceRegion(dest->resrc.Get(), 0, copy.destOffset, 0, 0, staging, 0, &box);
+	}
+	uploadStagingFrames[stagingNdx] = frame + 1;
+}
+
+void UnmapRing(DynamicRing& ring)
+{
+	if (ring.mapped != nullptr)
+	{
+		context->Unmap(ResolveResrc(buffers, ring.buffer).resrc.Get(), 0);
+		ring.mapped = nullptr;
+	}
+}
+
+void D3DWrapper::UnmapUploadRings()
+{
+	UnmapRing(constantRing);
+	UnmapRing(streamingRing);
 }
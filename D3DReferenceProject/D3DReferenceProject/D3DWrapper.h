@@ -3,6 +3,39 @@
 #include "D3DUtils.h"
 #include <d3d11.h>
 
+class CommandBuffer;
+
+// Flat, per-stage slot tables, filled in as bindings are added to a job & handed straight to *SetShaderResources/*SetConstantBuffers/
+// CSSetUnorderedAccessViews/OMSetRenderTargets at submission
+// Slots are assigned in the order bindings were added, per view type & stage (so the first SRV added for the PS lands in t0, the second in t1...)
+// Slots hold resource handles rather than views; the view each slot wants is implied by its table, & resolved as streams decode, so a job
+// outliving one of its resources trips the stale-handle check instead of binding a released view
+struct BindingTable
+{
+	static constexpr uint32_t max_srvs = 32;
+	static constexpr uint32_t max_cbuffers = D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT;
+	static constexpr uint32_t max_uavs = D3D11_PS_CS_UAV_REGISTER_COUNT; // FL11.0 only exposes UAVs to compute
+	static constexpr uint32_t max_rtvs = D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT;
+
+	struct StageTable
+	{
+		D3DHandle srvs[max_srvs] = {};
+		uint32_t numSRVs = 0;
+		D3DHandle cbuffers[max_cbuffers] = {};
+		uint32_t numCBuffers = 0;
+	};
+
+	StageTable stages[3]; // Indexed by SHADER_TYPES
+
+	D3DHandle uavs[max_uavs] = {};
+	uint32_t numUAVs = 0;
+
+	D3DHandle rtvs[max_rtvs] = {};
+	uint32_t numRTVs = 0;
+	D3DHandle dsv = {};
+	bool hasDSV = false;
+};
+
 static class D3DWrapper
 {
 	public:
@@ -12,23 +45,87 @@ static class D3DWrapper
 	static D3DHandle CreateTexture(uint32_t width, uint32_t height, DXGI_FORMAT format, RESRC_ACCESS_TYPES access, RESRC_VIEWS composed_views, void* init_data, uint32_t data_footprint_bytes);
 	static D3DHandle CreateBuffer(uint32_t num_elements, DXGI_FORMAT format, RESRC_ACCESS_TYPES access, RESRC_VIEWS composed_views, bool structured, void* init_data, uint32_t data_footprint_bytes);
 	static D3DHandle CreateVolume(uint32_t width, uint32_t height, uint32_t depth, DXGI_FORMAT format, RESRC_ACCESS_TYPES access, RESRC_VIEWS composed_views, void* init_data, uint32_t data_footprint_bytes);
-	static void		 ClearResrc(D3DHandle handle);
+	static void		 ClearResrc(D3DHandle handle); // Safe from any thread; the handle goes stale immediately, but its slot & GPU objects are left alone until the current frame retires
 
+	// Shaders are cached by bytecode (hash & size); creating a shader whose bytecode is already loaded (from any path) returns the existing handle
 	static D3DHandle CreateVertShader(const char* path, bool is2D);
 	static D3DHandle CreatePixelShader(const char* path);
 	static D3DHandle CreateComputeShader(const char* path);
 
-	static void SubmitDraw(D3DHandle* draw_textures, RESRC_VIEWS* textureBindings, SHADER_TYPES* bindTexturesFor, uint32_t numTextures,
-						   D3DHandle* draw_buffers, RESRC_VIEWS* bufferBindings, SHADER_TYPES* bindBuffersFor, uint32_t numBuffers,
-						   D3DHandle* draw_volumes, RESRC_VIEWS* volumeBindings, SHADER_TYPES* bindVolumesFor, uint32_t numVolumes,
-						   D3DHandle VS, D3DHandle PS, bool directToBackbuf, bool is2D, D3DHandle vbuffer, D3DHandle ibuffer, uint32_t numNdces);
+	// Reads & creates a batch of shaders on worker threads (device creation is free-threaded), so the Create*Shader() calls that follow
+	// are all cache hits; call from the main thread, after TaskScheduler::Init()
+	struct ShaderRequest
+	{
+		const char* path;
+		SHADER_TYPES type;
+		bool is2D; // Vertex shaders only
+	};
+	static void PreloadShaders(const ShaderRequest* requests, uint32_t numRequests);
 
-	static void SubmitDispatch(D3DHandle* textures, RESRC_VIEWS* textureBindings, uint32_t numTextures,
-							   D3DHandle* buffers, RESRC_VIEWS* bufferBindings, uint32_t numBuffers,
-							   D3DHandle* volumes, RESRC_VIEWS* volumeBindings, uint32_t numVolumes,
-							   D3DHandle CS, uint32_t dispatchX, uint32_t dispatchY, uint32_t dispatchZ);
+	// Rewrites the start of a CPU_WRITE buffer with [data] (render thread only)
+	static void UpdateBuffer(D3DHandle handle, const void* data, uint32_t numBytes);
+
+	// Overwrites [numBytes] of a CPU_UPDATE buffer from [firstByte] on, leaving everything else in place (render thread only)
+	static void UpdateBufferRange(D3DHandle handle, const void* data, uint32_t firstByte, uint32_t numBytes);
+
+	// Checks [resrc] has a view matching [bindAs] & appends it to the matching slot table in [table]
+	static void AddBinding(BindingTable& table, D3DHandle resrc, RESRC_VIEWS bindAs, SHADER_TYPES bindFor);
+
+	// Replays a recorded frame (see CommandBuffer.h) on the immediate context
+	static void ExecuteCommands(const CommandBuffer& cmds);
+
+	// Deferred contexts, for recording from several threads at once (see ParallelRecorder.h)
+	// RecordCommandList() replays [cmds] into deferred context [contextNdx] & closes it into a command list; safe from any thread, so long as
+	// no two threads share a context. ExecuteCommandList() runs that list on the immediate context (render thread only), & can be called again
+	// to resubmit the same list on later frames
+	static constexpr uint32_t max_deferred_contexts = 8;
+	static void InitDeferredContexts(uint32_t numContexts);
+	static void RecordCommandList(uint32_t contextNdx, const CommandBuffer& cmds);
+	static void ExecuteCommandList(uint32_t contextNdx);
 
 	static void PrepareBackbuf();
 	static void Present();
+
+	// Frame fences
+	// Frames are numbered from zero & end at Present(); the GPU is done with every frame before RetiredFrames(), so CPU-side copies of anything
+	// those frames read can be reused or released
+	static constexpr uint32_t max_frames_in_flight = 4;
+	static uint64_t CurrentFrame();
+	static uint64_t RetiredFrames();
+
+	// Per-frame upload rings
+	// Transient data (per-draw constants, streamed vertices & indices) is written straight into one of two big dynamic buffers, mapped once per
+	// frame with WRITE_NO_OVERWRITE & sub-allocated in order; space comes back as frames retire, so an upload is a pointer bump plus a memcpy
+	// into [cpu]. A ring that fills up waits for the GPU rather than overwriting anything it might still read
+	// Render thread only. Allocations must be written before the commands reading them execute (the rings are unmapped as they do), & don't
+	// outlive their frame, so streams binding them have to be re-recorded every frame
+	// Constant ranges are bound with CommandBuffer::EncodeConstantRange(), & need a D3D11.1 runtime (for cbuffer offsets & NO_OVERWRITE on
+	// dynamic cbuffers); streaming allocations go in DrawGeometry's buffer offsets & work on any runtime
+	static UploadAllocation AllocateConstants(uint32_t numBytes); // 256-byte aligned
+	static UploadAllocation AllocateStreaming(uint32_t numBytes, uint32_t alignment); // [alignment] is the vertex stride, or 4 for indices
+	static bool ConstantRingAvailable();
+	static void UnmapUploadRings(); // Called automatically before commands execute & on Present()
+
+	// Staged uploads
+	// Writes [numBytes] of [data] into buffer [dest] at [destOffset], in time for the commands of some later frame; safe from any thread, & [data]
+	// can be reused as soon as QueueUpload() returns. Destinations have to be DEFAULT-usage buffers (GPU_ONLY without GENERIC_READONLY, or CPU_UPDATE)
+	// FlushUploads() (render thread, once per frame, before the frame's commands) packs queued uploads into a staging buffer, oldest first & up
+	// to a fixed per-frame budget, then lands them with one copy per run of neighbouring writes; anything past the budget waits for the next
+	// frame, so a big upload spreads out instead of hitching
+	// QueueUpload() returns false (& queues nothing) while the queue is full; callers try again after the next FlushUploads()
+	static bool QueueUpload(D3DHandle dest, uint32_t destOffset, const void* data, uint32_t numBytes);
+	static void FlushUploads();
+
+	// Redundant-state filtering
+	// D3DWrapper remembers what it last bound on each context & skips binds that wouldn't change anything
+	// Stats for deferred contexts are folded into the frame's totals as their command lists execute
+	// Anything touching the context behind D3DWrapper's back should call InvalidateStateCache() afterward
+	struct StateCacheStats
+	{
+		uint32_t issued = 0;
+		uint32_t skipped = 0;
+	};
+	static void InvalidateStateCache();
+	static StateCacheStats LastFrameStateCacheStats();
 };
 
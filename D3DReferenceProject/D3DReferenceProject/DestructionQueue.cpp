@@ -0,0 +1,77 @@
+#include "DestructionQueue.h"
+#include "Memory.h"
+#include <cassert>
+
+void DestructionQueue::Init(uint32_t maxEntries)
+{
+	entries = Memory::AllocateArray<Entry>(maxEntries, alignof(Entry), MEM_TAGS::PIPELINE);
+	capacity = maxEntries;
+	head = 0;
+	tail = 0;
+}
+
+void DestructionQueue::Park(IUnknown* const* objects, uint32_t numObjects, uint64_t lastUsedFrame, OnRetired onRetired, uint32_t cookie)
+{
+	assert(("Too many objects for one destruction entry", numObjects <= max_objects_per_entry));
+
+	Entry entry = {};
+	entry.frame = lastUsedFrame;
+	entry.onRetired = onRetired;
+	entry.cookie = cookie;
+	for (uint32_t i = 0; i < numObjects; i++)
+	{
+		if (objects[i] != nullptr)
+		{
+			entry.objects[entry.numObjects++] = objects[i];
+		}
+	}
+
+	if (entry.numObjects == 0 && onRetired == nullptr)
+	{
+		return;
+	}
+
+	while (lock.test_and_set(std::memory_order_acquire)) {}
+	assert(("Destruction queue full; raise its capacity or retire frames more often", (tail - head) < capacity));
+	entries[tail % capacity] = entry;
+	tail++;
+	numParked.fetch_add(entry.numObjects, std::memory_order_relaxed);
+	lock.clear(std::memory_order_release);
+}
+
+uint32_t DestructionQueue::Collect(uint64_t retiredBefore)
+{
+	// Find retired entries under the lock, but release them outside it (Release() on a last reference can be slow); [head] only moves once
+	// they're done with, so parkers can't wrap around onto them in the meantime
+	while (lock.test_and_set(std::memory_order_acquire)) {}
+	const uint64_t first = head;
+	uint64_t end = head;
+	while (end != tail && entries[end % capacity].frame < retiredBefore)
+	{
+		end++;
+	}
+	lock.clear(std::memory_order_release);
+
+	uint32_t numReleased = 0;
+	for (uint64_t i = first; i < end; i++)
+	{
+		const Entry& entry = entries[i % capacity];
+		for (uint32_t j = 0; j < entry.numObjects; j++)
+		{
+			entry.objects[j]->Release();
+		}
+		numReleased += entry.numObjects;
+
+		if (entry.onRetired != nullptr)
+		{
+			entry.onRetired(entry.cookie);
+		}
+	}
+
+	while (lock.test_and_set(std::memory_order_acquire)) {}
+	head = end;
+	lock.clear(std::memory_order_release);
+
+	numParked.fetch_sub(numReleased, std::memory_order_relaxed);
+	return numReleased;
+}
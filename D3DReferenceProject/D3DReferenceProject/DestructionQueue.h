@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <d3d11.h>
+
+// Deferred release for GPU objects
+// Released resources (and their views) are parked with the frame they were last used in & only actually Release()d once the GPU has
+// retired that frame, so freeing something mid-frame never pulls it out from under in-flight work, and the driver never has to synchronize
+// on the release itself
+// The queue doesn't know how frames retire; D3DWrapper feeds it from event queries, anything without a device can feed it a plain frame counter
+// Entries can also carry a callback that Collect() runs once their objects are released, so owners can hold whatever referenced them (handle
+// slots, say) out of reuse until the frame retires as well
+// Parking is safe from any thread (short spinlock); collection is single-threaded (render thread), & so are the callbacks
+// Entries are kept in park order, which is frame order up to the odd race between threads parking on either side of a frame boundary; those
+// just wait for one more Collect()
+class DestructionQueue
+{
+	public:
+		static constexpr uint32_t max_objects_per_entry = 5; // A resource & all four view types
+
+		typedef void (*OnRetired)(uint32_t cookie);
+
+		void Init(uint32_t maxEntries);
+
+		// Takes over one reference to each non-null object in [objects]; [onRetired] (if any) gets [cookie] back after they're released
+		void Park(IUnknown* const* objects, uint32_t numObjects, uint64_t lastUsedFrame, OnRetired onRetired = nullptr, uint32_t cookie = 0);
+
+		// Releases everything parked for frames before [retiredBefore]; returns the number of objects released
+		uint32_t Collect(uint64_t retiredBefore);
+
+		// Releases everything, retired or not; only once the GPU is idle (shutdown)
+		uint32_t Flush() { return Collect(~0ull); }
+
+		uint32_t NumParked() const { return numParked.load(std::memory_order_relaxed); }
+
+	private:
+		struct Entry
+		{
+			uint64_t frame;
+			IUnknown* objects[max_objects_per_entry];
+			uint32_t numObjects;
+			OnRetired onRetired;
+			uint32_t cookie;
+		};
+
+		Entry* entries = nullptr;
+		uint32_t capacity = 0;
+		uint64_t head = 0; // Oldest parked entry
+		uint64_t tail = 0; // Next free entry; [head, tail) wraps around [entries]
+		std::atomic<uint32_t> numParked = 0;
+		std::atomic_flag lock = ATOMIC_FLAG_INIT;
+};
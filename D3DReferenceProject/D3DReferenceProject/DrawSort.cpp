@@ -0,0 +1,169 @@
+#include "DrawSort.h"
+#include <cstring>
+
+constexpr uint32_t target_bits = 11;
+constexpr uint32_t shader_bits = 16;
+constexpr uint32_t material_bits = 12;
+constexpr uint32_t binding_bits = 8;
+constexpr uint32_t depth_bits = 16;
+constexpr uint64_t translucent_bit = 1ull << 63;
+
+uint64_t FieldMask(uint32_t bits)
+{
+	return (1ull << bits) - 1;
+}
+
+// FNV-1a over resource handles (slot, generation & type)
+uint32_t HashHandles(const D3DHandle* handles, uint32_t numHandles, uint32_t hash = 2166136261u)
+{
+	for (uint32_t i = 0; i < numHandles; i++)
+	{
+		const uint64_t value = handles[i].index | (static_cast<uint64_t>(handles[i].generation) << 16) | (static_cast<uint64_t>(handles[i].objType) << 32);
+		for (uint32_t j = 0; j < 8; j++)
+		{
+			hash ^= (value >> (j * 8)) & 0xFF;
+			hash *= 16777619u;
+		}
+	}
+	return hash;
+}
+
+uint32_t DrawSort::TargetID(const DrawJob& job)
+{
+	if (job.directToBackbuf)
+	{
+		return 0; // Back-buffer draws sort first among opaque draws; they're the common case
+	}
+
+	const BindingTable& table = job.bindingTable;
+	uint32_t hash = HashHandles(table.rtvs, table.numRTVs);
+	hash = HashHandles(&table.dsv, table.hasDSV ? 1 : 0, hash);
+	return (hash % static_cast<uint32_t>(FieldMask(target_bits))) + 1;
+}
+
+uint32_t DrawSort::BindingSetID(const DrawJob& job)
+{
+	uint32_t hash = 2166136261u;
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		const BindingTable::StageTable& stage = job.bindingTable.stages[i];
+		hash = HashHandles(stage.srvs, stage.numSRVs, hash);
+		hash = HashHandles(stage.cbuffers, stage.numCBuffers, hash);
+	}
+	return hash & static_cast<uint32_t>(FieldMask(binding_bits));
+}
+
+uint32_t DrawSort::ShaderPairID(const DrawJob& job)
+{
+	return ((job.vs.index & 0xFF) << 8) | (job.ps.index & 0xFF);
+}
+
+uint64_t DrawSort::DrawKey(const DrawJob& job)
+{
+	// Positive floats compare the same way as their bit patterns, so the top 16 bits of the depth make a (coarse) monotonic depth key
+	// with no need to know the depth range
+	const float depth = (job.sortDepth > 0.0f) ? job.sortDepth : 0.0f;
+	uint32_t depthBits = 0;
+	memcpy(&depthBits, &depth, sizeof(float));
+	const uint64_t depthKey = depthBits >> (32 - depth_bits);
+
+	const uint64_t target = TargetID(job);
+	const uint64_t shaders = ShaderPairID(job);
+	const uint64_t material = job.materialID & FieldMask(material_bits);
+	const uint64_t bindings = BindingSetID(job);
+
+	if (!job.translucent)
+	{
+		return (target << (shader_bits + material_bits + binding_bits + depth_bits)) |
+			   (shaders << (material_bits + binding_bits + depth_bits)) |
+			   (material << (binding_bits + depth_bits)) |
+			   (bindings << depth_bits) |
+			   depthKey;
+	}
+	else
+	{
+		const uint64_t invDepthKey = FieldMask(depth_bits) - depthKey;
+		return translucent_bit |
+			   (invDepthKey << (target_bits + shader_bits + material_bits + binding_bits)) |
+			   (target << (shader_bits + material_bits + binding_bits)) |
+			   (shaders << (material_bits + binding_bits)) |
+			   (material << binding_bits) |
+			   bindings;
+	}
+}
+
+void DrawSort::RadixSort(uint64_t* keys, uint32_t* values, uint32_t numKeys, uint64_t* keyScratch, uint32_t* valueScratch)
+{
+	if (numKeys < 2)
+	{
+		return;
+	}
+
+	uint64_t* srcKeys = keys;
+	uint32_t* srcValues = values;
+	uint64_t* dstKeys = keyScratch;
+	uint32_t* dstValues = valueScratch;
+
+	for (uint32_t shift = 0; shift < 64; shift += 8)
+	{
+		uint32_t counts[256] = {};
+		for (uint32_t i = 0; i < numKeys; i++)
+		{
+			counts[(srcKeys[i] >> shift) & 0xFF]++;
+		}
+
+		// Every key shares this digit; the pass would just copy, so skip it
+		if (counts[(srcKeys[0] >> shift) & 0xFF] == numKeys)
+		{
+			continue;
+		}
+
+		uint32_t offset = 0;
+		for (uint32_t d = 0; d < 256; d++)
+		{
+			const uint32_t count = counts[d];
+			counts[d] = offset;
+			offset += count;
+		}
+
+		for (uint32_t i = 0; i < numKeys; i++)
+		{
+			const uint32_t dst = counts[(srcKeys[i] >> shift) & 0xFF]++;
+			dstKeys[dst] = srcKeys[i];
+			dstValues[dst] = srcValues[i];
+		}
+
+		uint64_t* tmpKeys = srcKeys;
+		srcKeys = dstKeys;
+		dstKeys = tmpKeys;
+
+		uint32_t* tmpValues = srcValues;
+		srcValues = dstValues;
+		dstValues = tmpValues;
+	}
+
+	// Results may have finished in the scratch arrays
+	if (srcKeys != keys)
+	{
+		memcpy(keys, srcKeys, numKeys * sizeof(uint64_t));
+		memcpy(values, srcValues, numKeys * sizeof(uint32_t));
+	}
+}
+
+void DrawSort::CountRebinds(const DrawJob* prev, const DrawJob& curr, RebindCounts& counts)
+{
+	if (prev == nullptr || TargetID(*prev) != TargetID(curr))
+	{
+		counts.targets++;
+	}
+
+	if (prev == nullptr || prev->vs.index != curr.vs.index || prev->ps.index != curr.ps.index)
+	{
+		counts.shaders++;
+	}
+
+	if (prev == nullptr || prev->materialID != curr.materialID || BindingSetID(*prev) != BindingSetID(curr))
+	{
+		counts.resources++;
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "ShadingJobs.h"
+
+// Sort keys & radix sorting for draw submission
+// Each draw gets a packed 64-bit key with the most expensive state changes in the highest bits, so sorting by key clusters draws sharing
+// render-targets, then shaders, then materials & bindings, and finally orders them by depth
+// Opaque keys (top bit clear):      [62..52] render-targets, [51..36] shader pair, [35..24] material, [23..16] binding set, [15..0] depth (front-to-back)
+// Translucent keys (top bit set):   [62..47] inverted depth (back-to-front), [46..36] render-targets, [35..20] shader pair, [19..8] material, [7..0] binding set
+// Translucent draws sort after every opaque draw, and by depth before state (blending needs it)
+// Target & binding-set fields are hashes; collisions only cost sort quality, never correctness
+
+class DrawSort
+{
+	public:
+		static uint64_t DrawKey(const DrawJob& job);
+
+		// Stable LSD radix sort (8-bit digits) of [keys] & their [values]; digits every key shares are skipped
+		// Scratch arrays need [numKeys] entries each
+		static void RadixSort(uint64_t* keys, uint32_t* values, uint32_t numKeys, uint64_t* keyScratch, uint32_t* valueScratch);
+
+		// Hashed state identifiers used in keys; also used to count rebinds between consecutive draws
+		static uint32_t TargetID(const DrawJob& job);
+		static uint32_t BindingSetID(const DrawJob& job);
+		static uint32_t ShaderPairID(const DrawJob& job);
+
+		// Number of state changes a sequence of draws implies
+		struct RebindCounts
+		{
+			uint32_t targets = 0;
+			uint32_t shaders = 0;
+			uint32_t resources = 0; // Material or binding-set changes
+		};
+		static void CountRebinds(const DrawJob* prev, const DrawJob& curr, RebindCounts& counts);
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <cassert>
+#include "TaggedFreelist.h"
+
+// Generational slot map behind D3DHandle
+// Values live in chunks of [chunkElements] slots carved from Memory's shared arena; chunks are never returned, but released slots go back on a
+// lock-free freelist (TaggedFreelist.h, same as ObjectPool's) and get reused, so streaming resources in & out never runs the table dry
+// Every slot carries a 16-bit generation that bumps when the slot is released; handles remember the generation they were issued with, so a
+// handle outliving its resource resolves to nullptr instead of quietly aliasing whatever moved into the slot after it
+// Generation zero is never issued, so zero-initialized handles never resolve either
+// Allocate/Free/Retire/Recycle/Resolve are safe from any number of threads, & tables can grow from any thread too (Reserve() just moves that cost up-front)
+
+template<typename StoredType, uint32_t chunkElements = 64, uint32_t maxChunks = 1024>
+class HandleTable
+{
+	struct Slot
+	{
+		StoredType value{};
+		std::atomic<uint32_t> nextFree;
+		std::atomic<uint16_t> generation;
+
+		explicit Slot(uint32_t) : nextFree(0), generation(1) {}
+	};
+
+	static_assert(chunkElements * maxChunks <= 65536, "Handle indices are 16-bit");
+
+	TaggedFreelist<Slot, chunkElements, maxChunks> slots;
+	std::atomic<uint32_t> numLive = 0;
+
+	public:
+		static constexpr uint32_t null_slot = TaggedFreelist<Slot, chunkElements, maxChunks>::null_slot;
+
+		// Claims a slot & reports the generation its handle should carry; the slot's value is whatever its last owner left behind
+		// (default-constructed if it's never been used)
+		// null_slot (& generation zero) once the table is full
+		uint32_t Allocate(uint16_t& outGeneration)
+		{
+			const uint32_t index = slots.Pop();
+			if (index == null_slot)
+			{
+				assert(("Handle table exhausted; raise maxChunks", false));
+				outGeneration = 0;
+				return null_slot;
+			}
+
+			numLive.fetch_add(1, std::memory_order_relaxed);
+			outGeneration = slots.SlotAt(index).generation.load(std::memory_order_relaxed);
+			return index;
+		}
+
+		// Retires [index] & puts it straight back up for reuse; every handle issued for it goes stale
+		// Callers release whatever the slot holds first
+		void Free(uint32_t index, uint16_t generation)
+		{
+			if (Retire(index, generation))
+			{
+				Recycle(index);
+			}
+		}
+
+		// Just the first half of Free(): handles go stale, but the slot stays out of Allocate()'s reach (& its value untouched) until
+		// Recycle(); for owners that have to wait on readers which resolved the slot before it was retired
+		// False (after asserting) for stale or repeated retires
+		bool Retire(uint32_t index, uint16_t generation)
+		{
+			Slot& slot = slots.SlotAt(index);
+			uint16_t nextGeneration = generation + 1;
+			nextGeneration = (nextGeneration != 0) ? nextGeneration : 1;
+
+			// Only the holder of a live handle can win this, so stale or double frees fall through to the assert
+			const bool retired = slot.generation.compare_exchange_strong(generation, nextGeneration, std::memory_order_acq_rel);
+			assert(("Stale or repeated free through a resource handle", retired));
+			if (retired)
+			{
+				numLive.fetch_sub(1, std::memory_order_relaxed);
+			}
+			return retired;
+		}
+
+		// Second half of Free(); only for slots Retire() succeeded on
+		void Recycle(uint32_t index)
+		{
+			slots.Push(index);
+		}
+
+		// nullptr for stale handles & indices the table never issued
+		StoredType* Resolve(uint32_t index, uint16_t generation)
+		{
+			if (index >= slots.Capacity())
+			{
+				return nullptr;
+			}
+
+			Slot& slot = slots.SlotAt(index);
+			return (slot.generation.load(std::memory_order_acquire) == generation) ? &slot.value : nullptr;
+		}
+
+		// Unchecked access to every slot ever carved, live or not; for teardown
+		StoredType& AtSlot(uint32_t index)
+		{
+			return slots.SlotAt(index).value;
+		}
+
+		// Grows the table up-front so at least [numHandles] slots exist
+		void Reserve(uint32_t numHandles)
+		{
+			if (!slots.Reserve(numHandles))
+			{
+				assert(("Handle table reservation larger than maxChunks allows", false));
+			}
+		}
+
+		uint32_t NumLive() const { return numLive.load(std::memory_order_relaxed); }
+		uint32_t Capacity() const { return slots.Capacity(); }
+};
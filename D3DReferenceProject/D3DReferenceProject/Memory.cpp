@@ -1,26 +1,401 @@
 #include "Memory.h"
-#include <malloc.h>
 #include <cassert>
+#include <cstdlib>
 
-char* Memory::block = nullptr;
-char* Memory::blockStart = nullptr;
+#if MEMORY_TELEMETRY
+#include <fstream>
+#endif
 
-void Memory::Init()
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+Memory::Region Memory::arena = {};
+Memory::Region Memory::largePageArena = {};
+Memory::Region Memory::sharedArena = {};
+std::atomic_flag Memory::sharedLock = ATOMIC_FLAG_INIT;
+
+#ifndef _WIN32
+// Raw mapping behind [largePageArena] (may start before the region itself, since transparent reservations are re-aligned to 2MB)
+void* largePageMapping = nullptr;
+uint64_t largePageMappingBytes = 0;
+#endif
+
+void Memory::ReserveRegion(Region& region, uint64_t reservedBytes)
+{
+	// Reserve address space only; no physical memory is touched until Commit()
+#ifdef _WIN32
+	region.blockStart = reinterpret_cast<char*>(VirtualAlloc(nullptr, reservedBytes, MEM_RESERVE, PAGE_NOACCESS));
+	assert(("Failed to reserve address space for the memory arena", region.blockStart != nullptr));
+#else
+	void* reservation = mmap(nullptr, reservedBytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	assert(("Failed to reserve address space for the memory arena", reservation != MAP_FAILED));
+	region.blockStart = reinterpret_cast<char*>(reservation);
+#endif
+
+	region.block = region.blockStart;
+	region.blockCommitted = region.blockStart;
+	region.reservedBytes = reservedBytes;
+	region.commitGranularity = commit_granularity;
+	region.backing = PAGE_BACKING::STANDARD;
+}
+
+void Memory::Init(bool largePages)
+{
+	ReserveRegion(arena, reserved_bytes);
+	ReserveRegion(sharedArena, shared_reserved_bytes);
+
+	if (largePages)
+	{
+		InitLargePageArena();
+	}
+}
+
+#ifdef _WIN32
+// Large pages on Windows are only handed to processes holding SeLockMemoryPrivilege, and even then the privilege has to be switched on
+// explicitly for our token
+bool EnableLockMemoryPrivilege()
+{
+	HANDLE token = nullptr;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+	{
+		return false;
+	}
+
+	TOKEN_PRIVILEGES privileges = {};
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	bool enabled = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+				   AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) &&
+				   GetLastError() == ERROR_SUCCESS; // AdjustTokenPrivileges "succeeds" with ERROR_NOT_ALL_ASSIGNED if the account doesn't hold the privilege
+	CloseHandle(token);
+	return enabled;
+}
+#endif
+
+void Memory::InitLargePageArena()
 {
-	block = (char*)malloc(Memory::initial_alloc);
-	blockStart = block;
+	Region& region = largePageArena;
+
+#ifdef _WIN32
+	// Windows large pages can't be reserved & committed separately, so the whole pool is committed (and pinned) here
+	// No transparent fallback on Windows - if this fails, large arrays just come out of the main arena
+	if (EnableLockMemoryPrivilege() && GetLargePageMinimum() > 0)
+	{
+		const uint64_t largePageBytes = GetLargePageMinimum();
+		const uint64_t poolBytes = ((explicit_huge_reserved_bytes + largePageBytes - 1) / largePageBytes) * largePageBytes;
+		region.blockStart = reinterpret_cast<char*>(VirtualAlloc(nullptr, poolBytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE));
+		if (region.blockStart != nullptr)
+		{
+			region.reservedBytes = poolBytes;
+			region.blockCommitted = region.blockStart + poolBytes;
+			region.commitGranularity = largePageBytes;
+			region.backing = PAGE_BACKING::EXPLICIT_HUGE;
+		}
+	}
+#else
+	// Pinned hugetlb pages first; mmap fails immediately if the system pool can't cover the request, so there are no surprise SIGBUSes later
+	void* pool = mmap(nullptr, explicit_huge_reserved_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (pool != MAP_FAILED)
+	{
+		largePageMapping = pool;
+		largePageMappingBytes = explicit_huge_reserved_bytes;
+		region.blockStart = reinterpret_cast<char*>(pool);
+		region.reservedBytes = explicit_huge_reserved_bytes;
+		region.blockCommitted = region.blockStart + explicit_huge_reserved_bytes;
+		region.commitGranularity = huge_page_bytes;
+		region.backing = PAGE_BACKING::EXPLICIT_HUGE;
+	}
+	else
+	{
+		// Transparent huge pages otherwise; over-reserve by one huge page so the region can start on a 2MB boundary (THP only promotes
+		// aligned 2MB extents), then commit in 2MB steps so every commit is promotable
+		void* reservation = mmap(nullptr, transparent_huge_reserved_bytes + huge_page_bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (reservation != MAP_FAILED)
+		{
+			largePageMapping = reservation;
+			largePageMappingBytes = transparent_huge_reserved_bytes + huge_page_bytes;
+			const uint64_t iReservation = reinterpret_cast<uint64_t>(reservation);
+			const uint64_t iAligned = ((iReservation + huge_page_bytes - 1) / huge_page_bytes) * huge_page_bytes;
+			region.blockStart = reinterpret_cast<char*>(iAligned);
+			region.reservedBytes = transparent_huge_reserved_bytes;
+			region.blockCommitted = region.blockStart;
+			region.commitGranularity = huge_page_bytes;
+			region.backing = (madvise(region.blockStart, region.reservedBytes, MADV_HUGEPAGE) == 0) ? PAGE_BACKING::TRANSPARENT_HUGE : PAGE_BACKING::STANDARD;
+		}
+	}
+#endif
+
+	region.block = region.blockStart;
 }
 
 void Memory::DeInit()
 {
-	free(blockStart);
+#ifdef _WIN32
+	VirtualFree(arena.blockStart, 0, MEM_RELEASE);
+	VirtualFree(sharedArena.blockStart, 0, MEM_RELEASE);
+	if (largePageArena.blockStart != nullptr)
+	{
+		VirtualFree(largePageArena.blockStart, 0, MEM_RELEASE);
+	}
+#else
+	munmap(arena.blockStart, arena.reservedBytes);
+	munmap(sharedArena.blockStart, sharedArena.reservedBytes);
+	if (largePageMapping != nullptr)
+	{
+		munmap(largePageMapping, largePageMappingBytes);
+		largePageMapping = nullptr;
+	}
+#endif
+
+	arena = {};
+	largePageArena = {};
+	sharedArena = {};
+}
+
+void Memory::Commit(Region& region, char* rangeEnd)
+{
+	const uint64_t bytesNeeded = static_cast<uint64_t>(rangeEnd - region.blockStart);
+	if (bytesNeeded > region.reservedBytes)
+	{
+		// Hard error on exhaustion - handing out memory past the end of the reservation would just trample whatever lives there
+		assert(("Memory arena exhausted", false));
+		std::abort();
+	}
+
+	// Round up to our commit granularity, but never past the end of the reservation
+	uint64_t commitEnd = ((bytesNeeded + region.commitGranularity - 1) / region.commitGranularity) * region.commitGranularity;
+	commitEnd = (commitEnd < region.reservedBytes) ? commitEnd : region.reservedBytes;
+
+	char* commitStart = region.blockCommitted;
+	const uint64_t commitBytes = static_cast<uint64_t>((region.blockStart + commitEnd) - commitStart);
+
+#ifdef _WIN32
+	const bool committed = VirtualAlloc(commitStart, commitBytes, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+	const bool committed = mprotect(commitStart, commitBytes, PROT_READ | PROT_WRITE) == 0;
+#endif
+
+	if (!committed)
+	{
+		// Out of physical memory/pagefile (rather than address space)
+		assert(("Failed to commit pages for the memory arena", false));
+		std::abort();
+	}
+
+	region.blockCommitted = region.blockStart + commitEnd;
+}
+
+void Memory::FreeToAddress(void* destAddr, bool decommit)
+{
+	assert(("Shared allocations are permanent; they can't be freed", !sharedArena.Contains(destAddr)));
+
+	Region& region = largePageArena.Contains(destAddr) ? largePageArena : arena;
+	assert(region.Contains(destAddr));
+
+#if MEMORY_TELEMETRY
+	RecordFree(region, destAddr);
+#endif
+
+	region.block = reinterpret_cast<char*>(destAddr); // Memory occupied at destAddr is effectively freed, will be re-used by future allocations
+
+	// Pinned huge pages stay committed for the lifetime of the region
+	if (decommit && region.backing != PAGE_BACKING::EXPLICIT_HUGE)
+	{
+		// Only whole pages above [destAddr] can be released; the page containing [destAddr] may still hold live data
+		const uint64_t offs = static_cast<uint64_t>(region.block - region.blockStart);
+		const uint64_t keepBytes = ((offs + region.commitGranularity - 1) / region.commitGranularity) * region.commitGranularity;
+		char* releaseStart = region.blockStart + keepBytes;
+		if (releaseStart < region.blockCommitted)
+		{
+			const uint64_t releaseBytes = static_cast<uint64_t>(region.blockCommitted - releaseStart);
+#ifdef _WIN32
+			VirtualFree(releaseStart, releaseBytes, MEM_DECOMMIT);
+#else
+			madvise(releaseStart, releaseBytes, MADV_DONTNEED); // Drops the physical pages...
+			mprotect(releaseStart, releaseBytes, PROT_NONE); // ...and makes stray accesses fault, same as a decommitted range on Windows
+#endif
+			region.blockCommitted = releaseStart;
+		}
+	}
 }
 
-void Memory::FreeToAddress(void* destAddr)
+#if MEMORY_TELEMETRY
+// Live allocations for each region, in address order; both regions are linear, so rewinds always pop from the top
+struct AllocRecord
+{
+	const void* addr;
+	uint64_t bytes;
+	uint64_t paddingBytes;
+	MEM_TAGS tag;
+};
+
+constexpr uint32_t numRegions = 3; // Main arena, large-page arena, shared arena
+constexpr uint32_t maxLiveRecords = 16384;
+AllocRecord liveRecords[numRegions][maxLiveRecords] = {};
+uint32_t numLiveRecords[numRegions] = {};
+
+// Ring-buffer trace of recent allocations & rewinds
+enum TRACE_OPS
+{
+	TRACE_ALLOC,
+	TRACE_FREE
+};
+
+struct TraceEvent
 {
-	const uint64_t iDestAddr = reinterpret_cast<uint64_t>(destAddr);
-	const uint64_t iBlockStart = reinterpret_cast<uint64_t>(blockStart);
-	assert((iDestAddr < (iBlockStart + initial_alloc)) && iDestAddr > iBlockStart);
+	uint64_t eventNdx;
+	TRACE_OPS op;
+	MEM_TAGS tag;
+	uint32_t region;
+	uint64_t offset; // From the start of the region
+	uint64_t bytes;
+	uint64_t totalBytesAfter; // Live bytes across all tags once this event completed
+};
+
+constexpr uint32_t traceRingLen = 4096;
+TraceEvent traceRing[traceRingLen] = {};
+uint64_t numTraceEvents = 0;
+
+Memory::TagStats tagStats[static_cast<uint32_t>(MEM_TAGS::NUM_TAGS)] = {};
+uint64_t currTotalBytes = 0;
+uint64_t peakTotalBytes = 0;
+uint64_t peakEventNdx = 0; // Trace event that set the current high-water mark
 
-	block = reinterpret_cast<char*>(destAddr); // Memory occupied at destAddr is effectively freed, will be re-used by future allocations
+// Shared-region allocations can come from any thread while the main thread allocates from the arena, so every telemetry access is locked
+std::atomic_flag telemetryBusy = ATOMIC_FLAG_INIT;
+
+struct TelemetryLock
+{
+	TelemetryLock() { while (telemetryBusy.test_and_set(std::memory_order_acquire)) {} }
+	~TelemetryLock() { telemetryBusy.clear(std::memory_order_release); }
+};
+
+void PushTraceEvent(TRACE_OPS op, MEM_TAGS tag, uint32_t region, uint64_t offset, uint64_t bytes)
+{
+	TraceEvent& evt = traceRing[numTraceEvents % traceRingLen];
+	evt.eventNdx = numTraceEvents;
+	evt.op = op;
+	evt.tag = tag;
+	evt.region = region;
+	evt.offset = offset;
+	evt.bytes = bytes;
+	evt.totalBytesAfter = currTotalBytes;
+	numTraceEvents++;
+}
+
+uint32_t Memory::RegionIndex(const Region& region)
+{
+	return (&region == &largePageArena) ? 1 : (&region == &sharedArena) ? 2 : 0;
+}
+
+void Memory::RecordAllocation(const Region& region, const void* addr, uint64_t bytes, uint64_t paddingBytes, MEM_TAGS tag)
+{
+	TelemetryLock lock;
+	const uint32_t regionNdx = RegionIndex(region);
+	assert(("Too many live allocations for memory telemetry; raise maxLiveRecords", numLiveRecords[regionNdx] < maxLiveRecords));
+	if (numLiveRecords[regionNdx] == maxLiveRecords)
+	{
+		return;
+	}
+
+	AllocRecord& record = liveRecords[regionNdx][numLiveRecords[regionNdx]];
+	record.addr = addr;
+	record.bytes = bytes;
+	record.paddingBytes = paddingBytes;
+	record.tag = tag;
+	numLiveRecords[regionNdx]++;
+
+	Memory::TagStats& stats = tagStats[static_cast<uint32_t>(tag)];
+	stats.currBytes += record.bytes;
+	stats.paddingBytes += paddingBytes;
+	stats.numAllocations++;
+	stats.peakBytes = (stats.currBytes > stats.peakBytes) ? stats.currBytes : stats.peakBytes;
+
+	currTotalBytes += record.bytes;
+	if (currTotalBytes > peakTotalBytes)
+	{
+		peakTotalBytes = currTotalBytes;
+		peakEventNdx = numTraceEvents;
+	}
+
+	PushTraceEvent(TRACE_ALLOC, tag, regionNdx, reinterpret_cast<const char*>(addr) - region.blockStart, record.bytes);
+}
+
+void Memory::RecordFree(const Region& region, const void* destAddr)
+{
+	TelemetryLock lock;
+	const uint32_t regionNdx = RegionIndex(region);
+	while (numLiveRecords[regionNdx] > 0)
+	{
+		const AllocRecord& record = liveRecords[regionNdx][numLiveRecords[regionNdx] - 1];
+		if (record.addr < destAddr)
+		{
+			break;
+		}
+
+		Memory::TagStats& stats = tagStats[static_cast<uint32_t>(record.tag)];
+		stats.currBytes -= record.bytes;
+		stats.paddingBytes -= record.paddingBytes;
+		currTotalBytes -= record.bytes;
+
+		PushTraceEvent(TRACE_FREE, record.tag, regionNdx, reinterpret_cast<const char*>(record.addr) - region.blockStart, record.bytes);
+		numLiveRecords[regionNdx]--;
+	}
+}
+
+Memory::TagStats Memory::GetTagStats(MEM_TAGS tag)
+{
+	TelemetryLock lock;
+	return tagStats[static_cast<uint32_t>(tag)];
+}
+
+uint64_t Memory::PeakBytes()
+{
+	TelemetryLock lock;
+	return peakTotalBytes;
+}
+
+void Memory::DumpTelemetry(const char* path)
+{
+	const char* tagNames[] = { "untagged", "loader", "scene", "pipeline", "pools", "heaps", "profiler" };
+	const char* regionNames[] = { "arena", "large-page arena", "shared arena" };
+	static_assert(sizeof(tagNames) / sizeof(tagNames[0]) == static_cast<uint32_t>(MEM_TAGS::NUM_TAGS), "Missing memory tag name");
+
+	TelemetryLock lock;
+	std::ofstream strm(path, std::ios::out | std::ios::trunc);
+	strm << "Memory telemetry\n";
+	strm << "Live bytes: " << currTotalBytes << ", peak bytes: " << peakTotalBytes << " (reached at event " << peakEventNdx << ")\n\n";
+
+	strm << "tag, live bytes, peak bytes, padding bytes, allocations\n";
+	for (uint32_t i = 0; i < static_cast<uint32_t>(MEM_TAGS::NUM_TAGS); i++)
+	{
+		strm << tagNames[i] << ", " << tagStats[i].currBytes << ", " << tagStats[i].peakBytes << ", " << tagStats[i].paddingBytes << ", " << tagStats[i].numAllocations << "\n";
+	}
+
+	strm << "\nevent, op, tag, region, offset, bytes, live bytes after\n";
+	const uint64_t firstEvent = (numTraceEvents > traceRingLen) ? (numTraceEvents - traceRingLen) : 0;
+	for (uint64_t i = firstEvent; i < numTraceEvents; i++)
+	{
+		const TraceEvent& evt = traceRing[i % traceRingLen];
+		strm << evt.eventNdx << ", " << ((evt.op == TRACE_ALLOC) ? "alloc" : "free") << ", " << tagNames[static_cast<uint32_t>(evt.tag)] << ", " << regionNames[evt.region] << ", "
+			 << evt.offset << ", " << evt.bytes << ", " << evt.totalBytesAfter << "\n";
+	}
+}
+#else
+Memory::TagStats Memory::GetTagStats(MEM_TAGS tag)
+{
+	return {};
+}
+
+uint64_t Memory::PeakBytes()
+{
+	return 0;
+}
+
+void Memory::DumpTelemetry(const char* path)
+{
 }
+#endif
@@ -1,23 +1,105 @@
 #pragma once
 
 #include <stdint.h>
+#include <atomic>
 
 // Basic, intro-level linear allocator
 // Never needed anything fancier for private projects ^_^'
 
+// The arena reserves a huge range of address space up-front, but only commits physical pages as the bump pointer reaches them
+// (so big scenes can keep growing contiguously without copies, small scenes only pay for what they touch, and running off the end is a hard error
+// instead of silent corruption)
+
+// The arena itself is single-threaded; structures that grow from worker/loader threads (pool & handle-table chunks) allocate through
+// AllocateShared() instead, which is served from a separate, locked region that never rewinds
+
+// Allocation telemetry (per-tag byte counts, high-water marks, a ring-buffer trace of recent allocations)
+// On by default in debug builds, compiled out entirely otherwise; define MEMORY_TELEMETRY to 0/1 to override
+#ifndef MEMORY_TELEMETRY
+#ifdef _DEBUG
+#define MEMORY_TELEMETRY 1
+#else
+#define MEMORY_TELEMETRY 0
+#endif
+#endif
+
+// Subsystem owning an allocation
+enum class MEM_TAGS
+{
+	UNTAGGED,
+	LOADER, // Model file data & attribute scratch
+	SCENE, // Scene vertex pool, baking scratch
+	PIPELINE, // Pipeline-side job & scene records
+	POOLS, // ObjectPool & HandleTable chunks
+	HEAPS, // Ranges handed to TLSF heaps
+	PROFILER, // Per-thread zone rings
+	NUM_TAGS
+};
+
+// Physical page sizes backing a range of memory
+enum class PAGE_BACKING
+{
+	STANDARD, // 4KB pages
+	TRANSPARENT_HUGE, // 2MB pages when the OS can find them (Linux THP through madvise(MADV_HUGEPAGE)), 4KB otherwise
+	EXPLICIT_HUGE // Pinned 2MB pages (MEM_LARGE_PAGES on Windows, MAP_HUGETLB on Linux)
+};
+
 class Memory
 {
-	static char* block;
-	static char* blockStart;
-	static constexpr uint64_t initial_alloc = 100000000; // About 100MB
+	// Contiguous reservation with its own bump pointer
+	// The main arena is one of these; big linearly/randomly-walked arrays (scene vertex pool, OBJ scratch) can live in a second one backed by huge pages,
+	// since 4KB pages thrash the TLB badly over 50MB arrays
+	struct Region
+	{
+		char* block = nullptr;
+		char* blockStart = nullptr;
+		char* blockCommitted = nullptr; // End of the committed (physically backed) part of the reservation; always page-aligned
+		uint64_t reservedBytes = 0;
+		uint64_t commitGranularity = 0;
+		PAGE_BACKING backing = PAGE_BACKING::STANDARD;
+
+		bool Contains(const void* addr) const
+		{
+			return addr >= blockStart && addr < (blockStart + reservedBytes);
+		}
+	};
+
+	static Region arena;
+	static Region largePageArena; // Left empty (reservedBytes == 0) if no huge-page backing was available
+	static Region sharedArena; // Serves AllocateShared(); only ever touched under [sharedLock]
+	static std::atomic_flag sharedLock;
+
+	// Reservations are address space, not memory, but 32-bit processes only get 2-4GB of that in total (& VirtualAlloc/mmap take pointer-sized
+	// lengths), so 32-bit builds reserve far less
+	static constexpr bool wide_address_space = sizeof(void*) == 8;
+	static constexpr uint64_t reserved_bytes = wide_address_space ? (64ull * 1024ull * 1024ull * 1024ull) : (1024ull * 1024ull * 1024ull); // 64GB on x64, 1GB on x86
+	static constexpr uint64_t commit_granularity = 65536; // Commit in 64KB steps (Windows' allocation granularity, and a multiple of every page size we care about)
+	static constexpr uint64_t huge_page_bytes = 2 * 1024 * 1024;
+	static constexpr uint64_t explicit_huge_reserved_bytes = 256 * 1024 * 1024; // Pinned huge pages are committed up-front, so keep that pool modest
+	static constexpr uint64_t transparent_huge_reserved_bytes = wide_address_space ? (16ull * 1024ull * 1024ull * 1024ull) : (256ull * 1024ull * 1024ull);
+	static constexpr uint64_t shared_reserved_bytes = wide_address_space ? (4ull * 1024ull * 1024ull * 1024ull) : (64ull * 1024ull * 1024ull);
+	static_assert(reserved_bytes <= SIZE_MAX && transparent_huge_reserved_bytes <= SIZE_MAX, "Reservations must fit in a pointer-sized length");
+
+	// Reserves [reservedBytes] of address space for [region], committed in [commit_granularity] steps
+	static void ReserveRegion(Region& region, uint64_t reservedBytes);
+
+	// Commits pages up to [rangeEnd], or fails hard if [rangeEnd] is past the end of the reservation
+	static void Commit(Region& region, char* rangeEnd);
+
+#if MEMORY_TELEMETRY
+	static uint32_t RegionIndex(const Region& region);
+	static void RecordAllocation(const Region& region, const void* addr, uint64_t bytes, uint64_t paddingBytes, MEM_TAGS tag); // [bytes] includes [paddingBytes]
+	static void RecordFree(const Region& region, const void* destAddr);
+#endif
+	static void InitLargePageArena();
 
 	template<typename TypeAllocating>
-	static TypeAllocating* AllocateRange(uint32_t alignment = 4, uint32_t elementsInRange = 1)
+	static TypeAllocating* AllocateRange(Region& region, uint32_t alignment, uint32_t elementsInRange, MEM_TAGS tag)
 	{
 		// Alignment
 		////////////
 
-		uint64_t offs = reinterpret_cast<uint64_t>(block);
+		uint64_t offs = reinterpret_cast<uint64_t>(region.block);
 		uint64_t toAlign = alignment - (offs % alignment);
 		toAlign = (toAlign != alignment) ? toAlign : 0; // Align starting address to size
 		// If an address is perfectly aligned already the logic in toAlign will offset it by [alignment] unnecessarily,
@@ -27,34 +109,93 @@ class Memory
 		uint64_t toAlignFootprint = alignment - (footprint % alignment);
 		footprint += (toAlignFootprint != alignment) ? toAlignFootprint : 0;
 
+		// Make sure the pages we're about to hand out actually exist
+		char* rangeEnd = region.block + toAlign + footprint;
+		if (rangeEnd > region.blockCommitted)
+		{
+			Commit(region, rangeEnd);
+		}
+
 		// Allocation offset
-		block += toAlign;
+		region.block += toAlign;
 
 		// Allocation
-		TypeAllocating* addr = reinterpret_cast<TypeAllocating*>(block);
-		block += footprint;
+		TypeAllocating* addr = reinterpret_cast<TypeAllocating*>(region.block);
+		region.block += footprint;
+
+#if MEMORY_TELEMETRY
+		RecordAllocation(region, addr, toAlign + footprint, toAlign + (footprint - sizeof(TypeAllocating) * elementsInRange), tag); // Consumed bytes, then the part of those lost to alignment
+#endif
 		return addr;
 	}
 
 	public:
-		static void Init();
+		// [largePages] asks for a second, huge-page backed region serving AllocateLargeArray()
+		// We try pinned huge pages first (needs SeLockMemoryPrivilege on Windows, or a configured hugetlb pool on Linux), then transparent huge pages,
+		// and fall back to the main arena if neither is available
+		static void Init(bool largePages = true);
 		static void DeInit();
 
 		template<typename TypeAllocating>
-		static TypeAllocating* AllocateSingle(int32_t alignment = 4)
+		static TypeAllocating* AllocateSingle(int32_t alignment = 4, MEM_TAGS tag = MEM_TAGS::UNTAGGED)
 		{
-			return AllocateRange<TypeAllocating>(alignment, 1);
+			return AllocateRange<TypeAllocating>(arena, alignment, 1, tag);
 		}
 
 		template<typename TypeAllocating>
-		static TypeAllocating* AllocateArray(uint32_t arrayLen, uint32_t alignment = 4)
+		static TypeAllocating* AllocateArray(uint32_t arrayLen, uint32_t alignment = 4, MEM_TAGS tag = MEM_TAGS::UNTAGGED)
 		{
-			return AllocateRange<TypeAllocating>(alignment, arrayLen);
+			return AllocateRange<TypeAllocating>(arena, alignment, arrayLen, tag);
+		}
+
+		// Same as AllocateArray, but served from huge pages where possible; [out_backing] reports what the allocation actually landed on
+		// Frees through FreeToAddress, exactly like the main arena (the large-page region is a separate linear allocator, so only loans on top of
+		// *that* region are released)
+		template<typename TypeAllocating>
+		static TypeAllocating* AllocateLargeArray(uint32_t arrayLen, PAGE_BACKING* out_backing = nullptr, uint32_t alignment = 4, MEM_TAGS tag = MEM_TAGS::UNTAGGED)
+		{
+			const uint64_t footprint = sizeof(TypeAllocating) * static_cast<uint64_t>(arrayLen) + alignment;
+			const bool fitsLargePages = (largePageArena.reservedBytes > 0) &&
+										(static_cast<uint64_t>(largePageArena.block - largePageArena.blockStart) + footprint) <= largePageArena.reservedBytes;
+
+			Region& region = fitsLargePages ? largePageArena : arena;
+			if (out_backing != nullptr)
+			{
+				*out_backing = region.backing;
+			}
+			return AllocateRange<TypeAllocating>(region, alignment, arrayLen, tag);
+		}
+
+		static PAGE_BACKING LargePageBacking() { return largePageArena.backing; }
+
+		// Same as AllocateArray, but safe from any thread
+		// Comes out of its own region behind a spinlock, & can never be freed (FreeToAddress rejects it), so only use it for storage that lives
+		// until shutdown anyway
+		template<typename TypeAllocating>
+		static TypeAllocating* AllocateShared(uint32_t arrayLen, uint32_t alignment = 4, MEM_TAGS tag = MEM_TAGS::UNTAGGED)
+		{
+			while (sharedLock.test_and_set(std::memory_order_acquire)) {}
+			TypeAllocating* addr = AllocateRange<TypeAllocating>(sharedArena, alignment, arrayLen, tag);
+			sharedLock.clear(std::memory_order_release);
+			return addr;
 		}
 
 		// Linear allocator - we can free all bytes back to some pointer, but not arbitrary data
 		// This means you can't release arbitrarily! Basically only short-term loans that sit on top of the allocator can be freed outside of shutdown
 		// (and on shutdown the whole block is permanently freed anyway, so the order of any pointer shuffles before that is irrelevant)
-		static void FreeToAddress(void* destAddr);
-};
+		// Pass [decommit] to hand the pages above [destAddr] back to the OS as well (good after big temporary loans, e.g. model loading; wasteful for
+		// small per-frame loans that will immediately re-commit the same pages)
+		static void FreeToAddress(void* destAddr, bool decommit = false);
 
+		// Telemetry queries; these still exist with telemetry compiled out, but report zeroes/write nothing
+		struct TagStats
+		{
+			uint64_t currBytes; // Includes alignment padding
+			uint64_t peakBytes;
+			uint64_t paddingBytes; // Bytes lost to alignment in live allocations
+			uint64_t numAllocations; // Lifetime total
+		};
+		static TagStats GetTagStats(MEM_TAGS tag);
+		static uint64_t PeakBytes(); // Across every tag & region
+		static void DumpTelemetry(const char* path); // Per-tag stats, then the trace ring (oldest event first)
+};
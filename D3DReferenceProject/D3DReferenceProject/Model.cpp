@@ -1,11 +1,10 @@
 #include "Model.h"
 #include "Memory.h"
+#include "Profiler.h"
 
 #include <fstream>
 #include <filesystem>
 
-uint32_t modelCtr = 0;
-
 enum MESH_SCAN_MODE
 {
 	POSITIONS,
@@ -16,17 +15,22 @@ enum MESH_SCAN_MODE
 
 void Model::Init(const char* path, Vertex3D* vtOutput, uint32_t outputOffset, uint32_t* numVtsLoaded, uint32_t maxVtsPerModel)
 {
+	PROFILE_FUNCTION();
+
 	// Allocate file data, load file
 	const uint64_t fsize = std::filesystem::file_size(path);
-	char* data = Memory::AllocateArray<char>(static_cast<uint32_t>(fsize));
+	char* data = Memory::AllocateArray<char>(static_cast<uint32_t>(fsize), 4, MEM_TAGS::LOADER);
 
 	std::fstream strm(path);
 	strm.read(data, fsize);
 
 	// Allocate raw attribute data
-	float* positions = Memory::AllocateArray<float>(maxVtsPerModel * 3);
-	float* texcoords = Memory::AllocateArray<float>(maxVtsPerModel * 3);
-	float* normals = Memory::AllocateArray<float>(maxVtsPerModel * 3);
+	// (big & randomly indexed while de-indexing faces, so served from huge pages where we have them)
+	float* positions = Memory::AllocateLargeArray<float>(maxVtsPerModel * 3, nullptr, 4, MEM_TAGS::LOADER);
+	float* texcoords = Memory::AllocateLargeArray<float>(maxVtsPerModel * 3, nullptr, 4, MEM_TAGS::LOADER);
+	float* normals = Memory::AllocateLargeArray<float>(maxVtsPerModel * 3, nullptr, 4, MEM_TAGS::LOADER);
+
+	vtOutput += outputOffset;
 
 	uint32_t posOffs = 0;
 	uint32_t texOffs = 0;
@@ -181,7 +185,7 @@ void Model::Init(const char* path, Vertex3D* vtOutput, uint32_t outputOffset, ui
 
 						memcpy(&vtOutput[vtsProcessed].mat, &texcoords[uvNdx], sizeof(float) * 2);
 						vtOutput[vtsProcessed].mat.z = MATERIAL_TYPES::DIFFUSE;
-						vtOutput[vtsProcessed].mat.w = static_cast<float>(modelCtr);
+						vtOutput[vtsProcessed].mat.w = 0; // Identical meshes must hash identically (see Scene::AddModel())
 
 						memcpy(&vtOutput[vtsProcessed].normals, &normals[normNdx], sizeof(float) * 3);
 						vtOutput[vtsProcessed].normals.w = 0;
@@ -204,7 +208,7 @@ void Model::Init(const char* path, Vertex3D* vtOutput, uint32_t outputOffset, ui
 	}
 
 	*numVtsLoaded = vtsProcessed;
-	modelCtr++;
 
-	Memory::FreeToAddress(data);
+	Memory::FreeToAddress(positions, true);
+	Memory::FreeToAddress(data, true); // File data + attribute scratch are big, one-off loans; give the pages back
 }
@@ -5,10 +5,14 @@
 struct Model
 {
 	Model() {}
+
+	// Parses the OBJ at [path] into [vtOutput], starting at [outputOffset]
 	void Init(const char* path, Vertex3D* vtOutput, uint32_t outputOffset, uint32_t* numVtsLoaded, uint32_t maxVtsPerModel);
 
-	// Need to add CPU-side transforms here
-	// (broadcasting every other operation to the GPU is expensive af)
-	///////////////////////////////////////
+	// Models are placements; geometry lives in the scene's mesh registry & is shared between every model placing the same mesh
+	uint16_t meshID = 0;
+
+	// Transforms live in the scene's TransformStore, at the model's index
+	// (broadcasting every other operation to the GPU is expensive af, so only moved models are uploaded)
 };
 
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <new>
+#include <utility>
+#include <cassert>
+#include "TaggedFreelist.h"
+
+// Fixed-size object pool with a lock-free freelist
+// Slots are carved from Memory's shared region in chunks of [chunkElements] and never returned to it; released slots go back on the freelist
+// and get reused, so job/handle churn never reaches the system allocator (see TaggedFreelist.h for the freelist itself)
+// Allocate/Free are safe from any number of threads, & pools can grow from any thread too (Reserve() just moves that cost up-front)
+
+template<typename PooledType, uint32_t chunkElements = 64, uint32_t maxChunks = 64>
+class ObjectPool
+{
+	struct Slot
+	{
+		alignas(PooledType) char storage[sizeof(PooledType)]; // Must stay first, so object pointers convert straight back to slots
+		std::atomic<uint32_t> nextFree;
+		uint32_t index;
+
+		explicit Slot(uint32_t slotIndex) : nextFree(0), index(slotIndex) {}
+	};
+
+	TaggedFreelist<Slot, chunkElements, maxChunks> slots;
+	std::atomic<uint32_t> numLive = 0;
+
+	public:
+		// Raw, uninitialized storage for one object
+		PooledType* Allocate()
+		{
+			const uint32_t index = slots.Pop();
+			if (index == slots.null_slot)
+			{
+				assert(("Object pool exhausted; raise maxChunks", false));
+				return nullptr;
+			}
+
+			numLive.fetch_add(1, std::memory_order_relaxed);
+			return reinterpret_cast<PooledType*>(slots.SlotAt(index).storage);
+		}
+
+		void Free(PooledType* obj)
+		{
+			const Slot& slot = *reinterpret_cast<Slot*>(obj);
+			numLive.fetch_sub(1, std::memory_order_relaxed);
+			slots.Push(slot.index);
+		}
+
+		template<typename... ArgTypes>
+		PooledType* New(ArgTypes&&... args)
+		{
+			PooledType* storage = Allocate();
+			return (storage != nullptr) ? new (storage) PooledType(std::forward<ArgTypes>(args)...) : nullptr;
+		}
+
+		void Delete(PooledType* obj)
+		{
+			obj->~PooledType();
+			Free(obj);
+		}
+
+		// Grows the pool up-front so at least [numObjects] slots exist
+		void Reserve(uint32_t numObjects)
+		{
+			if (!slots.Reserve(numObjects))
+			{
+				assert(("Object pool reservation larger than maxChunks allows", false));
+			}
+		}
+
+		uint32_t NumLive() const { return numLive.load(std::memory_order_relaxed); }
+		uint32_t Capacity() const { return slots.Capacity(); }
+};
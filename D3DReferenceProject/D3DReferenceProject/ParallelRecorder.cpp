@@ -0,0 +1,110 @@
+#include "ParallelRecorder.h"
+#include "D3DWrapper.h"
+#include "TaskScheduler.h"
+#include <chrono>
+
+void ParallelRecorder::Init(uint32_t maxChunks, uint32_t streamBytesPerChunk, RECORD_BACKENDS backend)
+{
+	assert(("Recording needs at least one chunk", maxChunks > 0));
+	assert(("Too many recording chunks requested", maxChunks <= max_chunks));
+
+	this->backend = backend;
+	this->maxChunks = maxChunks;
+	for (uint32_t i = 0; i < maxChunks; i++)
+	{
+		buffers[i].Init(streamBytesPerChunk);
+	}
+
+	if (backend == RECORD_BACKENDS::DEFERRED)
+	{
+		D3DWrapper::InitDeferredContexts(maxChunks);
+	}
+}
+
+void ParallelRecorder::DeInit()
+{
+	maxChunks = 0;
+	numChunks = 0;
+}
+
+void ParallelRecorder::RecordChunk(uint32_t chunkNdx)
+{
+	// Even split, with the remainder spread over the leading chunks
+	const uint32_t baseItems = numItems / numChunks;
+	const uint32_t extraItems = numItems % numChunks;
+	const uint32_t firstItem = (chunkNdx * baseItems) + ((chunkNdx < extraItems) ? chunkNdx : extraItems);
+	const uint32_t chunkItems = baseItems + ((chunkNdx < extraItems) ? 1 : 0);
+
+	CommandBuffer& cmds = buffers[chunkNdx];
+	cmds.Reset();
+	recordFn(cmds, firstItem, chunkItems, recordData);
+
+	// Chunk [i] always goes through deferred context [i], so no two threads ever share a context
+	if (backend == RECORD_BACKENDS::DEFERRED)
+	{
+		D3DWrapper::RecordCommandList(chunkNdx, cmds);
+	}
+}
+
+void ParallelRecorder::RecordChunks(uint32_t firstChunk, uint32_t endChunk, void* recorder)
+{
+	for (uint32_t i = firstChunk; i < endChunk; i++)
+	{
+		static_cast<ParallelRecorder*>(recorder)->RecordChunk(i);
+	}
+}
+
+void ParallelRecorder::Record(uint32_t numItems, RecordFn fn, void* userData)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	uint32_t chunks = numItems / min_items_per_chunk;
+	chunks = (chunks < 1) ? 1 : (chunks > maxChunks) ? maxChunks : chunks;
+
+	this->numItems = numItems;
+	numChunks = chunks;
+	recordFn = fn;
+	recordData = userData;
+
+	// One chunk per task
+	TaskScheduler::ParallelFor(0, chunks, RecordChunks, this, 1);
+
+	timings.recordMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	timings.numChunks = chunks;
+	timings.streamBytes = 0;
+	for (uint32_t i = 0; i < chunks; i++)
+	{
+		timings.streamBytes += buffers[i].UsedBytes();
+	}
+}
+
+void ParallelRecorder::Submit()
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	// Always chunk order; this is what keeps submission deterministic
+	uint32_t numCommands = 0;
+	for (uint32_t i = 0; i < numChunks; i++)
+	{
+		switch (backend)
+		{
+			case RECORD_BACKENDS::IMMEDIATE:
+				D3DWrapper::ExecuteCommands(buffers[i]);
+				break;
+
+			case RECORD_BACKENDS::DEFERRED:
+				D3DWrapper::ExecuteCommandList(i);
+				break;
+
+			case RECORD_BACKENDS::NULL_BACKEND:
+				for (const char* cursor = buffers[i].Begin(); cursor < buffers[i].End(); cursor += reinterpret_cast<const CommandHeader*>(cursor)->sizeBytes)
+				{
+					numCommands++;
+				}
+				break;
+		}
+	}
+
+	timings.submitMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	timings.numCommands = numCommands;
+}
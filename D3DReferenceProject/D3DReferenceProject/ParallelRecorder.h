@@ -0,0 +1,65 @@
+#pragma once
+
+#include "CommandBuffer.h"
+
+// Records a frame's command streams across several threads, then submits them in a fixed order
+// Work is split into contiguous chunks of items (compiled passes, for Pipeline), recorded as tasks on the TaskScheduler; chunk [i] always
+// records into buffer [i] & submission always walks buffers in index order, so what reaches the GPU is identical whatever the thread count
+// or scheduling
+// Backends:
+//	IMMEDIATE:		threads only encode; the render thread replays every stream on the immediate context
+//	DEFERRED:		threads also replay their stream into their own deferred context; the render thread just executes the finished command lists
+//	NULL_BACKEND:	threads encode & submission only walks the streams; needs no device, so recording cost can be measured on its own
+// Record() must be called from the main thread or a thread attached to the scheduler
+enum class RECORD_BACKENDS
+{
+	IMMEDIATE,
+	DEFERRED,
+	NULL_BACKEND
+};
+
+class ParallelRecorder
+{
+	public:
+		static constexpr uint32_t max_chunks = 8; // Also the number of deferred contexts
+		static constexpr uint32_t min_items_per_chunk = 16; // Below this, spawning another task costs more than it saves
+
+		// Encodes items [firstItem, firstItem + numItems) into [cmds]; called concurrently for different chunks, so it mustn't write shared state
+		typedef void (*RecordFn)(CommandBuffer& cmds, uint32_t firstItem, uint32_t numItems, void* userData);
+
+		void Init(uint32_t maxChunks, uint32_t streamBytesPerChunk, RECORD_BACKENDS backend);
+		void DeInit();
+
+		// The calling thread records chunks too, & returns once every chunk has been recorded
+		void Record(uint32_t numItems, RecordFn fn, void* userData);
+
+		// Render thread only; resubmitting without re-recording replays the last recorded frame
+		void Submit();
+
+		// CPU time spent in the last Record() & Submit() calls
+		struct Timings
+		{
+			double recordMs = 0.0;
+			double submitMs = 0.0;
+			uint32_t numChunks = 0;
+			uint32_t streamBytes = 0;
+			uint32_t numCommands = 0; // Only counted by the null backend
+		};
+		Timings LastTimings() const { return timings; }
+
+	private:
+		static void RecordChunks(uint32_t firstChunk, uint32_t endChunk, void* recorder);
+		void RecordChunk(uint32_t chunkNdx);
+
+		RECORD_BACKENDS backend = RECORD_BACKENDS::IMMEDIATE;
+		uint32_t maxChunks = 0;
+		CommandBuffer buffers[max_chunks];
+
+		// Current frame's work
+		uint32_t numItems = 0;
+		uint32_t numChunks = 0;
+		RecordFn recordFn = nullptr;
+		void* recordData = nullptr;
+
+		Timings timings;
+};
@@ -2,195 +2,301 @@
 #include "D3DWrapper.h"
 #include "D3DResource.h"
 #include "Memory.h"
+#include "RenderGraph.h"
+#include "CommandBuffer.h"
+#include "ParallelRecorder.h"
+#include "TripleBuffer.h"
+#include "TaskScheduler.h"
+#include "Profiler.h"
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
 
-// Arrays of resources &c consumed by the pipeline here...
-//////////////////////////////////////////////////////////
-
-// Heterogeneous array of jobs consumed by the pipeline
-
-struct ShadingJob
+struct SceneMesh
 {
-	static constexpr uint32_t maxBindingsAnyType = 16;
+	D3DHandle vbuffer;
+	D3DHandle ibuffer;
+	uint32_t numIndices = 0;
+};
 
-	void AddTexture(D3DHandle resrc, RESRC_VIEWS bindAs, SHADER_TYPES bindFor)
-	{
-		if ((bindAs & DEPTH_STENCIL) && hasDepthStencil)
-		{
-			assert(("No more than one depth-stencil buffer in each draw", false));
-		}
+SceneMesh* sceneData = nullptr;
+uint8_t numScenesAvailable = 0;
 
-		bindTexturesFor[numTextures] = bindFor;
-		textureBindings[numTextures] = bindAs;
-		textures[numTextures] = resrc;
-		numTextures++;
-	}
+RenderGraph graph;
+
+// Model transforms, GPU-resident; two float4s per model (quaternion, then translation + scale), read by the vertex shader
+// Only ranges changed since the last upload are re-sent, so upload bytes scale with motion rather than scene size
+// Scenes share the buffer; switching scenes re-uploads everything
+// Changed ranges go through D3DWrapper's staged uploads, so however many there are, they land with one copy per run of neighbouring writes
+constexpr uint32_t float4s_per_transform = 2;
+constexpr uint32_t max_transform_upload_gap = 4; // Re-sending this many unchanged transforms beats another queued write (& often another copy)
+constexpr uint32_t max_transform_uploads = 16; // Per frame; anything past this is merged into the last range
+D3DHandle transformBuffer;
+DirectX::XMFLOAT4 transformUploads[FrameSnapshot::maxNumModels * float4s_per_transform] = {};
+uint64_t uploadedTransformEpoch = 0;
+uint32_t uploadedTransformScene = 0xFFFFFFFF;
+
+// Per-instance model indices, in batch order; only rewritten when the visible set changes
+D3DHandle instanceBuffer;
+uint32_t instanceData[FrameSnapshot::maxNumModels] = {};
+uint16_t uploadedNumVisible = 0;
+uint16_t uploadedVisible[FrameSnapshot::maxNumModels] = {};
+
+// Passes are recorded in parallel chunks, one command stream per chunk
+// NULL_BACKEND skips the GPU entirely; handy for measuring recording throughput against thread count
+constexpr RECORD_BACKENDS recordBackend = RECORD_BACKENDS::DEFERRED;
+constexpr uint32_t chunkCommandBytes = 64 * 1024;
+ParallelRecorder recorder;
+uint32_t recordedVersion = 0;
+uint32_t recordedScene = 0xFFFFFFFF;
+uint16_t recordedNumBatches = 0;
+InstanceBatch recordedBatches[FrameSnapshot::maxNumMeshes] = {};
+
+TripleBuffer<FrameSnapshot> snapshots;
+uint64_t numPublished = 0; // Game-thread only
+std::thread renderThread;
+std::atomic<bool> rendering = false;
+
+// The render thread sleeps on [snapshotReady] between frames; [snapshotPending] is set by every publish & cleared by the render thread
+// before it acquires, so a publish landing between the two is never missed (at worst the thread wakes once to an empty Acquire())
+std::mutex snapshotLock;
+std::condition_variable snapshotReady;
+bool snapshotPending = false;
 
-	void AddBuffer(D3DHandle resrc, RESRC_VIEWS bindAs, SHADER_TYPES bindFor)
-	{
-		bindBuffersFor[numBuffers] = bindFor;
-		bufferBindings[numBuffers] = bindAs;
-		buffers[numBuffers] = resrc;
-		numBuffers++;
-	}
+void Pipeline::Init(Scene* scenes, uint8_t numScenes)
+{
+	sceneData = Memory::AllocateArray<SceneMesh>(numScenes, 4, MEM_TAGS::PIPELINE);
+	numScenesAvailable = numScenes;
 
-	void AddVolume(D3DHandle resrc, RESRC_VIEWS bindAs, SHADER_TYPES bindFor)
+	for (uint32_t i = 0; i < numScenes; i++)
 	{
-		bindVolumesFor[numVolumes] = bindFor;
-		volumeBindings[numVolumes] = bindAs;
-		volumes[numVolumes] = resrc;
-		numVolumes++;
+		scenes[i].GetSceneMesh(&sceneData[i].vbuffer, &sceneData[i].ibuffer, &sceneData[i].numIndices);
 	}
 
-	SHADER_TYPES bindTexturesFor[maxBindingsAnyType];
-	RESRC_VIEWS textureBindings[maxBindingsAnyType];
-	D3DHandle textures[maxBindingsAnyType];
-	uint32_t numTextures = 0;
-
-	SHADER_TYPES bindBuffersFor[maxBindingsAnyType];
-	RESRC_VIEWS bufferBindings[maxBindingsAnyType];
-	D3DHandle buffers[maxBindingsAnyType];
-	uint32_t numBuffers = 0;
-
-	SHADER_TYPES bindVolumesFor[maxBindingsAnyType];
-	RESRC_VIEWS volumeBindings[maxBindingsAnyType];
-	D3DHandle volumes[maxBindingsAnyType];
-	uint32_t numVolumes = 0;
-
-	bool hasDepthStencil = false;
-};
-
-struct DrawJob : public ShadingJob
-{
-	DrawJob() {}
-	DrawJob(const char* vs_path, const char* ps_path) : ShadingJob()
+	// Allocate any textures, buffers, volumes &c we want to use with draws/dispatches here
+	D3DResource<RESOURCE_TYPES::BUFFER> transforms;
+	D3DResource<RESOURCE_TYPES::BUFFER>::D3DResourceDesc transformDesc;
+	transformDesc.elts_per_axis[0] = FrameSnapshot::maxNumModels * float4s_per_transform;
+	transformDesc.init_data = transformUploads;
+	transformDesc.data_footprint_bytes = sizeof(transformUploads);
+	transformDesc.fmt = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	transforms.Init(transformDesc, RESRC_ACCESS_TYPES::CPU_UPDATE, GENERIC_READONLY);
+	transformBuffer = transforms.resource_handle;
+
+	D3DResource<RESOURCE_TYPES::BUFFER> instances;
+	D3DResource<RESOURCE_TYPES::BUFFER>::D3DResourceDesc instanceDesc;
+	instanceDesc.elts_per_axis[0] = FrameSnapshot::maxNumModels;
+	instanceDesc.init_data = instanceData;
+	instanceDesc.data_footprint_bytes = sizeof(instanceData);
+	instanceDesc.fmt = DXGI_FORMAT_UNKNOWN;
+	instances.Init(instanceDesc, RESRC_ACCESS_TYPES::CPU_WRITE, VERTEX);
+	instanceBuffer = instances.resource_handle;
+
+	graph.Init();
+
+	// One chunk per scheduler thread, at most
+	const uint32_t threads = TaskScheduler::NumThreads();
+	const uint32_t recordingChunks = (threads > ParallelRecorder::max_chunks) ? ParallelRecorder::max_chunks : threads;
+	recorder.Init(recordingChunks, chunkCommandBytes, recordBackend);
+
+	// Every shader the graph uses, created in parallel up-front; the jobs below then only hit the shader cache
+	const D3DWrapper::ShaderRequest shaders[] =
 	{
-		vs = D3DWrapper::CreateVertShader(vs_path, false);
-		ps = D3DWrapper::CreatePixelShader(ps_path);
-	}
+		{ "VertexShader.cso", SHADER_TYPES::VS, false },
+		{ "PixelShader.cso", SHADER_TYPES::PS, false }
+	};
+	D3DWrapper::PreloadShaders(shaders, sizeof(shaders) / sizeof(shaders[0]));
 
-	bool is2D = false;
-	bool directToBackbuf = true; // Set if this draw writes to the back-buffer instead of an intermediate RTV
+	// Just one draw for now
+	DrawJob job("VertexShader.cso", "PixelShader.cso");
+	job.directToBackbuf = true;
+	job.depthTestedOpaque = true; // Depth-tested against the default depth buffer
+	job.AddBuffer(transformBuffer, GENERIC_READONLY, SHADER_TYPES::VS);
+	graph.AddDrawPass(job);
+}
 
-	D3DHandle vs;
-	D3DHandle ps;
-};
+void Pipeline::DeInit()
+{
+	assert(("Render thread still running at pipeline shutdown", !rendering.load()));
+	recorder.DeInit();
+	graph.DeInit();
+}
 
-struct DispatchJob : ShadingJob
+// Encodes one contiguous run of compiled passes; runs on recording threads, so only reads the graph & scene
+void RecordPasses(CommandBuffer& cmds, uint32_t firstPass, uint32_t numPasses, void* userData)
 {
-	DispatchJob() {}
-	DispatchJob(const char* cs_path, uint32_t _dispatchX, uint32_t _dispatchY, uint32_t _dispatchZ) : dispatchX(_dispatchX), dispatchY(_dispatchY), dispatchZ(_dispatchZ)
+	const DrawGeometry& geometry = *static_cast<const DrawGeometry*>(userData);
+	for (uint32_t i = firstPass; i < firstPass + numPasses; i++)
 	{
-		cs = D3DWrapper::CreateComputeShader(cs_path);
+		const RenderGraph::RenderPass& pass = graph.CompiledPass(i);
+		if (pass.type == RenderGraph::DRAW)
+		{
+			cmds.EncodeDraw(*pass.drawJob, geometry);
+		}
+		else if (pass.type == RenderGraph::DISPATCH)
+		{
+			cmds.EncodeDispatch(*pass.dispatchJob);
+		}
 	}
+}
 
-	D3DHandle cs;
-	uint32_t dispatchX = 1, dispatchY = 1, dispatchZ = 1;
-};
-
-struct CopyJob
+FrameSnapshot& Pipeline::WriteSnapshot()
 {
-	// ...
-};
+	return snapshots.WriteSlot();
+}
 
-struct SceneMesh
+void Pipeline::PublishSnapshot()
 {
-	D3DHandle vbuffer;
-	D3DHandle ibuffer;
-	uint32_t numIndices = 0;
-};
+	snapshots.WriteSlot().frameNumber = ++numPublished;
+	snapshots.Publish();
 
-SceneMesh* sceneData = nullptr;
-uint8_t numScenesAvailable = 0;
+	{
+		std::lock_guard<std::mutex> lock(snapshotLock);
+		snapshotPending = true;
+	}
+	snapshotReady.notify_one();
+}
 
-struct JobArray
+void RenderLoop()
 {
-	static constexpr uint32_t maxDrawJobs = 8;
-	static constexpr uint32_t maxComputeJobs = 8;
+	// Recording spawns tasks from here
+	TaskScheduler::AttachThread();
+	Profiler::NameThread("Render");
 
-	enum JOB_TYPES
+	while (true)
 	{
-		DRAW,
-		DISPATCH
-	};
+		{
+			// Nothing new from the game thread; the last frame stays on screen until the next publish (or shutdown) wakes us
+			std::unique_lock<std::mutex> lock(snapshotLock);
+			snapshotReady.wait(lock, [] { return snapshotPending || !rendering.load(std::memory_order_relaxed); });
+			if (!rendering.load(std::memory_order_relaxed))
+			{
+				break;
+			}
+			snapshotPending = false;
+		}
 
-	DrawJob drawJobsCompact[maxDrawJobs] = {};
-	DispatchJob dispatchJobsCompact[maxComputeJobs] = {};
-	JOB_TYPES typesOfJob[maxDrawJobs + maxComputeJobs] = {};
-	uint32_t jobOffsets[maxDrawJobs + maxComputeJobs] = {};
+		const FrameSnapshot* frame = snapshots.Acquire();
+		if (frame == nullptr)
+		{
+			continue;
+		}
 
-	uint32_t drawJobCounter = 0;
-	uint32_t dispatchJobCounter = 0;
-	uint32_t combinedJobCounter = 0;
+		Pipeline::PushFrame(*frame);
+	}
+}
 
-	void SubmitDraw(DrawJob job)
-	{
-		drawJobsCompact[drawJobCounter] = job;
-		jobOffsets[combinedJobCounter] = drawJobCounter;
-		drawJobCounter++;
+void Pipeline::StartRenderThread()
+{
+	assert(("Render thread already running", !rendering.load()));
+	rendering.store(true, std::memory_order_release);
+	renderThread = std::thread(RenderLoop);
+}
 
-		typesOfJob[combinedJobCounter] = DRAW;
-		combinedJobCounter++;
+void Pipeline::StopRenderThread()
+{
+	{
+		std::lock_guard<std::mutex> lock(snapshotLock);
+		rendering.store(false, std::memory_order_release);
 	}
-
-	void SubmitCompute(DispatchJob job)
+	snapshotReady.notify_one();
+	if (renderThread.joinable())
 	{
-		dispatchJobsCompact[dispatchJobCounter] = job;
-		jobOffsets[combinedJobCounter] = dispatchJobCounter;
-		dispatchJobCounter++;
-
-		typesOfJob[combinedJobCounter] = DISPATCH;
-		combinedJobCounter++;
-
-		assert(("Depth-stencil buffers are unsupported for compute jobs", !job.hasDepthStencil));
+		renderThread.join();
 	}
-};
-
-JobArray jobs;
+}
 
-void Pipeline::Init(Scene* scenes, uint8_t numScenes)
+// Packs transforms changed since the last upload into [transformUploads] & queues them, one contiguous range at a time
+void UploadTransforms(const FrameSnapshot& frame)
 {
-	sceneData = Memory::AllocateArray<SceneMesh>(numScenes);
-	numScenesAvailable = numScenes;
+	PROFILE_FUNCTION();
 
-	for (uint32_t i = 0; i < numScenes; i++)
-	{
-		scenes[i].GetSceneMesh(&sceneData[i].vbuffer, &sceneData[i].ibuffer, &sceneData[i].numIndices);
-	}
+	// Epochs are per-scene, so a different scene means nothing on the GPU is current
+	const uint64_t sinceEpoch = (frame.sceneID == uploadedTransformScene) ? uploadedTransformEpoch : 0;
 
-	// Allocate any textures, buffers, volumes &c we want to use with draws/dispatches here
+	uint32_t runFirst[max_transform_uploads];
+	uint32_t runCounts[max_transform_uploads];
+	const uint32_t numRuns = FindChangedRuns(frame.transformChangedEpochs, frame.numModels, sinceEpoch, max_transform_upload_gap,
+											 runFirst, runCounts, max_transform_uploads);
 
-	// Just one draw for now
-	DrawJob job("VertexShader.cso", "PixelShader.cso");
-	job.directToBackbuf = true;
-	jobs.SubmitDraw(job);
-}
+	const TransformStreams& streams = frame.transforms;
+	for (uint32_t run = 0; run < numRuns; run++)
+	{
+		const uint32_t first = runFirst[run];
+		DirectX::XMFLOAT4* packed = transformUploads + (first * float4s_per_transform);
+		for (uint32_t i = first; i < first + runCounts[run]; i++)
+		{
+			*packed++ = DirectX::XMFLOAT4(streams.qx[i], streams.qy[i], streams.qz[i], streams.qw[i]);
+			*packed++ = DirectX::XMFLOAT4(streams.tx[i], streams.ty[i], streams.tz[i], streams.s[i]);
+		}
 
-void Pipeline::DeInit()
-{
-	// Empty for now
+		// A full upload queue leaves the GPU's copy where it was, so the next frame sends everything changed since then again (runs that did
+		// make it just land twice)
+		constexpr uint32_t transformBytes = float4s_per_transform * sizeof(DirectX::XMFLOAT4);
+		if (!D3DWrapper::QueueUpload(transformBuffer, first * transformBytes, transformUploads + (first * float4s_per_transform), runCounts[run] * transformBytes))
+		{
+			return;
+		}
+	}
+
+	uploadedTransformEpoch = frame.transformEpoch;
+	uploadedTransformScene = frame.sceneID;
 }
 
 // Probably going to need more in this than a direct present call ^_^'
-void Pipeline::PushFrame(uint32_t sceneID)
+void Pipeline::PushFrame(const FrameSnapshot& frame)
 {
+	PROFILE_FUNCTION();
+
+	const uint32_t sceneID = frame.sceneID;
+
 	D3DWrapper::PrepareBackbuf();
-	for (uint32_t i = 0; i < jobs.combinedJobCounter; i++)
+
+	// Cheap when the pass structure hasn't changed since the last frame (which is always, for now)
+	graph.Compile();
+	graph.SortPasses();
+
+	// Transforms & instances live in their own buffers; recorded streams only refer to them, so neither forces a re-record
+	// Transforms are queued before the flush, so they land in time for this frame's draws (unless this frame's staging buffer is still busy
+	// on the GPU, in which case they wait one more frame along with everything else queued)
+	UploadTransforms(frame);
+	D3DWrapper::FlushUploads();
+
+	const bool visibleChanged = (frame.numVisible != uploadedNumVisible) || (memcmp(frame.visible, uploadedVisible, frame.numVisible * sizeof(uint16_t)) != 0);
+	if (visibleChanged)
 	{
-		if (jobs.typesOfJob[i] == JobArray::DRAW)
+		for (uint16_t i = 0; i < frame.numVisible; i++)
 		{
-			DrawJob job = jobs.drawJobsCompact[jobs.jobOffsets[i]];
-			D3DWrapper::SubmitDraw(job.textures, job.textureBindings, job.bindTexturesFor, job.numTextures,
-								   job.buffers, job.bufferBindings, job.bindBuffersFor, job.numBuffers,
-								   job.volumes, job.volumeBindings, job.bindVolumesFor, job.numVolumes, job.vs, job.ps, job.directToBackbuf, job.is2D, sceneData[sceneID].vbuffer, sceneData[sceneID].ibuffer, sceneData[sceneID].numIndices);
-		}
-		else if (jobs.typesOfJob[i] == JobArray::DISPATCH)
-		{
-			DispatchJob job = jobs.dispatchJobsCompact[jobs.jobOffsets[i]];
-			D3DWrapper::SubmitDispatch(job.textures, job.textureBindings, job.numTextures,
-									   job.buffers, job.bufferBindings, job.numBuffers,
-									   job.volumes, job.volumeBindings, job.numVolumes, job.cs, job.dispatchX, job.dispatchY, job.dispatchZ);
+			instanceData[i] = frame.visible[i];
 		}
+		D3DWrapper::UpdateBuffer(instanceBuffer, instanceData, frame.numVisible * sizeof(uint32_t));
+
+		uploadedNumVisible = frame.numVisible;
+		memcpy(uploadedVisible, frame.visible, frame.numVisible * sizeof(uint16_t));
+	}
+
+	// Re-record only when the graph, the scene or the set of batches changed; otherwise last frame's streams (or command lists) replay as-is
+	const bool batchesChanged = (frame.numBatches != recordedNumBatches) || (memcmp(frame.batches, recordedBatches, frame.numBatches * sizeof(InstanceBatch)) != 0);
+	if (graph.Version() != recordedVersion || sceneID != recordedScene || batchesChanged)
+	{
+		DrawGeometry geometry;
+		geometry.vbuffer = sceneData[sceneID].vbuffer;
+		geometry.ibuffer = sceneData[sceneID].ibuffer;
+		geometry.instances = instanceBuffer;
+		geometry.hasInstances = true;
+		geometry.batches = frame.batches;
+		geometry.numBatches = frame.numBatches;
+		recorder.Record(graph.NumCompiledPasses(), RecordPasses, &geometry);
+
+		recordedVersion = graph.Version();
+		recordedScene = sceneID;
+		recordedNumBatches = frame.numBatches;
+		memcpy(recordedBatches, frame.batches, frame.numBatches * sizeof(InstanceBatch));
 	}
 
+	recorder.Submit();
+
 	D3DWrapper::Present();
 }
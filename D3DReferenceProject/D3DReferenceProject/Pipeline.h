@@ -3,11 +3,24 @@
 #include "D3DUtils.h"
 #include "Scene.h"
 
+// Rendering runs on its own thread, decoupled from simulation
+// The game thread fills in WriteSnapshot() & calls PublishSnapshot() once per update; the render thread picks up the newest published snapshot
+// each frame & never touches the live scene. Neither thread waits on the other (see TripleBuffer.h)
+// D3DWrapper belongs to the render thread between StartRenderThread() & StopRenderThread()
 class Pipeline
 {
 	public:
 		static void Init(Scene* scenes, uint8_t numScenes);
 		static void DeInit();
-		static void PushFrame(uint32_t sceneID);
+
+		static void StartRenderThread();
+		static void StopRenderThread();
+
+		// Game thread only
+		static FrameSnapshot& WriteSnapshot();
+		static void PublishSnapshot();
+
+		// Render thread only (or the main thread, when no render thread is running)
+		static void PushFrame(const FrameSnapshot& frame);
 };
 
@@ -0,0 +1,141 @@
+#include "Profiler.h"
+
+#if PROFILER_ZONES
+#include "Memory.h"
+#include <cassert>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+#include <new>
+
+Profiler::ThreadRing* Profiler::rings = nullptr;
+thread_local Profiler::ThreadRing* Profiler::threadRing = nullptr;
+
+std::atomic<uint32_t> maxRings = 0; // Zero until Init() (& again after DeInit()), so early zones are dropped rather than registered
+std::atomic<uint32_t> numRegistered = 0;
+
+// Clock pair from Init(); export measures the tick rate against it
+uint64_t originTicks = 0;
+std::chrono::steady_clock::time_point originTime;
+
+void Profiler::Init(uint32_t maxThreads, uint32_t zonesPerThread)
+{
+	assert(("Profiler zones per thread must be a power of two", zonesPerThread > 0 && (zonesPerThread & (zonesPerThread - 1)) == 0));
+
+	rings = Memory::AllocateArray<ThreadRing>(maxThreads, alignof(ThreadRing), MEM_TAGS::PROFILER);
+	for (uint32_t i = 0; i < maxThreads; i++)
+	{
+		ThreadRing* ring = new (&rings[i]) ThreadRing();
+		ring->numZones.store(0, std::memory_order_relaxed);
+		ring->zones = Memory::AllocateArray<Zone>(zonesPerThread, alignof(Zone), MEM_TAGS::PROFILER);
+		ring->mask = zonesPerThread - 1;
+		ring->name[0] = '\0';
+	}
+
+	originTicks = Now();
+	originTime = std::chrono::steady_clock::now();
+
+	numRegistered.store(0, std::memory_order_relaxed);
+	maxRings.store(maxThreads, std::memory_order_release);
+}
+
+void Profiler::DeInit()
+{
+	// Other threads have exited by now; only ours still points into the rings
+	maxRings.store(0, std::memory_order_release);
+	threadRing = nullptr;
+	rings = nullptr;
+}
+
+Profiler::ThreadRing* Profiler::RegisterThread()
+{
+	// Only reached through NameThread(), so threads that miss out bump the counter once per call rather than once per zone
+	const uint32_t capacity = maxRings.load(std::memory_order_acquire);
+	if (capacity == 0)
+	{
+		return nullptr;
+	}
+
+	const uint32_t ringNdx = numRegistered.fetch_add(1, std::memory_order_relaxed);
+	if (ringNdx >= capacity)
+	{
+		return nullptr;
+	}
+
+	threadRing = &rings[ringNdx];
+	return threadRing;
+}
+
+void Profiler::NameThread(const char* name)
+{
+	ThreadRing* ring = (threadRing != nullptr) ? threadRing : RegisterThread();
+	if (ring != nullptr)
+	{
+		strncpy_s(ring->name, name, max_thread_name_len - 1);
+	}
+}
+
+void Profiler::ExportChromeTrace(const char* path)
+{
+	const uint64_t exportTicks = Now();
+	const auto exportTime = std::chrono::steady_clock::now();
+	const double elapsedUs = std::chrono::duration<double, std::micro>(exportTime - originTime).count();
+	const double ticksPerUs = (elapsedUs > 0.0) ? (static_cast<double>(exportTicks - originTicks) / elapsedUs) : 1.0;
+
+	std::ofstream strm(path, std::ios::out | std::ios::trunc);
+	strm.setf(std::ios::fixed);
+	strm.precision(3);
+	strm << "{\"traceEvents\":[\n";
+
+	bool firstEvent = true;
+	const uint32_t registered = numRegistered.load(std::memory_order_relaxed);
+	const uint32_t capacity = maxRings.load(std::memory_order_acquire);
+	const uint32_t numRings = (registered < capacity) ? registered : capacity;
+	for (uint32_t i = 0; i < numRings; i++)
+	{
+		const ThreadRing& ring = rings[i];
+		if (ring.name[0] != '\0')
+		{
+			strm << (firstEvent ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << i << ",\"args\":{\"name\":\"" << ring.name << "\"}}";
+			firstEvent = false;
+		}
+
+		const uint64_t ringLen = ring.mask + 1;
+		const uint64_t numZones = ring.numZones.load(std::memory_order_acquire);
+		for (uint64_t z = (numZones > ringLen) ? (numZones - ringLen) : 0; z < numZones; z++)
+		{
+			const Zone zone = ring.zones[z & ring.mask];
+
+			// Seqlock-style check; if the owning thread lapped this slot while we read it, the copy may be torn
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (ring.numZones.load(std::memory_order_relaxed) - z > ringLen)
+			{
+				continue;
+			}
+
+			const double beginUs = static_cast<double>(zone.begin - originTicks) / ticksPerUs;
+			const double durationUs = static_cast<double>(zone.end - zone.begin) / ticksPerUs;
+			strm << (firstEvent ? "" : ",\n") << "{\"name\":\"" << zone.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << i << ",\"ts\":" << beginUs << ",\"dur\":" << durationUs << "}";
+			firstEvent = false;
+		}
+	}
+
+	strm << "\n]}\n";
+}
+#else
+void Profiler::Init(uint32_t maxThreads, uint32_t zonesPerThread)
+{
+}
+
+void Profiler::DeInit()
+{
+}
+
+void Profiler::NameThread(const char* name)
+{
+}
+
+void Profiler::ExportChromeTrace(const char* path)
+{
+}
+#endif
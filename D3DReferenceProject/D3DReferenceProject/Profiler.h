@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+// Scoped CPU zones, exported as Chrome trace JSON (open the file in chrome://tracing or ui.perfetto.dev)
+// Each thread writes finished zones into a ring of its own, so recording never takes a lock or shares a cache line with another thread; rings keep
+// the newest zones & quietly overwrite the oldest. Timestamps are raw rdtsc ticks, only converted to microseconds on export (calibrated against
+// steady_clock between Init() & the export)
+// Threads are only recorded once they've called NameThread(); zones look their thread's ring up once on entry & take one rdtsc per edge, so an
+// unrecorded thread pays a TLS load & a branch per zone, & a recorded one adds two timestamps & a 24-byte write on top
+// Zone names are stored by pointer, so they need to outlive the export; string literals & __FUNCTION__ both do
+
+// Zones on by default in debug builds, compiled out entirely otherwise (the macros expand to nothing); define PROFILER_ZONES to 0/1 to override
+#ifndef PROFILER_ZONES
+#ifdef _DEBUG
+#define PROFILER_ZONES 1
+#else
+#define PROFILER_ZONES 0
+#endif
+#endif
+
+#if PROFILER_ZONES
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+class Profiler
+{
+	public:
+		// Call from the main thread after Memory::Init(); threads past [maxThreads] just aren't recorded. [zonesPerThread] must be a power of two
+		static void Init(uint32_t maxThreads, uint32_t zonesPerThread = 8192);
+		static void DeInit();
+
+		// Registers the calling thread for recording & labels it in exported traces (the name is copied); call again to rename
+		// Zones on threads that never call this are dropped, which keeps registration out of the zone path entirely
+		static void NameThread(const char* name);
+
+		// Writes every zone the rings still hold; best called while profiled threads are quiet, since zones overwritten mid-export are dropped
+		static void ExportChromeTrace(const char* path);
+
+#if PROFILER_ZONES
+		static uint64_t Now() { return __rdtsc(); }
+
+	private:
+		friend class ProfileZone;
+		struct ThreadRing;
+
+		static void Record(ThreadRing* ring, const char* name, uint64_t begin, uint64_t end)
+		{
+			// Single writer, so a relaxed load of our own count is enough; the release publishes the zone to the exporter
+			const uint64_t zoneNdx = ring->numZones.load(std::memory_order_relaxed);
+			Zone& zone = ring->zones[zoneNdx & ring->mask];
+			zone.name = name;
+			zone.begin = begin;
+			zone.end = end;
+			ring->numZones.store(zoneNdx + 1, std::memory_order_release);
+		}
+
+		struct Zone
+		{
+			const char* name;
+			uint64_t begin;
+			uint64_t end;
+		};
+
+		static constexpr uint32_t max_thread_name_len = 32;
+
+		struct alignas(64) ThreadRing
+		{
+			std::atomic<uint64_t> numZones; // Lifetime total; the ring holds the last [mask + 1]
+			Zone* zones;
+			uint64_t mask;
+			char name[max_thread_name_len];
+		};
+
+		static ThreadRing* rings; // One per registered thread
+		static thread_local ThreadRing* threadRing;
+		static ThreadRing* RegisterThread();
+#endif
+};
+
+#if PROFILER_ZONES
+class ProfileZone
+{
+	public:
+		ProfileZone(const char* zoneName) : ring(Profiler::threadRing), name(zoneName), begin((ring != nullptr) ? Profiler::Now() : 0) {}
+		~ProfileZone()
+		{
+			if (ring != nullptr)
+			{
+				Profiler::Record(ring, name, begin, Profiler::Now());
+			}
+		}
+
+	private:
+		Profiler::ThreadRing* ring; // Null on unrecorded threads
+		const char* name;
+		uint64_t begin;
+};
+
+#define PROFILE_ZONE_CONCAT_INNER(a, b) a##b
+#define PROFILE_ZONE_CONCAT(a, b) PROFILE_ZONE_CONCAT_INNER(a, b)
+
+// Times the rest of the enclosing scope
+#define PROFILE_ZONE(name) ProfileZone PROFILE_ZONE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__FUNCTION__)
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_FUNCTION()
+#endif
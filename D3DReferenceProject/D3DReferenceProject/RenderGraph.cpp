@@ -0,0 +1,573 @@
+#include "RenderGraph.h"
+#include "Memory.h"
+
+constexpr uint64_t compiledHeapBytes = 256 * 1024; // Order + group tables for a few thousand passes
+
+void RenderGraph::Init()
+{
+	compiledHeap.Init(compiledHeapBytes);
+	ExportResource(backbuffer_resource);
+}
+
+void RenderGraph::DeInit()
+{
+	Reset();
+	compiledHeap.DeInit();
+	passesByDecl = nullptr;
+	compiledOrder = nullptr;
+	groupStarts = nullptr;
+	numCompiledPasses = 0;
+	numGroups = 0;
+	hasCompiled = false;
+}
+
+RenderGraph::RenderPass* RenderGraph::NewPass(PASS_TYPES type)
+{
+	RenderPass* pass = passPool.New();
+	pass->type = type;
+	pass->declNdx = numDeclaredPasses;
+
+	if (lastPass != nullptr)
+	{
+		lastPass->next = pass;
+	}
+	else
+	{
+		firstPass = pass;
+	}
+	lastPass = pass;
+	numDeclaredPasses++;
+
+	declarationsChanged = true;
+	return pass;
+}
+
+void RenderGraph::AddJobBindings(RenderPass* pass, const D3DHandle* handles, const RESRC_VIEWS* bindings, uint32_t numHandles, bool reorderableTargets)
+{
+	for (uint32_t i = 0; i < numHandles; i++)
+	{
+		const RenderResourceID resrc = ResourceID(handles[i]);
+		switch (bindings[i])
+		{
+			case UNORDERED_GPU_WRITES:
+				AddRead(pass, resrc); // UAVs are read-modify-write as far as ordering is concerned
+				AddWrite(pass, resrc);
+				break;
+
+			case RENDER_TARGET:
+			case DEPTH_STENCIL:
+				AddWrite(pass, resrc);
+				if (reorderableTargets)
+				{
+					pass->attachmentWrites |= 1ull << (pass->numWrites - 1);
+				}
+				break;
+
+			default:
+				AddRead(pass, resrc);
+				break;
+		}
+	}
+}
+
+RenderGraph::RenderPass* RenderGraph::AddDrawPass(const DrawJob& job)
+{
+	RenderPass* pass = NewPass(DRAW);
+	pass->drawJob = drawJobPool.New(job);
+	assert(("Translucent draws can't be depth-tested opaque", !(job.translucent && job.depthTestedOpaque)));
+
+	AddJobBindings(pass, job.textures, job.textureBindings, job.numTextures, job.depthTestedOpaque);
+	AddJobBindings(pass, job.buffers, job.bufferBindings, job.numBuffers, job.depthTestedOpaque);
+	AddJobBindings(pass, job.volumes, job.volumeBindings, job.numVolumes, job.depthTestedOpaque);
+
+	if (job.directToBackbuf)
+	{
+		AddWrite(pass, backbuffer_resource);
+		if (job.depthTestedOpaque)
+		{
+			pass->attachmentWrites |= 1ull << (pass->numWrites - 1);
+		}
+	}
+	return pass;
+}
+
+RenderGraph::RenderPass* RenderGraph::AddDispatchPass(const DispatchJob& job)
+{
+	assert(("Depth-stencil buffers are unsupported for compute jobs", !job.hasDepthStencil));
+
+	RenderPass* pass = NewPass(DISPATCH);
+	pass->dispatchJob = dispatchJobPool.New(job);
+
+	AddJobBindings(pass, job.textures, job.textureBindings, job.numTextures, false);
+	AddJobBindings(pass, job.buffers, job.bufferBindings, job.numBuffers, false);
+	AddJobBindings(pass, job.volumes, job.volumeBindings, job.numVolumes, false);
+	return pass;
+}
+
+void RenderGraph::AddRead(RenderPass* pass, RenderResourceID resrc)
+{
+	assert(("Too many reads declared for one render pass", pass->numReads < maxPassResources));
+	pass->reads[pass->numReads] = resrc;
+	pass->numReads++;
+	declarationsChanged = true;
+}
+
+void RenderGraph::AddWrite(RenderPass* pass, RenderResourceID resrc)
+{
+	assert(("Too many writes declared for one render pass", pass->numWrites < maxPassResources));
+	pass->writes[pass->numWrites] = resrc;
+	pass->numWrites++;
+	declarationsChanged = true;
+}
+
+void RenderGraph::ExportResource(RenderResourceID resrc)
+{
+	if (IsExported(resrc))
+	{
+		return;
+	}
+
+	assert(("Too many exported render-graph resources", numExports < maxExports));
+	exports[numExports] = resrc;
+	numExports++;
+	declarationsChanged = true;
+}
+
+bool RenderGraph::IsExported(RenderResourceID resrc) const
+{
+	for (uint32_t i = 0; i < numExports; i++)
+	{
+		if (exports[i] == resrc)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void RenderGraph::DeclareTransient(RenderResourceID resrc, uint64_t bytes, uint32_t alignment)
+{
+	assert(("Too many transient render-graph resources", numTransients < maxTransients));
+	transientIDs[numTransients] = resrc;
+	transients[numTransients].bytes = bytes;
+	transients[numTransients].alignment = alignment;
+	// [heapOffset] is left alone; if the graph hashes the same as last time Compile() skips planning, and the offset from last time still holds
+	numTransients++;
+	declarationsChanged = true;
+}
+
+uint64_t RenderGraph::TransientOffset(RenderResourceID resrc) const
+{
+	for (uint32_t i = 0; i < numTransients; i++)
+	{
+		if (transientIDs[i] == resrc)
+		{
+			return transients[i].heapOffset;
+		}
+	}
+
+	assert(("Resource wasn't declared transient", false));
+	return 0;
+}
+
+void RenderGraph::Reset()
+{
+	RenderPass* pass = firstPass;
+	while (pass != nullptr)
+	{
+		RenderPass* next = pass->next;
+		if (pass->type == DRAW)
+		{
+			drawJobPool.Delete(pass->drawJob);
+		}
+		else
+		{
+			dispatchJobPool.Delete(pass->dispatchJob);
+		}
+		passPool.Delete(pass);
+		pass = next;
+	}
+
+	firstPass = nullptr;
+	lastPass = nullptr;
+	numDeclaredPasses = 0;
+	numTransients = 0;
+
+	// The back-buffer is always an output
+	numExports = 0;
+	exports[numExports] = backbuffer_resource;
+	numExports++;
+
+	declarationsChanged = true;
+}
+
+uint64_t RenderGraph::HashStructure() const
+{
+	// FNV-1a over everything that affects culling & ordering
+	uint64_t hash = 14695981039346656037ull;
+	auto mix = [&hash](uint32_t value)
+	{
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			hash ^= (value >> (i * 8)) & 0xFF;
+			hash *= 1099511628211ull;
+		}
+	};
+
+	mix(numDeclaredPasses);
+	for (const RenderPass* pass = firstPass; pass != nullptr; pass = pass->next)
+	{
+		mix(pass->type);
+		mix(pass->neverCull ? 1 : 0);
+		mix(pass->numReads);
+		for (uint32_t i = 0; i < pass->numReads; i++)
+		{
+			mix(pass->reads[i]);
+		}
+		mix(pass->numWrites);
+		for (uint32_t i = 0; i < pass->numWrites; i++)
+		{
+			mix(pass->writes[i]);
+		}
+		mix(static_cast<uint32_t>(pass->attachmentWrites));
+		mix(static_cast<uint32_t>(pass->attachmentWrites >> 32));
+	}
+
+	mix(numExports);
+	for (uint32_t i = 0; i < numExports; i++)
+	{
+		mix(exports[i]);
+	}
+
+	mix(numTransients);
+	for (uint32_t i = 0; i < numTransients; i++)
+	{
+		mix(transientIDs[i]);
+		mix(static_cast<uint32_t>(transients[i].bytes));
+		mix(static_cast<uint32_t>(transients[i].bytes >> 32));
+		mix(transients[i].alignment);
+	}
+	return hash;
+}
+
+// Compile-time bookkeeping for each distinct resource touched by the graph
+struct ResourceState
+{
+	RenderResourceID id;
+	bool needed; // Culling: some live pass (or an export) consumes this resource
+	int32_t lastWriteLevel; // Ordering: highest level writing the current contents, -1 if none
+	int32_t attachmentFloor; // Ordering: lowest level the current run of opaque attachment writes may use, -1 outside a run
+	int32_t maxReadLevel; // Ordering: highest level reading the current contents, -1 if none
+	int32_t firstLevel; // Aliasing: earliest level touching this resource at all, -1 if none
+	int32_t lastLevel; // Aliasing: latest level touching this resource
+};
+
+ResourceState& FindResourceState(ResourceState* states, uint32_t& numStates, RenderResourceID id)
+{
+	// Graphs are small (tens of passes, a handful of resources each), so a linear scan beats hashing here
+	for (uint32_t i = 0; i < numStates; i++)
+	{
+		if (states[i].id == id)
+		{
+			return states[i];
+		}
+	}
+
+	ResourceState& state = states[numStates];
+	state.id = id;
+	state.needed = false;
+	state.lastWriteLevel = -1;
+	state.attachmentFloor = -1;
+	state.maxReadLevel = -1;
+	state.firstLevel = -1;
+	state.lastLevel = -1;
+	numStates++;
+	return state;
+}
+
+void RenderGraph::Compile()
+{
+	if (hasCompiled && !declarationsChanged)
+	{
+		return;
+	}
+	version++; // Even if the structure hashes the same, the jobs behind it may have changed
+
+	// Pass objects may have been re-created since the last compile even if the structure matches, so the declaration table is always refreshed
+	compiledHeap.Free(passesByDecl);
+	passesByDecl = compiledHeap.AllocateArray<RenderPass*>(numDeclaredPasses > 0 ? numDeclaredPasses : 1);
+	for (RenderPass* pass = firstPass; pass != nullptr; pass = pass->next)
+	{
+		passesByDecl[pass->declNdx] = pass;
+	}
+	declarationsChanged = false;
+
+	const uint64_t hash = HashStructure();
+	if (hasCompiled && hash == compiledHash)
+	{
+		return;
+	}
+
+	compiledHeap.Free(compiledOrder);
+	compiledHeap.Free(groupStarts);
+
+	// Scratch
+	uint32_t maxStates = numExports + numTransients;
+	for (RenderPass* pass = firstPass; pass != nullptr; pass = pass->next)
+	{
+		maxStates += pass->numReads + pass->numWrites;
+	}
+
+	ResourceState* states = compiledHeap.AllocateArray<ResourceState>(maxStates > 0 ? maxStates : 1);
+	bool* passLive = compiledHeap.AllocateArray<bool>(numDeclaredPasses > 0 ? numDeclaredPasses : 1);
+	int32_t* passLevels = compiledHeap.AllocateArray<int32_t>(numDeclaredPasses > 0 ? numDeclaredPasses : 1);
+	uint32_t numStates = 0;
+
+	// Culling
+	// Walk passes back-to-front; a pass survives if it writes anything a later live pass (or an export) needs, and then everything it reads
+	// becomes needed in turn
+	// Writes don't clear [needed] - render-targets, depth & UAVs are all read-modify-write in practice (blending, depth-testing, partial writes),
+	// so earlier writers to a needed resource stay alive as well
+	///////////////////////////////////////////////////////////////////
+
+	for (uint32_t i = 0; i < numExports; i++)
+	{
+		FindResourceState(states, numStates, exports[i]).needed = true;
+	}
+
+	for (int32_t declNdx = static_cast<int32_t>(numDeclaredPasses) - 1; declNdx >= 0; declNdx--)
+	{
+		const RenderPass* pass = passesByDecl[declNdx];
+		bool live = pass->neverCull;
+		for (uint32_t i = 0; i < pass->numWrites && !live; i++)
+		{
+			live = FindResourceState(states, numStates, pass->writes[i]).needed;
+		}
+
+		passLive[declNdx] = live;
+		if (live)
+		{
+			for (uint32_t i = 0; i < pass->numReads; i++)
+			{
+				FindResourceState(states, numStates, pass->reads[i]).needed = true;
+			}
+		}
+	}
+
+	// Ordering
+	// Walk live passes front-to-back, placing each one level past every hazard it has with earlier passes:
+	// RAW (after the latest writer of anything it reads), WAR (after every reader of anything it writes), WAW (after the latest writer)
+	// The exception is a run of draws flagged [depthTestedOpaque] into the same render-target/depth-buffer with no reads in between; depth-testing
+	// makes their order irrelevant, so they're only ordered against whatever came before the run & can share levels (and be sorted freely)
+	// Unflagged draws always take the strict write-after-write edge, since their order can matter (blending, fullscreen passes, UI...)
+	//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	int32_t maxLevel = -1;
+	uint32_t numLive = 0;
+	for (uint32_t declNdx = 0; declNdx < numDeclaredPasses; declNdx++)
+	{
+		if (!passLive[declNdx])
+		{
+			continue;
+		}
+
+		const RenderPass* pass = passesByDecl[declNdx];
+		int32_t level = 0;
+		for (uint32_t i = 0; i < pass->numReads; i++)
+		{
+			const ResourceState& state = FindResourceState(states, numStates, pass->reads[i]);
+			level = (state.lastWriteLevel + 1 > level) ? state.lastWriteLevel + 1 : level;
+		}
+
+		for (uint32_t i = 0; i < pass->numWrites; i++)
+		{
+			const ResourceState& state = FindResourceState(states, numStates, pass->writes[i]);
+			const bool joinsRun = ((pass->attachmentWrites >> i) & 1) && state.attachmentFloor >= 0;
+			const int32_t hazardLevel = (state.lastWriteLevel > state.maxReadLevel) ? state.lastWriteLevel : state.maxReadLevel;
+			const int32_t minLevel = joinsRun ? state.attachmentFloor : hazardLevel + 1;
+			level = (minLevel > level) ? minLevel : level;
+		}
+
+		for (uint32_t i = 0; i < pass->numReads; i++)
+		{
+			ResourceState& state = FindResourceState(states, numStates, pass->reads[i]);
+			state.maxReadLevel = (level > state.maxReadLevel) ? level : state.maxReadLevel;
+			state.attachmentFloor = -1;
+			state.firstLevel = (state.firstLevel < 0 || level < state.firstLevel) ? level : state.firstLevel;
+			state.lastLevel = (level > state.lastLevel) ? level : state.lastLevel;
+		}
+
+		for (uint32_t i = 0; i < pass->numWrites; i++)
+		{
+			ResourceState& state = FindResourceState(states, numStates, pass->writes[i]);
+			if ((pass->attachmentWrites >> i) & 1)
+			{
+				if (state.attachmentFloor < 0)
+				{
+					state.attachmentFloor = ((state.lastWriteLevel > state.maxReadLevel) ? state.lastWriteLevel : state.maxReadLevel) + 1;
+				}
+			}
+			else
+			{
+				state.attachmentFloor = -1;
+			}
+			state.lastWriteLevel = (level > state.lastWriteLevel) ? level : state.lastWriteLevel;
+			state.firstLevel = (state.firstLevel < 0 || level < state.firstLevel) ? level : state.firstLevel;
+			state.lastLevel = (level > state.lastLevel) ? level : state.lastLevel;
+		}
+
+		passLevels[declNdx] = level;
+		maxLevel = (level > maxLevel) ? level : maxLevel;
+		numLive++;
+	}
+
+	// Bucket live passes by level (counting sort, stable in declaration order)
+	numGroups = static_cast<uint32_t>(maxLevel + 1);
+	numCompiledPasses = numLive;
+	compiledOrder = compiledHeap.AllocateArray<uint32_t>(numLive > 0 ? numLive : 1);
+	groupStarts = compiledHeap.AllocateArray<uint32_t>(numGroups + 1);
+
+	for (uint32_t g = 0; g <= numGroups; g++)
+	{
+		groupStarts[g] = 0;
+	}
+
+	for (uint32_t declNdx = 0; declNdx < numDeclaredPasses; declNdx++)
+	{
+		if (passLive[declNdx])
+		{
+			groupStarts[passLevels[declNdx] + 1]++;
+		}
+	}
+
+	for (uint32_t g = 0; g < numGroups; g++)
+	{
+		groupStarts[g + 1] += groupStarts[g];
+	}
+
+	// Scatter into place
+	uint32_t* cursors = compiledHeap.AllocateArray<uint32_t>(numGroups > 0 ? numGroups : 1);
+	for (uint32_t g = 0; g < numGroups; g++)
+	{
+		cursors[g] = groupStarts[g];
+	}
+
+	for (uint32_t declNdx = 0; declNdx < numDeclaredPasses; declNdx++)
+	{
+		if (passLive[declNdx])
+		{
+			compiledOrder[cursors[passLevels[declNdx]]] = declNdx;
+			cursors[passLevels[declNdx]]++;
+		}
+	}
+
+	// Aliasing
+	// Lifetimes are measured in levels rather than passes, since passes sharing a level may run in any order (or at the same time)
+	// Exported transients stay alive to the end of the frame; transients no live pass touches take no space at all
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	TransientResource* liveTransients = compiledHeap.AllocateArray<TransientResource>(numTransients > 0 ? numTransients : 1, alignof(TransientResource));
+	uint32_t* liveTransientNdces = compiledHeap.AllocateArray<uint32_t>(numTransients > 0 ? numTransients : 1);
+	uint32_t* planScratch = compiledHeap.AllocateArray<uint32_t>(numTransients > 0 ? 2 * numTransients : 1);
+	uint32_t numLiveTransients = 0;
+
+	for (uint32_t i = 0; i < numTransients; i++)
+	{
+		transients[i].heapOffset = 0;
+
+		const ResourceState& state = FindResourceState(states, numStates, transientIDs[i]);
+		if (state.firstLevel < 0)
+		{
+			continue;
+		}
+
+		TransientResource& live = liveTransients[numLiveTransients];
+		live = transients[i];
+		live.firstUse = static_cast<uint32_t>(state.firstLevel);
+		live.lastUse = IsExported(transientIDs[i]) ? numGroups - 1 : static_cast<uint32_t>(state.lastLevel);
+		liveTransientNdces[numLiveTransients] = i;
+		numLiveTransients++;
+	}
+
+	aliasingReport = AliasingPlanner::Plan(liveTransients, numLiveTransients, planScratch);
+	for (uint32_t i = 0; i < numLiveTransients; i++)
+	{
+		transients[liveTransientNdces[i]].heapOffset = liveTransients[i].heapOffset;
+	}
+
+	compiledHeap.Free(planScratch);
+	compiledHeap.Free(liveTransientNdces);
+	compiledHeap.Free(liveTransients);
+	compiledHeap.Free(cursors);
+	compiledHeap.Free(passLevels);
+	compiledHeap.Free(passLive);
+	compiledHeap.Free(states);
+
+	compiledHash = hash;
+	hasCompiled = true;
+}
+
+uint32_t RenderGraph::CountRebinds(DrawSort::RebindCounts& counts)
+{
+	uint32_t numDraws = 0;
+	const DrawJob* prev = nullptr;
+	for (uint32_t i = 0; i < numCompiledPasses; i++)
+	{
+		const RenderPass& pass = CompiledPass(i);
+		if (pass.type == DRAW)
+		{
+			DrawSort::CountRebinds(prev, *pass.drawJob, counts);
+			prev = pass.drawJob;
+			numDraws++;
+		}
+	}
+	return numDraws;
+}
+
+void RenderGraph::SortPasses(SortReport* outReport)
+{
+	if (outReport != nullptr)
+	{
+		*outReport = SortReport();
+		CountRebinds(outReport->unsorted);
+	}
+
+	if (numCompiledPasses == 0)
+	{
+		return;
+	}
+
+	uint64_t* keys = compiledHeap.AllocateArray<uint64_t>(numCompiledPasses, alignof(uint64_t));
+	uint64_t* keyScratch = compiledHeap.AllocateArray<uint64_t>(numCompiledPasses, alignof(uint64_t));
+	uint32_t* values = compiledHeap.AllocateArray<uint32_t>(numCompiledPasses);
+	uint32_t* valueScratch = compiledHeap.AllocateArray<uint32_t>(numCompiledPasses);
+
+	for (uint32_t g = 0; g < numGroups; g++)
+	{
+		const uint32_t start = groupStarts[g];
+		const uint32_t numInGroup = groupStarts[g + 1] - start;
+		for (uint32_t i = 0; i < numInGroup; i++)
+		{
+			const RenderPass& pass = CompiledPass(start + i);
+			keys[i] = (pass.type == DRAW) ? DrawSort::DrawKey(*pass.drawJob) : 0; // Dispatches lead their group
+			values[i] = compiledOrder[start + i];
+		}
+
+		DrawSort::RadixSort(keys, values, numInGroup, keyScratch, valueScratch);
+		for (uint32_t i = 0; i < numInGroup; i++)
+		{
+			version += (compiledOrder[start + i] != values[i]) ? 1 : 0;
+			compiledOrder[start + i] = values[i];
+		}
+	}
+
+	compiledHeap.Free(valueScratch);
+	compiledHeap.Free(values);
+	compiledHeap.Free(keyScratch);
+	compiledHeap.Free(keys);
+
+	if (outReport != nullptr)
+	{
+		outReport->numDraws = CountRebinds(outReport->sorted);
+	}
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "ShadingJobs.h"
+#include "ObjectPool.h"
+#include "TLSFHeap.h"
+#include "AliasingPlanner.h"
+#include "DrawSort.h"
+
+// Render graph replacing the old fixed-size job list
+// Passes declare the resources they read & write (derived from their bindings, plus any explicit extras); compiling the graph
+// - culls passes whose outputs never reach an exported resource (the back-buffer is always exported)
+// - orders surviving passes topologically, honouring read-after-write, write-after-read & write-after-write hazards
+// - groups passes with no hazards between them into levels, so independent work sits together (and can be recorded in parallel later)
+// Compiled results are cached against a hash of the pass structure, so re-declaring an identical graph each frame costs a hash & no re-sort
+// Resources declared transient get a lifetime (first & last level touching them) and an offset into one shared heap from the aliasing planner
+
+// Resources are identified by their handle (object type + slot), with one reserved ID for the swap-chain back-buffer
+typedef uint32_t RenderResourceID;
+
+class RenderGraph
+{
+	public:
+		static constexpr RenderResourceID backbuffer_resource = 0xFFFFFFFF;
+		static constexpr uint32_t maxPassResources = 64;
+		static constexpr uint32_t default_transient_alignment = 65536; // D3D's default placement alignment for textures & buffers
+
+		enum PASS_TYPES
+		{
+			DRAW,
+			DISPATCH
+		};
+
+		struct RenderPass
+		{
+			PASS_TYPES type;
+			DrawJob* drawJob = nullptr;
+			DispatchJob* dispatchJob = nullptr;
+
+			RenderResourceID reads[maxPassResources];
+			uint32_t numReads = 0;
+			RenderResourceID writes[maxPassResources];
+			uint32_t numWrites = 0;
+			uint64_t attachmentWrites = 0; // Bit [i] set if writes[i] is a depth-tested opaque draw's render-target/depth/back-buffer write
+
+			bool neverCull = false; // For passes with side effects the graph can't see (readbacks, queries...)
+
+			uint32_t declNdx = 0;
+			RenderPass* next = nullptr; // Declaration order
+		};
+
+		static RenderResourceID ResourceID(D3DHandle handle)
+		{
+			return (static_cast<uint32_t>(handle.objType) << 16) | handle.index;
+		}
+
+		void Init();
+		void DeInit();
+
+		// Declaration
+		// Reads/writes are inferred from each job's bindings; render-targets, depth-stencils & UAVs count as writes (and UAVs as reads too),
+		// everything else as a read
+		RenderPass* AddDrawPass(const DrawJob& job);
+		RenderPass* AddDispatchPass(const DispatchJob& job);
+		void AddRead(RenderPass* pass, RenderResourceID resrc);
+		void AddWrite(RenderPass* pass, RenderResourceID resrc);
+		void ExportResource(RenderResourceID resrc); // Keeps passes contributing to [resrc] alive
+		void DeclareTransient(RenderResourceID resrc, uint64_t bytes, uint32_t alignment = default_transient_alignment); // Only needed by the passes in this graph
+		void Reset(); // Drops every pass, export & transient (compiled results stay cached until the next Compile())
+
+		// Compilation; a no-op if the pass structure hashes the same as last time
+		void Compile();
+
+		// Reorders passes within each compiled group by sort key (see DrawSort.h); passes in a group have no hazards between them, so any order
+		// is valid & the cached compile stays good
+		// Keys depend on per-frame inputs (depth), so this runs every frame, after Compile()
+		// Pass [outReport] to count the rebinds implied before & after sorting; that walks every draw twice more, so frames leave it out
+		struct SortReport
+		{
+			uint32_t numDraws = 0;
+			DrawSort::RebindCounts unsorted; // Rebinds implied by the order coming in (declaration-derived, or last frame's sort)
+			DrawSort::RebindCounts sorted;
+		};
+		void SortPasses(SortReport* outReport = nullptr);
+
+		// Changes whenever passes are re-declared or re-ordered; anything recorded from the compiled passes is still good while this holds
+		uint32_t Version() const { return version; }
+
+		// Compiled results
+		uint32_t NumCompiledPasses() const { return numCompiledPasses; }
+		RenderPass& CompiledPass(uint32_t ndx) { return *passesByDecl[compiledOrder[ndx]]; }
+		uint32_t NumGroups() const { return numGroups; }
+		uint32_t GroupStart(uint32_t group) const { return groupStarts[group]; } // Passes [GroupStart(g), GroupStart(g + 1)) have no hazards between them
+		uint32_t NumCulledPasses() const { return numDeclaredPasses - numCompiledPasses; }
+		uint64_t TransientOffset(RenderResourceID resrc) const; // Offset of [resrc] in the shared transient heap
+		const AliasingReport& TransientReport() const { return aliasingReport; }
+
+	private:
+		uint64_t HashStructure() const;
+		bool IsExported(RenderResourceID resrc) const;
+		uint32_t CountRebinds(DrawSort::RebindCounts& counts); // Returns the number of draws walked
+		RenderPass* NewPass(PASS_TYPES type);
+		void AddJobBindings(RenderPass* pass, const D3DHandle* handles, const RESRC_VIEWS* bindings, uint32_t numHandles, bool reorderableTargets);
+
+		ObjectPool<RenderPass, 16> passPool;
+		ObjectPool<DrawJob, 16> drawJobPool;
+		ObjectPool<DispatchJob, 16> dispatchJobPool;
+
+		RenderPass* firstPass = nullptr;
+		RenderPass* lastPass = nullptr;
+		uint32_t numDeclaredPasses = 0;
+
+		static constexpr uint32_t maxExports = 16;
+		RenderResourceID exports[maxExports] = {};
+		uint32_t numExports = 0;
+
+		static constexpr uint32_t maxTransients = 64;
+		RenderResourceID transientIDs[maxTransients] = {};
+		TransientResource transients[maxTransients];
+		uint32_t numTransients = 0;
+		AliasingReport aliasingReport;
+
+		// Compiled state, kept in a small private heap so recompiles can release the previous results
+		// The order is stored as declaration indices rather than pointers, so a cached order still applies after the same structure is re-declared
+		TLSFHeap compiledHeap;
+		RenderPass** passesByDecl = nullptr;
+		uint32_t* compiledOrder = nullptr;
+		uint32_t numCompiledPasses = 0;
+		uint32_t* groupStarts = nullptr; // [numGroups + 1] entries
+		uint32_t numGroups = 0;
+
+		uint32_t version = 0;
+
+		uint64_t compiledHash = 0;
+		bool hasCompiled = false;
+		bool declarationsChanged = false;
+};
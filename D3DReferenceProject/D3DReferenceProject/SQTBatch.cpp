@@ -0,0 +1,227 @@
+#include "SQTKernels.h"
+#include <emmintrin.h>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// SSE2 lanes; baseline on every x64 CPU, so this build always works
+struct SSELanes
+{
+	__m128 v;
+	static constexpr uint32_t width = 4;
+};
+
+template<> inline SSELanes Load<SSELanes>(const float* src) { return { _mm_loadu_ps(src) }; }
+template<> inline SSELanes Splat<SSELanes>(float x) { return { _mm_set1_ps(x) }; }
+inline void Store(float* dst, SSELanes a) { _mm_storeu_ps(dst, a.v); }
+inline SSELanes operator+(SSELanes a, SSELanes b) { return { _mm_add_ps(a.v, b.v) }; }
+inline SSELanes operator-(SSELanes a, SSELanes b) { return { _mm_sub_ps(a.v, b.v) }; }
+inline SSELanes operator*(SSELanes a, SSELanes b) { return { _mm_mul_ps(a.v, b.v) }; }
+inline SSELanes MulAdd(SSELanes a, SSELanes b, SSELanes c) { return { _mm_add_ps(_mm_mul_ps(a.v, b.v), c.v) }; }
+inline SSELanes Div(SSELanes a, SSELanes b) { return { _mm_div_ps(a.v, b.v) }; }
+inline SSELanes Sqrt(SSELanes a) { return { _mm_sqrt_ps(a.v) }; }
+inline SSELanes Negate(SSELanes a) { return { _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)) }; }
+inline SSELanes Greater(SSELanes a, SSELanes b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+inline SSELanes Select(SSELanes mask, SSELanes a, SSELanes b) { return { _mm_or_ps(_mm_and_ps(mask.v, b.v), _mm_andnot_ps(mask.v, a.v)) }; }
+
+const SQTKernelTable sse_kernels = MakeKernelTable<SSELanes>();
+
+bool CPUSupportsAVX2()
+{
+#ifdef _MSC_VER
+	int regs[4] = {};
+	__cpuid(regs, 0);
+	if (regs[0] < 7)
+	{
+		return false;
+	}
+
+	// AVX & FMA in hardware, and an OS that saves YMM registers across context switches
+	__cpuid(regs, 1);
+	const bool fma = (regs[2] & (1 << 12)) != 0;
+	const bool osxsave = (regs[2] & (1 << 27)) != 0;
+	const bool avx = (regs[2] & (1 << 28)) != 0;
+	if (!fma || !osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+	{
+		return false;
+	}
+
+	__cpuidex(regs, 7, 0);
+	return (regs[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+bool forceSSE = false;
+
+const SQTKernelTable& Kernels()
+{
+	static const SQTKernelTable& table = CPUSupportsAVX2() ? avx2_kernels : sse_kernels;
+	return forceSSE ? sse_kernels : table;
+}
+
+SQTStreams SQTStreams::Of(TransformStreams& streams, uint32_t first)
+{
+	return { streams.qx + first, streams.qy + first, streams.qz + first, streams.qw + first,
+			 streams.tx + first, streams.ty + first, streams.tz + first, streams.s + first };
+}
+
+// One group's worth of transforms, for running partial groups through whole-group kernels
+struct SQTScratch
+{
+	alignas(32) float components[8][SQTBatch::width];
+
+	SQTStreams Streams()
+	{
+		return { components[0], components[1], components[2], components[3], components[4], components[5], components[6], components[7] };
+	}
+};
+
+void CopyTransforms(SQTStreams dst, SQTStreams src, uint32_t count)
+{
+	float* const dstComponents[8] = { dst.qx, dst.qy, dst.qz, dst.qw, dst.tx, dst.ty, dst.tz, dst.s };
+	const float* const srcComponents[8] = { src.qx, src.qy, src.qz, src.qw, src.tx, src.ty, src.tz, src.s };
+	for (uint32_t c = 0; c < 8; c++)
+	{
+		memcpy(dstComponents[c], srcComponents[c], count * sizeof(float));
+	}
+}
+
+// Identity-filled scratch, so unused lanes stay finite
+SQTScratch IdentityScratch()
+{
+	SQTScratch scratch = {};
+	for (uint32_t i = 0; i < SQTBatch::width; i++)
+	{
+		scratch.components[3][i] = 1.0f;
+		scratch.components[7][i] = 1.0f;
+	}
+	return scratch;
+}
+
+SQTStreams Offset(SQTStreams streams, uint32_t first)
+{
+	return { streams.qx + first, streams.qy + first, streams.qz + first, streams.qw + first,
+			 streams.tx + first, streams.ty + first, streams.tz + first, streams.s + first };
+}
+
+void Run(SQTKernel kernel, SQTStreams out, SQTStreams a, SQTStreams b, float t, uint32_t count, bool readsB)
+{
+	const uint32_t numGroups = count / SQTBatch::width;
+	if (numGroups > 0)
+	{
+		kernel(out, a, b, t, numGroups);
+	}
+
+	const uint32_t first = numGroups * SQTBatch::width;
+	const uint32_t tail = count - first;
+	if (tail > 0)
+	{
+		SQTScratch scratchA = IdentityScratch();
+		SQTScratch scratchB = IdentityScratch();
+		SQTScratch scratchOut = {};
+		CopyTransforms(scratchA.Streams(), Offset(a, first), tail);
+		if (readsB)
+		{
+			CopyTransforms(scratchB.Streams(), Offset(b, first), tail);
+		}
+
+		kernel(scratchOut.Streams(), scratchA.Streams(), scratchB.Streams(), t, 1);
+		CopyTransforms(Offset(out, first), scratchOut.Streams(), tail);
+	}
+}
+
+// Quaternion-only kernels leave translation & scale alone; copy those lanes through so partial groups don't clobber them
+void RunQuats(SQTKernel kernel, SQTStreams out, SQTStreams a, SQTStreams b, uint32_t count, bool readsB)
+{
+	const uint32_t numGroups = count / SQTBatch::width;
+	if (numGroups > 0)
+	{
+		kernel(out, a, b, 0.0f, numGroups);
+	}
+
+	const uint32_t first = numGroups * SQTBatch::width;
+	const uint32_t tail = count - first;
+	if (tail > 0)
+	{
+		SQTScratch scratchA = IdentityScratch();
+		SQTScratch scratchB = IdentityScratch();
+		CopyTransforms(scratchA.Streams(), Offset(a, first), tail);
+		if (readsB)
+		{
+			CopyTransforms(scratchB.Streams(), Offset(b, first), tail);
+		}
+
+		kernel(scratchA.Streams(), scratchA.Streams(), scratchB.Streams(), 0.0f, 1);
+		const SQTStreams src = scratchA.Streams();
+		const SQTStreams dst = Offset(out, first);
+		memcpy(dst.qx, src.qx, tail * sizeof(float));
+		memcpy(dst.qy, src.qy, tail * sizeof(float));
+		memcpy(dst.qz, src.qz, tail * sizeof(float));
+		memcpy(dst.qw, src.qw, tail * sizeof(float));
+	}
+}
+
+void SQTBatch::MultiplyQuats(SQTStreams out, SQTStreams a, SQTStreams b, uint32_t count)
+{
+	RunQuats(Kernels().multiplyQuats, out, a, b, count, true);
+}
+
+void SQTBatch::NormalizeQuats(SQTStreams inout, uint32_t count)
+{
+	RunQuats(Kernels().normalizeQuats, inout, inout, inout, count, false);
+}
+
+void SQTBatch::Compose(SQTStreams out, SQTStreams parent, SQTStreams local, uint32_t count)
+{
+	Run(Kernels().compose, out, parent, local, 0.0f, count, true);
+}
+
+void SQTBatch::Invert(SQTStreams out, SQTStreams in, uint32_t count)
+{
+	Run(Kernels().invert, out, in, in, 0.0f, count, false);
+}
+
+void SQTBatch::ToMatrices(DirectX::XMFLOAT4X4* out, SQTStreams in, uint32_t count)
+{
+	const uint32_t numGroups = count / width;
+	if (numGroups > 0)
+	{
+		Kernels().toMatrices(out, in, numGroups);
+	}
+
+	const uint32_t first = numGroups * width;
+	const uint32_t tail = count - first;
+	if (tail > 0)
+	{
+		SQTScratch scratch = IdentityScratch();
+		CopyTransforms(scratch.Streams(), Offset(in, first), tail);
+
+		DirectX::XMFLOAT4X4 matrices[width];
+		Kernels().toMatrices(matrices, scratch.Streams(), 1);
+		memcpy(out + first, matrices, tail * sizeof(DirectX::XMFLOAT4X4));
+	}
+}
+
+void SQTBatch::Nlerp(SQTStreams out, SQTStreams a, SQTStreams b, float t, uint32_t count)
+{
+	Run(Kernels().nlerp, out, a, b, t, count, true);
+}
+
+void SQTBatch::Slerp(SQTStreams out, SQTStreams a, SQTStreams b, float t, uint32_t count)
+{
+	Run(Kernels().slerp, out, a, b, t, count, true);
+}
+
+bool SQTBatch::UsingAVX2()
+{
+	return &Kernels() == &avx2_kernels;
+}
+
+void SQTBatch::ForceSSE(bool force)
+{
+	forceSSE = force;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "TransformStore.h"
+
+// Batched SQT math over structure-of-arrays transforms, eight at a time
+// Kernels come in AVX2 (8 lanes, FMA) & SSE (2x4 lanes) builds; the AVX2 build is picked at startup when the CPU & OS support it
+// Any count is accepted; partial groups at the end are run through a scratch block, so nothing past [count] is ever read or written
+// Outputs may alias inputs
+
+// Pointers to the eight component streams of a run of transforms (see TransformStreams); lets kernels run on any run, or on scratch storage
+struct SQTStreams
+{
+	float* qx;
+	float* qy;
+	float* qz;
+	float* qw;
+	float* tx;
+	float* ty;
+	float* tz;
+	float* s;
+
+	static SQTStreams Of(TransformStreams& streams, uint32_t first = 0);
+};
+
+class SQTBatch
+{
+	public:
+		static constexpr uint32_t width = 8;
+
+		// Rotations only; [out.q] = [a.q] * [b.q] (Hamilton product; rotates by [b] first, like XMQuaternionMultiply(b, a))
+		static void MultiplyQuats(SQTStreams out, SQTStreams a, SQTStreams b, uint32_t count);
+		static void NormalizeQuats(SQTStreams inout, uint32_t count);
+
+		// [out] = [parent] applied after [local]; scales are uniform, so this is exact
+		static void Compose(SQTStreams out, SQTStreams parent, SQTStreams local, uint32_t count);
+
+		// Expects unit quaternions & non-zero scales
+		static void Invert(SQTStreams out, SQTStreams in, uint32_t count);
+
+		// Row-vector matrices (scale * rotation * translation), matching XMMatrixAffineTransformation()
+		static void ToMatrices(DirectX::XMFLOAT4X4* out, SQTStreams in, uint32_t count);
+
+		// Blends from [a] (t = 0) to [b] (t = 1), taking the shorter arc; translation & scale are lerped
+		// Nlerp is cheaper but speeds up mid-blend; Slerp holds constant angular velocity (falling back to nlerp for nearly-equal rotations)
+		static void Nlerp(SQTStreams out, SQTStreams a, SQTStreams b, float t, uint32_t count);
+		static void Slerp(SQTStreams out, SQTStreams a, SQTStreams b, float t, uint32_t count);
+
+		static bool UsingAVX2();
+
+		// Routes every call through the SSE kernels, even on AVX2 machines; lets tests & benchmarks compare the two builds
+		// Main thread only, & not while any batch is running
+		static void ForceSSE(bool force);
+};
@@ -0,0 +1,25 @@
+#include "SQTKernels.h"
+#include <immintrin.h>
+
+// AVX2 + FMA lanes; this file alone is built with /arch:AVX2, & SQTBatch only calls into it after checking the CPU supports it
+// (nothing here may run, or be inlined into code that runs, before that check)
+struct AVX2Lanes
+{
+	__m256 v;
+	static constexpr uint32_t width = 8;
+};
+
+template<> inline AVX2Lanes Load<AVX2Lanes>(const float* src) { return { _mm256_loadu_ps(src) }; }
+template<> inline AVX2Lanes Splat<AVX2Lanes>(float x) { return { _mm256_set1_ps(x) }; }
+inline void Store(float* dst, AVX2Lanes a) { _mm256_storeu_ps(dst, a.v); }
+inline AVX2Lanes operator+(AVX2Lanes a, AVX2Lanes b) { return { _mm256_add_ps(a.v, b.v) }; }
+inline AVX2Lanes operator-(AVX2Lanes a, AVX2Lanes b) { return { _mm256_sub_ps(a.v, b.v) }; }
+inline AVX2Lanes operator*(AVX2Lanes a, AVX2Lanes b) { return { _mm256_mul_ps(a.v, b.v) }; }
+inline AVX2Lanes MulAdd(AVX2Lanes a, AVX2Lanes b, AVX2Lanes c) { return { _mm256_fmadd_ps(a.v, b.v, c.v) }; }
+inline AVX2Lanes Div(AVX2Lanes a, AVX2Lanes b) { return { _mm256_div_ps(a.v, b.v) }; }
+inline AVX2Lanes Sqrt(AVX2Lanes a) { return { _mm256_sqrt_ps(a.v) }; }
+inline AVX2Lanes Negate(AVX2Lanes a) { return { _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)) }; }
+inline AVX2Lanes Greater(AVX2Lanes a, AVX2Lanes b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+inline AVX2Lanes Select(AVX2Lanes mask, AVX2Lanes a, AVX2Lanes b) { return { _mm256_blendv_ps(a.v, b.v, mask.v) }; }
+
+const SQTKernelTable avx2_kernels = MakeKernelTable<AVX2Lanes>();
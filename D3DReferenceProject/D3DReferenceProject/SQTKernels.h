@@ -0,0 +1,308 @@
+#pragma once
+
+#include "SQTBatch.h"
+
+// Kernel bodies shared by the SSE & AVX2 builds of SQTBatch; only SQTBatch.cpp & SQTBatch_AVX2.cpp should include this
+// Each build defines a lane type [V] (with a static [width]), specializes Load<V>() & Splat<V>() for it, & defines these operations on it:
+// Store(float*, V), V + V, V - V, V * V, MulAdd(a, b, c) (a * b + c), Div(a, b), Sqrt(v), Negate(v),
+// Greater(a, b) (lane mask), Select(mask, a, b) (b where the mask is set, a elsewhere)
+// Kernels work on whole groups of SQTBatch::width transforms; SQTBatch handles partial groups
+
+// Every kernel takes the same arguments, so the dispatcher can treat them uniformly; unused ones are ignored
+typedef void(*SQTKernel)(SQTStreams out, SQTStreams a, SQTStreams b, float t, uint32_t numGroups);
+typedef void(*SQTMatrixKernel)(DirectX::XMFLOAT4X4* out, SQTStreams in, uint32_t numGroups);
+
+struct SQTKernelTable
+{
+	SQTKernel multiplyQuats;
+	SQTKernel normalizeQuats;
+	SQTKernel compose;
+	SQTKernel invert;
+	SQTKernel nlerp;
+	SQTKernel slerp;
+	SQTMatrixKernel toMatrices;
+};
+
+extern const SQTKernelTable sse_kernels;
+extern const SQTKernelTable avx2_kernels;
+
+// Unaligned load of [V::width] floats, & one float broadcast to every lane
+template<typename V> V Load(const float* src);
+template<typename V> V Splat(float x);
+
+template<typename V>
+struct QuatLanes
+{
+	V x, y, z, w;
+};
+
+template<typename V>
+struct Vec3Lanes
+{
+	V x, y, z;
+};
+
+template<typename V>
+QuatLanes<V> LoadQuats(const SQTStreams& in, uint32_t i)
+{
+	return { Load<V>(in.qx + i), Load<V>(in.qy + i), Load<V>(in.qz + i), Load<V>(in.qw + i) };
+}
+
+template<typename V>
+void StoreQuats(const SQTStreams& out, uint32_t i, const QuatLanes<V>& q)
+{
+	Store(out.qx + i, q.x);
+	Store(out.qy + i, q.y);
+	Store(out.qz + i, q.z);
+	Store(out.qw + i, q.w);
+}
+
+template<typename V>
+Vec3Lanes<V> LoadTranslations(const SQTStreams& in, uint32_t i)
+{
+	return { Load<V>(in.tx + i), Load<V>(in.ty + i), Load<V>(in.tz + i) };
+}
+
+template<typename V>
+void StoreTranslations(const SQTStreams& out, uint32_t i, const Vec3Lanes<V>& t)
+{
+	Store(out.tx + i, t.x);
+	Store(out.ty + i, t.y);
+	Store(out.tz + i, t.z);
+}
+
+template<typename V>
+QuatLanes<V> QuatMul(const QuatLanes<V>& a, const QuatLanes<V>& b)
+{
+	QuatLanes<V> r;
+	r.x = MulAdd(a.w, b.x, MulAdd(a.x, b.w, (a.y * b.z) - (a.z * b.y)));
+	r.y = MulAdd(a.w, b.y, MulAdd(a.y, b.w, (a.z * b.x) - (a.x * b.z)));
+	r.z = MulAdd(a.w, b.z, MulAdd(a.z, b.w, (a.x * b.y) - (a.y * b.x)));
+	r.w = (a.w * b.w) - MulAdd(a.x, b.x, MulAdd(a.y, b.y, a.z * b.z));
+	return r;
+}
+
+template<typename V>
+QuatLanes<V> QuatNormalize(const QuatLanes<V>& q)
+{
+	const V lenSq = MulAdd(q.x, q.x, MulAdd(q.y, q.y, MulAdd(q.z, q.z, q.w * q.w)));
+	const V invLen = Div(Splat<V>(1.0f), Sqrt(lenSq));
+	return { q.x * invLen, q.y * invLen, q.z * invLen, q.w * invLen };
+}
+
+// v + 2 * cross(q.xyz, cross(q.xyz, v) + q.w * v); same form as the vertex shader's
+template<typename V>
+Vec3Lanes<V> QuatRotate(const QuatLanes<V>& q, const Vec3Lanes<V>& v)
+{
+	const V cx = MulAdd(q.w, v.x, (q.y * v.z) - (q.z * v.y));
+	const V cy = MulAdd(q.w, v.y, (q.z * v.x) - (q.x * v.z));
+	const V cz = MulAdd(q.w, v.z, (q.x * v.y) - (q.y * v.x));
+
+	const V two = Splat<V>(2.0f);
+	return { MulAdd(two, (q.y * cz) - (q.z * cy), v.x),
+			 MulAdd(two, (q.z * cx) - (q.x * cz), v.y),
+			 MulAdd(two, (q.x * cy) - (q.y * cx), v.z) };
+}
+
+template<typename V>
+V Lerp(V a, V b, V t)
+{
+	return MulAdd(t, b - a, a);
+}
+
+template<typename V>
+void MultiplyQuatsKernel(SQTStreams out, SQTStreams a, SQTStreams b, float, uint32_t numGroups)
+{
+	for (uint32_t i = 0; i < numGroups * SQTBatch::width; i += V::width)
+	{
+		StoreQuats(out, i, QuatMul(LoadQuats<V>(a, i), LoadQuats<V>(b, i)));
+	}
+}
+
+template<typename V>
+void NormalizeQuatsKernel(SQTStreams out, SQTStreams a, SQTStreams, float, uint32_t numGroups)
+{
+	for (uint32_t i = 0; i < numGroups * SQTBatch::width; i += V::width)
+	{
+		StoreQuats(out, i, QuatNormalize(LoadQuats<V>(a, i)));
+	}
+}
+
+template<typename V>
+void ComposeKernel(SQTStreams out, SQTStreams parent, SQTStreams local, float, uint32_t numGroups)
+{
+	for (uint32_t i = 0; i < numGroups * SQTBatch::width; i += V::width)
+	{
+		const QuatLanes<V> pq = LoadQuats<V>(parent, i);
+		const QuatLanes<V> lq = LoadQuats<V>(local, i);
+		const V ps = Load<V>(parent.s + i);
+		const V ls = Load<V>(local.s + i);
+		const Vec3Lanes<V> pt = LoadTranslations<V>(parent, i);
+		const Vec3Lanes<V> lt = LoadTranslations<V>(local, i);
+
+		// Local translation is scaled & rotated into the parent's space, then offset by the parent's translation
+		const Vec3Lanes<V> rotated = QuatRotate(pq, Vec3Lanes<V>{ lt.x * ps, lt.y * ps, lt.z * ps });
+		StoreTranslations(out, i, Vec3Lanes<V>{ rotated.x + pt.x, rotated.y + pt.y, rotated.z + pt.z });
+		StoreQuats(out, i, QuatMul(pq, lq));
+		Store(out.s + i, ps * ls);
+	}
+}
+
+template<typename V>
+void InvertKernel(SQTStreams out, SQTStreams in, SQTStreams, float, uint32_t numGroups)
+{
+	for (uint32_t i = 0; i < numGroups * SQTBatch::width; i += V::width)
+	{
+		const QuatLanes<V> q = LoadQuats<V>(in, i);
+		const QuatLanes<V> conj = { Negate(q.x), Negate(q.y), Negate(q.z), q.w };
+		const V invScale = Div(Splat<V>(1.0f), Load<V>(in.s + i));
+
+		// Undo translation, then rotation, then scale
+		const Vec3Lanes<V> t = QuatRotate(conj, LoadTranslations<V>(in, i));
+		StoreTranslations(out, i, Vec3Lanes<V>{ Negate(t.x * invScale), Negate(t.y * invScale), Negate(t.z * invScale) });
+		StoreQuats(out, i, conj);
+		Store(out.s + i, invScale);
+	}
+}
+
+template<typename V>
+void ToMatricesKernel(DirectX::XMFLOAT4X4* out, SQTStreams in, uint32_t numGroups)
+{
+	for (uint32_t i = 0; i < numGroups * SQTBatch::width; i += V::width)
+	{
+		const QuatLanes<V> q = LoadQuats<V>(in, i);
+		const V s = Load<V>(in.s + i);
+		const V two = Splat<V>(2.0f);
+		const V one = Splat<V>(1.0f);
+
+		const V xx = two * q.x * q.x, yy = two * q.y * q.y, zz = two * q.z * q.z;
+		const V xy = two * q.x * q.y, xz = two * q.x * q.z, yz = two * q.y * q.z;
+		const V wx = two * q.w * q.x, wy = two * q.w * q.y, wz = two * q.w * q.z;
+
+		// Rows of the scaled rotation, then the translation row
+		alignas(32) float rows[12][V::width];
+		Store(rows[0], (one - (yy + zz)) * s);
+		Store(rows[1], (xy + wz) * s);
+		Store(rows[2], (xz - wy) * s);
+		Store(rows[3], (xy - wz) * s);
+		Store(rows[4], (one - (xx + zz)) * s);
+		Store(rows[5], (yz + wx) * s);
+		Store(rows[6], (xz + wy) * s);
+		Store(rows[7], (yz - wx) * s);
+		Store(rows[8], (one - (xx + yy)) * s);
+		Store(rows[9], Load<V>(in.tx + i));
+		Store(rows[10], Load<V>(in.ty + i));
+		Store(rows[11], Load<V>(in.tz + i));
+
+		// Matrices are AoS, so lanes are written out one at a time
+		for (uint32_t lane = 0; lane < V::width; lane++)
+		{
+			DirectX::XMFLOAT4X4& m = out[i + lane];
+			for (uint32_t r = 0; r < 4; r++)
+			{
+				m.m[r][0] = rows[(r * 3) + 0][lane];
+				m.m[r][1] = rows[(r * 3) + 1][lane];
+				m.m[r][2] = rows[(r * 3) + 2][lane];
+				m.m[r][3] = (r == 3) ? 1.0f : 0.0f;
+			}
+		}
+	}
+}
+
+// Flips [b] onto [a]'s hemisphere, so blends take the shorter arc; returns the (now non-negative) cosine between them
+template<typename V>
+V AlignHemisphere(const QuatLanes<V>& a, QuatLanes<V>& b)
+{
+	const V d = MulAdd(a.x, b.x, MulAdd(a.y, b.y, MulAdd(a.z, b.z, a.w * b.w)));
+	const V flip = Greater(Splat<V>(0.0f), d);
+	b.x = Select(flip, b.x, Negate(b.x));
+	b.y = Select(flip, b.y, Negate(b.y));
+	b.z = Select(flip, b.z, Negate(b.z));
+	b.w = Select(flip, b.w, Negate(b.w));
+	return Select(flip, d, Negate(d));
+}
+
+template<typename V>
+void BlendTranslationScale(const SQTStreams& out, const SQTStreams& a, const SQTStreams& b, uint32_t i, V t)
+{
+	Store(out.tx + i, Lerp(Load<V>(a.tx + i), Load<V>(b.tx + i), t));
+	Store(out.ty + i, Lerp(Load<V>(a.ty + i), Load<V>(b.ty + i), t));
+	Store(out.tz + i, Lerp(Load<V>(a.tz + i), Load<V>(b.tz + i), t));
+	Store(out.s + i, Lerp(Load<V>(a.s + i), Load<V>(b.s + i), t));
+}
+
+template<typename V>
+void NlerpKernel(SQTStreams out, SQTStreams a, SQTStreams b, float t, uint32_t numGroups)
+{
+	const V tv = Splat<V>(t);
+	for (uint32_t i = 0; i < numGroups * SQTBatch::width; i += V::width)
+	{
+		const QuatLanes<V> qa = LoadQuats<V>(a, i);
+		QuatLanes<V> qb = LoadQuats<V>(b, i);
+		AlignHemisphere(qa, qb);
+
+		const QuatLanes<V> q = { Lerp(qa.x, qb.x, tv), Lerp(qa.y, qb.y, tv), Lerp(qa.z, qb.z, tv), Lerp(qa.w, qb.w, tv) };
+		StoreQuats(out, i, QuatNormalize(q));
+		BlendTranslationScale(out, a, b, i, tv);
+	}
+}
+
+// acos() on [0, 1]; Abramowitz & Stegun 4.4.46, |error| <= 2e-8
+template<typename V>
+V ACosUnit(V x)
+{
+	V p = Splat<V>(-0.0012624911f);
+	p = MulAdd(p, x, Splat<V>(0.0066700901f));
+	p = MulAdd(p, x, Splat<V>(-0.0170881256f));
+	p = MulAdd(p, x, Splat<V>(0.0308918810f));
+	p = MulAdd(p, x, Splat<V>(-0.0501743046f));
+	p = MulAdd(p, x, Splat<V>(0.0889789874f));
+	p = MulAdd(p, x, Splat<V>(-0.2145988016f));
+	p = MulAdd(p, x, Splat<V>(1.5707963050f));
+	return Sqrt(Splat<V>(1.0f) - x) * p;
+}
+
+// sin() on [0, pi/2]; Taylor series to x^11, |error| < 6e-8 over that range
+template<typename V>
+V SinHalfPi(V x)
+{
+	const V x2 = x * x;
+	V p = Splat<V>(-1.0f / 39916800.0f);
+	p = MulAdd(p, x2, Splat<V>(1.0f / 362880.0f));
+	p = MulAdd(p, x2, Splat<V>(-1.0f / 5040.0f));
+	p = MulAdd(p, x2, Splat<V>(1.0f / 120.0f));
+	p = MulAdd(p, x2, Splat<V>(-1.0f / 6.0f));
+	p = MulAdd(p, x2, Splat<V>(1.0f));
+	return x * p;
+}
+
+template<typename V>
+void SlerpKernel(SQTStreams out, SQTStreams a, SQTStreams b, float t, uint32_t numGroups)
+{
+	const V tv = Splat<V>(t);
+	const V one = Splat<V>(1.0f);
+	for (uint32_t i = 0; i < numGroups * SQTBatch::width; i += V::width)
+	{
+		const QuatLanes<V> qa = LoadQuats<V>(a, i);
+		QuatLanes<V> qb = LoadQuats<V>(b, i);
+		const V d = AlignHemisphere(qa, qb);
+
+		// Shorter arc means theta <= pi/2, so both sines stay in range; nearly-equal rotations would divide by ~0, so they lerp instead
+		const V theta = ACosUnit(d);
+		const V invSinTheta = Div(one, Sqrt(one - (d * d)));
+		const V nearlyEqual = Greater(d, Splat<V>(0.9995f));
+		const V wa = Select(nearlyEqual, SinHalfPi((one - tv) * theta) * invSinTheta, one - tv);
+		const V wb = Select(nearlyEqual, SinHalfPi(tv * theta) * invSinTheta, tv);
+
+		// Renormalized either way; exact slerp results barely move, lerped ones need it
+		const QuatLanes<V> q = { MulAdd(wa, qa.x, wb * qb.x), MulAdd(wa, qa.y, wb * qb.y), MulAdd(wa, qa.z, wb * qb.z), MulAdd(wa, qa.w, wb * qb.w) };
+		StoreQuats(out, i, QuatNormalize(q));
+		BlendTranslationScale(out, a, b, i, tv);
+	}
+}
+
+template<typename V>
+constexpr SQTKernelTable MakeKernelTable()
+{
+	return { MultiplyQuatsKernel<V>, NormalizeQuatsKernel<V>, ComposeKernel<V>, InvertKernel<V>, NlerpKernel<V>, SlerpKernel<V>, ToMatricesKernel<V> };
+}
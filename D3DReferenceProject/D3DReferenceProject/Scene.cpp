@@ -1,6 +1,9 @@
 #include "Scene.h"
 #include "Memory.h"
 #include "D3DResource.h"
+#include "Profiler.h"
+#include <cstring>
+#include <cmath>
 
 const uint32_t maxNumVts = 1048576;
 Vertex3D* modelVts = {};
@@ -11,21 +14,110 @@ uint32_t numVts = 0;
 
 Scene::Scene()
 {
-	modelVts = Memory::AllocateArray<Vertex3D>(maxNumVts);
+	// ~48MB, walked linearly during loading & randomly during dedup/remapping in BakeModels(); prefer huge pages so those walks don't thrash the TLB
+	PAGE_BACKING backing = PAGE_BACKING::STANDARD;
+	modelVts = Memory::AllocateLargeArray<Vertex3D>(maxNumVts, &backing, 4, MEM_TAGS::SCENE);
+
+	const char* backingNames[] = { "Scene vertex pool backed by 4KB pages\n", "Scene vertex pool backed by transparent huge pages\n", "Scene vertex pool backed by pinned huge pages\n" };
+	OutputDebugStringA(backingNames[static_cast<uint32_t>(backing)]);
 	//modelNdces = Memory::AllocateArray<uint32_t>(maxNumVts);
+
+	modelBounds.Init(maxNumModels, maxNumModels * 2, 1.0f, MEM_TAGS::SCENE);
+}
+
+// Sphere around the vertices' bounding box; not minimal, but one pass & good enough for queries
+DirectX::XMFLOAT4 BoundingSphere(const Vertex3D* vts, uint32_t numVts)
+{
+	if (numVts == 0)
+	{
+		return DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+	}
+
+	float lo[3] = { vts[0].pos.x, vts[0].pos.y, vts[0].pos.z };
+	float hi[3] = { lo[0], lo[1], lo[2] };
+	for (uint32_t i = 1; i < numVts; i++)
+	{
+		const float p[3] = { vts[i].pos.x, vts[i].pos.y, vts[i].pos.z };
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			lo[axis] = (p[axis] < lo[axis]) ? p[axis] : lo[axis];
+			hi[axis] = (p[axis] > hi[axis]) ? p[axis] : hi[axis];
+		}
+	}
+
+	const float c[3] = { (lo[0] + hi[0]) * 0.5f, (lo[1] + hi[1]) * 0.5f, (lo[2] + hi[2]) * 0.5f };
+	float radiusSq = 0.0f;
+	for (uint32_t i = 0; i < numVts; i++)
+	{
+		const float dx = vts[i].pos.x - c[0];
+		const float dy = vts[i].pos.y - c[1];
+		const float dz = vts[i].pos.z - c[2];
+		const float distSq = (dx * dx) + (dy * dy) + (dz * dz);
+		radiusSq = (distSq > radiusSq) ? distSq : radiusSq;
+	}
+	return DirectX::XMFLOAT4(c[0], c[1], c[2], sqrtf(radiusSq));
 }
 
-void Scene::AddModel(const char* path)
+uint16_t Scene::AddModel(const char* path, const SQT_Transform& transform, uint16_t parent)
 {
+	assert(("Too many models for one scene", currNumModels < maxNumModels));
+	Model& model = models[currNumModels];
+
+	// Known path; just another instance
+	const uint64_t pathHash = HashBytes(path, strlen(path));
+	for (uint16_t i = 0; i < currNumMeshPaths; i++)
+	{
+		if (meshPaths[i].pathHash == pathHash)
+		{
+			model.meshID = meshPaths[i].meshID;
+			hierarchy.AddNode(currNumModels, parent, transform);
+			return currNumModels++;
+		}
+	}
+
+	// New path; load it past the end of the vertex pool, then check whether the same geometry is already there under another name
 	uint32_t numVtsLoaded = 0;
-	models[currNumModels].Init(path, modelVts, numVts, &numVtsLoaded, maxNumVts - numVts);
-	numVts += numVtsLoaded;
+	model.Init(path, modelVts, numVts, &numVtsLoaded, maxNumVts - numVts);
+	const uint64_t contentHash = HashBytes(modelVts + numVts, numVtsLoaded * sizeof(Vertex3D));
+
+	uint16_t meshID = currNumMeshes;
+	for (uint16_t i = 0; i < currNumMeshes; i++)
+	{
+		// The hash only narrows things down; both copies are right here, so confirm byte-for-byte rather than risk drawing the wrong mesh
+		if (meshes[i].contentHash == contentHash && meshes[i].numVertices == numVtsLoaded &&
+			memcmp(modelVts + meshes[i].firstVertex, modelVts + numVts, numVtsLoaded * sizeof(Vertex3D)) == 0)
+		{
+			meshID = i; // Duplicate; leave [numVts] where it was, so the copy we just loaded gets overwritten
+			break;
+		}
+	}
+
+	if (meshID == currNumMeshes)
+	{
+		assert(("Too many unique meshes for one scene", currNumMeshes < maxNumMeshes));
+		meshes[meshID].contentHash = contentHash;
+		meshes[meshID].firstVertex = numVts;
+		meshes[meshID].numVertices = numVtsLoaded;
+		meshes[meshID].bounds = BoundingSphere(modelVts + numVts, numVtsLoaded);
+		numVts += numVtsLoaded;
+		currNumMeshes++;
+	}
+
+	meshPaths[currNumMeshPaths].pathHash = pathHash;
+	meshPaths[currNumMeshPaths].meshID = meshID;
+	currNumMeshPaths++;
+
+	model.meshID = meshID;
+	hierarchy.AddNode(currNumModels, parent, transform);
+	return currNumModels++;
 }
 
 void Scene::BakeModels(bool deduplicate)
 {
+	PROFILE_FUNCTION();
+
 	// Generate index buffer
-	uint32_t* modelNdces = Memory::AllocateArray<uint32_t>(maxNumVts);
+	uint32_t* modelNdces = Memory::AllocateLargeArray<uint32_t>(maxNumVts, nullptr, 4, MEM_TAGS::SCENE);
 	uint32_t numNdces = numVts;
 
 	// Seems likely but not certain that objs are pre-indexed
@@ -116,6 +208,13 @@ void Scene::BakeModels(bool deduplicate)
 	numVts = numTestVts;
 #endif
 
+#ifdef LOG_INDICES
+	// Index text is batched & printed a few KB at a time; one debug-output call per index crawls on real meshes
+	const uint32_t logTextLen = 4096;
+	char logText[logTextLen] = {};
+	uint32_t logTextUsed = 0;
+#endif
+
 	// 24 vertices before indexing, 16 after
 	uint32_t uniqueNdxCounter = 0;
 	for (uint32_t i = 0; i < numVts; i++)
@@ -180,11 +279,25 @@ void Scene::BakeModels(bool deduplicate)
 			terminatorOffs += 1;
 		}
 
-		// Append null terminator, print
-		OutputDebugStringA(output);
+		// Append to the batch, printing it first if it's full
+		const uint32_t outputLen = textBufUsedLen + terminatorOffs;
+		if (logTextUsed + outputLen >= logTextLen)
+		{
+			OutputDebugStringA(logText);
+			logTextUsed = 0;
+		}
+		memcpy(logText + logTextUsed, output, outputLen + 1); // Null terminator included
+		logTextUsed += outputLen;
 #endif
 	}
 
+#ifdef LOG_INDICES
+	if (logTextUsed > 0)
+	{
+		OutputDebugStringA(logText);
+	}
+#endif
+
 #ifdef INDEXATION_DEBUG_VERTS
 	// Indexation with fake verts invalidates the rest of this block - halt here
 	// Technique for messages in assertions found here ^_^
@@ -203,30 +316,71 @@ void Scene::BakeModels(bool deduplicate)
 
 	// Reduce [modelVts] to match index buffer
 	// (loan a copy of the buffer from our allocator, feed in verts corresponding to values in the index buffer, copy the buffer back over [modelVts], return the loan)
-	Vertex3D* tmpVts = Memory::AllocateArray<Vertex3D>(maxNumVts);
+	Vertex3D* tmpVts = Memory::AllocateLargeArray<Vertex3D>(maxNumVts, nullptr, 4, MEM_TAGS::SCENE);
 	for (uint32_t i = 0; i < numNdces; i++)
 	{
-		tmpVts[modelNdces[i]] = modelVts[modelNdces[i]];
+		tmpVts[modelNdces[i]] = modelVts[i];
 	}
 
 	// Could zero modelVts here, but expensive and no reason since the excess data won't be used
 
 	// Copy tmpVts back over modelVts
-	memcpy(modelVts, tmpVts, sizeof(Vertex3D) * numNdces);
+	memcpy(modelVts, tmpVts, sizeof(Vertex3D) * uniqueNdxCounter);
 	Memory::FreeToAddress(tmpVts);
-	Memory::FreeToAddress(modelNdces);
+	Memory::FreeToAddress(modelNdces, true); // Index + remap scratch are ~50MB together, hand those pages back once baking finishes
 
 	// Generate vertex buffer
 	D3DResource<RESOURCE_TYPES::BUFFER> vbuffer;
 	D3DResource<RESOURCE_TYPES::BUFFER>::D3DResourceDesc vbDesc;
-	vbDesc.elts_per_axis[0] = numNdces;
+	vbDesc.elts_per_axis[0] = uniqueNdxCounter;
 	vbDesc.init_data = modelVts;
-	vbDesc.data_footprint_bytes = numNdces * sizeof(Vertex3D);
+	vbDesc.data_footprint_bytes = uniqueNdxCounter * sizeof(Vertex3D);
 	vbDesc.fmt = DXGI_FORMAT_UNKNOWN;
 	vbuffer.Init(vbDesc, RESRC_ACCESS_TYPES::GPU_ONLY, VERTEX);
 	sceneMeshData_vbuffer = vbuffer.resource_handle;
 }
 
+void Scene::SetModelTransform(uint16_t modelID, const SQT_Transform& transform)
+{
+	assert(("No model with that ID in this scene", modelID < currNumModels));
+	hierarchy.SetLocal(modelID, transform);
+}
+
+// Moves the bounds of every model whose transform changed in [published]
+void Scene::UpdateModelBounds(const FrameSnapshot& published)
+{
+	const TransformStreams& streams = published.transforms;
+	for (uint16_t i = 0; i < currNumModels; i++)
+	{
+		if (published.transformChangedEpochs[i] != published.transformEpoch)
+		{
+			continue;
+		}
+
+		// Local center through the model's SQT: scale, rotate (v + 2 * cross(q.xyz, cross(q.xyz, v) + q.w * v)), translate
+		const DirectX::XMFLOAT4& local = meshes[models[i].meshID].bounds;
+		const float s = streams.s[i];
+		const float v[3] = { local.x * s, local.y * s, local.z * s };
+		const float q[4] = { streams.qx[i], streams.qy[i], streams.qz[i], streams.qw[i] };
+		const float c[3] = { (q[1] * v[2]) - (q[2] * v[1]) + (q[3] * v[0]),
+							 (q[2] * v[0]) - (q[0] * v[2]) + (q[3] * v[1]),
+							 (q[0] * v[1]) - (q[1] * v[0]) + (q[3] * v[2]) };
+		const DirectX::XMFLOAT3 center = { v[0] + 2.0f * ((q[1] * c[2]) - (q[2] * c[1])) + streams.tx[i],
+										   v[1] + 2.0f * ((q[2] * c[0]) - (q[0] * c[2])) + streams.ty[i],
+										   v[2] + 2.0f * ((q[0] * c[1]) - (q[1] * c[0])) + streams.tz[i] };
+		const float radius = local.w * fabsf(s);
+
+		if (modelBounds.Contains(i))
+		{
+			modelBounds.Move(i, center, radius);
+		}
+		else
+		{
+			modelBounds.Insert(i, center, radius);
+		}
+	}
+}
+
 void Scene::Update()
 {
 }
@@ -235,6 +389,48 @@ void Scene::PlayerLook()
 {
 }
 
+void Scene::WriteSnapshot(FrameSnapshot& out)
+{
+	out.camera = playerCamera;
+	out.numModels = currNumModels;
+	hierarchy.Propagate(transforms);
+	out.transformEpoch = transforms.Publish(out.transforms, out.transformChangedEpochs, currNumModels);
+	UpdateModelBounds(out);
+
+	// No culling yet; everything is visible
+	// Counting-sort models by mesh, so each mesh's instances are contiguous & make one batch
+	uint16_t meshCounts[maxNumMeshes] = {};
+	for (uint16_t i = 0; i < currNumModels; i++)
+	{
+		meshCounts[models[i].meshID]++;
+	}
+
+	uint16_t meshOffsets[maxNumMeshes] = {};
+	uint16_t numInstances = 0;
+	out.numBatches = 0;
+	for (uint16_t i = 0; i < currNumMeshes; i++)
+	{
+		meshOffsets[i] = numInstances;
+		if (meshCounts[i] > 0)
+		{
+			// Baking indexes vertex [i] as index [i] (before de-duplication remaps it), so mesh vertex ranges are index ranges too
+			InstanceBatch& batch = out.batches[out.numBatches];
+			batch.firstIndex = meshes[i].firstVertex;
+			batch.numIndices = meshes[i].numVertices;
+			batch.firstInstance = numInstances;
+			batch.numInstances = meshCounts[i];
+			out.numBatches++;
+		}
+		numInstances += meshCounts[i];
+	}
+
+	for (uint16_t i = 0; i < currNumModels; i++)
+	{
+		out.visible[meshOffsets[models[i].meshID]++] = i;
+	}
+	out.numVisible = numInstances;
+}
+
 void Scene::GetSceneMesh(D3DHandle* out_vbuffer, D3DHandle* out_ibuffer, uint32_t* out_numIndices)
 {
 	*out_ibuffer = sceneMeshData_ibuffer;
@@ -2,35 +2,110 @@
 
 #include "Model.h"
 #include "Camera.h"
+#include "TransformHierarchy.h"
+#include "SpatialHash.h"
+
+// Immutable copy of everything the render thread needs from a scene for one frame
+// The game thread fills one in after each update & publishes it (see TripleBuffer.h); the renderer only ever reads snapshots, never the live scene
+struct FrameSnapshot
+{
+	static constexpr uint16_t maxNumModels = 256; // Matches Scene::maxNumModels
+	static constexpr uint16_t maxNumMeshes = 64; // Matches Scene::maxNumMeshes
+
+	uint64_t frameNumber = 0;
+	uint32_t sceneID = 0;
+	Camera camera = {};
+
+	uint16_t numModels = 0;
+	TransformStreams transforms = {};
+
+	// Epoch each transform last changed in; the renderer re-uploads transforms changed since the epoch it last uploaded
+	uint64_t transformEpoch = 0;
+	uint64_t transformChangedEpochs[maxNumModels] = {};
+
+	// Models to draw this frame, as indices into [transforms], grouped by mesh
+	uint16_t numVisible = 0;
+	uint16_t visible[maxNumModels] = {};
+
+	// One instanced draw per mesh with anything visible; instance [i] of the frame is model [visible[i]]
+	uint16_t numBatches = 0;
+	InstanceBatch batches[maxNumMeshes] = {};
+};
 
 class Scene
 {
 	public:
 		Scene();
-		void AddModel(const char* path);
+		// Places the model at [path]; meshes already in the scene (same path, or same contents under another path) are shared rather than loaded again
+		// [transform] is relative to [parent] (a model added earlier) when one is given, so whole assemblies move with their parent
+		// Returns the new model's ID
+		uint16_t AddModel(const char* path, const SQT_Transform& transform = { { 0.0f, 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } },
+						  uint16_t parent = TransformHierarchy::no_parent);
 		void BakeModels(bool deduplicate); // All models have been submitted, generate scene VB/IB
 
+		// Moves a placed model (relative to its parent, if it has one), along with everything attached to it
+		// Only models moved between snapshots are re-uploaded
+		void SetModelTransform(uint16_t modelID, const SQT_Transform& transform);
+
 		void Update();
 
 		void PlayerLook();
 		void PlayerMove();
 
+		// Copies camera, model transforms & the visible-model list into [out]
+		// Not const; propagates moved hierarchies first, & publishing transforms clears their dirty bits
+		void WriteSnapshot(FrameSnapshot& out);
+
 		void GetSceneMesh(D3DHandle* out_vbuffer, D3DHandle* out_ibuffer, uint32_t* out_numIndices); // Needed to pass scene mesh data over to the pipeline for rendering
 
+		// World-space model bounds, keyed by model ID; kept current as of the last WriteSnapshot()
+		const SpatialHash& ModelBounds() const { return modelBounds; }
+
 		static constexpr uint16_t maxNumModels = 256; // Any more than this and storing explicit meshes will be much slower than procedural generation on the GPU
+		static constexpr uint16_t maxNumMeshes = 64; // Unique geometry; placements of the same mesh only cost a Model each
+		static_assert(maxNumModels == FrameSnapshot::maxNumModels, "Snapshots must be able to hold every model in a scene");
+		static_assert(maxNumMeshes == FrameSnapshot::maxNumMeshes, "Snapshots must be able to batch every mesh in a scene");
+		static_assert(maxNumModels <= TransformStreams::capacity, "Every model needs a transform");
 
 	private:
 		Camera playerCamera = {};
 		bool cameraMovedSinceLastFrame = false;
 
+		// Mesh registry
+		// Each mesh is a contiguous run of [modelVts] (and of the baked index buffer, which starts out 1:1 with it)
+		struct Mesh
+		{
+			uint64_t contentHash = 0;
+			uint32_t firstVertex = 0;
+			uint32_t numVertices = 0;
+			DirectX::XMFLOAT4 bounds = {}; // Local bounding sphere; center in xyz, radius in w
+		};
+
+		// Paths already loaded, so placing the same file again never reaches the loader
+		struct MeshPath
+		{
+			uint64_t pathHash = 0;
+			uint16_t meshID = 0;
+		};
+
+		uint16_t currNumMeshes = 0;
+		Mesh meshes[maxNumMeshes] = {};
+		uint16_t currNumMeshPaths = 0;
+		MeshPath meshPaths[maxNumModels] = {};
+
 		uint16_t currNumModels = 0;
 		Model models[maxNumModels] = {};
-		bool modelsMovedSinceLastFrame[maxNumModels] = {};
+
+		// World-space model transforms, indexed like [models]; kept apart from them in SoA form, dirty-tracked for uploads (see TransformStore.h)
+		// Written by [hierarchy], which holds the local transforms users actually set
+		TransformStore transforms;
+		TransformHierarchy hierarchy;
+
+		// Re-inserted whenever a model's world transform changes
+		SpatialHash modelBounds;
+		void UpdateModelBounds(const FrameSnapshot& published);
 
 		D3DHandle sceneMeshData_vbuffer = {}; // Beeeg mesh containing all the submeshes associated with this scene
 		D3DHandle sceneMeshData_ibuffer = {};
-
-		D3DHandle transforms = {}; // CBuffer with transforms stored in SQT form (scale, quaternion, translation)
-								   // Transforms are applied during vertex shading & multiplied against the user's camera
 };
 
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "D3DUtils.h"
+#include "D3DWrapper.h"
+#include <cassert>
+
+// Draw/dispatch descriptions consumed by the pipeline (through the render graph)
+
+struct ShadingJob
+{
+	static constexpr uint32_t maxBindingsAnyType = 16;
+
+	void AddTexture(D3DHandle resrc, RESRC_VIEWS bindAs, SHADER_TYPES bindFor)
+	{
+		if ((bindAs & DEPTH_STENCIL) && hasDepthStencil)
+		{
+			assert(("No more than one depth-stencil buffer in each draw", false));
+		}
+
+		bindTexturesFor[numTextures] = bindFor;
+		textureBindings[numTextures] = bindAs;
+		textures[numTextures] = resrc;
+		numTextures++;
+
+		D3DWrapper::AddBinding(bindingTable, resrc, bindAs, bindFor);
+	}
+
+	void AddBuffer(D3DHandle resrc, RESRC_VIEWS bindAs, SHADER_TYPES bindFor)
+	{
+		bindBuffersFor[numBuffers] = bindFor;
+		bufferBindings[numBuffers] = bindAs;
+		buffers[numBuffers] = resrc;
+		numBuffers++;
+
+		D3DWrapper::AddBinding(bindingTable, resrc, bindAs, bindFor);
+	}
+
+	void AddVolume(D3DHandle resrc, RESRC_VIEWS bindAs, SHADER_TYPES bindFor)
+	{
+		bindVolumesFor[numVolumes] = bindFor;
+		volumeBindings[numVolumes] = bindAs;
+		volumes[numVolumes] = resrc;
+		numVolumes++;
+
+		D3DWrapper::AddBinding(bindingTable, resrc, bindAs, bindFor);
+	}
+
+	SHADER_TYPES bindTexturesFor[maxBindingsAnyType];
+	RESRC_VIEWS textureBindings[maxBindingsAnyType];
+	D3DHandle textures[maxBindingsAnyType];
+	uint32_t numTextures = 0;
+
+	SHADER_TYPES bindBuffersFor[maxBindingsAnyType];
+	RESRC_VIEWS bufferBindings[maxBindingsAnyType];
+	D3DHandle buffers[maxBindingsAnyType];
+	uint32_t numBuffers = 0;
+
+	SHADER_TYPES bindVolumesFor[maxBindingsAnyType];
+	RESRC_VIEWS volumeBindings[maxBindingsAnyType];
+	D3DHandle volumes[maxBindingsAnyType];
+	uint32_t numVolumes = 0;
+
+	bool hasDepthStencil = false;
+
+	// Slot tables built up as bindings are added above, so submission never has to sort/search through the arrays
+	// (those stay around for the render graph's read/write tracking)
+	BindingTable bindingTable;
+};
+
+struct DrawJob : public ShadingJob
+{
+	DrawJob() {}
+	DrawJob(const char* vs_path, const char* ps_path) : ShadingJob()
+	{
+		vs = D3DWrapper::CreateVertShader(vs_path, false);
+		ps = D3DWrapper::CreatePixelShader(ps_path);
+	}
+
+	bool is2D = false;
+	bool directToBackbuf = true; // Set if this draw writes to the back-buffer instead of an intermediate RTV
+
+	// Sorting inputs (see DrawSort.h)
+	uint16_t materialID = 0;
+	float sortDepth = 0.0f; // View-space distance, refreshed by whoever owns the draw whenever the camera or object moves
+	bool translucent = false;
+
+	// Opt-in: set for opaque draws that depth-test against their own depth buffer (and write it), so their order into shared targets can't
+	// change the image. The render graph only lets draws flagged this way share levels & reorder; every other target write (post-processing,
+	// fullscreen passes, UI, anything without a depth test) stays in declaration order
+	bool depthTestedOpaque = false;
+
+	D3DHandle vs;
+	D3DHandle ps;
+};
+
+struct DispatchJob : ShadingJob
+{
+	DispatchJob() {}
+	DispatchJob(const char* cs_path, uint32_t _dispatchX, uint32_t _dispatchY, uint32_t _dispatchZ) : dispatchX(_dispatchX), dispatchY(_dispatchY), dispatchZ(_dispatchZ)
+	{
+		cs = D3DWrapper::CreateComputeShader(cs_path);
+	}
+
+	D3DHandle cs;
+	uint32_t dispatchX = 1, dispatchY = 1, dispatchZ = 1;
+};
+
+struct CopyJob
+{
+	// ...
+};
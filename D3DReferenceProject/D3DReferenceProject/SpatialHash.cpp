@@ -0,0 +1,384 @@
+#include "SpatialHash.h"
+#include <cmath>
+#include <cassert>
+
+// Past this, a query is scanned level-by-level rather than walked cell-by-cell (& cell coordinates could overflow)
+constexpr float max_cells_per_axis = 65536.0f;
+
+void SpatialHash::Init(uint32_t maxObjs, uint32_t numBuckets, float finestCellSize, MEM_TAGS tag)
+{
+	assert(("Spatial hash needs a positive cell size", finestCellSize > 0.0f));
+
+	uint32_t bucketCount = 1;
+	while (bucketCount < numBuckets)
+	{
+		bucketCount <<= 1;
+	}
+
+	maxObjects = maxObjs;
+	bucketMask = bucketCount - 1;
+	objects = Memory::AllocateArray<Object>(maxObjs, 16, tag);
+	buckets = Memory::AllocateArray<uint32_t>(bucketCount, 4, tag);
+
+	for (uint32_t i = 0; i < maxObjs; i++)
+	{
+		objects[i].level = unused_level;
+	}
+
+	for (uint32_t i = 0; i < bucketCount; i++)
+	{
+		buckets[i] = invalid_id;
+	}
+
+	for (uint32_t i = 0; i < num_levels; i++)
+	{
+		cellSizes[i] = finestCellSize * static_cast<float>(1u << i);
+		levelCounts[i] = 0;
+		levelHeads[i] = invalid_id;
+	}
+	numObjects = 0;
+}
+
+// Smallest level whose cells are at least as wide as the object; anything bigger than the coarsest cells overhangs them, & is still found
+// since queries loosen by the object's own radius there
+uint8_t SpatialHash::LevelFor(float radius) const
+{
+	const float diameter = radius * 2.0f;
+	uint8_t level = 0;
+	while (level < num_levels - 1 && cellSizes[level] < diameter)
+	{
+		level++;
+	}
+	return level;
+}
+
+uint32_t SpatialHash::Bucket(uint8_t level, const int32_t cell[3]) const
+{
+	const uint32_t hash = (static_cast<uint32_t>(cell[0]) * 73856093u) ^ (static_cast<uint32_t>(cell[1]) * 19349663u) ^
+						  (static_cast<uint32_t>(cell[2]) * 83492791u) ^ (static_cast<uint32_t>(level) * 2654435761u);
+	return hash & bucketMask;
+}
+
+void SpatialHash::Link(uint32_t id)
+{
+	Object& obj = objects[id];
+	obj.bucket = Bucket(obj.level, obj.cell);
+	obj.prev = invalid_id;
+	obj.next = buckets[obj.bucket];
+	if (obj.next != invalid_id)
+	{
+		objects[obj.next].prev = id;
+	}
+	buckets[obj.bucket] = id;
+
+	obj.levelPrev = invalid_id;
+	obj.levelNext = levelHeads[obj.level];
+	if (obj.levelNext != invalid_id)
+	{
+		objects[obj.levelNext].levelPrev = id;
+	}
+	levelHeads[obj.level] = id;
+	levelCounts[obj.level]++;
+}
+
+void SpatialHash::Unlink(uint32_t id)
+{
+	Object& obj = objects[id];
+	if (obj.prev != invalid_id)
+	{
+		objects[obj.prev].next = obj.next;
+	}
+	else
+	{
+		buckets[obj.bucket] = obj.next;
+	}
+
+	if (obj.next != invalid_id)
+	{
+		objects[obj.next].prev = obj.prev;
+	}
+
+	if (obj.levelPrev != invalid_id)
+	{
+		objects[obj.levelPrev].levelNext = obj.levelNext;
+	}
+	else
+	{
+		levelHeads[obj.level] = obj.levelNext;
+	}
+
+	if (obj.levelNext != invalid_id)
+	{
+		objects[obj.levelNext].levelPrev = obj.levelPrev;
+	}
+	levelCounts[obj.level]--;
+}
+
+void SpatialHash::Insert(uint32_t id, DirectX::XMFLOAT3 center, float radius)
+{
+	assert(("Spatial hash object ID out of range", id < maxObjects));
+	assert(("Object already in the spatial hash; use Move()", !Contains(id)));
+
+	Object& obj = objects[id];
+	obj.center = center;
+	obj.radius = radius;
+	obj.level = LevelFor(radius);
+
+	const float invSize = 1.0f / cellSizes[obj.level];
+	obj.cell[0] = static_cast<int32_t>(floorf(center.x * invSize));
+	obj.cell[1] = static_cast<int32_t>(floorf(center.y * invSize));
+	obj.cell[2] = static_cast<int32_t>(floorf(center.z * invSize));
+	Link(id);
+	numObjects++;
+}
+
+void SpatialHash::Move(uint32_t id, DirectX::XMFLOAT3 center, float radius)
+{
+	assert(("Object isn't in the spatial hash; use Insert()", Contains(id)));
+
+	Object& obj = objects[id];
+	const uint8_t level = LevelFor(radius);
+	const float invSize = 1.0f / cellSizes[level];
+	const int32_t cell[3] = { static_cast<int32_t>(floorf(center.x * invSize)), static_cast<int32_t>(floorf(center.y * invSize)), static_cast<int32_t>(floorf(center.z * invSize)) };
+
+	obj.center = center;
+	obj.radius = radius;
+
+	// Most moves are small & stay in the same cell; only the stored bounds change then
+	if (level == obj.level && cell[0] == obj.cell[0] && cell[1] == obj.cell[1] && cell[2] == obj.cell[2])
+	{
+		return;
+	}
+
+	Unlink(id);
+	obj.level = level;
+	obj.cell[0] = cell[0];
+	obj.cell[1] = cell[1];
+	obj.cell[2] = cell[2];
+	Link(id);
+}
+
+void SpatialHash::Remove(uint32_t id)
+{
+	assert(("Object isn't in the spatial hash", Contains(id)));
+	Unlink(id);
+	objects[id].level = unused_level;
+	numObjects--;
+}
+
+template<typename Visitor>
+void SpatialHash::ForEachCandidate(const float lo[3], const float hi[3], Visitor&& visit) const
+{
+	for (uint8_t level = 0; level < num_levels; level++)
+	{
+		if (levelCounts[level] == 0)
+		{
+			continue;
+		}
+
+		// Objects here overhang their cell by up to half a cell; the coarsest level also takes anything too big for the rest, so its overhang
+		// is unbounded & it's always scanned whole
+		const float size = cellSizes[level];
+		const float invSize = 1.0f / size;
+		bool scanLevel = (level == num_levels - 1);
+		int32_t cellLo[3] = {};
+		int32_t cellHi[3] = {};
+		uint64_t numCells = 1;
+		for (uint32_t axis = 0; axis < 3 && !scanLevel; axis++)
+		{
+			const float cellMin = floorf((lo[axis] - (size * 0.5f)) * invSize);
+			const float cellMax = floorf((hi[axis] + (size * 0.5f)) * invSize);
+			if (cellMax - cellMin > max_cells_per_axis)
+			{
+				scanLevel = true;
+				break;
+			}
+
+			cellLo[axis] = static_cast<int32_t>(cellMin);
+			cellHi[axis] = static_cast<int32_t>(cellMax);
+			numCells *= static_cast<uint64_t>(cellHi[axis] - cellLo[axis] + 1);
+		}
+
+		// Big queries over sparse levels; scanning the level's objects directly beats walking a mostly-empty grid
+		if (scanLevel || numCells > levelCounts[level])
+		{
+			for (uint32_t id = levelHeads[level]; id != invalid_id; id = objects[id].levelNext)
+			{
+				visit(id, objects[id]);
+			}
+			continue;
+		}
+
+		for (int32_t z = cellLo[2]; z <= cellHi[2]; z++)
+		{
+			for (int32_t y = cellLo[1]; y <= cellHi[1]; y++)
+			{
+				for (int32_t x = cellLo[0]; x <= cellHi[0]; x++)
+				{
+					// Other cells can share this bucket, so filter on the object's own cell; each object then only turns up from the one cell it's in
+					const int32_t cell[3] = { x, y, z };
+					for (uint32_t id = buckets[Bucket(level, cell)]; id != invalid_id; id = objects[id].next)
+					{
+						const Object& obj = objects[id];
+						if (obj.level == level && obj.cell[0] == x && obj.cell[1] == y && obj.cell[2] == z)
+						{
+							visit(id, obj);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+uint32_t SpatialHash::QueryRadius(DirectX::XMFLOAT3 center, float radius, uint32_t* outIDs, uint32_t maxResults) const
+{
+	const float lo[3] = { center.x - radius, center.y - radius, center.z - radius };
+	const float hi[3] = { center.x + radius, center.y + radius, center.z + radius };
+
+	uint32_t numFound = 0;
+	ForEachCandidate(lo, hi, [&](uint32_t id, const Object& obj)
+	{
+		const float dx = obj.center.x - center.x;
+		const float dy = obj.center.y - center.y;
+		const float dz = obj.center.z - center.z;
+		const float reach = radius + obj.radius;
+		if ((dx * dx) + (dy * dy) + (dz * dz) <= reach * reach)
+		{
+			if (numFound < maxResults)
+			{
+				outIDs[numFound] = id;
+			}
+			numFound++;
+		}
+	});
+	return numFound;
+}
+
+uint32_t SpatialHash::QueryAABB(DirectX::XMFLOAT3 boxMin, DirectX::XMFLOAT3 boxMax, uint32_t* outIDs, uint32_t maxResults) const
+{
+	const float lo[3] = { boxMin.x, boxMin.y, boxMin.z };
+	const float hi[3] = { boxMax.x, boxMax.y, boxMax.z };
+
+	uint32_t numFound = 0;
+	ForEachCandidate(lo, hi, [&](uint32_t id, const Object& obj)
+	{
+		// Squared distance from the sphere's center to the box
+		const float c[3] = { obj.center.x, obj.center.y, obj.center.z };
+		float distSq = 0.0f;
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			const float d = (c[axis] < lo[axis]) ? lo[axis] - c[axis] : ((c[axis] > hi[axis]) ? c[axis] - hi[axis] : 0.0f);
+			distSq += d * d;
+		}
+
+		if (distSq <= obj.radius * obj.radius)
+		{
+			if (numFound < maxResults)
+			{
+				outIDs[numFound] = id;
+			}
+			numFound++;
+		}
+	});
+	return numFound;
+}
+
+// Max-heap over parallel ID/distance arrays, so the worst of the current k-nearest is always at the root
+void HeapSiftUp(uint32_t* ids, float* dists, uint32_t i)
+{
+	while (i > 0)
+	{
+		const uint32_t parent = (i - 1) / 2;
+		if (dists[parent] >= dists[i])
+		{
+			break;
+		}
+
+		const uint32_t id = ids[i]; ids[i] = ids[parent]; ids[parent] = id;
+		const float dist = dists[i]; dists[i] = dists[parent]; dists[parent] = dist;
+		i = parent;
+	}
+}
+
+void HeapSiftDown(uint32_t* ids, float* dists, uint32_t count, uint32_t i)
+{
+	for (;;)
+	{
+		const uint32_t left = (i * 2) + 1;
+		const uint32_t right = left + 1;
+		uint32_t largest = i;
+		largest = (left < count && dists[left] > dists[largest]) ? left : largest;
+		largest = (right < count && dists[right] > dists[largest]) ? right : largest;
+		if (largest == i)
+		{
+			break;
+		}
+
+		const uint32_t id = ids[i]; ids[i] = ids[largest]; ids[largest] = id;
+		const float dist = dists[i]; dists[i] = dists[largest]; dists[largest] = dist;
+		i = largest;
+	}
+}
+
+uint32_t SpatialHash::QueryNearest(DirectX::XMFLOAT3 point, uint32_t k, uint32_t* outIDs, float* outDistances) const
+{
+	const uint32_t want = (k < numObjects) ? k : numObjects;
+	if (want == 0)
+	{
+		return 0;
+	}
+
+	// Expanding search: anything within [searchRadius] of the point is sure to be visited, so once the worst of the best [want] found is no
+	// further than that, nothing unvisited can beat it
+	float searchRadius = cellSizes[0];
+	uint32_t numHeld = 0;
+	for (;;)
+	{
+		const float lo[3] = { point.x - searchRadius, point.y - searchRadius, point.z - searchRadius };
+		const float hi[3] = { point.x + searchRadius, point.y + searchRadius, point.z + searchRadius };
+
+		numHeld = 0;
+		uint32_t numVisited = 0;
+		ForEachCandidate(lo, hi, [&](uint32_t id, const Object& obj)
+		{
+			const float dx = obj.center.x - point.x;
+			const float dy = obj.center.y - point.y;
+			const float dz = obj.center.z - point.z;
+			const float centerDist = sqrtf((dx * dx) + (dy * dy) + (dz * dz));
+			const float dist = (centerDist > obj.radius) ? centerDist - obj.radius : 0.0f;
+			numVisited++;
+
+			if (numHeld < want)
+			{
+				outIDs[numHeld] = id;
+				outDistances[numHeld] = dist;
+				HeapSiftUp(outIDs, outDistances, numHeld);
+				numHeld++;
+			}
+			else if (dist < outDistances[0])
+			{
+				outIDs[0] = id;
+				outDistances[0] = dist;
+				HeapSiftDown(outIDs, outDistances, numHeld, 0);
+			}
+		});
+
+		if (numVisited == numObjects || (numHeld == want && outDistances[0] <= searchRadius))
+		{
+			break;
+		}
+
+		// With a full heap, its worst distance is a radius that's sure to finish the search; otherwise keep doubling
+		searchRadius = (numHeld == want) ? outDistances[0] : searchRadius * 2.0f;
+	}
+
+	// Heap order -> nearest first
+	for (uint32_t count = numHeld; count > 1; count--)
+	{
+		const uint32_t id = outIDs[0]; outIDs[0] = outIDs[count - 1]; outIDs[count - 1] = id;
+		const float dist = outDistances[0]; outDistances[0] = outDistances[count - 1]; outDistances[count - 1] = dist;
+		HeapSiftDown(outIDs, outDistances, count - 1, 0);
+	}
+	return numHeld;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "D3DUtils.h"
+#include "Memory.h"
+
+// Multi-level spatial hash over bounding spheres, for finding models near a point or region without scanning every model
+// Each level is an infinite grid of cubic cells, each level's cells twice the size of the one below. Objects live in the finest level whose
+// cells are at least as wide as they are, in the cell holding their center, so one object is only ever in one cell (& may overhang it by
+// at most half a cell; queries grow by that much per level). Cells hash into a fixed bucket table, & buckets chain objects intrusively, so
+// inserting, moving & removing are O(1) & nothing allocates after Init()
+// Queries write object IDs into caller-provided buffers & never allocate either; they're const, so any number can run alongside each other
+// (but not alongside updates)
+class SpatialHash
+{
+	public:
+		static constexpr uint32_t num_levels = 16;
+		static constexpr uint32_t invalid_id = 0xFFFFFFFF;
+
+		// Objects are identified by caller-chosen IDs in [0, maxObjects); [numBuckets] rounds up to a power of two, & works best at around
+		// twice the number of live objects
+		void Init(uint32_t maxObjects, uint32_t numBuckets, float finestCellSize, MEM_TAGS tag);
+
+		void Insert(uint32_t id, DirectX::XMFLOAT3 center, float radius);
+		void Move(uint32_t id, DirectX::XMFLOAT3 center, float radius); // Cheap when the object stays in its cell
+		void Remove(uint32_t id);
+		bool Contains(uint32_t id) const { return id < maxObjects && objects[id].level != unused_level; }
+		uint32_t NumObjects() const { return numObjects; }
+
+		// Objects whose bounds overlap the sphere/box; returns the number of matches, which may be more than [maxResults] (only the first
+		// [maxResults] are written, in no particular order)
+		uint32_t QueryRadius(DirectX::XMFLOAT3 center, float radius, uint32_t* outIDs, uint32_t maxResults) const;
+		uint32_t QueryAABB(DirectX::XMFLOAT3 boxMin, DirectX::XMFLOAT3 boxMax, uint32_t* outIDs, uint32_t maxResults) const;
+
+		// The [k] objects with bounds closest to [point] (zero when inside them), nearest first, with their distances in [outDistances]
+		// Returns the number found (less than [k] only when there are fewer objects than that)
+		uint32_t QueryNearest(DirectX::XMFLOAT3 point, uint32_t k, uint32_t* outIDs, float* outDistances) const;
+
+	private:
+		static constexpr uint8_t unused_level = 0xFF;
+
+		struct Object
+		{
+			DirectX::XMFLOAT3 center;
+			float radius;
+			int32_t cell[3];
+			uint8_t level;
+			uint32_t bucket;
+			uint32_t prev; // Bucket chain
+			uint32_t next;
+			uint32_t levelPrev; // Everything in the same level, for queries that scan a level whole
+			uint32_t levelNext;
+		};
+
+		// Visits every object whose cell might hold something overlapping the box [lo, hi] (before per-level loosening), once each
+		template<typename Visitor>
+		void ForEachCandidate(const float lo[3], const float hi[3], Visitor&& visit) const;
+
+		uint8_t LevelFor(float radius) const;
+		uint32_t Bucket(uint8_t level, const int32_t cell[3]) const;
+		void Link(uint32_t id);
+		void Unlink(uint32_t id);
+
+		Object* objects = nullptr;
+		uint32_t* buckets = nullptr;
+		uint32_t maxObjects = 0;
+		uint32_t bucketMask = 0;
+		uint32_t numObjects = 0;
+		uint32_t levelCounts[num_levels] = {};
+		uint32_t levelHeads[num_levels] = {};
+		float cellSizes[num_levels] = {};
+};
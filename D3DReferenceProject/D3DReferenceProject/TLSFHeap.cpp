@@ -0,0 +1,334 @@
+#include "TLSFHeap.h"
+#include "Memory.h"
+#include <cassert>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Bit-scan helpers; [x] is never zero at any call site
+uint32_t FindLastSet(uint64_t x)
+{
+#if defined(_M_X64) || defined(_M_ARM64)
+	unsigned long ndx = 0;
+	_BitScanReverse64(&ndx, x);
+	return static_cast<uint32_t>(ndx);
+#elif defined(_MSC_VER)
+	// No 64-bit scans on x86; try the high half first
+	unsigned long ndx = 0;
+	if (_BitScanReverse(&ndx, static_cast<uint32_t>(x >> 32)))
+	{
+		return static_cast<uint32_t>(ndx) + 32;
+	}
+	_BitScanReverse(&ndx, static_cast<uint32_t>(x));
+	return static_cast<uint32_t>(ndx);
+#else
+	return 63 - static_cast<uint32_t>(__builtin_clzll(x));
+#endif
+}
+
+uint32_t FindFirstSet(uint32_t x)
+{
+#ifdef _MSC_VER
+	unsigned long ndx = 0;
+	_BitScanForward(&ndx, x);
+	return static_cast<uint32_t>(ndx);
+#else
+	return static_cast<uint32_t>(__builtin_ctz(x));
+#endif
+}
+
+uint64_t AlignUp(uint64_t x, uint64_t alignment)
+{
+	return (x + (alignment - 1)) & ~(alignment - 1);
+}
+
+void TLSFHeap::MappingInsert(uint64_t size, uint32_t& out_fl, uint32_t& out_sl)
+{
+	if (size < small_block_size)
+	{
+		// Small blocks are spread linearly over the first first-level bin
+		out_fl = 0;
+		out_sl = static_cast<uint32_t>(size / (small_block_size / sl_index_count));
+	}
+	else
+	{
+		const uint32_t fl = FindLastSet(size);
+		out_sl = static_cast<uint32_t>(size >> (fl - sl_index_count_log2)) ^ (1u << sl_index_count_log2);
+		out_fl = fl - (fl_index_shift - 1);
+	}
+}
+
+void TLSFHeap::MappingSearch(uint64_t size, uint32_t& out_fl, uint32_t& out_sl)
+{
+	if (size >= small_block_size)
+	{
+		size += (1ull << (FindLastSet(size) - sl_index_count_log2)) - 1;
+	}
+	MappingInsert(size, out_fl, out_sl);
+}
+
+TLSFHeap::BlockHeader* TLSFHeap::FindSuitableBlock(uint32_t& fl, uint32_t& sl)
+{
+	if (fl >= fl_index_count)
+	{
+		return nullptr;
+	}
+
+	// Any non-empty bin in the same first-level class, at or above [sl]...
+	uint32_t slMap = slBitmaps[fl] & (~0u << sl);
+	if (slMap == 0)
+	{
+		// ...otherwise the smallest non-empty first-level class above [fl]
+		const uint32_t flMap = (fl + 1 < 32) ? (flBitmap & (~0u << (fl + 1))) : 0;
+		if (flMap == 0)
+		{
+			return nullptr; // Out of memory
+		}
+
+		fl = FindFirstSet(flMap);
+		slMap = slBitmaps[fl];
+	}
+
+	sl = FindFirstSet(slMap);
+	return freeLists[fl][sl];
+}
+
+void TLSFHeap::InsertFreeBlock(BlockHeader* block)
+{
+	uint32_t fl = 0, sl = 0;
+	MappingInsert(block->size & ~block_flag_bits, fl, sl);
+
+	BlockHeader* head = freeLists[fl][sl];
+	block->nextFree = head;
+	block->prevFree = nullptr;
+	if (head != nullptr)
+	{
+		head->prevFree = block;
+	}
+	freeLists[fl][sl] = block;
+
+	flBitmap |= (1u << fl);
+	slBitmaps[fl] |= (1u << sl);
+}
+
+void TLSFHeap::RemoveFreeBlock(BlockHeader* block)
+{
+	uint32_t fl = 0, sl = 0;
+	MappingInsert(block->size & ~block_flag_bits, fl, sl);
+
+	if (block->prevFree != nullptr)
+	{
+		block->prevFree->nextFree = block->nextFree;
+	}
+	else
+	{
+		freeLists[fl][sl] = block->nextFree;
+	}
+
+	if (block->nextFree != nullptr)
+	{
+		block->nextFree->prevFree = block->prevFree;
+	}
+
+	// Clear bitmap bits for bins we just emptied
+	if (freeLists[fl][sl] == nullptr)
+	{
+		slBitmaps[fl] &= ~(1u << sl);
+		if (slBitmaps[fl] == 0)
+		{
+			flBitmap &= ~(1u << fl);
+		}
+	}
+}
+
+TLSFHeap::BlockHeader* TLSFHeap::NextPhys(BlockHeader* block, uint64_t blockSize)
+{
+	return reinterpret_cast<BlockHeader*>(reinterpret_cast<char*>(block) + block_overhead + blockSize);
+}
+
+TLSFHeap::BlockHeader* TLSFHeap::Split(BlockHeader* block, uint64_t size)
+{
+	// [block] keeps its flags and the first [size] bytes of payload; the remainder becomes a new free block
+	const uint64_t blockSize = block->size & ~block_flag_bits;
+	BlockHeader* remainder = NextPhys(block, size);
+	remainder->size = (blockSize - size - block_overhead) | block_free_bit;
+	remainder->prevPhys = block;
+
+	block->size = size | (block->size & block_flag_bits);
+
+	BlockHeader* next = NextPhys(remainder, remainder->size & ~block_flag_bits);
+	next->prevPhys = remainder;
+	next->size |= prev_free_bit;
+	return remainder;
+}
+
+TLSFHeap::BlockHeader* TLSFHeap::MergePrev(BlockHeader* block)
+{
+	if ((block->size & prev_free_bit) == 0)
+	{
+		return block;
+	}
+
+	BlockHeader* prev = block->prevPhys;
+	RemoveFreeBlock(prev);
+
+	// Absorb [block] (header included) into [prev]
+	const uint64_t mergedSize = (prev->size & ~block_flag_bits) + block_overhead + (block->size & ~block_flag_bits);
+	prev->size = mergedSize | (prev->size & block_flag_bits);
+	NextPhys(prev, mergedSize)->prevPhys = prev;
+	return prev;
+}
+
+TLSFHeap::BlockHeader* TLSFHeap::MergeNext(BlockHeader* block)
+{
+	const uint64_t blockSize = block->size & ~block_flag_bits;
+	BlockHeader* next = NextPhys(block, blockSize);
+	if ((next->size & block_free_bit) == 0)
+	{
+		return block;
+	}
+
+	RemoveFreeBlock(next);
+
+	const uint64_t mergedSize = blockSize + block_overhead + (next->size & ~block_flag_bits);
+	block->size = mergedSize | (block->size & block_flag_bits);
+	NextPhys(block, mergedSize)->prevPhys = block;
+	return block;
+}
+
+void TLSFHeap::TrimFree(BlockHeader* block, uint64_t size)
+{
+	const uint64_t blockSize = block->size & ~block_flag_bits;
+	if (blockSize >= size + sizeof(BlockHeader))
+	{
+		BlockHeader* remainder = Split(block, size);
+		InsertFreeBlock(MergeNext(remainder));
+	}
+}
+
+void TLSFHeap::Init(uint64_t capacityBytes)
+{
+	assert(("TLSF heaps can't manage more than 4GB", capacityBytes < (1ull << fl_index_max)));
+	assert(("TLSF heap too small to hold a single block", capacityBytes >= 2 * sizeof(BlockHeader)));
+
+	heapBytes = capacityBytes & ~(align_size - 1);
+	heapStart = Memory::AllocateArray<char>(static_cast<uint32_t>(heapBytes), static_cast<uint32_t>(align_size), MEM_TAGS::HEAPS);
+	usedBytes = 0;
+
+	// One big free block spanning the range, followed by a zero-sized "used" sentinel so merges never walk off the end
+	BlockHeader* block = reinterpret_cast<BlockHeader*>(heapStart);
+	block->prevPhys = nullptr;
+	block->size = (heapBytes - 2 * block_overhead) | block_free_bit;
+	InsertFreeBlock(block);
+
+	BlockHeader* sentinel = NextPhys(block, block->size & ~block_flag_bits);
+	sentinel->prevPhys = block;
+	sentinel->size = 0 | prev_free_bit;
+}
+
+void TLSFHeap::DeInit()
+{
+	// The backing range belongs to the Memory arena & is released with it; just forget about it here
+	*this = TLSFHeap();
+}
+
+void* TLSFHeap::Allocate(uint64_t bytes, uint32_t alignment)
+{
+	void* addr = TryAllocate(bytes, alignment);
+	assert(("TLSF heap exhausted", addr != nullptr));
+	return addr;
+}
+
+void* TLSFHeap::TryAllocate(uint64_t bytes, uint32_t alignment)
+{
+	assert(("TLSF alignments must be powers of two", (alignment & (alignment - 1)) == 0));
+
+	uint64_t size = AlignUp(bytes > block_size_min ? bytes : block_size_min, align_size);
+	const uint64_t payloadAlign = (alignment > align_size) ? alignment : align_size;
+
+	// Over-aligned requests need room for a leading gap big enough to stand alone as a free block
+	const uint64_t searchSize = (payloadAlign > align_size) ? (size + payloadAlign + sizeof(BlockHeader)) : size;
+
+	uint32_t fl = 0, sl = 0;
+	MappingSearch(searchSize, fl, sl);
+	BlockHeader* block = FindSuitableBlock(fl, sl);
+	if (block == nullptr)
+	{
+		return nullptr;
+	}
+	RemoveFreeBlock(block);
+
+	if (payloadAlign > align_size)
+	{
+		// Find the first aligned payload address that leaves a leading gap of either zero bytes or at least one minimum-sized block
+		char* payload = reinterpret_cast<char*>(block) + block_overhead;
+		uint64_t gap = AlignUp(reinterpret_cast<uint64_t>(payload), payloadAlign) - reinterpret_cast<uint64_t>(payload);
+		while (gap != 0 && gap < sizeof(BlockHeader))
+		{
+			gap += payloadAlign;
+		}
+
+		if (gap != 0)
+		{
+			// Peel the gap off as its own free block; the aligned part carries on as [block]
+			BlockHeader* aligned = Split(block, gap - block_overhead);
+			aligned->size |= prev_free_bit;
+			InsertFreeBlock(block); // Can't merge backwards - [block] came off a free list, so its previous neighbour is in use
+			block = aligned;
+		}
+	}
+
+	TrimFree(block, size);
+
+	// Mark used
+	block->size &= ~block_free_bit;
+	const uint64_t blockSize = block->size & ~block_flag_bits;
+	NextPhys(block, blockSize)->size &= ~prev_free_bit;
+	usedBytes += blockSize;
+
+	return reinterpret_cast<char*>(block) + block_overhead;
+}
+
+void TLSFHeap::Free(void* addr)
+{
+	if (addr == nullptr)
+	{
+		return;
+	}
+
+	assert(("Pointer freed to the wrong TLSF heap", addr >= heapStart && addr < heapStart + heapBytes));
+
+	BlockHeader* block = reinterpret_cast<BlockHeader*>(reinterpret_cast<char*>(addr) - block_overhead);
+	assert(("Double-free in TLSF heap", (block->size & block_free_bit) == 0));
+
+	usedBytes -= block->size & ~block_flag_bits;
+
+	block->size |= block_free_bit;
+	NextPhys(block, block->size & ~block_flag_bits)->size |= prev_free_bit;
+
+	block = MergePrev(block);
+	block = MergeNext(block);
+	InsertFreeBlock(block);
+}
+
+TLSFHeap::HeapStats TLSFHeap::GetStats() const
+{
+	HeapStats stats = {};
+	stats.usedBytes = usedBytes;
+
+	BlockHeader* block = reinterpret_cast<BlockHeader*>(heapStart);
+	uint64_t blockSize = block->size & ~block_flag_bits;
+	while (blockSize != 0)
+	{
+		if (block->size & block_free_bit)
+		{
+			stats.freeBytes += blockSize;
+			stats.largestFreeBlock = (blockSize > stats.largestFreeBlock) ? blockSize : stats.largestFreeBlock;
+			stats.numFreeBlocks++;
+		}
+		block = NextPhys(block, blockSize);
+		blockSize = block->size & ~block_flag_bits;
+	}
+	return stats;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdint.h>
+
+// Two-level segregated-fit heap (TLSF, Masmano et al.), carved out of a range of the linear Memory arena
+// Memory can only rewind, so anything with an independent lifetime (streamed models, per-model buffers, long-running sessions) goes here instead
+// Allocation & release are O(1): free blocks are binned by size class (power-of-two first level, 32 linear subdivisions second level), a pair of bitmaps
+// finds the smallest non-empty bin that fits, and neighbouring free blocks are merged immediately on release so fragmentation stays bounded
+
+class TLSFHeap
+{
+	// Physical block header; the payload follows immediately after [size]
+	// Free blocks keep their free-list links at the start of their payload, so used blocks only cost 16 bytes of overhead
+	struct BlockHeader
+	{
+		BlockHeader* prevPhys; // Block immediately before this one in memory
+		uint64_t size; // Payload bytes, flags in the low bits (sizes are always multiples of [align_size])
+
+		// Only valid while the block is free
+		BlockHeader* nextFree;
+		BlockHeader* prevFree;
+	};
+
+	static constexpr uint64_t block_free_bit = 1;
+	static constexpr uint64_t prev_free_bit = 2;
+	static constexpr uint64_t block_flag_bits = block_free_bit | prev_free_bit;
+
+	static constexpr uint32_t align_size_log2 = 4;
+	static constexpr uint64_t align_size = 1ull << align_size_log2; // Base alignment for every payload
+	static constexpr uint64_t block_overhead = 2 * sizeof(uint64_t); // [prevPhys] + [size]
+	static constexpr uint64_t block_size_min = sizeof(BlockHeader) - block_overhead; // Room for the free-list links
+
+	static constexpr uint32_t sl_index_count_log2 = 5;
+	static constexpr uint32_t sl_index_count = 1 << sl_index_count_log2;
+	static constexpr uint32_t fl_index_shift = sl_index_count_log2 + align_size_log2;
+	static constexpr uint32_t fl_index_max = 32; // Largest block is just under 4GB
+	static constexpr uint32_t fl_index_count = fl_index_max - fl_index_shift + 1;
+	static constexpr uint64_t small_block_size = 1ull << fl_index_shift; // Blocks smaller than this all share the first first-level bin
+
+	BlockHeader* freeLists[fl_index_count][sl_index_count] = {};
+	uint32_t flBitmap = 0;
+	uint32_t slBitmaps[fl_index_count] = {};
+
+	char* heapStart = nullptr;
+	uint64_t heapBytes = 0;
+	uint64_t usedBytes = 0;
+
+	// Size-class mapping
+	static void MappingInsert(uint64_t size, uint32_t& out_fl, uint32_t& out_sl);
+	static void MappingSearch(uint64_t size, uint32_t& out_fl, uint32_t& out_sl); // Rounds [size] up to the next class so any block found is big enough
+
+	static BlockHeader* NextPhys(BlockHeader* block, uint64_t blockSize); // Physical neighbour after [block]
+
+	BlockHeader* FindSuitableBlock(uint32_t& fl, uint32_t& sl);
+	void InsertFreeBlock(BlockHeader* block);
+	void RemoveFreeBlock(BlockHeader* block);
+
+	BlockHeader* Split(BlockHeader* block, uint64_t size); // Returns the (free, unlinked) remainder
+	BlockHeader* MergePrev(BlockHeader* block);
+	BlockHeader* MergeNext(BlockHeader* block);
+	void TrimFree(BlockHeader* block, uint64_t size); // Gives the tail of [block] back to the free lists if it's big enough to stand alone
+
+	public:
+		// Claims [capacityBytes] from the Memory arena; the heap lives as long as that range does
+		void Init(uint64_t capacityBytes);
+		void DeInit();
+
+		void* Allocate(uint64_t bytes, uint32_t alignment = align_size);
+		void Free(void* addr);
+
+		// Allocate() without the exhaustion assert; for callers that can back off & retry later
+		void* TryAllocate(uint64_t bytes, uint32_t alignment = align_size);
+
+		template<typename TypeAllocating>
+		TypeAllocating* AllocateSingle(uint32_t alignment = 4)
+		{
+			return reinterpret_cast<TypeAllocating*>(Allocate(sizeof(TypeAllocating), alignment));
+		}
+
+		template<typename TypeAllocating>
+		TypeAllocating* AllocateArray(uint32_t arrayLen, uint32_t alignment = 4)
+		{
+			return reinterpret_cast<TypeAllocating*>(Allocate(sizeof(TypeAllocating) * static_cast<uint64_t>(arrayLen), alignment));
+		}
+
+		// Fragmentation metrics; walks every physical block, so not for per-frame use
+		struct HeapStats
+		{
+			uint64_t usedBytes;
+			uint64_t freeBytes;
+			uint64_t largestFreeBlock;
+			uint32_t numFreeBlocks;
+		};
+		HeapStats GetStats() const;
+};
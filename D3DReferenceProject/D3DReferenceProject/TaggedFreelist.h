@@ -0,0 +1,134 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <new>
+#include "Memory.h"
+
+// Chunked slot storage with a lock-free freelist; the shared core of ObjectPool & HandleTable
+// Slots are carved from Memory's shared region in chunks of [chunkElements] and never returned to it; popped slots belong to the caller until
+// they're pushed back, & get reused from there
+// The freelist head packs a 32-bit slot index with a 32-bit generation tag that bumps on every push/pop, so a slot popped, reused & pushed back
+// between another thread's load and CAS can't fool that CAS (ABA)
+// [SlotType] needs a std::atomic<uint32_t> [nextFree] member, & a constructor taking the slot's index; every slot is constructed explicitly
+// when its chunk is carved, rather than trusting fresh pages to be zeroed
+// Pop/Push are safe from any number of threads; growth takes a short spinlock, & allocates through Memory::AllocateShared(), so it's safe from
+// any thread too (Reserve() just moves that cost up-front)
+
+template<typename SlotType, uint32_t chunkElements, uint32_t maxChunks>
+class TaggedFreelist
+{
+	static constexpr uint64_t index_mask = 0xFFFFFFFF;
+
+	std::atomic<SlotType*> chunks[maxChunks] = {};
+	std::atomic<uint32_t> numChunks = 0;
+	std::atomic<uint64_t> freeHead = null_slot; // Generation tag in the high 32 bits, slot index in the low 32 bits
+	std::atomic_flag growing = ATOMIC_FLAG_INIT;
+
+	static uint64_t PackHead(uint64_t prevHead, uint32_t index)
+	{
+		return (((prevHead >> 32) + 1) << 32) | index;
+	}
+
+	// Pushes the pre-linked run of slots [first]...[last] onto the freelist in one CAS
+	void PushChain(uint32_t first, SlotType& last)
+	{
+		uint64_t head = freeHead.load(std::memory_order_relaxed);
+		uint64_t newHead = 0;
+		do
+		{
+			last.nextFree.store(static_cast<uint32_t>(head & index_mask), std::memory_order_relaxed);
+			newHead = PackHead(head, first);
+		} while (!freeHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	// Carves one more chunk out of Memory & pushes its slots onto the freelist; caller holds [growing]
+	// Returns false if the freelist is at [maxChunks] already
+	bool AddChunk()
+	{
+		const uint32_t chunkNdx = numChunks.load(std::memory_order_relaxed);
+		if (chunkNdx == maxChunks)
+		{
+			return false;
+		}
+
+		SlotType* chunk = Memory::AllocateShared<SlotType>(chunkElements, alignof(SlotType) > 4 ? alignof(SlotType) : 4, MEM_TAGS::POOLS);
+		const uint32_t firstIndex = chunkNdx * chunkElements;
+		for (uint32_t i = 0; i < chunkElements; i++)
+		{
+			new (&chunk[i]) SlotType(firstIndex + i);
+			chunk[i].nextFree.store(firstIndex + i + 1, std::memory_order_relaxed);
+		}
+
+		// Publish the chunk before any of its slots become reachable through the freelist
+		chunks[chunkNdx].store(chunk, std::memory_order_release);
+		numChunks.store(chunkNdx + 1, std::memory_order_release);
+		PushChain(firstIndex, chunk[chunkElements - 1]);
+		return true;
+	}
+
+	bool Grow()
+	{
+		while (growing.test_and_set(std::memory_order_acquire)) {}
+
+		// Someone else may have grown (or pushed onto) the freelist while we were waiting
+		const bool grown = ((freeHead.load(std::memory_order_acquire) & index_mask) != null_slot) || AddChunk();
+
+		growing.clear(std::memory_order_release);
+		return grown;
+	}
+
+	public:
+		static constexpr uint32_t null_slot = 0xFFFFFFFF;
+
+		SlotType& SlotAt(uint32_t index)
+		{
+			return chunks[index / chunkElements].load(std::memory_order_acquire)[index % chunkElements];
+		}
+
+		// Claims a free slot, growing if there isn't one; null_slot once [maxChunks] are carved & all of them are taken
+		uint32_t Pop()
+		{
+			uint64_t head = freeHead.load(std::memory_order_acquire);
+			while (true)
+			{
+				const uint32_t index = static_cast<uint32_t>(head & index_mask);
+				if (index == null_slot)
+				{
+					if (!Grow())
+					{
+						return null_slot;
+					}
+					head = freeHead.load(std::memory_order_acquire);
+					continue;
+				}
+
+				// [nextFree] may be stale if another thread pops this slot first, but then the tag has moved on & the CAS below fails
+				const uint32_t next = SlotAt(index).nextFree.load(std::memory_order_relaxed);
+				if (freeHead.compare_exchange_weak(head, PackHead(head, next), std::memory_order_acquire, std::memory_order_acquire))
+				{
+					return index;
+				}
+			}
+		}
+
+		void Push(uint32_t index)
+		{
+			PushChain(index, SlotAt(index));
+		}
+
+		// Grows up-front so at least [numSlots] slots exist; false if that's more than [maxChunks] allows
+		bool Reserve(uint32_t numSlots)
+		{
+			bool reserved = true;
+			while (growing.test_and_set(std::memory_order_acquire)) {}
+			while (reserved && numChunks.load(std::memory_order_relaxed) * chunkElements < numSlots)
+			{
+				reserved = AddChunk();
+			}
+			growing.clear(std::memory_order_release);
+			return reserved;
+		}
+
+		uint32_t Capacity() const { return numChunks.load(std::memory_order_acquire) * chunkElements; }
+};
@@ -0,0 +1,371 @@
+#include "TaskScheduler.h"
+#include "ObjectPool.h"
+#include "Profiler.h"
+#include <cstdio>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+struct Task
+{
+	TaskFn fn = nullptr;
+	RangeTaskFn rangeFn = nullptr; // Set instead of [fn] for ParallelFor pieces
+	void* data = nullptr;
+	TaskGroup* group = nullptr;
+	uint32_t begin = 0;
+	uint32_t end = 0;
+	uint32_t grain = 0;
+};
+
+// Fixed-capacity Chase-Lev deque, with the memory orderings from Le et al., "Correct and Efficient Work-Stealing for Weak Memory Models" (2013)
+// Push() & Pop() are owner-only; Steal() is safe from any thread
+struct WorkDeque
+{
+	static constexpr int64_t index_mask = TaskScheduler::deque_capacity - 1;
+	static_assert((TaskScheduler::deque_capacity & index_mask) == 0, "Deque capacity must be a power of two");
+
+	alignas(64) std::atomic<int64_t> top = 0; // Thieves take from here
+	alignas(64) std::atomic<int64_t> bottom = 0; // Owner pushes & pops here
+	std::atomic<Task*> tasks[TaskScheduler::deque_capacity] = {};
+
+	bool Push(Task* task)
+	{
+		const int64_t b = bottom.load(std::memory_order_relaxed);
+		const int64_t t = top.load(std::memory_order_acquire);
+		if (b - t >= TaskScheduler::deque_capacity)
+		{
+			return false;
+		}
+
+		tasks[b & index_mask].store(task, std::memory_order_release);
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	Task* Pop()
+	{
+		const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+
+		if (t > b)
+		{
+			// Empty
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		Task* task = tasks[b & index_mask].load(std::memory_order_relaxed);
+		if (t == b)
+		{
+			// Last task; race any thieves for it
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			{
+				task = nullptr;
+			}
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return task;
+	}
+
+	Task* Steal()
+	{
+		int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const int64_t b = bottom.load(std::memory_order_acquire);
+		if (t >= b)
+		{
+			return nullptr;
+		}
+
+		Task* task = tasks[t & index_mask].load(std::memory_order_acquire);
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			return nullptr; // Lost to the owner or another thief; caller just moves on
+		}
+		return task;
+	}
+};
+
+constexpr uint32_t max_deques = 1 + TaskScheduler::max_workers + TaskScheduler::max_attached_threads;
+constexpr uint32_t unattached_thread = 0xFFFFFFFF;
+constexpr uint32_t idle_spins = 64; // Failed find attempts before a worker goes to sleep
+
+WorkDeque deques[max_deques]; // [0] is the main thread's, then workers', then attached threads'
+std::thread workers[TaskScheduler::max_workers];
+uint32_t numWorkers = 0;
+std::atomic<uint32_t> numAttached = 0;
+thread_local uint32_t threadNdx = unattached_thread;
+
+ObjectPool<Task, 256, TaskScheduler::max_tasks_in_flight / 256> taskPool;
+
+// Sleeping workers; spawns only touch the lock when somebody is actually asleep
+std::mutex sleepLock;
+std::condition_variable wake;
+std::atomic<uint32_t> numSleeping = 0;
+std::atomic<uint32_t> wakeEpoch = 0;
+std::atomic<bool> quit = false;
+
+Task* FindTask()
+{
+	if (threadNdx != unattached_thread)
+	{
+		Task* task = deques[threadNdx].Pop();
+		if (task != nullptr)
+		{
+			return task;
+		}
+	}
+
+	// Start with our neighbour rather than always deque zero, so thieves spread out
+	const uint32_t start = (threadNdx != unattached_thread) ? threadNdx + 1 : 0;
+	for (uint32_t i = 0; i < max_deques; i++)
+	{
+		const uint32_t victim = (start + i) % max_deques;
+		if (victim != threadNdx)
+		{
+			Task* task = deques[victim].Steal();
+			if (task != nullptr)
+			{
+				return task;
+			}
+		}
+	}
+	return nullptr;
+}
+
+void WakeSleepers()
+{
+	// Pairs with the announce-then-look in WorkerLoop(); the spawn must be visible before we check for sleepers
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (numSleeping.load(std::memory_order_seq_cst) > 0)
+	{
+		wakeEpoch.fetch_add(1, std::memory_order_seq_cst);
+		{
+			std::lock_guard<std::mutex> guard(sleepLock);
+		}
+		wake.notify_all();
+	}
+}
+
+void Execute(Task* task);
+
+// [preCounted] tasks were already added to [group]'s count (continuations are, so waiting on their group can't return before they're spawned)
+void Spawn(TaskGroup* group, TaskFn fn, RangeTaskFn rangeFn, void* data, uint32_t begin, uint32_t end, uint32_t grain, bool preCounted = false)
+{
+	assert(("Spawning tasks from a thread the scheduler doesn't know about; call AttachThread() first", threadNdx != unattached_thread));
+
+	Task* task = taskPool.New();
+	task->fn = fn;
+	task->rangeFn = rangeFn;
+	task->data = data;
+	task->group = group;
+	task->begin = begin;
+	task->end = end;
+	task->grain = grain;
+
+	if (group != nullptr && !preCounted)
+	{
+		group->pending.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	if (!deques[threadNdx].Push(task))
+	{
+		Execute(task); // Deque full; plenty of work queued already, so just do this one now
+		return;
+	}
+	WakeSleepers();
+}
+
+// Nothing past the decrement may touch [group] unless it has a continuation; a waiter can return & destroy the group the moment the count hits zero
+void CompleteTask(TaskGroup& group)
+{
+	const uint32_t prev = group.pending.fetch_sub(1, std::memory_order_acq_rel);
+	if (prev == (TaskGroup::continuation_flag | 1))
+	{
+		Spawn(group.continuationGroup, group.continuation, nullptr, group.continuationData, 0, 0, 0, true);
+	}
+}
+
+// Splits off upper halves for other threads to steal until the range is down to [grain], then runs what's left
+void RunRange(RangeTaskFn fn, void* data, uint32_t begin, uint32_t end, uint32_t grain, TaskGroup* group)
+{
+	while (end - begin > grain)
+	{
+		const uint32_t mid = begin + ((end - begin) / 2);
+		Spawn(group, nullptr, fn, data, mid, end, grain);
+		end = mid;
+	}
+	fn(begin, end, data);
+}
+
+void Execute(Task* task)
+{
+	if (task->rangeFn != nullptr)
+	{
+		RunRange(task->rangeFn, task->data, task->begin, task->end, task->grain, task->group);
+	}
+	else
+	{
+		task->fn(task->data);
+	}
+
+	TaskGroup* group = task->group;
+	taskPool.Delete(task);
+	if (group != nullptr)
+	{
+		CompleteTask(*group);
+	}
+}
+
+void WorkerLoop(uint32_t ndx)
+{
+	threadNdx = ndx;
+
+	char name[16] = {};
+	snprintf(name, sizeof(name), "Worker %u", ndx);
+	Profiler::NameThread(name);
+
+	uint32_t misses = 0;
+	while (!quit.load(std::memory_order_acquire))
+	{
+		Task* task = FindTask();
+		if (task != nullptr)
+		{
+			Execute(task);
+			misses = 0;
+			continue;
+		}
+
+		if (++misses < idle_spins)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		// Announce we're about to sleep, then look once more; anything spawned after this point sees us & bumps the epoch
+		numSleeping.fetch_add(1, std::memory_order_seq_cst);
+		const uint32_t epoch = wakeEpoch.load(std::memory_order_seq_cst);
+		task = FindTask();
+		if (task == nullptr)
+		{
+			std::unique_lock<std::mutex> guard(sleepLock);
+			wake.wait(guard, [epoch]() { return wakeEpoch.load(std::memory_order_seq_cst) != epoch || quit.load(std::memory_order_acquire); });
+		}
+		numSleeping.fetch_sub(1, std::memory_order_seq_cst);
+
+		if (task != nullptr)
+		{
+			Execute(task);
+		}
+		misses = 0;
+	}
+}
+
+void TaskScheduler::Init(uint32_t workers)
+{
+	if (workers == 0)
+	{
+		const uint32_t cores = std::thread::hardware_concurrency();
+		workers = (cores > 1) ? cores - 1 : 1;
+	}
+	numWorkers = (workers > max_workers) ? max_workers : workers;
+
+	// Reserved up-front, so spawning never pays for pool growth mid-frame
+	taskPool.Reserve(max_tasks_in_flight);
+
+	threadNdx = 0;
+	quit.store(false, std::memory_order_release);
+	for (uint32_t i = 0; i < numWorkers; i++)
+	{
+		::workers[i] = std::thread(WorkerLoop, i + 1);
+	}
+}
+
+void TaskScheduler::DeInit()
+{
+	quit.store(true, std::memory_order_release);
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+	}
+	wake.notify_all();
+
+	for (uint32_t i = 0; i < numWorkers; i++)
+	{
+		workers[i].join();
+	}
+	numWorkers = 0;
+}
+
+void TaskScheduler::AttachThread()
+{
+	if (threadNdx != unattached_thread)
+	{
+		return;
+	}
+
+	const uint32_t attachNdx = numAttached.fetch_add(1, std::memory_order_relaxed);
+	assert(("Too many attached threads; raise max_attached_threads", attachNdx < max_attached_threads));
+	threadNdx = 1 + max_workers + attachNdx;
+}
+
+uint32_t TaskScheduler::NumThreads()
+{
+	return numWorkers + 1;
+}
+
+void TaskScheduler::Run(TaskGroup& group, TaskFn fn, void* data)
+{
+	Spawn(&group, fn, nullptr, data, 0, 0, 0);
+}
+
+void TaskScheduler::Then(TaskGroup& group, TaskFn fn, void* data, TaskGroup* continuationGroup)
+{
+	assert(("Group already has a continuation", (group.pending.load(std::memory_order_relaxed) & TaskGroup::continuation_flag) == 0));
+
+	// Fields first, then the flag (plus one count, holding the group open), so whichever task finishes last sees both
+	group.continuation = fn;
+	group.continuationData = data;
+	group.continuationGroup = continuationGroup;
+	if (continuationGroup != nullptr)
+	{
+		continuationGroup->pending.fetch_add(1, std::memory_order_relaxed);
+	}
+	group.pending.fetch_add(TaskGroup::continuation_flag | 1, std::memory_order_acq_rel);
+	CompleteTask(group);
+}
+
+void TaskScheduler::Wait(TaskGroup& group)
+{
+	while ((group.pending.load(std::memory_order_acquire) & ~TaskGroup::continuation_flag) != 0)
+	{
+		Task* task = FindTask();
+		if (task != nullptr)
+		{
+			Execute(task);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void TaskScheduler::ParallelFor(uint32_t begin, uint32_t end, RangeTaskFn fn, void* data, uint32_t minGrain)
+{
+	if (begin >= end)
+	{
+		return;
+	}
+
+	// Roughly four pieces per thread leaves slack for stealing to even out uneven work, without drowning small loops in task overhead
+	uint32_t grain = (end - begin) / (NumThreads() * 4);
+	grain = (grain < minGrain) ? minGrain : grain;
+	grain = (grain < 1) ? 1 : grain;
+
+	TaskGroup group;
+	RunRange(fn, data, begin, end, grain, &group);
+	Wait(group);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+// Work-stealing task scheduler
+// One worker thread per core (less one for the main thread, which takes part too). Each participating thread owns a Chase-Lev deque: it pushes
+// & pops tasks at the bottom (LIFO, so recently-spawned work is still in cache), while idle threads steal from the top (FIFO, so they take the
+// oldest & usually largest pieces of work)
+// Threads that wait on a group help run tasks until it completes, rather than blocking; only workers with nothing to run or steal sleep
+// Tasks can be spawned from the main thread, from inside other tasks, or from any thread that called AttachThread() first (the render thread,
+// say); each attached thread gets its own deque
+// Task records come from a lock-free pool reserved up-front in Init(), so spawning never touches Memory off the main thread
+
+typedef void (*TaskFn)(void* data);
+typedef void (*RangeTaskFn)(uint32_t begin, uint32_t end, void* data);
+
+// Counts outstanding tasks; wait on it with TaskScheduler::Wait(), or have it launch a continuation with TaskScheduler::Then()
+// Groups must outlive their tasks; groups with a continuation must outlive the point it's spawned, so wait on the continuation's group instead
+struct TaskGroup
+{
+	static constexpr uint32_t continuation_flag = 1u << 31;
+
+	std::atomic<uint32_t> pending = 0; // Outstanding tasks, plus [continuation_flag] once Then() was called
+	TaskFn continuation = nullptr;
+	void* continuationData = nullptr;
+	TaskGroup* continuationGroup = nullptr;
+};
+
+class TaskScheduler
+{
+	public:
+		static constexpr uint32_t max_workers = 31;
+		static constexpr uint32_t max_attached_threads = 2; // Non-worker threads allowed to spawn tasks, besides the main thread
+		static constexpr uint32_t max_tasks_in_flight = 16384;
+		static constexpr uint32_t deque_capacity = 4096; // Per thread; spawning into a full deque runs the task inline instead
+
+		// Call from the main thread after Memory::Init(); [numWorkers] of zero picks one per core, less one for the main thread
+		static void Init(uint32_t numWorkers = 0);
+		static void DeInit();
+
+		// Gives the calling (non-worker) thread a deque of its own, so it can spawn & wait
+		static void AttachThread();
+
+		static uint32_t NumThreads(); // Workers + the main thread
+
+		// Spawns [fn(data)] as part of [group]
+		static void Run(TaskGroup& group, TaskFn fn, void* data);
+
+		// Spawns [fn(data)] once every task currently in [group] has finished (optionally as part of [continuationGroup])
+		// Nothing else may be added to [group] after this
+		static void Then(TaskGroup& group, TaskFn fn, void* data, TaskGroup* continuationGroup = nullptr);
+
+		// Runs other tasks until [group] has no tasks left
+		static void Wait(TaskGroup& group);
+
+		// Calls [fn] over [begin, end) in sub-ranges, spread over every thread
+		// Ranges split in halves, down to roughly four pieces per thread, & never below [minGrain] items; the halves left behind are up for
+		// stealing, so load balances itself without tuning
+		static void ParallelFor(uint32_t begin, uint32_t end, RangeTaskFn fn, void* data, uint32_t minGrain = 1);
+};
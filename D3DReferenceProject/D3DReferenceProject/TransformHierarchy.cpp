@@ -0,0 +1,149 @@
+#include "TransformHierarchy.h"
+#include "SQTBatch.h"
+#include "TaskScheduler.h"
+#include <cassert>
+
+// Below this many dirty nodes a level isn't worth spreading over threads
+constexpr uint32_t min_nodes_per_task = 64;
+
+void TransformHierarchy::AddNode(uint16_t model, uint16_t parentModel, const SQT_Transform& local)
+{
+	assert(("Hierarchy nodes must be added in model order", model == numNodes && model < capacity));
+	assert(("Parents must be added before their children", parentModel == no_parent || parentModel < model));
+
+	parents[model] = parentModel;
+	depths[model] = (parentModel == no_parent) ? 0 : static_cast<uint8_t>(depths[parentModel] + 1);
+	assert(("Hierarchy too deep", depths[model] < max_depth));
+
+	locals.Set(model, local);
+	dirty[model] = true;
+	anyDirty = true;
+	sorted = false;
+	numNodes++;
+}
+
+void TransformHierarchy::SetLocal(uint16_t model, const SQT_Transform& local)
+{
+	assert(("No node for that model", model < numNodes));
+	locals.Set(model, local);
+	dirty[model] = true;
+	anyDirty = true;
+}
+
+// Counting sort by depth; stable, so siblings keep their model order
+void TransformHierarchy::Sort()
+{
+	uint16_t counts[max_depth] = {};
+	numLevels = 0;
+	for (uint16_t i = 0; i < numNodes; i++)
+	{
+		counts[depths[i]]++;
+		numLevels = (depths[i] + 1u > numLevels) ? depths[i] + 1u : numLevels;
+	}
+
+	uint16_t offsets[max_depth] = {};
+	uint16_t offset = 0;
+	for (uint32_t level = 0; level < numLevels; level++)
+	{
+		levelStarts[level] = offset;
+		offsets[level] = offset;
+		offset += counts[level];
+	}
+	levelStarts[numLevels] = offset;
+
+	for (uint16_t i = 0; i < numNodes; i++)
+	{
+		order[offsets[depths[i]]++] = i;
+	}
+	sorted = true;
+}
+
+// Gathers one slice of a level's dirty nodes, composes it, & scatters the results; slices never overlap, so they run on any thread
+void TransformHierarchy::ComposeSlice(uint32_t begin, uint32_t end)
+{
+	TransformStreams& worlds = target->Streams();
+	for (uint32_t i = begin; i < end; i++)
+	{
+		const uint16_t model = levelNodes[i];
+		scratchLocals.Set(i, locals.Get(model));
+		scratchParents.Set(i, worlds.Get(parents[model]));
+	}
+
+	SQTBatch::Compose(SQTStreams::Of(scratchLocals, begin), SQTStreams::Of(scratchParents, begin), SQTStreams::Of(scratchLocals, begin), end - begin);
+
+	for (uint32_t i = begin; i < end; i++)
+	{
+		worlds.Set(levelNodes[i], scratchLocals.Get(i));
+	}
+}
+
+void TransformHierarchy::ComposeGroups(uint32_t firstGroup, uint32_t endGroup, void* hierarchy)
+{
+	TransformHierarchy& self = *static_cast<TransformHierarchy*>(hierarchy);
+	const uint32_t end = endGroup * SQTBatch::width;
+	self.ComposeSlice(firstGroup * SQTBatch::width, (end < self.numLevelNodes) ? end : self.numLevelNodes);
+}
+
+void TransformHierarchy::Propagate(TransformStore& worlds)
+{
+	if (!anyDirty)
+	{
+		return;
+	}
+
+	if (!sorted)
+	{
+		Sort();
+	}
+
+	target = &worlds;
+	TransformStreams& worldStreams = worlds.Streams();
+	for (uint32_t level = 0; level < numLevels; level++)
+	{
+		// Compact the level's dirty nodes; anything under a dirty parent is dirty too
+		numLevelNodes = 0;
+		for (uint32_t n = levelStarts[level]; n < levelStarts[level + 1]; n++)
+		{
+			const uint16_t model = order[n];
+			if (parents[model] != no_parent && dirty[parents[model]])
+			{
+				dirty[model] = true;
+			}
+
+			if (dirty[model])
+			{
+				levelNodes[numLevelNodes++] = model;
+			}
+		}
+
+		if (level == 0)
+		{
+			// Roots are already in world space
+			for (uint32_t i = 0; i < numLevelNodes; i++)
+			{
+				worldStreams.Set(levelNodes[i], locals.Get(levelNodes[i]));
+			}
+		}
+		else if (numLevelNodes >= min_nodes_per_task * 2)
+		{
+			// Split in whole groups of eight, so only the level's last slice has a partial group
+			TaskScheduler::ParallelFor(0, (numLevelNodes + SQTBatch::width - 1) / SQTBatch::width, ComposeGroups, this, min_nodes_per_task / SQTBatch::width);
+		}
+		else
+		{
+			ComposeSlice(0, numLevelNodes);
+		}
+	}
+
+	// Publishing from the store is single-threaded, so dirty marks are left until every level is done
+	for (uint16_t i = 0; i < numNodes; i++)
+	{
+		if (dirty[i])
+		{
+			worlds.MarkDirty(i, 1);
+			dirty[i] = false;
+		}
+	}
+	anyDirty = false;
+	target = nullptr;
+}
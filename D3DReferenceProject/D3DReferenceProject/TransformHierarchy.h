@@ -0,0 +1,53 @@
+#pragma once
+
+#include "TransformStore.h"
+
+// Parent/child relations between models, with world transforms propagated level by level
+// Nodes are kept depth-sorted in flat arrays (roots, then their children, then grandchildren...), so every parent comes before its children
+// & each level only reads the level above it. Propagation is one linear sweep per level: dirty nodes are compacted, their parents' world
+// transforms gathered, & the whole level composed eight at a time (see SQTBatch.h), split across the task scheduler when it's big enough
+// Only nodes under something that changed are recomputed
+// Local transforms are indexed by model; world transforms are written straight into the scene's TransformStore, so moved subtrees upload too
+class TransformHierarchy
+{
+	public:
+		static constexpr uint16_t no_parent = 0xFFFF;
+		static constexpr uint32_t max_depth = 16;
+		static constexpr uint32_t capacity = TransformStreams::capacity;
+
+		// Models are added in order, parents before children (so [parentModel] is always an existing model, or [no_parent])
+		void AddNode(uint16_t model, uint16_t parentModel, const SQT_Transform& local);
+
+		// Relative to the model's parent (or to the world, for roots)
+		void SetLocal(uint16_t model, const SQT_Transform& local);
+		SQT_Transform GetLocal(uint16_t model) const { return locals.Get(model); }
+		uint16_t Parent(uint16_t model) const { return parents[model]; }
+
+		// Recomputes world transforms below every node changed since the last call, & writes them into [worlds]
+		void Propagate(TransformStore& worlds);
+
+	private:
+		void Sort();
+		void ComposeSlice(uint32_t begin, uint32_t end);
+		static void ComposeGroups(uint32_t firstGroup, uint32_t endGroup, void* hierarchy); // ParallelFor() body
+
+		uint16_t numNodes = 0;
+		uint16_t parents[capacity] = {}; // By model
+		uint8_t depths[capacity] = {}; // By model
+		TransformStreams locals = {}; // By model
+		bool dirty[capacity] = {}; // By model; set for changed nodes, then spread to their descendants during propagation
+
+		// Depth-sorted order; level [i] is [order[levelStarts[i]], order[levelStarts[i + 1]])
+		bool sorted = true;
+		uint16_t order[capacity] = {};
+		uint16_t levelStarts[max_depth + 1] = {};
+		uint32_t numLevels = 0;
+		bool anyDirty = false;
+
+		// Per-level working set, compacted; [scratchLocals] ends up holding world transforms
+		uint16_t levelNodes[capacity] = {};
+		uint32_t numLevelNodes = 0;
+		TransformStreams scratchParents = {};
+		TransformStreams scratchLocals = {};
+		TransformStore* target = nullptr;
+};
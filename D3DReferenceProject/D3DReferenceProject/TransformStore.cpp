@@ -0,0 +1,121 @@
+#include "TransformStore.h"
+#include <cstring>
+#include <cassert>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// [x] is never zero
+uint32_t FindFirstSet64(uint64_t x)
+{
+#if defined(_M_X64) || defined(_M_ARM64)
+	unsigned long ndx = 0;
+	_BitScanForward64(&ndx, x);
+	return static_cast<uint32_t>(ndx);
+#elif defined(_MSC_VER)
+	// No 64-bit scans on x86; try the low half first
+	unsigned long ndx = 0;
+	if (_BitScanForward(&ndx, static_cast<uint32_t>(x)))
+	{
+		return static_cast<uint32_t>(ndx);
+	}
+	_BitScanForward(&ndx, static_cast<uint32_t>(x >> 32));
+	return static_cast<uint32_t>(ndx) + 32;
+#else
+	return static_cast<uint32_t>(__builtin_ctzll(x));
+#endif
+}
+
+SQT_Transform TransformStreams::Get(uint32_t i) const
+{
+	SQT_Transform transform;
+	transform.q = DirectX::XMFLOAT4(qx[i], qy[i], qz[i], qw[i]);
+	transform.ts = DirectX::XMFLOAT4(tx[i], ty[i], tz[i], s[i]);
+	return transform;
+}
+
+void TransformStreams::Set(uint32_t i, const SQT_Transform& transform)
+{
+	qx[i] = transform.q.x;
+	qy[i] = transform.q.y;
+	qz[i] = transform.q.z;
+	qw[i] = transform.q.w;
+	tx[i] = transform.ts.x;
+	ty[i] = transform.ts.y;
+	tz[i] = transform.ts.z;
+	s[i] = transform.ts.w;
+}
+
+void TransformStore::Set(uint32_t i, const SQT_Transform& transform)
+{
+	assert(("Transform index out of range", i < TransformStreams::capacity));
+	streams.Set(i, transform);
+	dirty[i / 64] |= 1ull << (i % 64);
+}
+
+void TransformStore::MarkDirty(uint32_t first, uint32_t count)
+{
+	assert(("Transform range out of bounds", first + count <= TransformStreams::capacity));
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		dirty[i / 64] |= 1ull << (i % 64);
+	}
+}
+
+uint64_t TransformStore::Publish(TransformStreams& outStreams, uint64_t* outChangedEpochs, uint32_t numTransforms)
+{
+	epoch++;
+	for (uint32_t word = 0; word < dirty_words; word++)
+	{
+		uint64_t bits = dirty[word];
+		while (bits != 0)
+		{
+			const uint32_t bit = FindFirstSet64(bits);
+			changedEpochs[(word * 64) + bit] = epoch;
+			bits &= bits - 1;
+		}
+		dirty[word] = 0;
+	}
+
+	// Whole streams, rounded up to a batch of eight; cheap next to an upload, & keeps the snapshot's streams batch-ready
+	const uint32_t numCopied = (numTransforms + 7) & ~7u;
+	memcpy(outStreams.qx, streams.qx, numCopied * sizeof(float));
+	memcpy(outStreams.qy, streams.qy, numCopied * sizeof(float));
+	memcpy(outStreams.qz, streams.qz, numCopied * sizeof(float));
+	memcpy(outStreams.qw, streams.qw, numCopied * sizeof(float));
+	memcpy(outStreams.tx, streams.tx, numCopied * sizeof(float));
+	memcpy(outStreams.ty, streams.ty, numCopied * sizeof(float));
+	memcpy(outStreams.tz, streams.tz, numCopied * sizeof(float));
+	memcpy(outStreams.s, streams.s, numCopied * sizeof(float));
+	memcpy(outChangedEpochs, changedEpochs, numTransforms * sizeof(uint64_t));
+	return epoch;
+}
+
+uint32_t FindChangedRuns(const uint64_t* changedEpochs, uint32_t numTransforms, uint64_t sinceEpoch, uint32_t maxGap,
+						 uint32_t* outFirst, uint32_t* outCounts, uint32_t maxRuns)
+{
+	uint32_t numRuns = 0;
+	uint32_t lastChanged = 0;
+	for (uint32_t i = 0; i < numTransforms; i++)
+	{
+		if (changedEpochs[i] <= sinceEpoch)
+		{
+			continue;
+		}
+
+		const bool extendsRun = (numRuns > 0) && ((i - lastChanged - 1) <= maxGap || numRuns == maxRuns);
+		if (extendsRun)
+		{
+			outCounts[numRuns - 1] = i - outFirst[numRuns - 1] + 1;
+		}
+		else
+		{
+			outFirst[numRuns] = i;
+			outCounts[numRuns] = 1;
+			numRuns++;
+		}
+		lastChanged = i;
+	}
+	return numRuns;
+}
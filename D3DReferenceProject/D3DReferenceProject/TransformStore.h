@@ -0,0 +1,53 @@
+#pragma once
+
+#include "D3DUtils.h"
+
+// Structure-of-arrays SQT storage
+// One stream per component, each 32-byte aligned & padded to a multiple of eight, so batch kernels can load any component of eight transforms at once
+struct TransformStreams
+{
+	static constexpr uint32_t capacity = 256;
+	static_assert(capacity % 8 == 0, "Streams are processed eight transforms at a time");
+
+	alignas(32) float qx[capacity];
+	alignas(32) float qy[capacity];
+	alignas(32) float qz[capacity];
+	alignas(32) float qw[capacity];
+	alignas(32) float tx[capacity];
+	alignas(32) float ty[capacity];
+	alignas(32) float tz[capacity];
+	alignas(32) float s[capacity];
+
+	SQT_Transform Get(uint32_t i) const;
+	void Set(uint32_t i, const SQT_Transform& transform);
+};
+
+// Scene-side transforms, plus the bookkeeping needed to upload only what moved
+// Writes mark transforms dirty; Publish() stamps everything dirty with a new epoch & copies the streams out (into a frame snapshot). Consumers
+// compare stamps against the last epoch they uploaded, so they catch every change even if they skip snapshots
+class TransformStore
+{
+	static constexpr uint32_t dirty_words = TransformStreams::capacity / 64;
+
+	TransformStreams streams = {};
+	uint64_t dirty[dirty_words] = {};
+	uint64_t changedEpochs[TransformStreams::capacity] = {};
+	uint64_t epoch = 0;
+
+	public:
+		SQT_Transform Get(uint32_t i) const { return streams.Get(i); }
+		void Set(uint32_t i, const SQT_Transform& transform);
+
+		// Direct access for batch updates; mark whatever was written with MarkDirty()
+		TransformStreams& Streams() { return streams; }
+		void MarkDirty(uint32_t first, uint32_t count);
+
+		// Returns the new epoch
+		uint64_t Publish(TransformStreams& outStreams, uint64_t* outChangedEpochs, uint32_t numTransforms);
+};
+
+// Contiguous runs of transforms changed after [sinceEpoch], merging runs separated by gaps of [maxGap] or fewer (re-sending a few unchanged
+// transforms is cheaper than another upload call)
+// Returns the number of runs written to [outFirst]/[outCounts] (at most [maxRuns]; anything past that is merged into the last run)
+uint32_t FindChangedRuns(const uint64_t* changedEpochs, uint32_t numTransforms, uint64_t sinceEpoch, uint32_t maxGap,
+						 uint32_t* outFirst, uint32_t* outCounts, uint32_t maxRuns);
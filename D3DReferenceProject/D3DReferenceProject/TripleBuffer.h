@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+// Lock-free single-producer/single-consumer triple buffer
+// The writer always owns one slot & the reader always owns another; the third sits between them. Publishing swaps the writer's slot with the
+// middle one (flagged as fresh), acquiring swaps the reader's slot with the middle one if it's fresh. Both swaps are a single atomic exchange,
+// so neither side ever waits on the other; the reader just sees the newest complete snapshot, & snapshots it never got to are overwritten
+// Exactly one thread may write & exactly one thread may read
+
+template<typename SnapshotType>
+class TripleBuffer
+{
+	static constexpr uint32_t fresh_flag = 1 << 2; // Set while the middle slot holds a snapshot the reader hasn't seen
+	static constexpr uint32_t index_mask = fresh_flag - 1;
+
+	SnapshotType slots[3] = {};
+	alignas(64) std::atomic<uint32_t> middle = 2; // Kept off the slots' cache lines; both threads hammer it
+	uint32_t writeNdx = 0; // Writer-owned
+	uint32_t readNdx = 1; // Reader-owned
+
+	public:
+		// Writer side: fill in WriteSlot(), then Publish() it; the next WriteSlot() is a different slot, with stale contents
+		SnapshotType& WriteSlot()
+		{
+			return slots[writeNdx];
+		}
+
+		void Publish()
+		{
+			writeNdx = middle.exchange(writeNdx | fresh_flag, std::memory_order_acq_rel) & index_mask;
+		}
+
+		// Reader side: returns the newest published snapshot, or nullptr if nothing was published since the last call
+		// The returned snapshot stays valid (& unchanged) until the next successful Acquire()
+		const SnapshotType* Acquire()
+		{
+			if ((middle.load(std::memory_order_relaxed) & fresh_flag) == 0)
+			{
+				return nullptr;
+			}
+
+			readNdx = middle.exchange(readNdx, std::memory_order_acq_rel) & index_mask;
+			return &slots[readNdx];
+		}
+};
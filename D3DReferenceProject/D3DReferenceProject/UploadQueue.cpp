@@ -0,0 +1,168 @@
+#include "UploadQueue.h"
+#include "DrawSort.h"
+#include "Memory.h"
+#include <cassert>
+#include <cstring>
+
+void UploadQueue::Init(uint32_t maxQueuedUploads, uint64_t maxQueuedBytes)
+{
+	uploads = Memory::AllocateArray<PendingUpload>(maxQueuedUploads, alignof(PendingUpload), MEM_TAGS::PIPELINE);
+	capacity = maxQueuedUploads;
+	head = 0;
+	tail = 0;
+	dataHeap.Init(maxQueuedBytes);
+
+	pieces = Memory::AllocateArray<Piece>(max_pieces_per_pack, alignof(Piece), MEM_TAGS::PIPELINE);
+	keys = Memory::AllocateArray<uint64_t>(max_pieces_per_pack, 8, MEM_TAGS::PIPELINE);
+	order = Memory::AllocateArray<uint32_t>(max_pieces_per_pack, 4, MEM_TAGS::PIPELINE);
+	keyScratch = Memory::AllocateArray<uint64_t>(max_pieces_per_pack, 8, MEM_TAGS::PIPELINE);
+	orderScratch = Memory::AllocateArray<uint32_t>(max_pieces_per_pack, 4, MEM_TAGS::PIPELINE);
+}
+
+void UploadQueue::DeInit()
+{
+	dataHeap.DeInit();
+	head = 0;
+	tail = 0;
+	numQueued.store(0, std::memory_order_relaxed);
+}
+
+bool UploadQueue::Enqueue(D3DHandle dest, uint32_t destOffset, const void* data, uint32_t numBytes)
+{
+	assert(("Uploads go to buffers", dest.objType == D3D_OBJ_TYPES::BUFFER));
+	if (numBytes == 0)
+	{
+		return true;
+	}
+
+	// Claim space under the lock, but copy outside it; the upload only becomes visible to Pack() once it's pushed
+	Lock();
+	char* copy = reinterpret_cast<char*>(dataHeap.TryAllocate(numBytes));
+	Unlock();
+	if (copy == nullptr)
+	{
+		return false; // Out of data space
+	}
+	memcpy(copy, data, numBytes);
+
+	PendingUpload upload = {};
+	upload.dest = dest;
+	upload.destOffset = destOffset;
+	upload.numBytes = numBytes;
+	upload.consumed = 0;
+	upload.data = copy;
+
+	Lock();
+	if ((tail - head) == capacity)
+	{
+		dataHeap.Free(copy);
+		Unlock();
+		return false; // Out of entries
+	}
+
+	uploads[tail % capacity] = upload;
+	tail++;
+	numQueued.fetch_add(1, std::memory_order_relaxed);
+	Unlock();
+	return true;
+}
+
+bool SameHandle(D3DHandle a, D3DHandle b)
+{
+	return a.index == b.index && a.generation == b.generation && a.objType == b.objType;
+}
+
+uint32_t UploadQueue::Pack(char* staging, uint32_t stagingBytes, UploadCopy* outCopies)
+{
+	// Take a prefix of the queue (oldest first) up to the budget, splitting the upload that crosses it
+	// Fully-taken uploads stay in the ring until we're done reading their data; [head] only moves at the end, so nothing can wrap onto them
+	uint32_t numPieces = 0;
+	uint32_t takenBytes = 0;
+	Lock();
+	uint64_t cursor = head;
+	while (cursor != tail && numPieces < max_pieces_per_pack && takenBytes < stagingBytes)
+	{
+		PendingUpload& upload = uploads[cursor % capacity];
+		const uint32_t remaining = upload.numBytes - upload.consumed;
+		const uint32_t take = (remaining < stagingBytes - takenBytes) ? remaining : (stagingBytes - takenBytes);
+
+		Piece& piece = pieces[numPieces++];
+		piece.dest = upload.dest;
+		piece.destOffset = upload.destOffset + upload.consumed;
+		piece.numBytes = take;
+		piece.data = upload.data + upload.consumed;
+
+		upload.consumed += take;
+		takenBytes += take;
+		if (upload.consumed < upload.numBytes)
+		{
+			break;
+		}
+		cursor++;
+	}
+	Unlock();
+
+	if (numPieces == 0)
+	{
+		return 0;
+	}
+
+	// Sort by destination & offset (stable, so equal offsets keep queue order), then sweep into spans of touching/overlapping pieces
+	// Destinations are whole handles, generation included; a slot released & reused between writes is a different buffer, & merging the two would
+	// let writes meant for the old one land on the new one (or the other way around)
+	for (uint32_t i = 0; i < numPieces; i++)
+	{
+		keys[i] = (static_cast<uint64_t>(pieces[i].dest.index) << 48) | (static_cast<uint64_t>(pieces[i].dest.generation) << 32) | pieces[i].destOffset;
+		order[i] = i;
+	}
+	DrawSort::RadixSort(keys, order, numPieces, keyScratch, orderScratch);
+
+	uint32_t numCopies = 0;
+	uint32_t stagedBytes = 0;
+	for (uint32_t i = 0; i < numPieces; i++)
+	{
+		Piece& piece = pieces[order[i]];
+		UploadCopy* span = (numCopies > 0) ? &outCopies[numCopies - 1] : nullptr;
+		const bool extends = (span != nullptr) && SameHandle(span->dest, piece.dest) && (piece.destOffset <= span->destOffset + span->numBytes);
+		if (extends)
+		{
+			const uint32_t pieceEnd = piece.destOffset + piece.numBytes;
+			const uint32_t spanEnd = span->destOffset + span->numBytes;
+			if (pieceEnd > spanEnd)
+			{
+				span->numBytes += pieceEnd - spanEnd;
+				stagedBytes += pieceEnd - spanEnd;
+			}
+		}
+		else
+		{
+			span = &outCopies[numCopies++];
+			span->dest = piece.dest;
+			span->destOffset = piece.destOffset;
+			span->stagingOffset = stagedBytes;
+			span->numBytes = piece.numBytes;
+			stagedBytes += piece.numBytes;
+		}
+		piece.span = numCopies - 1;
+	}
+
+	// Spans cover their pieces exactly, so painting pieces in queue order fills every staged byte & leaves the newest write on top
+	for (uint32_t i = 0; i < numPieces; i++)
+	{
+		const Piece& piece = pieces[i];
+		const UploadCopy& span = outCopies[piece.span];
+		memcpy(staging + span.stagingOffset + (piece.destOffset - span.destOffset), piece.data, piece.numBytes);
+	}
+
+	// Retire everything fully packed
+	Lock();
+	for (uint64_t i = head; i < cursor; i++)
+	{
+		dataHeap.Free(uploads[i % capacity].data);
+	}
+	numQueued.fetch_sub(static_cast<uint32_t>(cursor - head), std::memory_order_relaxed);
+	head = cursor;
+	Unlock();
+
+	return numCopies;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "D3DUtils.h"
+#include "TLSFHeap.h"
+#include <atomic>
+
+// Batched uploads into GPU-resident buffers
+// Callers queue (destination, offset, bytes) writes from any thread; the bytes are copied into a private heap straight away, so callers can
+// reuse their data as soon as Enqueue() returns. Once per frame the render thread packs queued writes into a staging buffer & gets back the
+// smallest set of copies that lands them: writes are sorted by destination & merged wherever they touch or overlap (later writes winning
+// overlaps), so a burst of small updates to one buffer costs a single copy
+// Packing stops at a byte budget, splitting the write that crosses it; everything left stays queued, in order, for later frames, so big
+// uploads trickle in instead of hitching one frame
+// Knows nothing about D3D beyond handles; D3DWrapper owns the staging buffers & issues the copies
+struct UploadCopy
+{
+	D3DHandle dest;
+	uint32_t destOffset;
+	uint32_t stagingOffset;
+	uint32_t numBytes;
+};
+
+class UploadQueue
+{
+	public:
+		static constexpr uint32_t max_pieces_per_pack = 1024; // Also the most copies one Pack() can return
+
+		void Init(uint32_t maxQueuedUploads, uint64_t maxQueuedBytes);
+		void DeInit();
+
+		// Safe from any thread
+		// False (with nothing queued) when the queue is out of entries or data space; both free up as Pack() drains it, so callers retry
+		// after the next one
+		bool Enqueue(D3DHandle dest, uint32_t destOffset, const void* data, uint32_t numBytes);
+
+		// Render thread only; packs up to [stagingBytes] of queued writes into [staging] & writes the copies landing them to [outCopies]
+		// (which needs max_pieces_per_pack entries); returns the number of copies
+		uint32_t Pack(char* staging, uint32_t stagingBytes, UploadCopy* outCopies);
+
+		uint32_t NumQueued() const { return numQueued.load(std::memory_order_relaxed); }
+
+	private:
+		struct PendingUpload
+		{
+			D3DHandle dest;
+			uint32_t destOffset;
+			uint32_t numBytes;
+			uint32_t consumed; // Bytes already packed in earlier frames
+			char* data;
+		};
+
+		struct Piece
+		{
+			D3DHandle dest;
+			uint32_t destOffset;
+			uint32_t numBytes;
+			const char* data;
+			uint32_t span; // Copy this piece lands in
+		};
+
+		PendingUpload* uploads = nullptr;
+		uint32_t capacity = 0;
+		uint64_t head = 0; // Oldest queued upload
+		uint64_t tail = 0; // Next free entry; [head, tail) wraps around [uploads]
+		std::atomic<uint32_t> numQueued = 0;
+
+		TLSFHeap dataHeap;
+		std::atomic_flag lock = ATOMIC_FLAG_INIT; // Covers the upload ring & [dataHeap]
+
+		// Pack() scratch
+		Piece* pieces = nullptr;
+		uint64_t* keys = nullptr;
+		uint32_t* order = nullptr;
+		uint64_t* keyScratch = nullptr;
+		uint32_t* orderScratch = nullptr;
+
+		void Lock() { while (lock.test_and_set(std::memory_order_acquire)) {} }
+		void Unlock() { lock.clear(std::memory_order_release); }
+};
@@ -0,0 +1,76 @@
+#include "UploadRing.h"
+#include <cassert>
+
+void UploadRing::Init(uint32_t capacityBytes)
+{
+	capacity = capacityBytes;
+	head = 0;
+	tail = 0;
+	firstMark = 0;
+	numMarks = 0;
+}
+
+bool UploadRing::Allocate(uint32_t numBytes, uint32_t alignment, uint32_t& outOffset)
+{
+	assert(("Upload ring alignment must be a power of two dividing its capacity", (alignment & (alignment - 1)) == 0 && (capacity % alignment) == 0));
+	assert(("Allocation larger than the whole upload ring", numBytes <= capacity));
+
+	uint64_t start = (head + alignment - 1) & ~static_cast<uint64_t>(alignment - 1);
+	if ((start % capacity) + numBytes > capacity)
+	{
+		start = ((start / capacity) + 1) * capacity;
+	}
+
+	// Nothing held at all, so nothing needs the skipped bytes either; without this, an empty ring could still turn down a full-size allocation
+	if (head == tail)
+	{
+		tail = start;
+	}
+
+	if ((start + numBytes) - tail > capacity)
+	{
+		return false;
+	}
+
+	outOffset = static_cast<uint32_t>(start % capacity);
+	head = start + numBytes;
+	return true;
+}
+
+void UploadRing::EndFrame(uint64_t frame)
+{
+	// Frames that allocated nothing don't need a mark
+	const uint64_t lastEnd = (numMarks > 0) ? marks[(firstMark + numMarks - 1) % max_pending_frames].end : tail;
+	if (head == lastEnd)
+	{
+		return;
+	}
+
+	if (numMarks == max_pending_frames)
+	{
+		FrameMark& newest = marks[(firstMark + numMarks - 1) % max_pending_frames];
+		newest.frame = frame;
+		newest.end = head;
+		return;
+	}
+
+	FrameMark& mark = marks[(firstMark + numMarks) % max_pending_frames];
+	mark.frame = frame;
+	mark.end = head;
+	numMarks++;
+}
+
+void UploadRing::Retire(uint64_t retiredBefore)
+{
+	while (numMarks > 0 && marks[firstMark].frame < retiredBefore)
+	{
+		tail = marks[firstMark].end;
+		firstMark = (firstMark + 1) % max_pending_frames;
+		numMarks--;
+	}
+}
+
+uint64_t UploadRing::OldestPendingFrame() const
+{
+	return (numMarks > 0) ? marks[firstMark].frame : ~0ull;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+// Frame-fenced ring allocator behind D3DWrapper's dynamic upload buffers
+// Only hands out offsets; whoever owns the ring maps the memory they refer to. Space allocated during a frame only comes back once that frame
+// has retired on the GPU, so writes through WRITE_NO_OVERWRITE can never land on anything still in flight
+// Positions only ever grow & wrap onto the buffer modulo its capacity; an allocation that would straddle the end of the buffer skips to the start
+// instead, & the skipped tail is reclaimed along with the frame that skipped it
+// Knows nothing about D3D, so it can be driven by a plain frame counter; single-threaded
+class UploadRing
+{
+	public:
+		static constexpr uint32_t max_pending_frames = 8; // Frames past this share a mark with the newest one (so they just retire a little later)
+
+		void Init(uint32_t capacityBytes);
+
+		// [alignment] must be a power of two dividing the capacity; returns false if everything past [numBytes] is still held by unretired frames
+		bool Allocate(uint32_t numBytes, uint32_t alignment, uint32_t& outOffset);
+
+		// Everything allocated since the last EndFrame() belongs to [frame]
+		void EndFrame(uint64_t frame);
+
+		// Reclaims the space held by frames before [retiredBefore]
+		void Retire(uint64_t retiredBefore);
+
+		// Oldest frame still holding space (~0 if none); allocations that haven't been closed by EndFrame() yet don't count
+		uint64_t OldestPendingFrame() const;
+
+		uint32_t Capacity() const { return capacity; }
+		uint32_t BytesInUse() const { return static_cast<uint32_t>(head - tail); }
+
+	private:
+		struct FrameMark
+		{
+			uint64_t frame;
+			uint64_t end; // [head] as the frame closed
+		};
+
+		FrameMark marks[max_pending_frames] = {};
+		uint32_t firstMark = 0;
+		uint32_t numMarks = 0;
+
+		uint64_t head = 0; // Next free byte
+		uint64_t tail = 0; // Oldest byte still held by a frame
+		uint32_t capacity = 0;
+};
@@ -1,11 +1,21 @@
 
 #include "shaders_shared.hlsli"
 
-Pixel main( Vertex vt )
+// Model transforms, two elements per model: rotation quaternion, then translation in xyz & uniform scale in w
+Buffer<float4> transforms : register(t0);
+
+float3 QuatRotate(float4 q, float3 v)
+{
+    return v + 2.0f * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+Pixel main( Vertex vt, Instance inst )
 {
-    // Convert model SQT to model matrix and multiply against view * projection product
-    // Apply computed MVP to vertex position before passing on to the pixel-shader stage
-    ////////////////////////////////////////////////////////////////////////////////////
+    // Apply the instance's SQT (scale, rotate, then translate); no camera yet, so no view * projection
+    const float4 q = transforms[inst.modelID * 2];
+    const float4 ts = transforms[inst.modelID * 2 + 1];
+    vt.pos.xyz = QuatRotate(q, vt.pos.xyz * ts.w) + ts.xyz;
+    vt.normals.xyz = QuatRotate(q, vt.normals.xyz);
 
     // Just a random filler transform for now, so we have something to compile
     //vt.pos += vt.normals.wxyz;
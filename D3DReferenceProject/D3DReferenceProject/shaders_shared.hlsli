@@ -6,6 +6,12 @@ struct Vertex
     float4 normals : TEXCOORD1;
 };
 
+// Per-instance model index, from the instance stream (vertex slot 1)
+struct Instance
+{
+    uint modelID : TEXCOORD2;
+};
+
 struct Pixel
 {
     float4 pos : SV_POSITION;
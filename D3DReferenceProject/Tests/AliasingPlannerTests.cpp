@@ -0,0 +1,108 @@
+#include "TestHarness.h"
+#include "AliasingPlanner.h"
+
+constexpr uint64_t one_mb = 1024 * 1024;
+
+TransientResource MakeTransient(uint64_t bytes, uint32_t alignment, uint32_t firstUse, uint32_t lastUse)
+{
+	TransientResource resrc;
+	resrc.bytes = bytes;
+	resrc.alignment = alignment;
+	resrc.firstUse = firstUse;
+	resrc.lastUse = lastUse;
+	return resrc;
+}
+
+bool BytesOverlap(const TransientResource& a, const TransientResource& b)
+{
+	return a.heapOffset < (b.heapOffset + b.bytes) && b.heapOffset < (a.heapOffset + a.bytes);
+}
+
+TEST_CASE(AliasingDisjointLifetimesShareBytes)
+{
+	TransientResource resources[] = { MakeTransient(one_mb, 256, 0, 1), MakeTransient(one_mb, 256, 2, 3), MakeTransient(one_mb / 2, 256, 4, 4) };
+	uint32_t scratch[6] = {};
+	const AliasingReport report = AliasingPlanner::Plan(resources, 3, scratch);
+
+	CHECK(resources[0].heapOffset == 0);
+	CHECK(resources[1].heapOffset == 0);
+	CHECK(resources[2].heapOffset == 0);
+	CHECK(report.heapBytes == one_mb);
+	CHECK(report.naiveBytes == 2 * one_mb + one_mb / 2);
+	CHECK(report.savedBytes == one_mb + one_mb / 2);
+	CHECK(report.numResources == 3);
+}
+
+TEST_CASE(AliasingOverlappingLifetimesDontShareBytes)
+{
+	// Lifetimes are inclusive, so touching at a single step still counts as overlapping
+	TransientResource resources[] = { MakeTransient(one_mb, 256, 0, 2), MakeTransient(one_mb, 256, 2, 3), MakeTransient(one_mb, 256, 1, 1) };
+	uint32_t scratch[6] = {};
+	const AliasingReport report = AliasingPlanner::Plan(resources, 3, scratch);
+
+	CHECK(!BytesOverlap(resources[0], resources[1]));
+	CHECK(!BytesOverlap(resources[0], resources[2]));
+
+	// [1] & [2] are never alive together, so the third resource still fits into a heap of two
+	CHECK(resources[1].heapOffset == resources[2].heapOffset);
+	CHECK(report.heapBytes == 2 * one_mb);
+	CHECK(report.savedBytes == one_mb);
+}
+
+TEST_CASE(AliasingRespectsAlignment)
+{
+	// The big unaligned resource goes down first; the overlapping ones have to skip to their next aligned offset past it
+	TransientResource resources[] = { MakeTransient(1000, 1, 0, 3), MakeTransient(64, 4096, 1, 2), MakeTransient(10, 64, 0, 0) };
+	uint32_t scratch[6] = {};
+	const AliasingReport report = AliasingPlanner::Plan(resources, 3, scratch);
+
+	CHECK(resources[0].heapOffset == 0);
+	CHECK(resources[1].heapOffset == 4096);
+	CHECK(resources[2].heapOffset == 1024);
+	CHECK(report.heapBytes == 4096 + 64);
+
+	// Naive sizes are rounded up to each resource's alignment
+	CHECK(report.naiveBytes == 1000 + 4096 + 64);
+}
+
+TEST_CASE(AliasingRandomPlansAreValid)
+{
+	constexpr uint32_t num_resources = 64;
+	TransientResource resources[num_resources];
+	uint32_t scratch[2 * num_resources] = {};
+
+	uint64_t rng = 0x853C49E6748FEA9Bull;
+	for (uint32_t plan = 0; plan < 64; plan++)
+	{
+		for (uint32_t i = 0; i < num_resources; i++)
+		{
+			rng = rng * 6364136223846793005ull + 1442695040888963407ull;
+			const uint32_t firstUse = static_cast<uint32_t>(rng >> 59);
+			const uint32_t span = static_cast<uint32_t>((rng >> 54) & 7);
+			const uint64_t bytes = 1 + ((rng >> 20) % (4 * one_mb));
+			const uint32_t alignment = 1u << ((rng >> 8) % 17);
+			resources[i] = MakeTransient(bytes, alignment, firstUse, firstUse + span);
+		}
+
+		const AliasingReport report = AliasingPlanner::Plan(resources, num_resources, scratch);
+
+		bool valid = true;
+		uint64_t heapEnd = 0;
+		for (uint32_t i = 0; i < num_resources; i++)
+		{
+			const TransientResource& a = resources[i];
+			valid &= (a.heapOffset % a.alignment) == 0;
+			heapEnd = (a.heapOffset + a.bytes > heapEnd) ? a.heapOffset + a.bytes : heapEnd;
+			for (uint32_t j = i + 1; j < num_resources; j++)
+			{
+				const TransientResource& b = resources[j];
+				const bool aliveTogether = a.firstUse <= b.lastUse && b.firstUse <= a.lastUse;
+				valid &= !(aliveTogether && BytesOverlap(a, b));
+			}
+		}
+
+		CHECK(valid);
+		CHECK(report.heapBytes == heapEnd);
+		CHECK(report.heapBytes <= report.naiveBytes);
+	}
+}
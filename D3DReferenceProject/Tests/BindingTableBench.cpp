@@ -0,0 +1,226 @@
+#include "TestHarness.h"
+#include "CommandBuffer.h"
+#include "HandleTable.h"
+#include "Memory.h"
+
+// Per-draw binding cost: precompiled binding tables vs the search-per-draw path they replaced
+// Neither side talks to a device; both stop at the view arrays they'd hand to the context, & resolve views through a handle table of
+// stand-in pointers, the same lookup D3DWrapper does
+//	Search:	the old BindResources(); arena scratch per draw, an O(n^2) scan grouping bindings by view type & stage, then per-group view lists
+//	Tables:	EncodeDraw() copying the job's slot tables into a stream, then the decoder's walk resolving each recorded slot
+
+constexpr uint32_t bench_draws = 4096;
+constexpr uint32_t bench_frames = 16;
+
+struct BenchView
+{
+	void* srv;
+	void* rtv;
+	void* dsv;
+	void* cbuffer;
+};
+
+// A typical lit, textured draw: 8 PS SRVs, 2 cbuffers each for the VS & PS, one render-target & a depth buffer
+struct BenchBindings
+{
+	static constexpr uint32_t max_bindings = 16;
+	D3DHandle resources[max_bindings];
+	RESRC_VIEWS views[max_bindings];
+	SHADER_TYPES stages[max_bindings];
+	uint32_t numBindings = 0;
+
+	void Add(D3DHandle handle, RESRC_VIEWS view, SHADER_TYPES stage)
+	{
+		resources[numBindings] = handle;
+		views[numBindings] = view;
+		stages[numBindings] = stage;
+		numBindings++;
+	}
+};
+
+HandleTable<BenchView>* benchViews = nullptr;
+
+D3DHandle AddBenchResource()
+{
+	D3DHandle handle = {};
+	handle.index = static_cast<uint16_t>(benchViews->Allocate(handle.generation));
+	handle.objType = D3D_OBJ_TYPES::TEXTURE;
+
+	// Distinct non-null stand-ins, so nothing downstream can shortcut on nullptr
+	BenchView& views = *benchViews->Resolve(handle.index, handle.generation);
+	views.srv = &views.srv;
+	views.rtv = &views.rtv;
+	views.dsv = &views.dsv;
+	views.cbuffer = &views.cbuffer;
+	return handle;
+}
+
+const BenchView& ResolveBenchView(D3DHandle handle)
+{
+	return *benchViews->Resolve(handle.index, handle.generation);
+}
+
+// The old path, minus the context calls
+uint64_t BindBySearching(const BenchBindings& bindings)
+{
+	uint64_t checksum = 0;
+	const uint32_t numResources = bindings.numBindings;
+	bool* bound = Memory::AllocateArray<bool>(numResources);
+	for (uint32_t i = 0; i < numResources; i++)
+	{
+		bound[i] = false;
+	}
+
+	for (uint32_t i = 0; i < numResources; i++)
+	{
+		if (bound[i])
+		{
+			continue;
+		}
+
+		D3DHandle* matches = Memory::AllocateArray<D3DHandle>(numResources - i);
+		uint32_t numMatches = 0;
+		for (uint32_t k = i; k < numResources; k++)
+		{
+			if (bindings.views[k] == bindings.views[i] && bindings.stages[k] == bindings.stages[i])
+			{
+				matches[numMatches++] = bindings.resources[k];
+				bound[k] = true;
+			}
+		}
+
+		void** viewList = Memory::AllocateArray<void*>(numMatches, alignof(void*));
+		for (uint32_t k = 0; k < numMatches; k++)
+		{
+			const BenchView& views = ResolveBenchView(matches[k]);
+			viewList[k] = (bindings.views[i] == GENERIC_READONLY) ? views.srv :
+						  (bindings.views[i] == CONSTANT_BUFFER) ? views.cbuffer :
+						  (bindings.views[i] == RENDER_TARGET) ? views.rtv : views.dsv;
+		}
+		checksum += reinterpret_cast<uint64_t>(viewList[numMatches - 1]);
+		Memory::FreeToAddress(viewList);
+		Memory::FreeToAddress(matches);
+	}
+
+	Memory::FreeToAddress(bound);
+	return checksum;
+}
+
+// The decoder's share of the table path: one handle lookup per recorded slot into a local view array
+uint64_t ResolveRecordedTables(const CommandBuffer& cmds)
+{
+	uint64_t checksum = 0;
+	void* views[BindingTable::max_srvs];
+	for (const char* cursor = cmds.Begin(); cursor < cmds.End(); cursor += reinterpret_cast<const CommandHeader*>(cursor)->sizeBytes)
+	{
+		const CommandHeader& header = *reinterpret_cast<const CommandHeader*>(cursor);
+		const D3DHandle* handles = reinterpret_cast<const D3DHandle*>(&header + 1);
+		switch (header.type)
+		{
+			case CMD_TYPES::SET_TARGETS:
+			{
+				const CmdSetTargets& targets = *reinterpret_cast<const CmdSetTargets*>(&header + 1);
+				handles = reinterpret_cast<const D3DHandle*>(&targets + 1);
+				for (uint32_t i = 0; i < header.count; i++)
+				{
+					views[i] = ResolveBenchView(handles[i]).rtv;
+				}
+				checksum += reinterpret_cast<uint64_t>(views[0]) + reinterpret_cast<uint64_t>(ResolveBenchView(targets.dsv).dsv);
+				break;
+			}
+
+			case CMD_TYPES::SET_SRVS:
+			case CMD_TYPES::SET_CBUFFERS:
+				for (uint32_t i = 0; i < header.count; i++)
+				{
+					const BenchView& resolved = ResolveBenchView(handles[i]);
+					views[i] = (header.type == CMD_TYPES::SET_SRVS) ? resolved.srv : resolved.cbuffer;
+				}
+				checksum += reinterpret_cast<uint64_t>(views[header.count - 1]);
+				break;
+
+			default:
+				break;
+		}
+	}
+	return checksum;
+}
+
+BENCHMARK(BindingTablesVsSearch)
+{
+	benchViews = new (Memory::AllocateSingle<HandleTable<BenchView>>(alignof(HandleTable<BenchView>))) HandleTable<BenchView>();
+
+	constexpr uint32_t num_resources = 256;
+	D3DHandle resources[num_resources];
+	for (uint32_t i = 0; i < num_resources; i++)
+	{
+		resources[i] = AddBenchResource();
+	}
+
+	// Same bindings both ways; the table side fills slot tables exactly as D3DWrapper::AddBinding() would
+	BenchBindings* searchBindings = Memory::AllocateArray<BenchBindings>(bench_draws, alignof(BenchBindings));
+	DrawJob* jobs = Memory::AllocateArray<DrawJob>(bench_draws, alignof(DrawJob));
+	for (uint32_t d = 0; d < bench_draws; d++)
+	{
+		BenchBindings& search = *new (&searchBindings[d]) BenchBindings();
+		DrawJob& job = *new (&jobs[d]) DrawJob();
+		job.directToBackbuf = false;
+
+		BindingTable& table = job.bindingTable;
+		for (uint32_t i = 0; i < 8; i++)
+		{
+			const D3DHandle srv = resources[(d * 7 + i) % num_resources];
+			search.Add(srv, GENERIC_READONLY, SHADER_TYPES::PS);
+			table.stages[static_cast<uint32_t>(SHADER_TYPES::PS)].srvs[table.stages[static_cast<uint32_t>(SHADER_TYPES::PS)].numSRVs++] = srv;
+		}
+
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			const D3DHandle vsConstants = resources[(d + i) % num_resources];
+			const D3DHandle psConstants = resources[(d + i + 2) % num_resources];
+			search.Add(vsConstants, CONSTANT_BUFFER, SHADER_TYPES::VS);
+			search.Add(psConstants, CONSTANT_BUFFER, SHADER_TYPES::PS);
+			table.stages[static_cast<uint32_t>(SHADER_TYPES::VS)].cbuffers[table.stages[static_cast<uint32_t>(SHADER_TYPES::VS)].numCBuffers++] = vsConstants;
+			table.stages[static_cast<uint32_t>(SHADER_TYPES::PS)].cbuffers[table.stages[static_cast<uint32_t>(SHADER_TYPES::PS)].numCBuffers++] = psConstants;
+		}
+
+		search.Add(resources[0], RENDER_TARGET, SHADER_TYPES::PS);
+		search.Add(resources[1], DEPTH_STENCIL, SHADER_TYPES::PS);
+		table.rtvs[table.numRTVs++] = resources[0];
+		table.dsv = resources[1];
+		table.hasDSV = true;
+	}
+
+	uint64_t checksum = 0;
+	BenchTimer timer;
+	for (uint32_t frame = 0; frame < bench_frames; frame++)
+	{
+		for (uint32_t d = 0; d < bench_draws; d++)
+		{
+			checksum += BindBySearching(searchBindings[d]);
+		}
+	}
+	TestHarness::Report("search per draw (old BindResources)", timer.ElapsedNs() / (bench_frames * bench_draws), "ns/draw");
+
+	// Geometry & shaders are encoded too, but with one batch & no instances they're a small, fixed part of each draw
+	CommandBuffer cmds;
+	cmds.Init(bench_draws * 512);
+	const InstanceBatch batch = {};
+	DrawGeometry geometry;
+	geometry.batches = &batch;
+	geometry.numBatches = 1;
+
+	timer.Restart();
+	for (uint32_t frame = 0; frame < bench_frames; frame++)
+	{
+		cmds.Reset();
+		for (uint32_t d = 0; d < bench_draws; d++)
+		{
+			cmds.EncodeDraw(jobs[d], geometry);
+		}
+		checksum += ResolveRecordedTables(cmds);
+	}
+	TestHarness::Report("binding tables, encode + resolve", timer.ElapsedNs() / (bench_frames * bench_draws), "ns/draw");
+	TestHarness::Report("binding tables, stream bytes per draw", static_cast<double>(cmds.UsedBytes()) / bench_draws, "bytes");
+	TestHarness::Consume(checksum);
+}
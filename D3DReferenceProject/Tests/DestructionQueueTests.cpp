@@ -0,0 +1,126 @@
+#include "TestHarness.h"
+#include "DestructionQueue.h"
+#include "Memory.h"
+#include <new>
+
+// Frames here are a plain counter, & parked objects are fakes that count their Release() calls, so no device is involved
+
+struct CountingObject : public IUnknown
+{
+	uint32_t releases = 0;
+
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, void** out) override
+	{
+		*out = nullptr;
+		return E_NOINTERFACE;
+	}
+
+	ULONG STDMETHODCALLTYPE AddRef() override { return 1; }
+	ULONG STDMETHODCALLTYPE Release() override { return ++releases; }
+};
+
+// Cookies in the order Collect() hands them back, & whether the entry's objects were already released by then
+constexpr uint32_t max_retired_cookies = 16;
+uint32_t retiredCookies[max_retired_cookies];
+uint32_t numRetiredCookies = 0;
+bool releasedBeforeRetire = true;
+CountingObject* cookieObjects = nullptr;
+
+void RecordRetired(uint32_t cookie)
+{
+	releasedBeforeRetire &= (cookieObjects == nullptr) || (cookieObjects[cookie].releases == 1);
+	retiredCookies[numRetiredCookies++] = cookie;
+}
+
+DestructionQueue* NewDestructionQueue(uint32_t maxEntries)
+{
+	DestructionQueue* queue = new (Memory::AllocateSingle<DestructionQueue>(alignof(DestructionQueue))) DestructionQueue();
+	queue->Init(maxEntries);
+	return queue;
+}
+
+TEST_CASE(DestructionQueueWaitsForRetiredFrames)
+{
+	DestructionQueue& queue = *NewDestructionQueue(8);
+	CountingObject objects[4];
+
+	// Frame 0 frees a resource & one view (plus a view slot it never had); frames 1 & 2 free one object each
+	uint64_t frame = 0;
+	IUnknown* first[] = { &objects[0], nullptr, &objects[1] };
+	queue.Park(first, 3, frame);
+	frame++;
+	IUnknown* second[] = { &objects[2] };
+	queue.Park(second, 1, frame);
+	frame++;
+	IUnknown* third[] = { &objects[3] };
+	queue.Park(third, 1, frame);
+	CHECK(queue.NumParked() == 4);
+
+	// Nothing retired, nothing released
+	CHECK(queue.Collect(0) == 0);
+	CHECK(objects[0].releases == 0 && objects[1].releases == 0);
+
+	// Frame 0 retires; frame 1's object stays put even though the GPU could be done with it, since it isn't known to be
+	CHECK(queue.Collect(1) == 2);
+	CHECK(objects[0].releases == 1 && objects[1].releases == 1);
+	CHECK(objects[2].releases == 0 && objects[3].releases == 0);
+	CHECK(queue.NumParked() == 2);
+
+	// Collecting the same frame again is a no-op
+	CHECK(queue.Collect(1) == 0);
+
+	CHECK(queue.Collect(2) == 1);
+	CHECK(objects[2].releases == 1 && objects[3].releases == 0);
+
+	// Flush() takes whatever's left, retired or not, & only once
+	CHECK(queue.Flush() == 1);
+	CHECK(queue.Flush() == 0);
+	CHECK(queue.NumParked() == 0);
+	CHECK(objects[0].releases == 1 && objects[1].releases == 1 && objects[2].releases == 1 && objects[3].releases == 1);
+}
+
+TEST_CASE(DestructionQueueRetiresCookiesAfterReleases)
+{
+	// Four entries' room, cycled over a dozen frames, so the ring wraps a few times
+	constexpr uint32_t num_frames = 12;
+	DestructionQueue& queue = *NewDestructionQueue(4);
+	CountingObject objects[num_frames];
+	cookieObjects = objects;
+	numRetiredCookies = 0;
+	releasedBeforeRetire = true;
+
+	for (uint64_t frame = 0; frame < num_frames; frame++)
+	{
+		IUnknown* parked[] = { &objects[frame] };
+		queue.Park(parked, 1, frame, RecordRetired, static_cast<uint32_t>(frame));
+
+		// Two frames in flight, the way the renderer runs
+		if (frame >= 2)
+		{
+			queue.Collect(frame - 1);
+		}
+	}
+
+	CHECK(numRetiredCookies == num_frames - 2);
+	queue.Flush();
+	CHECK(numRetiredCookies == num_frames);
+	CHECK(releasedBeforeRetire);
+
+	bool inOrder = true;
+	for (uint32_t i = 0; i < numRetiredCookies; i++)
+	{
+		inOrder &= (retiredCookies[i] == i);
+	}
+	CHECK(inOrder);
+
+	// An entry with nothing to release still gets its callback, & still waits for its frame
+	cookieObjects = nullptr;
+	numRetiredCookies = 0;
+	queue.Park(nullptr, 0, num_frames, RecordRetired, 7);
+	CHECK(queue.Collect(num_frames) == 0 && numRetiredCookies == 0);
+	CHECK(queue.Collect(num_frames + 1) == 0 && numRetiredCookies == 1 && retiredCookies[0] == 7);
+
+	// Without one, an empty entry isn't worth parking at all
+	queue.Park(nullptr, 0, num_frames + 1);
+	CHECK(queue.Flush() == 0 && numRetiredCookies == 1);
+}
@@ -0,0 +1,137 @@
+#include "TestHarness.h"
+#include "RenderGraph.h"
+#include "Memory.h"
+#include <cstdio>
+#include <new>
+
+// Rebinds before & after sorting, on a scene-shaped graph: a shadow pass into one depth buffer, then a few hundred opaque submeshes into the
+// back-buffer (sampling the shadow map) & a handful of translucent ones, all declared in scene-walk order the way models hand them out
+// Jobs are filled in by hand (the same slot tables AddTexture() builds), so no device is needed
+// Also times SortPasses() per frame with & without the report, since frames run it without one
+
+constexpr uint32_t sort_bench_objects = 64;
+constexpr uint32_t sort_bench_submeshes = 6; // Per object
+constexpr uint32_t sort_bench_translucent = 16;
+constexpr uint32_t sort_bench_materials = 24;
+constexpr uint32_t sort_bench_shaders = 6;
+constexpr uint32_t sort_bench_frames = 256;
+
+// Mirrors ShadingJob::AddTexture() without resolving views
+void AddBenchTexture(DrawJob& job, D3DHandle resrc, RESRC_VIEWS bindAs, SHADER_TYPES bindFor)
+{
+	job.bindTexturesFor[job.numTextures] = bindFor;
+	job.textureBindings[job.numTextures] = bindAs;
+	job.textures[job.numTextures] = resrc;
+	job.numTextures++;
+
+	BindingTable::StageTable& stage = job.bindingTable.stages[static_cast<uint32_t>(bindFor)];
+	if (bindAs == DEPTH_STENCIL)
+	{
+		job.bindingTable.dsv = resrc;
+		job.bindingTable.hasDSV = true;
+		job.hasDepthStencil = true;
+	}
+	else
+	{
+		stage.srvs[stage.numSRVs] = resrc;
+		stage.numSRVs++;
+	}
+}
+
+void ReportRebinds(const char* order, const DrawSort::RebindCounts& counts)
+{
+	char line[96] = {};
+	snprintf(line, sizeof(line), "%s: render-target rebinds", order);
+	TestHarness::Report(line, counts.targets, "");
+	snprintf(line, sizeof(line), "%s: shader rebinds", order);
+	TestHarness::Report(line, counts.shaders, "");
+	snprintf(line, sizeof(line), "%s: material/binding rebinds", order);
+	TestHarness::Report(line, counts.resources, "");
+}
+
+BENCHMARK(DrawSortRebinds)
+{
+	RenderGraph* graph = new (Memory::AllocateSingle<RenderGraph>(alignof(RenderGraph))) RenderGraph();
+	graph->Init();
+
+	const D3DHandle shadowMap = { 1, 1, D3D_OBJ_TYPES::TEXTURE };
+	uint32_t seed = 2463534242u;
+	auto next = [&seed]()
+	{
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		return seed;
+	};
+
+	// Each object's submeshes pick their own material & shader, & sit at roughly the object's depth; the shadow pass walks the same objects
+	DrawJob job;
+	for (uint32_t pass = 0; pass < 2; pass++)
+	{
+		for (uint32_t object = 0; object < sort_bench_objects; object++)
+		{
+			const float objectDepth = 1.0f + static_cast<float>(next() % 1000) * 0.1f;
+			for (uint32_t submesh = 0; submesh < sort_bench_submeshes; submesh++)
+			{
+				job = DrawJob();
+				job.depthTestedOpaque = true;
+				job.sortDepth = objectDepth + static_cast<float>(submesh) * 0.01f;
+				job.materialID = static_cast<uint16_t>(pass == 0 ? 0 : next() % sort_bench_materials);
+
+				// Depth-only shadow draws share one pixel shader; their vertex shaders still vary with skinning & such
+				const uint16_t shader = static_cast<uint16_t>(next() % sort_bench_shaders);
+				job.vs = D3DHandle{ shader, 0, D3D_OBJ_TYPES::VERTEX_SHADER };
+				job.ps = D3DHandle{ static_cast<uint16_t>(pass == 0 ? 0 : shader), 0, D3D_OBJ_TYPES::PIXEL_SHADER };
+				if (pass == 0)
+				{
+					job.directToBackbuf = false;
+					AddBenchTexture(job, shadowMap, DEPTH_STENCIL, SHADER_TYPES::PS);
+				}
+				else
+				{
+					AddBenchTexture(job, shadowMap, GENERIC_READONLY, SHADER_TYPES::PS);
+					AddBenchTexture(job, D3DHandle{ static_cast<uint16_t>(16 + job.materialID), 1, D3D_OBJ_TYPES::TEXTURE }, GENERIC_READONLY, SHADER_TYPES::PS);
+				}
+				graph->AddDrawPass(job);
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < sort_bench_translucent; i++)
+	{
+		job = DrawJob();
+		job.translucent = true;
+		job.sortDepth = 1.0f + static_cast<float>(next() % 1000) * 0.1f;
+		job.materialID = static_cast<uint16_t>(next() % sort_bench_materials);
+		job.vs = D3DHandle{ 0, 0, D3D_OBJ_TYPES::VERTEX_SHADER };
+		job.ps = D3DHandle{ 0, 0, D3D_OBJ_TYPES::PIXEL_SHADER };
+		graph->AddDrawPass(job);
+	}
+
+	graph->Compile();
+	RenderGraph::SortReport report;
+	graph->SortPasses(&report);
+
+	TestHarness::Report("draws", report.numDraws, "");
+	TestHarness::Report("compiled groups", graph->NumGroups(), "");
+	ReportRebinds("declaration order", report.unsorted);
+	ReportRebinds("sorted", report.sorted);
+
+	// Per-frame cost; the order is already sorted after the first frame, but the keys are rebuilt & every digit pass still runs
+	BenchTimer timer;
+	for (uint32_t frame = 0; frame < sort_bench_frames; frame++)
+	{
+		graph->SortPasses();
+	}
+	TestHarness::Report("SortPasses()", timer.ElapsedNs() / (1000.0 * sort_bench_frames), "us/frame");
+
+	timer.Restart();
+	for (uint32_t frame = 0; frame < sort_bench_frames; frame++)
+	{
+		graph->SortPasses(&report);
+	}
+	TestHarness::Report("SortPasses(), with a rebind report", timer.ElapsedNs() / (1000.0 * sort_bench_frames), "us/frame");
+	TestHarness::Consume(report.sorted.resources + graph->Version());
+
+	graph->DeInit();
+}
@@ -0,0 +1,107 @@
+#include "TestHarness.h"
+#include "DrawSort.h"
+
+// Keys only read job fields & slot tables, so jobs here carry bare handles & never touch a device
+
+DrawJob MakeSortJob(uint16_t shaderNdx, uint16_t materialID, float sortDepth, bool translucent)
+{
+	DrawJob job;
+	job.vs = D3DHandle{ shaderNdx, 0, D3D_OBJ_TYPES::VERTEX_SHADER };
+	job.ps = D3DHandle{ shaderNdx, 0, D3D_OBJ_TYPES::PIXEL_SHADER };
+	job.materialID = materialID;
+	job.sortDepth = sortDepth;
+	job.translucent = translucent;
+	return job;
+}
+
+TEST_CASE(DrawKeysPutTranslucentDrawsLast)
+{
+	// The cheapest opaque draw in every field still sorts ahead of the nearest translucent one
+	const DrawJob opaque = MakeSortJob(255, 4095, 1000.0f, false);
+	const DrawJob translucent = MakeSortJob(0, 0, 0.001f, true);
+	CHECK(DrawSort::DrawKey(opaque) < DrawSort::DrawKey(translucent));
+
+	DrawJob offscreen = opaque;
+	offscreen.directToBackbuf = false;
+	offscreen.bindingTable.rtvs[offscreen.bindingTable.numRTVs++] = D3DHandle{ 7, 1, D3D_OBJ_TYPES::TEXTURE };
+	CHECK(DrawSort::DrawKey(offscreen) < DrawSort::DrawKey(translucent));
+}
+
+TEST_CASE(DrawKeysSortOpaqueDrawsByStateThenFrontToBack)
+{
+	// Same state: nearer first
+	CHECK(DrawSort::DrawKey(MakeSortJob(1, 1, 1.0f, false)) < DrawSort::DrawKey(MakeSortJob(1, 1, 5.0f, false)));
+
+	// Shaders outrank materials, & materials outrank depth
+	CHECK(DrawSort::DrawKey(MakeSortJob(1, 9, 9.0f, false)) < DrawSort::DrawKey(MakeSortJob(2, 0, 0.5f, false)));
+	CHECK(DrawSort::DrawKey(MakeSortJob(1, 1, 9.0f, false)) < DrawSort::DrawKey(MakeSortJob(1, 2, 0.5f, false)));
+
+	// Back-buffer draws lead off-screen targets
+	DrawJob offscreen = MakeSortJob(0, 0, 0.0f, false);
+	offscreen.directToBackbuf = false;
+	offscreen.bindingTable.rtvs[offscreen.bindingTable.numRTVs++] = D3DHandle{ 7, 1, D3D_OBJ_TYPES::TEXTURE };
+	CHECK(DrawSort::DrawKey(MakeSortJob(255, 4095, 1000.0f, false)) < DrawSort::DrawKey(offscreen));
+
+	// Depths behind the camera clamp to zero rather than wrapping to the far end
+	CHECK(DrawSort::DrawKey(MakeSortJob(1, 1, -3.0f, false)) == DrawSort::DrawKey(MakeSortJob(1, 1, 0.0f, false)));
+}
+
+TEST_CASE(DrawKeysSortTranslucentDrawsBackToFront)
+{
+	// Depth first & inverted, whatever the state says
+	CHECK(DrawSort::DrawKey(MakeSortJob(1, 1, 5.0f, true)) < DrawSort::DrawKey(MakeSortJob(1, 1, 1.0f, true)));
+	CHECK(DrawSort::DrawKey(MakeSortJob(2, 9, 5.0f, true)) < DrawSort::DrawKey(MakeSortJob(1, 0, 1.0f, true)));
+
+	// State only breaks depth ties
+	CHECK(DrawSort::DrawKey(MakeSortJob(1, 1, 2.0f, true)) < DrawSort::DrawKey(MakeSortJob(2, 1, 2.0f, true)));
+}
+
+TEST_CASE(RadixSortIsStable)
+{
+	// Few distinct keys spread over every digit, so most passes run & equal keys have plenty of chances to swap
+	constexpr uint32_t num_keys = 1000;
+	uint64_t keys[num_keys];
+	uint32_t values[num_keys];
+	uint64_t keyScratch[num_keys];
+	uint32_t valueScratch[num_keys];
+
+	const uint64_t distinct[] = { 0x0, 0xFF, 0x8000000000000000ull, 0x00FF00FF00FF00FFull, 0x0123456789ABCDEFull, 0x0123456789ABCDEEull, 0xFFFFFFFFFFFFFFFFull };
+	constexpr uint32_t num_distinct = sizeof(distinct) / sizeof(uint64_t);
+	uint32_t seed = 12345;
+	for (uint32_t i = 0; i < num_keys; i++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		keys[i] = distinct[(seed >> 16) % num_distinct];
+		values[i] = i;
+	}
+
+	DrawSort::RadixSort(keys, values, num_keys, keyScratch, valueScratch);
+
+	bool ordered = true;
+	bool stable = true;
+	for (uint32_t i = 1; i < num_keys; i++)
+	{
+		ordered &= keys[i - 1] <= keys[i];
+		stable &= (keys[i - 1] != keys[i]) || (values[i - 1] < values[i]);
+	}
+	CHECK(ordered);
+	CHECK(stable);
+}
+
+TEST_CASE(RadixSortKeepsSharedKeysInPlace)
+{
+	// Every digit is shared, so every pass is skipped & nothing may move
+	uint64_t keys[] = { 42, 42, 42, 42 };
+	uint32_t values[] = { 3, 1, 2, 0 };
+	uint64_t keyScratch[4];
+	uint32_t valueScratch[4];
+	DrawSort::RadixSort(keys, values, 4, keyScratch, valueScratch);
+	CHECK(values[0] == 3 && values[1] == 1 && values[2] == 2 && values[3] == 0);
+
+	// An odd number of passes leaves the results in the scratch arrays; they still have to come back
+	uint64_t oddKeys[] = { 0x0300, 0x0100, 0x0200 };
+	uint32_t oddValues[] = { 0, 1, 2 };
+	DrawSort::RadixSort(oddKeys, oddValues, 3, keyScratch, valueScratch);
+	CHECK(oddKeys[0] == 0x0100 && oddKeys[1] == 0x0200 && oddKeys[2] == 0x0300);
+	CHECK(oddValues[0] == 1 && oddValues[1] == 2 && oddValues[2] == 0);
+}
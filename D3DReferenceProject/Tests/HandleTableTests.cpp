@@ -0,0 +1,85 @@
+#include "TestHarness.h"
+#include "HandleTable.h"
+#include "TaskScheduler.h"
+
+// Tables grow from whichever thread runs dry (resource creation off loader tasks, say), so growth has to be safe without a Reserve() first
+
+constexpr uint32_t table_test_handles = 8192;
+
+struct TableTestData
+{
+	HandleTable<uint32_t> table;
+	uint32_t indices[table_test_handles];
+	uint16_t generations[table_test_handles];
+};
+
+void AllocateTableHandles(uint32_t begin, uint32_t end, void* data)
+{
+	TableTestData& test = *static_cast<TableTestData*>(data);
+	for (uint32_t i = begin; i < end; i++)
+	{
+		test.indices[i] = test.table.Allocate(test.generations[i]);
+		uint32_t* value = test.table.Resolve(test.indices[i], test.generations[i]);
+		if (value != nullptr)
+		{
+			*value = i;
+		}
+	}
+}
+
+TEST_CASE(HandleTableGrowsFromWorkers)
+{
+	TableTestData* test = new (Memory::AllocateSingle<TableTestData>(alignof(TableTestData))) TableTestData();
+	TaskScheduler::ParallelFor(0, table_test_handles, AllocateTableHandles, test, 16);
+
+	CHECK(test->table.NumLive() == table_test_handles);
+	CHECK(test->table.Capacity() == table_test_handles);
+
+	// Every handle got its own slot, & nothing trampled anything else's
+	bool allValid = true;
+	for (uint32_t i = 0; i < table_test_handles; i++)
+	{
+		const uint32_t* value = test->table.Resolve(test->indices[i], test->generations[i]);
+		allValid &= (value != nullptr) && (*value == i);
+	}
+	CHECK(allValid);
+
+	// Released handles stop resolving, & their slots are reused before the table grows again
+	for (uint32_t i = 0; i < table_test_handles; i++)
+	{
+		test->table.Free(test->indices[i], test->generations[i]);
+	}
+	CHECK(test->table.NumLive() == 0);
+	CHECK(test->table.Resolve(test->indices[0], test->generations[0]) == nullptr);
+	TaskScheduler::ParallelFor(0, table_test_handles, AllocateTableHandles, test, 16);
+	CHECK(test->table.Capacity() == table_test_handles);
+}
+
+
+TEST_CASE(HandleTableHoldsRetiredSlotsUntilRecycled)
+{
+	typedef HandleTable<uint32_t, 4, 1> FourSlotTable; // One chunk, never grows
+	FourSlotTable* table = new (Memory::AllocateSingle<FourSlotTable>(alignof(FourSlotTable))) FourSlotTable();
+	uint16_t generation = 0;
+	const uint32_t retired = table->Allocate(generation);
+	*table->Resolve(retired, generation) = 42;
+
+	// The handle goes stale straight away, but the value stays put & the slot stays out of circulation
+	CHECK(table->Retire(retired, generation));
+	CHECK(table->Resolve(retired, generation) == nullptr);
+	CHECK(table->AtSlot(retired) == 42 && table->NumLive() == 0);
+
+	uint16_t others[3];
+	bool neverRetired = true;
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		neverRetired &= (table->Allocate(others[i]) != retired);
+	}
+	CHECK(neverRetired);
+
+	// Once recycled, it's the only slot left
+	table->Recycle(retired);
+	uint16_t reused = 0;
+	CHECK(table->Allocate(reused) == retired);
+	CHECK(reused != generation && table->Resolve(retired, reused) != nullptr);
+}
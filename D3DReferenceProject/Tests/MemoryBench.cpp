@@ -0,0 +1,91 @@
+#include "TestHarness.h"
+#include "Memory.h"
+#include "D3DUtils.h"
+#include <cstdio>
+
+// Huge-page backing vs standard pages, over the access patterns BakeModels() runs on the scene vertex pool (~48MB of Vertex3D): a linear pass
+// (dedup's scan), then a random gather through an index buffer (the remap into the baked vertex array)
+// Neither pattern is compute-bound, so the difference between the two runs is mostly TLB misses; on Windows, huge pages need
+// SeLockMemoryPrivilege, & without it both runs land on standard pages
+
+constexpr uint32_t walk_vts = 1048576; // Matches the scene's [maxNumVts]
+constexpr uint32_t walk_passes = 4;
+
+const char* BackingName(PAGE_BACKING backing)
+{
+	switch (backing)
+	{
+		case PAGE_BACKING::TRANSPARENT_HUGE: return "transparent huge pages";
+		case PAGE_BACKING::EXPLICIT_HUGE: return "explicit huge pages";
+		default: return "standard pages";
+	}
+}
+
+void WalkVertices(const char* label, Vertex3D* vts, Vertex3D* remapped, const uint32_t* ndces)
+{
+	for (uint32_t i = 0; i < walk_vts; i++)
+	{
+		vts[i].pos = { static_cast<float>(i), 0.0f, 0.0f, 1.0f };
+		vts[i].mat = {};
+		vts[i].normals = {};
+	}
+
+	char line[96] = {};
+	BenchTimer timer;
+	float sum = 0.0f;
+	for (uint32_t pass = 0; pass < walk_passes; pass++)
+	{
+		for (uint32_t i = 0; i < walk_vts; i++)
+		{
+			sum += vts[i].pos.x;
+		}
+	}
+	snprintf(line, sizeof(line), "%s, linear pass", label);
+	TestHarness::Report(line, timer.ElapsedMs() / walk_passes, "ms");
+
+	timer.Restart();
+	for (uint32_t pass = 0; pass < walk_passes; pass++)
+	{
+		for (uint32_t i = 0; i < walk_vts; i++)
+		{
+			remapped[i] = vts[ndces[i]];
+		}
+	}
+	snprintf(line, sizeof(line), "%s, random gather", label);
+	TestHarness::Report(line, timer.ElapsedMs() / walk_passes, "ms");
+	TestHarness::Consume(static_cast<uint64_t>(sum + remapped[walk_vts / 2].pos.x));
+}
+
+BENCHMARK(HugePageVertexWalk)
+{
+	// Shuffled indices, so the gather touches a different page almost every vertex
+	uint32_t* ndces = Memory::AllocateArray<uint32_t>(walk_vts);
+	for (uint32_t i = 0; i < walk_vts; i++)
+	{
+		ndces[i] = i;
+	}
+
+	uint64_t rng = 0x9E3779B97F4A7C15ull;
+	for (uint32_t i = walk_vts - 1; i > 0; i--)
+	{
+		rng ^= rng << 13;
+		rng ^= rng >> 7;
+		rng ^= rng << 17;
+		const uint32_t j = static_cast<uint32_t>(rng % (i + 1));
+		const uint32_t swap = ndces[i];
+		ndces[i] = ndces[j];
+		ndces[j] = swap;
+	}
+
+	Vertex3D* vts = Memory::AllocateArray<Vertex3D>(walk_vts, 16);
+	Vertex3D* remapped = Memory::AllocateArray<Vertex3D>(walk_vts, 16);
+	WalkVertices("standard pages", vts, remapped, ndces);
+
+	PAGE_BACKING backing = PAGE_BACKING::STANDARD;
+	Vertex3D* largeVts = Memory::AllocateLargeArray<Vertex3D>(walk_vts, &backing, 16);
+	Vertex3D* largeRemapped = Memory::AllocateLargeArray<Vertex3D>(walk_vts, nullptr, 16);
+	WalkVertices(BackingName(backing), largeVts, largeRemapped, ndces);
+
+	// The harness only rewinds the main arena, so hand the large-page loans back here
+	Memory::FreeToAddress(largeVts);
+}
@@ -0,0 +1,58 @@
+#include "TestHarness.h"
+#include "ObjectPool.h"
+#include "TaskScheduler.h"
+
+// Pools grow from whichever thread runs dry, so growth has to be safe off the main thread without a Reserve() first
+
+constexpr uint32_t pool_test_objects = 8192;
+
+struct PoolTestObject
+{
+	uint32_t value;
+	uint32_t padding[7];
+};
+
+struct PoolTestData
+{
+	ObjectPool<PoolTestObject, 64, pool_test_objects / 64> pool;
+	PoolTestObject* objects[pool_test_objects];
+};
+
+void AllocatePoolObjects(uint32_t begin, uint32_t end, void* data)
+{
+	PoolTestData& test = *static_cast<PoolTestData*>(data);
+	for (uint32_t i = begin; i < end; i++)
+	{
+		test.objects[i] = test.pool.New();
+		if (test.objects[i] != nullptr)
+		{
+			test.objects[i]->value = i;
+		}
+	}
+}
+
+TEST_CASE(ObjectPoolGrowsFromWorkers)
+{
+	PoolTestData* test = new (Memory::AllocateSingle<PoolTestData>(alignof(PoolTestData))) PoolTestData();
+	TaskScheduler::ParallelFor(0, pool_test_objects, AllocatePoolObjects, test, 16);
+
+	CHECK(test->pool.NumLive() == pool_test_objects);
+	CHECK(test->pool.Capacity() == pool_test_objects);
+
+	// Every object got its own slot, & nothing trampled anything else's
+	bool allValid = true;
+	for (uint32_t i = 0; i < pool_test_objects; i++)
+	{
+		allValid &= (test->objects[i] != nullptr) && (test->objects[i]->value == i);
+	}
+	CHECK(allValid);
+
+	// Freed slots are reused before the pool grows again
+	for (uint32_t i = 0; i < pool_test_objects; i++)
+	{
+		test->pool.Delete(test->objects[i]);
+	}
+	CHECK(test->pool.NumLive() == 0);
+	TaskScheduler::ParallelFor(0, pool_test_objects, AllocatePoolObjects, test, 16);
+	CHECK(test->pool.Capacity() == pool_test_objects);
+}
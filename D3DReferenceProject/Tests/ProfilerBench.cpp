@@ -0,0 +1,76 @@
+#include "TestHarness.h"
+#include "Profiler.h"
+#include <thread>
+
+// Per-zone cost against the 50ns budget, next to a bare rdtsc pair (the floor any rdtsc-timed zone pays)
+// rdtsc's own cost varies a lot between hosts (some hypervisors trap it, which alone can blow the budget), so the checks hold what a zone adds
+// on top of its two timestamps to the budget; the absolute numbers are reported alongside
+// The Tests project builds with PROFILER_ZONES on in every configuration, so Release runs measure zones as the optimizer leaves them
+// Unrecorded threads (ones that never called NameThread()) are measured too, since their zones should cost next to nothing
+
+constexpr uint32_t profiled_zones = 1 << 22;
+constexpr double zone_budget_ns = 50.0;
+
+#if PROFILER_ZONES
+// Out of line, so each call opens & closes its zone the way an instrumented function would
+#ifdef _MSC_VER
+__declspec(noinline)
+#else
+__attribute__((noinline))
+#endif
+uint64_t ProfiledLeaf(uint64_t x)
+{
+	PROFILE_ZONE("ProfiledLeaf");
+	return x * 0x9E3779B97F4A7C15ull;
+}
+
+#ifdef _MSC_VER
+__declspec(noinline)
+#else
+__attribute__((noinline))
+#endif
+uint64_t PlainLeaf(uint64_t x)
+{
+	return x * 0x9E3779B97F4A7C15ull;
+}
+
+double TimeLeaves(uint64_t (*leaf)(uint64_t))
+{
+	uint64_t sum = 0;
+	BenchTimer timer;
+	for (uint32_t i = 0; i < profiled_zones; i++)
+	{
+		sum += leaf(i);
+	}
+	const double ns = timer.ElapsedNs() / profiled_zones;
+	TestHarness::Consume(sum);
+	return ns;
+}
+
+BENCHMARK(ProfilerZoneCost)
+{
+	uint64_t ticks = 0;
+	BenchTimer timer;
+	for (uint32_t i = 0; i < profiled_zones; i++)
+	{
+		const uint64_t begin = Profiler::Now();
+		ticks += Profiler::Now() - begin;
+	}
+	const double rdtscNs = timer.ElapsedNs() / profiled_zones;
+	TestHarness::Report("bare rdtsc pair", rdtscNs, "ns");
+	TestHarness::Consume(ticks);
+
+	const double plainNs = TimeLeaves(PlainLeaf);
+	const double zoneNs = TimeLeaves(ProfiledLeaf) - plainNs;
+	TestHarness::Report("zone, recorded thread", zoneNs, "ns/zone");
+	TestHarness::Report("zone, recorded thread, beyond the rdtsc pair", zoneNs - rdtscNs, "ns/zone");
+	CHECK(zoneNs - rdtscNs < zone_budget_ns);
+
+	// A fresh thread that never names itself
+	double unrecordedNs = 0.0;
+	std::thread unrecorded([&unrecordedNs, plainNs] { unrecordedNs = TimeLeaves(ProfiledLeaf) - plainNs; });
+	unrecorded.join();
+	TestHarness::Report("zone, unrecorded thread", unrecordedNs, "ns/zone");
+	CHECK(unrecordedNs < zone_budget_ns);
+}
+#endif
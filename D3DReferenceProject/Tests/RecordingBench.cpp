@@ -0,0 +1,80 @@
+#include "TestHarness.h"
+#include "ParallelRecorder.h"
+#include "TaskScheduler.h"
+#include "Memory.h"
+#include <cstdio>
+#include <new>
+
+// Recording time vs recording chunks, on the null backend (encode only, no device), so the numbers are pure CPU recording cost
+// Each frame records the same draw list; going from one chunk to [max_chunks] shows how recording scales with the threads the scheduler
+// can put on it (capped by TaskScheduler::NumThreads(), which is reported alongside)
+
+constexpr uint32_t recorded_draws = 8192;
+constexpr uint32_t recorded_frames = 32;
+constexpr uint32_t recording_stream_bytes = 4 * 1024 * 1024;
+
+struct RecordingBenchData
+{
+	DrawJob* jobs;
+	DrawGeometry geometry;
+};
+
+void RecordBenchDraws(CommandBuffer& cmds, uint32_t firstItem, uint32_t numItems, void* userData)
+{
+	const RecordingBenchData& data = *static_cast<const RecordingBenchData*>(userData);
+	for (uint32_t i = firstItem; i < firstItem + numItems; i++)
+	{
+		cmds.EncodeDraw(data.jobs[i], data.geometry);
+	}
+}
+
+BENCHMARK(ParallelRecordingScaling)
+{
+	RecordingBenchData data;
+	data.jobs = Memory::AllocateArray<DrawJob>(recorded_draws, alignof(DrawJob));
+
+	// A handful of bindings per draw, so each one encodes to a realistic few hundred bytes
+	for (uint32_t d = 0; d < recorded_draws; d++)
+	{
+		DrawJob& job = *new (&data.jobs[d]) DrawJob();
+		BindingTable::StageTable& ps = job.bindingTable.stages[static_cast<uint32_t>(SHADER_TYPES::PS)];
+		BindingTable::StageTable& vs = job.bindingTable.stages[static_cast<uint32_t>(SHADER_TYPES::VS)];
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			ps.srvs[ps.numSRVs++] = D3DHandle{ static_cast<uint16_t>(d + i), 1, D3D_OBJ_TYPES::TEXTURE };
+		}
+		vs.cbuffers[vs.numCBuffers++] = D3DHandle{ static_cast<uint16_t>(d), 1, D3D_OBJ_TYPES::BUFFER };
+		ps.cbuffers[ps.numCBuffers++] = D3DHandle{ static_cast<uint16_t>(d + 1), 1, D3D_OBJ_TYPES::BUFFER };
+	}
+
+	const InstanceBatch batch = {};
+	data.geometry.batches = &batch;
+	data.geometry.numBatches = 1;
+
+	char line[96] = {};
+	snprintf(line, sizeof(line), "scheduler threads");
+	TestHarness::Report(line, TaskScheduler::NumThreads(), "");
+
+	for (uint32_t chunks = 1; chunks <= ParallelRecorder::max_chunks; chunks *= 2)
+	{
+		ParallelRecorder recorder;
+		recorder.Init(chunks, recording_stream_bytes, RECORD_BACKENDS::NULL_BACKEND);
+
+		double recordMs = 0.0;
+		double submitMs = 0.0;
+		for (uint32_t frame = 0; frame < recorded_frames; frame++)
+		{
+			recorder.Record(recorded_draws, RecordBenchDraws, &data);
+			recorder.Submit();
+			recordMs += recorder.LastTimings().recordMs;
+			submitMs += recorder.LastTimings().submitMs;
+		}
+
+		snprintf(line, sizeof(line), "%u chunk(s), record %u draws", chunks, recorded_draws);
+		TestHarness::Report(line, recordMs / recorded_frames, "ms");
+		snprintf(line, sizeof(line), "%u chunk(s), submit (stream walk)", chunks);
+		TestHarness::Report(line, submitMs / recorded_frames, "ms");
+		TestHarness::Consume(recorder.LastTimings().numCommands);
+		recorder.DeInit();
+	}
+}
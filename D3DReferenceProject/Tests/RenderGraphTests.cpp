@@ -0,0 +1,177 @@
+#include "TestHarness.h"
+#include "RenderGraph.h"
+
+// Back-buffer draws only need a default DrawJob, so these run without a device
+
+RenderGraph* NewTestGraph()
+{
+	RenderGraph* graph = new (Memory::AllocateSingle<RenderGraph>(alignof(RenderGraph))) RenderGraph();
+	graph->Init();
+	return graph;
+}
+
+RenderGraph::RenderPass* AddBackbufferDraw(RenderGraph& graph, bool depthTestedOpaque, float sortDepth = 0.0f)
+{
+	DrawJob job;
+	job.directToBackbuf = true;
+	job.depthTestedOpaque = depthTestedOpaque;
+	job.sortDepth = sortDepth;
+	return graph.AddDrawPass(job);
+}
+
+// Off-screen draws with no bindings; tests declare their reads & writes by hand
+RenderGraph::RenderPass* AddOffscreenDraw(RenderGraph& graph)
+{
+	DrawJob job;
+	job.directToBackbuf = false;
+	return graph.AddDrawPass(job);
+}
+
+RenderResourceID TestTexture(uint16_t index)
+{
+	return RenderGraph::ResourceID(D3DHandle{ index, 1, D3D_OBJ_TYPES::TEXTURE });
+}
+
+TEST_CASE(RenderGraphDepthTestedDrawsShareLevels)
+{
+	RenderGraph& graph = *NewTestGraph();
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		AddBackbufferDraw(graph, true);
+	}
+	graph.Compile();
+
+	CHECK(graph.NumCompiledPasses() == 4);
+	CHECK(graph.NumGroups() == 1);
+	graph.DeInit();
+}
+
+TEST_CASE(RenderGraphUnflaggedDrawsKeepOrder)
+{
+	// Post-processing, fullscreen passes & UI don't opt in, so every one of them waits on the previous write
+	RenderGraph& graph = *NewTestGraph();
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		AddBackbufferDraw(graph, false);
+	}
+	graph.Compile();
+
+	CHECK(graph.NumCompiledPasses() == 3);
+	CHECK(graph.NumGroups() == 3);
+	graph.DeInit();
+}
+
+TEST_CASE(RenderGraphUnflaggedDrawsSplitRuns)
+{
+	// scene, scene, UI, scene: the UI draw lands after the first run, & the last draw can't hop back over it
+	RenderGraph& graph = *NewTestGraph();
+	AddBackbufferDraw(graph, true);
+	AddBackbufferDraw(graph, true);
+	AddBackbufferDraw(graph, false);
+	AddBackbufferDraw(graph, true);
+	graph.Compile();
+
+	CHECK(graph.NumGroups() == 3);
+	CHECK(graph.GroupStart(1) == 2);
+	CHECK(graph.CompiledPass(2).drawJob->depthTestedOpaque == false);
+	CHECK(graph.CompiledPass(3).declNdx == 3);
+	graph.DeInit();
+}
+
+TEST_CASE(RenderGraphCullsUnexportedChains)
+{
+	// shadow map -> blurred shadow map, which nothing reads; only the final back-buffer draw should survive
+	RenderGraph& graph = *NewTestGraph();
+	RenderGraph::RenderPass* shadows = AddOffscreenDraw(graph);
+	graph.AddWrite(shadows, TestTexture(1));
+	RenderGraph::RenderPass* blur = AddOffscreenDraw(graph);
+	graph.AddRead(blur, TestTexture(1));
+	graph.AddWrite(blur, TestTexture(2));
+	AddBackbufferDraw(graph, false);
+	graph.Compile();
+
+	CHECK(graph.NumCompiledPasses() == 1);
+	CHECK(graph.NumCulledPasses() == 2);
+	CHECK(graph.CompiledPass(0).declNdx == 2);
+
+	// Exporting the end of the chain keeps all of it alive
+	graph.ExportResource(TestTexture(2));
+	graph.Compile();
+	CHECK(graph.NumCompiledPasses() == 3);
+	CHECK(graph.NumCulledPasses() == 0);
+	graph.DeInit();
+}
+
+TEST_CASE(RenderGraphReadAfterWriteSplitsLevels)
+{
+	// The consumer reads what the producer writes, so it can't share the producer's level
+	RenderGraph& graph = *NewTestGraph();
+	RenderGraph::RenderPass* producer = AddOffscreenDraw(graph);
+	graph.AddWrite(producer, TestTexture(1));
+	RenderGraph::RenderPass* consumer = AddBackbufferDraw(graph, true);
+	graph.AddRead(consumer, TestTexture(1));
+	graph.Compile();
+
+	CHECK(graph.NumCompiledPasses() == 2);
+	CHECK(graph.NumGroups() == 2);
+	CHECK(graph.GroupStart(1) == 1);
+	CHECK(graph.CompiledPass(0).declNdx == 0);
+	CHECK(graph.CompiledPass(1).declNdx == 1);
+	graph.DeInit();
+}
+
+TEST_CASE(RenderGraphIndependentPassesShareLevels)
+{
+	// Two producers with nothing in common, & a consumer of both
+	RenderGraph& graph = *NewTestGraph();
+	RenderGraph::RenderPass* first = AddOffscreenDraw(graph);
+	graph.AddWrite(first, TestTexture(1));
+	RenderGraph::RenderPass* second = AddOffscreenDraw(graph);
+	graph.AddWrite(second, TestTexture(2));
+	RenderGraph::RenderPass* consumer = AddBackbufferDraw(graph, false);
+	graph.AddRead(consumer, TestTexture(1));
+	graph.AddRead(consumer, TestTexture(2));
+	graph.Compile();
+
+	CHECK(graph.NumCompiledPasses() == 3);
+	CHECK(graph.NumGroups() == 2);
+	CHECK(graph.GroupStart(1) == 2);
+	CHECK(graph.CompiledPass(2).declNdx == 2);
+	graph.DeInit();
+}
+
+TEST_CASE(RenderGraphSkipsUnchangedRecompiles)
+{
+	// Sorting puts the nearer (second) draw first; a cached compile keeps that order, while a real recompile starts over in declaration order
+	RenderGraph& graph = *NewTestGraph();
+	AddBackbufferDraw(graph, true, 2.0f);
+	AddBackbufferDraw(graph, true, 1.0f);
+	graph.Compile();
+	graph.SortPasses();
+	CHECK(graph.CompiledPass(0).declNdx == 1);
+
+	// Same structure, fresh pass objects; the jobs behind the cached order still change, so the version moves on
+	const uint32_t sortedVersion = graph.Version();
+	graph.Reset();
+	AddBackbufferDraw(graph, true, 2.0f);
+	AddBackbufferDraw(graph, true, 1.0f);
+	graph.Compile();
+	CHECK(graph.CompiledPass(0).declNdx == 1);
+	CHECK(graph.CompiledPass(1).drawJob->sortDepth == 2.0f);
+	CHECK(graph.Version() != sortedVersion);
+
+	// Nothing re-declared at all; Compile() shouldn't touch anything
+	const uint32_t cachedVersion = graph.Version();
+	graph.Compile();
+	CHECK(graph.Version() == cachedVersion);
+
+	// One more pass changes the structure
+	graph.Reset();
+	AddBackbufferDraw(graph, true, 2.0f);
+	AddBackbufferDraw(graph, true, 1.0f);
+	AddBackbufferDraw(graph, false);
+	graph.Compile();
+	CHECK(graph.NumCompiledPasses() == 3);
+	CHECK(graph.CompiledPass(0).declNdx == 0);
+	graph.DeInit();
+}
\ No newline at end of file
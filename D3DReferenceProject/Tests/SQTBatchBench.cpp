@@ -0,0 +1,111 @@
+#include "TestHarness.h"
+#include "SQTBatch.h"
+#include "Memory.h"
+#include <cmath>
+#include <cstdio>
+
+// SQTBatch throughput on one thread, so the numbers are transforms per second per core
+// Runs are long (well past L2) so each kernel streams its inputs from memory the way a big scene's batch update would; SSE & AVX2 builds are
+// measured back-to-back on the same data (on CPUs without AVX2 the AVX2 rows just repeat SSE, & say so)
+
+constexpr uint32_t sqt_bench_count = 64 * 1024;
+constexpr uint32_t sqt_bench_passes = 64;
+
+// One SoA run, each component stream in its own 32-byte aligned block
+struct SQTBenchRun
+{
+	float* components[8];
+
+	SQTStreams Streams()
+	{
+		return { components[0], components[1], components[2], components[3], components[4], components[5], components[6], components[7] };
+	}
+};
+
+// Unit rotations about a slowly drifting axis, translations along a line & positive scales; enough variety that slerp takes its full path
+SQTBenchRun NewSQTBenchRun(float phase)
+{
+	SQTBenchRun run;
+	for (uint32_t c = 0; c < 8; c++)
+	{
+		run.components[c] = Memory::AllocateArray<float>(sqt_bench_count, 32);
+	}
+
+	for (uint32_t i = 0; i < sqt_bench_count; i++)
+	{
+		const float angle = phase + static_cast<float>(i) * 0.001f;
+		const float axisX = cosf(angle * 0.37f);
+		const float axisY = sinf(angle * 0.37f);
+		const float halfSin = sinf(angle * 0.5f);
+		run.components[0][i] = axisX * halfSin;
+		run.components[1][i] = axisY * halfSin;
+		run.components[2][i] = 0.0f;
+		run.components[3][i] = cosf(angle * 0.5f);
+		run.components[4][i] = static_cast<float>(i) * 0.01f;
+		run.components[5][i] = phase;
+		run.components[6][i] = -static_cast<float>(i) * 0.02f;
+		run.components[7][i] = 1.0f + phase * 0.5f;
+	}
+	return run;
+}
+
+typedef void (*SQTBenchKernel)(SQTBenchRun& out, SQTBenchRun& a, SQTBenchRun& b, DirectX::XMFLOAT4X4* matrices);
+
+void BenchCompose(SQTBenchRun& out, SQTBenchRun& a, SQTBenchRun& b, DirectX::XMFLOAT4X4*)
+{
+	SQTBatch::Compose(out.Streams(), a.Streams(), b.Streams(), sqt_bench_count);
+}
+
+void BenchToMatrices(SQTBenchRun&, SQTBenchRun& a, SQTBenchRun&, DirectX::XMFLOAT4X4* matrices)
+{
+	SQTBatch::ToMatrices(matrices, a.Streams(), sqt_bench_count);
+}
+
+void BenchSlerp(SQTBenchRun& out, SQTBenchRun& a, SQTBenchRun& b, DirectX::XMFLOAT4X4*)
+{
+	SQTBatch::Slerp(out.Streams(), a.Streams(), b.Streams(), 0.3f, sqt_bench_count);
+}
+
+BENCHMARK(SQTBatchThroughput)
+{
+	SQTBenchRun a = NewSQTBenchRun(0.0f);
+	SQTBenchRun b = NewSQTBenchRun(1.0f);
+	SQTBenchRun out = NewSQTBenchRun(0.0f);
+	DirectX::XMFLOAT4X4* matrices = Memory::AllocateArray<DirectX::XMFLOAT4X4>(sqt_bench_count, 32);
+
+	const char* const kernelNames[] = { "Compose", "ToMatrices", "Slerp" };
+	const SQTBenchKernel kernels[] = { BenchCompose, BenchToMatrices, BenchSlerp };
+	const char* const buildNames[] = { "SSE", "AVX2" };
+
+	char line[96] = {};
+	snprintf(line, sizeof(line), "transforms per run");
+	TestHarness::Report(line, sqt_bench_count, "");
+
+	for (uint32_t build = 0; build < 2; build++)
+	{
+		SQTBatch::ForceSSE(build == 0);
+		if (build == 1 && !SQTBatch::UsingAVX2())
+		{
+			std::printf("  (no AVX2 on this CPU; the AVX2 rows run the SSE kernels)\n");
+		}
+
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			kernels[k](out, a, b, matrices); // Warm-up; faults in the output pages
+
+			BenchTimer timer;
+			for (uint32_t pass = 0; pass < sqt_bench_passes; pass++)
+			{
+				kernels[k](out, a, b, matrices);
+			}
+			const double seconds = timer.ElapsedNs() * 1e-9;
+
+			snprintf(line, sizeof(line), "%s, %s", buildNames[build], kernelNames[k]);
+			TestHarness::Report(line, (static_cast<double>(sqt_bench_count) * sqt_bench_passes) / (seconds * 1e6), "M transforms/s");
+		}
+	}
+
+	SQTBatch::ForceSSE(false);
+	const float last = out.components[3][sqt_bench_count - 1] + matrices[sqt_bench_count - 1].m[3][0];
+	TestHarness::Consume(static_cast<uint64_t>(static_cast<int64_t>(last * 1000.0f)));
+}
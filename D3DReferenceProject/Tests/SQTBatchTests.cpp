@@ -0,0 +1,298 @@
+#include "TestHarness.h"
+#include "SQTBatch.h"
+#include "Memory.h"
+#include <DirectXMath.h>
+#include <cstdio>
+#include <new>
+
+// SQTBatch against DirectXMath, once on the SSE kernels & once on the AVX2 ones
+// Counts end in a partial group, & everything past them starts out as a sentinel that has to survive each call
+// On CPUs without AVX2 the "AVX2" cases run SSE again (& say so)
+
+constexpr uint32_t sqt_test_count = 2 * SQTBatch::width + 5;
+constexpr float sqt_sentinel = -12345.0f;
+constexpr float sqt_eps = 1e-4f;
+
+struct SQTTestData
+{
+	TransformStreams a;
+	TransformStreams b;
+	TransformStreams out;
+};
+
+float NextSigned(uint64_t& rng)
+{
+	rng = rng * 6364136223846793005ull + 1442695040888963407ull;
+	return (static_cast<float>(rng >> 40) / static_cast<float>(1ull << 24)) * 2.0f - 1.0f;
+}
+
+SQT_Transform RandomTransform(uint64_t& rng)
+{
+	DirectX::XMFLOAT4 q = {};
+	DirectX::XMStoreFloat4(&q, DirectX::XMQuaternionNormalize(DirectX::XMVectorSet(NextSigned(rng), NextSigned(rng), NextSigned(rng), NextSigned(rng))));
+
+	SQT_Transform transform;
+	transform.q = q;
+	transform.ts = DirectX::XMFLOAT4(NextSigned(rng) * 10.0f, NextSigned(rng) * 10.0f, NextSigned(rng) * 10.0f, 1.25f + NextSigned(rng) * 0.75f);
+	return transform;
+}
+
+void FillSentinel(TransformStreams& streams)
+{
+	float* const components[8] = { streams.qx, streams.qy, streams.qz, streams.qw, streams.tx, streams.ty, streams.tz, streams.s };
+	for (uint32_t c = 0; c < 8; c++)
+	{
+		for (uint32_t i = 0; i < TransformStreams::capacity; i++)
+		{
+			components[c][i] = sqt_sentinel;
+		}
+	}
+}
+
+bool TailUntouched(const TransformStreams& streams)
+{
+	const float* const components[8] = { streams.qx, streams.qy, streams.qz, streams.qw, streams.tx, streams.ty, streams.tz, streams.s };
+	bool untouched = true;
+	for (uint32_t c = 0; c < 8; c++)
+	{
+		for (uint32_t i = sqt_test_count; i < TransformStreams::capacity; i++)
+		{
+			untouched &= (components[c][i] == sqt_sentinel);
+		}
+	}
+	return untouched;
+}
+
+// Random inputs; every fourth [b] rotation is a near-copy of [a]'s & every fourth is its negation, so slerp's lerp fallback & hemisphere
+// flip both get exercised
+SQTTestData* NewSQTTestData()
+{
+	SQTTestData* data = new (Memory::AllocateSingle<SQTTestData>(alignof(SQTTestData))) SQTTestData();
+	FillSentinel(data->a);
+	FillSentinel(data->b);
+	FillSentinel(data->out);
+
+	uint64_t rng = 0x2545F4914F6CDD1Dull;
+	for (uint32_t i = 0; i < sqt_test_count; i++)
+	{
+		const SQT_Transform a = RandomTransform(rng);
+		SQT_Transform b = RandomTransform(rng);
+		if ((i % 4) == 1)
+		{
+			const DirectX::XMVECTOR nudged = DirectX::XMVectorSet(a.q.x + 0.001f, a.q.y, a.q.z - 0.001f, a.q.w);
+			DirectX::XMStoreFloat4(&b.q, DirectX::XMQuaternionNormalize(nudged));
+		}
+		else if ((i % 4) == 2)
+		{
+			b.q = DirectX::XMFLOAT4(-a.q.x, -a.q.y, -a.q.z, -a.q.w);
+		}
+		data->a.Set(i, a);
+		data->b.Set(i, b);
+	}
+	return data;
+}
+
+void SelectKernels(bool sse)
+{
+	SQTBatch::ForceSSE(sse);
+	if (!sse && !SQTBatch::UsingAVX2())
+	{
+		std::printf("  (no AVX2 on this CPU; running the SSE kernels instead)\n");
+	}
+}
+
+DirectX::XMMATRIX AffineMatrix(const SQT_Transform& transform)
+{
+	return DirectX::XMMatrixAffineTransformation(DirectX::XMVectorReplicate(transform.ts.w), DirectX::XMVectorZero(),
+												 DirectX::XMLoadFloat4(&transform.q),
+												 DirectX::XMVectorSet(transform.ts.x, transform.ts.y, transform.ts.z, 0.0f));
+}
+
+float MatrixError(const DirectX::XMFLOAT4X4& m, DirectX::FXMMATRIX reference)
+{
+	DirectX::XMFLOAT4X4 expected;
+	DirectX::XMStoreFloat4x4(&expected, reference);
+
+	float maxError = 0.0f;
+	for (uint32_t r = 0; r < 4; r++)
+	{
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			const float error = fabsf(m.m[r][c] - expected.m[r][c]);
+			maxError = (error > maxError) ? error : maxError;
+		}
+	}
+	return maxError;
+}
+
+float QuatError(const DirectX::XMFLOAT4& q, DirectX::FXMVECTOR reference)
+{
+	DirectX::XMFLOAT4 expected;
+	DirectX::XMStoreFloat4(&expected, reference);
+	const float errors[4] = { fabsf(q.x - expected.x), fabsf(q.y - expected.y), fabsf(q.z - expected.z), fabsf(q.w - expected.w) };
+
+	float maxError = 0.0f;
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		maxError = (errors[i] > maxError) ? errors[i] : maxError;
+	}
+	return maxError;
+}
+
+// Translation & scale are plain lerps in both blends
+float TranslationScaleError(const SQT_Transform& blended, const SQT_Transform& a, const SQT_Transform& b, float t)
+{
+	DirectX::XMFLOAT4 expected;
+	DirectX::XMStoreFloat4(&expected, DirectX::XMVectorLerp(DirectX::XMLoadFloat4(&a.ts), DirectX::XMLoadFloat4(&b.ts), t));
+	return QuatError(blended.ts, DirectX::XMLoadFloat4(&expected));
+}
+
+void CheckCompose(bool sse)
+{
+	SelectKernels(sse);
+	SQTTestData& data = *NewSQTTestData();
+	SQTBatch::Compose(SQTStreams::Of(data.out), SQTStreams::Of(data.a), SQTStreams::Of(data.b), sqt_test_count);
+
+	// Row vectors, so applying the local transform first puts it on the left
+	float matrixError = 0.0f;
+	float quatError = 0.0f;
+	for (uint32_t i = 0; i < sqt_test_count; i++)
+	{
+		const SQT_Transform parent = data.a.Get(i);
+		const SQT_Transform local = data.b.Get(i);
+		const SQT_Transform composed = data.out.Get(i);
+
+		DirectX::XMFLOAT4X4 m;
+		DirectX::XMStoreFloat4x4(&m, AffineMatrix(composed));
+		const float mError = MatrixError(m, DirectX::XMMatrixMultiply(AffineMatrix(local), AffineMatrix(parent)));
+		const float qError = QuatError(composed.q, DirectX::XMQuaternionMultiply(DirectX::XMLoadFloat4(&local.q), DirectX::XMLoadFloat4(&parent.q)));
+		matrixError = (mError > matrixError) ? mError : matrixError;
+		quatError = (qError > quatError) ? qError : quatError;
+	}
+
+	CHECK_NEAR(matrixError, 0.0f, sqt_eps * 10.0f);
+	CHECK_NEAR(quatError, 0.0f, sqt_eps);
+	CHECK(TailUntouched(data.out));
+	SQTBatch::ForceSSE(false);
+}
+
+void CheckInvert(bool sse)
+{
+	SelectKernels(sse);
+	SQTTestData& data = *NewSQTTestData();
+	SQTBatch::Invert(SQTStreams::Of(data.out), SQTStreams::Of(data.a), sqt_test_count);
+
+	float maxError = 0.0f;
+	for (uint32_t i = 0; i < sqt_test_count; i++)
+	{
+		DirectX::XMFLOAT4X4 m;
+		DirectX::XMStoreFloat4x4(&m, AffineMatrix(data.out.Get(i)));
+		const float error = MatrixError(m, DirectX::XMMatrixInverse(nullptr, AffineMatrix(data.a.Get(i))));
+		maxError = (error > maxError) ? error : maxError;
+	}
+
+	CHECK_NEAR(maxError, 0.0f, sqt_eps * 10.0f);
+	CHECK(TailUntouched(data.out));
+	SQTBatch::ForceSSE(false);
+}
+
+void CheckToMatrices(bool sse)
+{
+	SelectKernels(sse);
+	SQTTestData& data = *NewSQTTestData();
+	DirectX::XMFLOAT4X4* matrices = Memory::AllocateArray<DirectX::XMFLOAT4X4>(sqt_test_count + SQTBatch::width, alignof(DirectX::XMFLOAT4X4));
+	for (uint32_t i = 0; i < sqt_test_count + SQTBatch::width; i++)
+	{
+		for (uint32_t e = 0; e < 16; e++)
+		{
+			matrices[i].m[e / 4][e % 4] = sqt_sentinel;
+		}
+	}
+
+	SQTBatch::ToMatrices(matrices, SQTStreams::Of(data.a), sqt_test_count);
+
+	float maxError = 0.0f;
+	for (uint32_t i = 0; i < sqt_test_count; i++)
+	{
+		const float error = MatrixError(matrices[i], AffineMatrix(data.a.Get(i)));
+		maxError = (error > maxError) ? error : maxError;
+	}
+
+	bool untouched = true;
+	for (uint32_t i = sqt_test_count; i < sqt_test_count + SQTBatch::width; i++)
+	{
+		for (uint32_t e = 0; e < 16; e++)
+		{
+			untouched &= (matrices[i].m[e / 4][e % 4] == sqt_sentinel);
+		}
+	}
+
+	CHECK_NEAR(maxError, 0.0f, sqt_eps);
+	CHECK(untouched);
+	SQTBatch::ForceSSE(false);
+}
+
+void CheckBlends(bool sse, bool slerp)
+{
+	SelectKernels(sse);
+	SQTTestData& data = *NewSQTTestData();
+
+	const float ts[] = { 0.0f, 0.25f, 0.5f, 0.9f, 1.0f };
+	float quatError = 0.0f;
+	float lerpError = 0.0f;
+	bool untouched = true;
+	for (float t : ts)
+	{
+		if (slerp)
+		{
+			SQTBatch::Slerp(SQTStreams::Of(data.out), SQTStreams::Of(data.a), SQTStreams::Of(data.b), t, sqt_test_count);
+		}
+		else
+		{
+			SQTBatch::Nlerp(SQTStreams::Of(data.out), SQTStreams::Of(data.a), SQTStreams::Of(data.b), t, sqt_test_count);
+		}
+
+		for (uint32_t i = 0; i < sqt_test_count; i++)
+		{
+			const SQT_Transform a = data.a.Get(i);
+			const SQT_Transform b = data.b.Get(i);
+			const SQT_Transform blended = data.out.Get(i);
+			const DirectX::XMVECTOR qa = DirectX::XMLoadFloat4(&a.q);
+			DirectX::XMVECTOR qb = DirectX::XMLoadFloat4(&b.q);
+
+			// XMQuaternionSlerp() already takes the shorter arc; nlerp has to be flipped onto it by hand
+			DirectX::XMVECTOR expected;
+			if (slerp)
+			{
+				expected = DirectX::XMQuaternionSlerp(qa, qb, t);
+			}
+			else
+			{
+				qb = (DirectX::XMVectorGetX(DirectX::XMQuaternionDot(qa, qb)) < 0.0f) ? DirectX::XMVectorNegate(qb) : qb;
+				expected = DirectX::XMQuaternionNormalize(DirectX::XMVectorLerp(qa, qb, t));
+			}
+
+			const float qError = QuatError(blended.q, expected);
+			const float tsError = TranslationScaleError(blended, a, b, t);
+			quatError = (qError > quatError) ? qError : quatError;
+			lerpError = (tsError > lerpError) ? tsError : lerpError;
+		}
+		untouched &= TailUntouched(data.out);
+	}
+
+	CHECK_NEAR(quatError, 0.0f, sqt_eps);
+	CHECK_NEAR(lerpError, 0.0f, sqt_eps);
+	CHECK(untouched);
+	SQTBatch::ForceSSE(false);
+}
+
+TEST_CASE(SQTComposeMatchesDirectXMathSSE) { CheckCompose(true); }
+TEST_CASE(SQTComposeMatchesDirectXMathAVX2) { CheckCompose(false); }
+TEST_CASE(SQTInvertMatchesDirectXMathSSE) { CheckInvert(true); }
+TEST_CASE(SQTInvertMatchesDirectXMathAVX2) { CheckInvert(false); }
+TEST_CASE(SQTToMatricesMatchesDirectXMathSSE) { CheckToMatrices(true); }
+TEST_CASE(SQTToMatricesMatchesDirectXMathAVX2) { CheckToMatrices(false); }
+TEST_CASE(SQTNlerpMatchesDirectXMathSSE) { CheckBlends(true, false); }
+TEST_CASE(SQTNlerpMatchesDirectXMathAVX2) { CheckBlends(false, false); }
+TEST_CASE(SQTSlerpMatchesDirectXMathSSE) { CheckBlends(true, true); }
+TEST_CASE(SQTSlerpMatchesDirectXMathAVX2) { CheckBlends(false, true); }
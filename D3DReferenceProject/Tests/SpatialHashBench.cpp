@@ -0,0 +1,152 @@
+#include "TestHarness.h"
+#include "SpatialHash.h"
+#include "Memory.h"
+#include <cstdio>
+#include <new>
+
+// SpatialHash insert, move & query costs at 10k, 100k & 1M objects
+// Objects are scattered at constant density (the world grows with the count), mostly small with a few large ones, & the hash is set up the
+// way Scene does it (twice as many buckets as objects, one-unit finest cells)
+//	Moves:		every object nudged by up to a quarter unit (mostly staying in its cell), then every object teleported somewhere random
+//	Queries:	radius queries of two & eight units & eight-nearest queries at random points, plus the linear scan a radius query replaces
+// Radius queries probe every cell they touch on each populated level, so their cost follows query size (in cells); once the bucket table &
+// objects outgrow the cache, most of those probes are misses, which is what the growth from 10k to 1M objects mostly is
+
+constexpr uint32_t hash_bench_sizes[] = { 10000, 100000, 1000000 };
+constexpr uint32_t hash_bench_queries = 4096;
+constexpr uint32_t hash_bench_scans = 16; // Linear scans are O(n) each, so far fewer of them
+constexpr float hash_bench_query_radii[] = { 2.0f, 8.0f };
+constexpr uint32_t hash_bench_max_results = 4096;
+
+struct HashBenchObject
+{
+	DirectX::XMFLOAT3 center;
+	float radius;
+};
+
+float NextUnitFloat(uint64_t& rng)
+{
+	rng = rng * 6364136223846793005ull + 1442695040888963407ull;
+	return static_cast<float>(rng >> 40) / static_cast<float>(1ull << 24);
+}
+
+DirectX::XMFLOAT3 RandomPoint(uint64_t& rng, float extent)
+{
+	return { NextUnitFloat(rng) * extent, NextUnitFloat(rng) * extent, NextUnitFloat(rng) * extent };
+}
+
+// One object per eight cubic units
+float WorldExtent(uint32_t numObjects)
+{
+	return cbrtf(static_cast<float>(numObjects) * 8.0f);
+}
+
+uint32_t ScanRadius(const HashBenchObject* objects, uint32_t numObjects, DirectX::XMFLOAT3 center, float radius)
+{
+	uint32_t matches = 0;
+	for (uint32_t i = 0; i < numObjects; i++)
+	{
+		const float dx = objects[i].center.x - center.x;
+		const float dy = objects[i].center.y - center.y;
+		const float dz = objects[i].center.z - center.z;
+		const float reach = objects[i].radius + radius;
+		matches += ((dx * dx) + (dy * dy) + (dz * dz)) <= (reach * reach);
+	}
+	return matches;
+}
+
+BENCHMARK(SpatialHashScaling)
+{
+	char line[96] = {};
+	uint32_t* results = Memory::AllocateArray<uint32_t>(hash_bench_max_results);
+	float* distances = Memory::AllocateArray<float>(hash_bench_max_results);
+	for (uint32_t numObjects : hash_bench_sizes)
+	{
+		const float extent = WorldExtent(numObjects);
+		uint64_t rng = 0x9E3779B97F4A7C15ull;
+
+		// One in a hundred objects is large enough to land a few levels up
+		HashBenchObject* objects = Memory::AllocateArray<HashBenchObject>(numObjects);
+		for (uint32_t i = 0; i < numObjects; i++)
+		{
+			objects[i].center = RandomPoint(rng, extent);
+			objects[i].radius = ((i % 100) == 0) ? (4.0f + NextUnitFloat(rng) * 28.0f) : (0.25f + NextUnitFloat(rng) * 1.75f);
+		}
+
+		SpatialHash* hash = new (Memory::AllocateSingle<SpatialHash>(alignof(SpatialHash))) SpatialHash();
+		hash->Init(numObjects, numObjects * 2, 1.0f, MEM_TAGS::SCENE);
+
+		BenchTimer timer;
+		for (uint32_t i = 0; i < numObjects; i++)
+		{
+			hash->Insert(i, objects[i].center, objects[i].radius);
+		}
+		snprintf(line, sizeof(line), "%u objects, insert", numObjects);
+		TestHarness::Report(line, timer.ElapsedNs() / numObjects, "ns/object");
+
+		for (uint32_t i = 0; i < numObjects; i++)
+		{
+			objects[i].center.x += (NextUnitFloat(rng) - 0.5f) * 0.5f;
+			objects[i].center.y += (NextUnitFloat(rng) - 0.5f) * 0.5f;
+			objects[i].center.z += (NextUnitFloat(rng) - 0.5f) * 0.5f;
+		}
+		timer.Restart();
+		for (uint32_t i = 0; i < numObjects; i++)
+		{
+			hash->Move(i, objects[i].center, objects[i].radius);
+		}
+		snprintf(line, sizeof(line), "%u objects, move (small steps)", numObjects);
+		TestHarness::Report(line, timer.ElapsedNs() / numObjects, "ns/object");
+
+		for (uint32_t i = 0; i < numObjects; i++)
+		{
+			objects[i].center = RandomPoint(rng, extent);
+		}
+		timer.Restart();
+		for (uint32_t i = 0; i < numObjects; i++)
+		{
+			hash->Move(i, objects[i].center, objects[i].radius);
+		}
+		snprintf(line, sizeof(line), "%u objects, move (teleports)", numObjects);
+		TestHarness::Report(line, timer.ElapsedNs() / numObjects, "ns/object");
+
+		DirectX::XMFLOAT3* queryPoints = Memory::AllocateArray<DirectX::XMFLOAT3>(hash_bench_queries);
+		for (uint32_t q = 0; q < hash_bench_queries; q++)
+		{
+			queryPoints[q] = RandomPoint(rng, extent);
+		}
+
+		uint64_t matches = 0;
+		for (float radius : hash_bench_query_radii)
+		{
+			uint64_t radiusMatches = 0;
+			timer.Restart();
+			for (uint32_t q = 0; q < hash_bench_queries; q++)
+			{
+				radiusMatches += hash->QueryRadius(queryPoints[q], radius, results, hash_bench_max_results);
+			}
+			snprintf(line, sizeof(line), "%u objects, radius %.0f query", numObjects, radius);
+			TestHarness::Report(line, timer.ElapsedNs() / hash_bench_queries, "ns/query");
+			snprintf(line, sizeof(line), "%u objects, radius %.0f query matches", numObjects, radius);
+			TestHarness::Report(line, static_cast<double>(radiusMatches) / hash_bench_queries, "objects");
+			matches += radiusMatches;
+		}
+
+		timer.Restart();
+		for (uint32_t q = 0; q < hash_bench_queries; q++)
+		{
+			matches += hash->QueryNearest(queryPoints[q], 8, results, distances);
+		}
+		snprintf(line, sizeof(line), "%u objects, 8-nearest query", numObjects);
+		TestHarness::Report(line, timer.ElapsedNs() / hash_bench_queries, "ns/query");
+
+		timer.Restart();
+		for (uint32_t q = 0; q < hash_bench_scans; q++)
+		{
+			matches += ScanRadius(objects, numObjects, queryPoints[q], hash_bench_query_radii[0]);
+		}
+		snprintf(line, sizeof(line), "%u objects, linear scan (any radius)", numObjects);
+		TestHarness::Report(line, timer.ElapsedNs() / hash_bench_scans, "ns/query");
+		TestHarness::Consume(matches);
+	}
+}
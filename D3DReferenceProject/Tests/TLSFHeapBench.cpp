@@ -0,0 +1,125 @@
+#include "TestHarness.h"
+#include "TLSFHeap.h"
+#include "Memory.h"
+#include <cstdio>
+#include <cstdlib>
+
+// TLSF vs malloc under a randomized load/unload workload: a fixed set of slots, each step either loading a randomly-sized allocation into an
+// empty slot or unloading a random live one, biased towards loads while the heap is mostly empty (streaming models in & out, roughly)
+// Reports mean & worst-case latency per operation (each timed individually, so both sides pay the same clock overhead; worst cases include
+// page faults & preemption), then TLSF's fragmentation
+// at the end of the run; malloc has no portable way to report the same
+
+constexpr uint32_t churn_slots = 2048;
+constexpr uint32_t churn_steps = 200000;
+constexpr uint32_t churn_min_bytes = 16;
+constexpr uint32_t churn_max_bytes_log2 = 16; // Up to 64KB, so live bytes stay well under the heap's capacity
+constexpr uint64_t churn_heap_bytes = 256ull * 1024ull * 1024ull;
+
+struct ChurnStats
+{
+	double allocNs = 0.0;
+	double freeNs = 0.0;
+	double worstAllocNs = 0.0;
+	double worstFreeNs = 0.0;
+	uint32_t numAllocs = 0;
+	uint32_t numFrees = 0;
+};
+
+uint64_t NextRandom(uint64_t& state)
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+// Log-uniform sizes; most allocations are small, a few are large
+uint32_t RandomSize(uint64_t& state)
+{
+	const uint32_t log2 = static_cast<uint32_t>(NextRandom(state) % (churn_max_bytes_log2 - 3)) + 4;
+	const uint32_t size = static_cast<uint32_t>(NextRandom(state) % (1u << log2));
+	return (size < churn_min_bytes) ? churn_min_bytes : size;
+}
+
+// [AllocFn]/[FreeFn] wrap the allocator under test; both sides replay the same random sequence
+template<typename AllocFn, typename FreeFn>
+ChurnStats Churn(void** slots, AllocFn alloc, FreeFn release)
+{
+	ChurnStats stats;
+	uint32_t numLive = 0;
+	uint64_t rng = 0x2545F4914F6CDD1Dull;
+	for (uint32_t i = 0; i < churn_slots; i++)
+	{
+		slots[i] = nullptr;
+	}
+
+	for (uint32_t step = 0; step < churn_steps; step++)
+	{
+		const uint32_t slot = static_cast<uint32_t>(NextRandom(rng) % churn_slots);
+		const bool load = (slots[slot] == nullptr) && ((NextRandom(rng) % churn_slots) >= numLive / 2);
+		if (load)
+		{
+			const uint32_t bytes = RandomSize(rng);
+			BenchTimer timer;
+			slots[slot] = alloc(bytes);
+			const double ns = timer.ElapsedNs();
+			static_cast<char*>(slots[slot])[0] = 1; // Touch it, like a real load would
+			stats.allocNs += ns;
+			stats.worstAllocNs = (ns > stats.worstAllocNs) ? ns : stats.worstAllocNs;
+			stats.numAllocs++;
+			numLive++;
+		}
+		else if (slots[slot] != nullptr)
+		{
+			BenchTimer timer;
+			release(slots[slot]);
+			const double ns = timer.ElapsedNs();
+			stats.freeNs += ns;
+			stats.worstFreeNs = (ns > stats.worstFreeNs) ? ns : stats.worstFreeNs;
+			stats.numFrees++;
+			slots[slot] = nullptr;
+			numLive--;
+		}
+	}
+
+	return stats;
+}
+
+void ReportChurn(const char* label, const ChurnStats& stats)
+{
+	char line[96] = {};
+	snprintf(line, sizeof(line), "%s, mean allocate", label);
+	TestHarness::Report(line, stats.allocNs / stats.numAllocs, "ns");
+	snprintf(line, sizeof(line), "%s, worst allocate", label);
+	TestHarness::Report(line, stats.worstAllocNs, "ns");
+	snprintf(line, sizeof(line), "%s, mean free", label);
+	TestHarness::Report(line, stats.freeNs / stats.numFrees, "ns");
+	snprintf(line, sizeof(line), "%s, worst free", label);
+	TestHarness::Report(line, stats.worstFreeNs, "ns");
+}
+
+BENCHMARK(TLSFHeapVsMallocChurn)
+{
+	void** slots = Memory::AllocateArray<void*>(churn_slots, alignof(void*));
+
+	TLSFHeap heap;
+	heap.Init(churn_heap_bytes);
+	const ChurnStats tlsfStats = Churn(slots, [&heap](uint32_t bytes) { return heap.Allocate(bytes); }, [&heap](void* addr) { heap.Free(addr); });
+	ReportChurn("TLSF", tlsfStats);
+
+	// Fragmentation with the final working set still live; 0% means every free byte sits in one block
+	const TLSFHeap::HeapStats heapStats = heap.GetStats();
+	const double fragmentation = (heapStats.freeBytes > 0) ? (100.0 * (1.0 - static_cast<double>(heapStats.largestFreeBlock) / heapStats.freeBytes)) : 0.0;
+	TestHarness::Report("TLSF, live bytes at end", static_cast<double>(heapStats.usedBytes), "bytes");
+	TestHarness::Report("TLSF, free blocks at end", heapStats.numFreeBlocks, "blocks");
+	TestHarness::Report("TLSF, fragmentation (1 - largest free / free)", fragmentation, "%");
+	heap.DeInit();
+
+	const ChurnStats mallocStats = Churn(slots, [](uint32_t bytes) { return std::malloc(bytes); }, [](void* addr) { std::free(addr); });
+	ReportChurn("malloc", mallocStats);
+	for (uint32_t i = 0; i < churn_slots; i++)
+	{
+		std::free(slots[i]);
+	}
+}
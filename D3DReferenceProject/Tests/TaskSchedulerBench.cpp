@@ -0,0 +1,121 @@
+#include "TestHarness.h"
+#include "TaskScheduler.h"
+#include <thread>
+#include <cstdio>
+
+// Scheduler overhead & scaling
+//	Spawn cost:	empty tasks spawned from the main thread into one group, timed once for the spawns alone & once through the Wait() that drains them
+//	Scaling:	ParallelFor over a fixed, compute-bound range, restarting the scheduler with 1, 2, 4... workers up to one per core, against the
+//				same loop run serially
+// The scheduler is restarted with its default worker count afterwards, so later cases see it as usual
+
+constexpr uint32_t spawn_batch = 1024; // Well under deque_capacity, so nothing runs inline at spawn
+constexpr uint32_t spawn_batches = 256;
+constexpr uint32_t scaling_items = 1 << 20;
+constexpr uint32_t scaling_rounds = 8;
+
+void EmptyTask(void* data)
+{
+}
+
+// A few dozen ns of pure ALU work per item, so the loop scales with cores rather than memory bandwidth
+uint64_t HashItem(uint32_t item)
+{
+	uint64_t h = item * 0x9E3779B97F4A7C15ull;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		h ^= h >> 29;
+		h *= 0xBF58476D1CE4E5B9ull;
+	}
+	return h;
+}
+
+struct ScalingData
+{
+	std::atomic<uint64_t> checksum = 0;
+};
+
+void HashRange(uint32_t begin, uint32_t end, void* data)
+{
+	uint64_t sum = 0;
+	for (uint32_t i = begin; i < end; i++)
+	{
+		sum += HashItem(i);
+	}
+	static_cast<ScalingData*>(data)->checksum.fetch_add(sum, std::memory_order_relaxed);
+}
+
+BENCHMARK(TaskSchedulerSpawnCost)
+{
+	double spawnNs = 0.0;
+	double totalNs = 0.0;
+	for (uint32_t batch = 0; batch < spawn_batches; batch++)
+	{
+		TaskGroup group;
+		BenchTimer timer;
+		for (uint32_t i = 0; i < spawn_batch; i++)
+		{
+			TaskScheduler::Run(group, EmptyTask, nullptr);
+		}
+		spawnNs += timer.ElapsedNs();
+		TaskScheduler::Wait(group);
+		totalNs += timer.ElapsedNs();
+	}
+
+	TestHarness::Report("scheduler threads", TaskScheduler::NumThreads(), "");
+	TestHarness::Report("spawn (Run) only", spawnNs / (spawn_batches * spawn_batch), "ns/task");
+	TestHarness::Report("spawn + run + wait", totalNs / (spawn_batches * spawn_batch), "ns/task");
+
+	// The smallest useful ParallelFor: one piece per thread over a trivially short range, i.e. its fixed cost per call
+	ScalingData data;
+	BenchTimer timer;
+	for (uint32_t call = 0; call < spawn_batches; call++)
+	{
+		TaskScheduler::ParallelFor(0, TaskScheduler::NumThreads(), HashRange, &data);
+	}
+	TestHarness::Report("ParallelFor fixed cost (one item per thread)", timer.ElapsedNs() / spawn_batches, "ns/call");
+	TestHarness::Consume(data.checksum.load());
+}
+
+BENCHMARK(TaskSchedulerParallelForScaling)
+{
+	ScalingData data;
+	BenchTimer timer;
+	for (uint32_t round = 0; round < scaling_rounds; round++)
+	{
+		HashRange(0, scaling_items, &data);
+	}
+	const double serialMs = timer.ElapsedMs() / scaling_rounds;
+	TestHarness::Report("serial loop", serialMs, "ms");
+
+	const uint32_t cores = std::thread::hardware_concurrency();
+	const uint32_t maxWorkers = (cores > 1) ? cores - 1 : 1;
+
+	char line[96] = {};
+	for (uint32_t workers = 1; ; workers = (workers * 2 < maxWorkers) ? workers * 2 : maxWorkers)
+	{
+		TaskScheduler::DeInit();
+		TaskScheduler::Init(workers);
+
+		timer.Restart();
+		for (uint32_t round = 0; round < scaling_rounds; round++)
+		{
+			TaskScheduler::ParallelFor(0, scaling_items, HashRange, &data);
+		}
+		const double parallelMs = timer.ElapsedMs() / scaling_rounds;
+
+		snprintf(line, sizeof(line), "ParallelFor, %u thread(s)", TaskScheduler::NumThreads());
+		TestHarness::Report(line, parallelMs, "ms");
+		snprintf(line, sizeof(line), "ParallelFor, %u thread(s), speedup", TaskScheduler::NumThreads());
+		TestHarness::Report(line, serialMs / parallelMs, "x");
+
+		if (workers >= maxWorkers)
+		{
+			break;
+		}
+	}
+
+	TaskScheduler::DeInit();
+	TaskScheduler::Init();
+	TestHarness::Consume(data.checksum.load());
+}
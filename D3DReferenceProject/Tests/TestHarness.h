@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+
+// Minimal test & benchmark runner for the Tests project
+// Cases register themselves at static-init time through TEST_CASE()/BENCHMARK(); failed checks are reported & counted rather than aborting, so
+// one run lists everything that's broken
+// Usage: Tests.exe [--bench] [name filter]
+//	Tests run by default; --bench runs the benchmarks instead (build Release for meaningful numbers)
+//	The filter is a plain substring match against case names
+// The process exit code is the number of failed checks
+// Memory, the Profiler & the TaskScheduler are up for every case, & the main arena is rewound after each one; cases that take loans from the
+// large-page region give them back themselves
+// Profiler zones are compiled in for every configuration (PROFILER_ZONES=1 in the project), so Release runs can measure them
+
+typedef void (*TestFn)();
+
+class TestHarness
+{
+	public:
+		static constexpr uint32_t max_cases = 256;
+
+		static void Register(const char* name, TestFn fn, bool benchmark);
+		static int Run(int argc, char** argv);
+
+		// Check failures; [file] & [line] point at the failing CHECK
+		static void Fail(const char* file, int line, const char* expr);
+		static void FailNear(const char* file, int line, const char* expr, double a, double b);
+
+		// Benchmark output, one aligned line per result
+		static void Report(const char* label, double value, const char* unit);
+
+		// Keeps benchmarked results alive, so the optimizer can't drop the work producing them
+		static void Consume(uint64_t value);
+};
+
+struct TestRegistrar
+{
+	TestRegistrar(const char* name, TestFn fn, bool benchmark) { TestHarness::Register(name, fn, benchmark); }
+};
+
+// Wall-clock stopwatch for benchmarks
+class BenchTimer
+{
+	public:
+		BenchTimer() : start(std::chrono::steady_clock::now()) {}
+		void Restart() { start = std::chrono::steady_clock::now(); }
+		double ElapsedMs() const { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(); }
+		double ElapsedNs() const { return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count(); }
+
+	private:
+		std::chrono::steady_clock::time_point start;
+};
+
+#define TEST_CASE(name) static void name(); static TestRegistrar name##Registrar(#name, name, false); static void name()
+#define BENCHMARK(name) static void name(); static TestRegistrar name##Registrar(#name, name, true); static void name()
+
+#define CHECK(cond) ((cond) ? (void)0 : TestHarness::Fail(__FILE__, __LINE__, #cond))
+#define CHECK_NEAR(a, b, eps) ((((a) - (b)) <= (eps) && ((b) - (a)) <= (eps)) ? (void)0 : TestHarness::FailNear(__FILE__, __LINE__, #a " ~= " #b, (a), (b)))
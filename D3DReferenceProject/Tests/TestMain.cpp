@@ -0,0 +1,117 @@
+#include "TestHarness.h"
+#include "Memory.h"
+#include "Profiler.h"
+#include "TaskScheduler.h"
+#include <cstdio>
+#include <cstring>
+
+struct TestCase
+{
+	const char* name;
+	TestFn fn;
+	bool benchmark;
+};
+
+// Registration happens during static init, before Memory exists, so the registry is a plain fixed-size array
+TestCase cases[TestHarness::max_cases] = {};
+uint32_t numCases = 0;
+
+uint32_t numFailures = 0;
+volatile uint64_t consumed = 0;
+
+void TestHarness::Register(const char* name, TestFn fn, bool benchmark)
+{
+	if (numCases == max_cases)
+	{
+		std::printf("Too many test cases; raise TestHarness::max_cases (dropped %s)\n", name);
+		numFailures++;
+		return;
+	}
+
+	cases[numCases++] = { name, fn, benchmark };
+}
+
+void TestHarness::Fail(const char* file, int line, const char* expr)
+{
+	std::printf("  FAILED %s(%d): %s\n", file, line, expr);
+	numFailures++;
+}
+
+void TestHarness::FailNear(const char* file, int line, const char* expr, double a, double b)
+{
+	std::printf("  FAILED %s(%d): %s (%f vs %f)\n", file, line, expr, a, b);
+	numFailures++;
+}
+
+void TestHarness::Report(const char* label, double value, const char* unit)
+{
+	std::printf("  %-56s %12.3f %s\n", label, value, unit);
+}
+
+void TestHarness::Consume(uint64_t value)
+{
+	consumed = consumed + value;
+}
+
+int TestHarness::Run(int argc, char** argv)
+{
+	bool benchmarks = false;
+	const char* filter = nullptr;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--bench") == 0)
+		{
+			benchmarks = true;
+		}
+		else
+		{
+			filter = argv[i];
+		}
+	}
+
+#ifdef _DEBUG
+	if (benchmarks)
+	{
+		std::printf("Debug build; benchmark numbers are only useful for spotting gross regressions\n");
+	}
+#endif
+
+	uint32_t numRun = 0;
+	for (uint32_t i = 0; i < numCases; i++)
+	{
+		const TestCase& test = cases[i];
+		if (test.benchmark != benchmarks || (filter != nullptr && std::strstr(test.name, filter) == nullptr))
+		{
+			continue;
+		}
+
+		std::printf("%s\n", test.name);
+		const uint32_t failuresBefore = numFailures;
+
+		// Rewind everything the case took from the main arena, so a run's footprint is its largest case rather than the sum of them
+		void* mark = Memory::AllocateSingle<char>();
+		test.fn();
+		Memory::FreeToAddress(mark);
+
+		std::printf("  %s\n", (numFailures == failuresBefore) ? "ok" : "FAILED");
+		numRun++;
+	}
+
+	std::printf("\n%u %s run, %u failed check(s)\n", numRun, benchmarks ? "benchmark(s)" : "test(s)", numFailures);
+	return static_cast<int>(numFailures);
+}
+
+int main(int argc, char** argv)
+{
+	Memory::Init();
+	Profiler::Init(1 + TaskScheduler::max_workers + TaskScheduler::max_attached_threads);
+	Profiler::NameThread("Main");
+	TaskScheduler::Init();
+
+	const int failures = TestHarness::Run(argc, argv);
+
+	TaskScheduler::DeInit();
+	Profiler::DeInit();
+	Memory::DeInit();
+	return failures;
+}
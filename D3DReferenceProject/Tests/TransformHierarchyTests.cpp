@@ -0,0 +1,178 @@
+#include "TestHarness.h"
+#include "TransformHierarchy.h"
+#include "SQTBatch.h"
+#include "Memory.h"
+#include <DirectXMath.h>
+#include <new>
+
+// World transforms from Propagate() against composing by hand, plus the bookkeeping that keeps clean subtrees out of uploads
+
+constexpr float hierarchy_eps = 1e-4f;
+
+struct HierarchyTestData
+{
+	TransformHierarchy hierarchy;
+	TransformStore worlds;
+	TransformStreams snapshot;
+	uint64_t changedEpochs[TransformStreams::capacity];
+};
+
+HierarchyTestData* NewHierarchyTestData()
+{
+	return new (Memory::AllocateSingle<HierarchyTestData>(alignof(HierarchyTestData))) HierarchyTestData();
+}
+
+// Any unit quaternion will do; [spin] just picks a different one
+SQT_Transform HierarchyTransform(float spin, float x, float y, float z, float scale)
+{
+	SQT_Transform transform;
+	DirectX::XMStoreFloat4(&transform.q, DirectX::XMQuaternionNormalize(DirectX::XMVectorSet(spin, spin * 0.5f, -spin, 1.0f)));
+	transform.ts = DirectX::XMFLOAT4(x, y, z, scale);
+	return transform;
+}
+
+// Row-vector matrix for [transform], the same convention as SQTBatch::ToMatrices()
+DirectX::XMMATRIX HierarchyMatrix(const SQT_Transform& transform)
+{
+	return DirectX::XMMatrixAffineTransformation(DirectX::XMVectorReplicate(transform.ts.w), DirectX::XMVectorZero(),
+												 DirectX::XMLoadFloat4(&transform.q),
+												 DirectX::XMVectorSet(transform.ts.x, transform.ts.y, transform.ts.z, 0.0f));
+}
+
+bool MatricesNear(DirectX::FXMMATRIX a, DirectX::CXMMATRIX b)
+{
+	DirectX::XMFLOAT4X4 ma;
+	DirectX::XMFLOAT4X4 mb;
+	DirectX::XMStoreFloat4x4(&ma, a);
+	DirectX::XMStoreFloat4x4(&mb, b);
+
+	bool near = true;
+	for (uint32_t r = 0; r < 4; r++)
+	{
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			const float error = ma.m[r][c] - mb.m[r][c];
+			near &= (error <= hierarchy_eps) && (error >= -hierarchy_eps);
+		}
+	}
+	return near;
+}
+
+bool SameTransform(const SQT_Transform& a, const SQT_Transform& b)
+{
+	return a.q.x == b.q.x && a.q.y == b.q.y && a.q.z == b.q.z && a.q.w == b.q.w &&
+		   a.ts.x == b.ts.x && a.ts.y == b.ts.y && a.ts.z == b.ts.z && a.ts.w == b.ts.w;
+}
+
+TEST_CASE(HierarchyComposesChains)
+{
+	HierarchyTestData& data = *NewHierarchyTestData();
+	const SQT_Transform root = HierarchyTransform(0.3f, 5.0f, 0.0f, -2.0f, 2.0f);
+	const SQT_Transform child = HierarchyTransform(-0.7f, 1.0f, 2.0f, 0.0f, 0.5f);
+	const SQT_Transform grandchild = HierarchyTransform(1.1f, 0.0f, -1.0f, 3.0f, 1.5f);
+	data.hierarchy.AddNode(0, TransformHierarchy::no_parent, root);
+	data.hierarchy.AddNode(1, 0, child);
+	data.hierarchy.AddNode(2, 1, grandchild);
+	data.hierarchy.Propagate(data.worlds);
+
+	// Row vectors, so a child's world matrix is its local matrix followed by every ancestor's
+	const DirectX::XMMATRIX rootWorld = HierarchyMatrix(root);
+	const DirectX::XMMATRIX childWorld = DirectX::XMMatrixMultiply(HierarchyMatrix(child), rootWorld);
+	const DirectX::XMMATRIX grandchildWorld = DirectX::XMMatrixMultiply(HierarchyMatrix(grandchild), childWorld);
+	CHECK(MatricesNear(HierarchyMatrix(data.worlds.Get(0)), rootWorld));
+	CHECK(MatricesNear(HierarchyMatrix(data.worlds.Get(1)), childWorld));
+	CHECK(MatricesNear(HierarchyMatrix(data.worlds.Get(2)), grandchildWorld));
+
+	// Moving the middle node carries the grandchild along
+	const SQT_Transform moved = HierarchyTransform(0.2f, -4.0f, 1.0f, 1.0f, 1.0f);
+	data.hierarchy.SetLocal(1, moved);
+	data.hierarchy.Propagate(data.worlds);
+	const DirectX::XMMATRIX movedWorld = DirectX::XMMatrixMultiply(HierarchyMatrix(moved), rootWorld);
+	CHECK(MatricesNear(HierarchyMatrix(data.worlds.Get(1)), movedWorld));
+	CHECK(MatricesNear(HierarchyMatrix(data.worlds.Get(2)), DirectX::XMMatrixMultiply(HierarchyMatrix(grandchild), movedWorld)));
+}
+
+TEST_CASE(HierarchyOnlyUpdatesDirtySubtrees)
+{
+	//     0
+	//   1   2
+	//   3   4
+	HierarchyTestData& data = *NewHierarchyTestData();
+	data.hierarchy.AddNode(0, TransformHierarchy::no_parent, HierarchyTransform(0.1f, 1.0f, 0.0f, 0.0f, 1.0f));
+	data.hierarchy.AddNode(1, 0, HierarchyTransform(0.2f, 0.0f, 1.0f, 0.0f, 1.0f));
+	data.hierarchy.AddNode(2, 0, HierarchyTransform(0.3f, 0.0f, 0.0f, 1.0f, 1.0f));
+	data.hierarchy.AddNode(3, 1, HierarchyTransform(0.4f, 1.0f, 1.0f, 0.0f, 1.0f));
+	data.hierarchy.AddNode(4, 2, HierarchyTransform(0.5f, 0.0f, 1.0f, 1.0f, 1.0f));
+	data.hierarchy.Propagate(data.worlds);
+	const uint64_t settled = data.worlds.Publish(data.snapshot, data.changedEpochs, 5);
+
+	// Scribble over 4's world transform behind the hierarchy's back; recomputing it would overwrite this
+	SQT_Transform scribbled = data.worlds.Get(4);
+	scribbled.ts.x = -999.0f;
+	data.worlds.Streams().tx[4] = scribbled.ts.x;
+	const SQT_Transform rootBefore = data.worlds.Get(0);
+	const SQT_Transform siblingBefore = data.worlds.Get(2);
+
+	data.hierarchy.SetLocal(1, HierarchyTransform(-0.2f, 0.0f, 2.0f, 0.0f, 1.0f));
+	data.hierarchy.Propagate(data.worlds);
+	const uint64_t moved = data.worlds.Publish(data.snapshot, data.changedEpochs, 5);
+
+	CHECK(data.changedEpochs[1] == moved && data.changedEpochs[3] == moved);
+	CHECK(data.changedEpochs[0] == settled && data.changedEpochs[2] == settled && data.changedEpochs[4] == settled);
+	CHECK(SameTransform(data.worlds.Get(0), rootBefore));
+	CHECK(SameTransform(data.worlds.Get(2), siblingBefore));
+	CHECK(SameTransform(data.worlds.Get(4), scribbled));
+
+	// Nothing changed since; nothing to do
+	data.hierarchy.Propagate(data.worlds);
+	CHECK(data.worlds.Publish(data.snapshot, data.changedEpochs, 5) == moved + 1);
+	CHECK(data.changedEpochs[1] == moved && data.changedEpochs[3] == moved);
+}
+
+TEST_CASE(HierarchyWideLevelsMatchSerialComposition)
+{
+	// 160 children under one root (wide enough to split across the scheduler), & 80 grandchildren (composed serially)
+	constexpr uint16_t num_children = 160;
+	constexpr uint16_t num_grandchildren = 80;
+	HierarchyTestData& data = *NewHierarchyTestData();
+	data.hierarchy.AddNode(0, TransformHierarchy::no_parent, HierarchyTransform(0.25f, 3.0f, -1.0f, 2.0f, 1.5f));
+	for (uint16_t i = 0; i < num_children; i++)
+	{
+		data.hierarchy.AddNode(1 + i, 0, HierarchyTransform(0.01f * i, static_cast<float>(i), 0.5f, -0.25f * i, 0.75f + 0.005f * i));
+	}
+
+	for (uint16_t i = 0; i < num_grandchildren; i++)
+	{
+		data.hierarchy.AddNode(1 + num_children + i, 1 + (i * 2), HierarchyTransform(-0.02f * i, 0.0f, static_cast<float>(i), 1.0f, 1.25f));
+	}
+	data.hierarchy.Propagate(data.worlds);
+
+	// One node at a time through the same kernel, in depth order
+	TransformStreams& expected = *Memory::AllocateSingle<TransformStreams>(alignof(TransformStreams));
+	TransformStreams& local = *Memory::AllocateSingle<TransformStreams>(alignof(TransformStreams));
+	TransformStreams& parent = *Memory::AllocateSingle<TransformStreams>(alignof(TransformStreams));
+	expected.Set(0, data.hierarchy.GetLocal(0));
+
+	const uint16_t numNodes = 1 + num_children + num_grandchildren;
+	for (uint16_t model = 1; model < numNodes; model++)
+	{
+		local.Set(0, data.hierarchy.GetLocal(model));
+		parent.Set(0, expected.Get(data.hierarchy.Parent(model)));
+		SQTBatch::Compose(SQTStreams::Of(local), SQTStreams::Of(parent), SQTStreams::Of(local), 1);
+		expected.Set(model, local.Get(0));
+	}
+
+	bool allSame = true;
+	for (uint16_t model = 0; model < numNodes; model++)
+	{
+		allSame &= SameTransform(data.worlds.Get(model), expected.Get(model));
+	}
+	CHECK(allSame);
+
+	// Re-dirtying the root sends the whole tree through again, wide level & all
+	data.hierarchy.SetLocal(0, HierarchyTransform(-0.5f, 0.0f, 0.0f, 0.0f, 1.0f));
+	data.hierarchy.Propagate(data.worlds);
+	const DirectX::XMMATRIX rootWorld = HierarchyMatrix(data.hierarchy.GetLocal(0));
+	const DirectX::XMMATRIX lastChildWorld = DirectX::XMMatrixMultiply(HierarchyMatrix(data.hierarchy.GetLocal(num_children)), rootWorld);
+	CHECK(MatricesNear(HierarchyMatrix(data.worlds.Get(num_children)), lastChildWorld));
+}
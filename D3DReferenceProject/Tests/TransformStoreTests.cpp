@@ -0,0 +1,112 @@
+#include "TestHarness.h"
+#include "TransformStore.h"
+#include "Memory.h"
+#include <new>
+
+// Changed-run merging & epoch stamping; no device involved, runs only describe what an upload would send
+
+constexpr uint32_t max_test_runs = 8;
+
+struct ChangedRuns
+{
+	uint32_t first[max_test_runs];
+	uint32_t counts[max_test_runs];
+	uint32_t numRuns;
+};
+
+// Epochs for [numTransforms] transforms, with the listed indices changed at epoch 1
+void StampChanged(uint64_t* changedEpochs, uint32_t numTransforms, const uint32_t* changed, uint32_t numChanged)
+{
+	for (uint32_t i = 0; i < numTransforms; i++)
+	{
+		changedEpochs[i] = 0;
+	}
+
+	for (uint32_t i = 0; i < numChanged; i++)
+	{
+		changedEpochs[changed[i]] = 1;
+	}
+}
+
+ChangedRuns FindTestRuns(const uint64_t* changedEpochs, uint32_t numTransforms, uint64_t sinceEpoch, uint32_t maxGap, uint32_t maxRuns)
+{
+	ChangedRuns runs;
+	runs.numRuns = FindChangedRuns(changedEpochs, numTransforms, sinceEpoch, maxGap, runs.first, runs.counts, maxRuns);
+	return runs;
+}
+
+TEST_CASE(ChangedRunsMergeAcrossSmallGaps)
+{
+	// Three unchanged transforms between 2 & 6, then a lone change at the end
+	uint64_t changedEpochs[16];
+	const uint32_t changed[] = { 1, 2, 6, 15 };
+	StampChanged(changedEpochs, 16, changed, 4);
+
+	// A gap of exactly [maxGap] merges...
+	ChangedRuns runs = FindTestRuns(changedEpochs, 16, 0, 3, max_test_runs);
+	CHECK(runs.numRuns == 2);
+	CHECK(runs.first[0] == 1 && runs.counts[0] == 6);
+	CHECK(runs.first[1] == 15 && runs.counts[1] == 1);
+
+	// ...& one more keeps the runs apart
+	runs = FindTestRuns(changedEpochs, 16, 0, 2, max_test_runs);
+	CHECK(runs.numRuns == 3);
+	CHECK(runs.first[0] == 1 && runs.counts[0] == 2);
+	CHECK(runs.first[1] == 6 && runs.counts[1] == 1);
+	CHECK(runs.first[2] == 15 && runs.counts[2] == 1);
+
+	// Nothing newer than the epoch asked about, nothing to send
+	CHECK(FindTestRuns(changedEpochs, 16, 1, 3, max_test_runs).numRuns == 0);
+}
+
+TEST_CASE(ChangedRunsOverflowIntoLastRun)
+{
+	// Four isolated changes, but room for only two runs; the second absorbs everything after it
+	uint64_t changedEpochs[40];
+	const uint32_t changed[] = { 0, 10, 20, 30 };
+	StampChanged(changedEpochs, 40, changed, 4);
+
+	const ChangedRuns runs = FindTestRuns(changedEpochs, 40, 0, 0, 2);
+	CHECK(runs.numRuns == 2);
+	CHECK(runs.first[0] == 0 && runs.counts[0] == 1);
+	CHECK(runs.first[1] == 10 && runs.counts[1] == 21);
+}
+
+TEST_CASE(TransformStoreReportsSkippedSnapshots)
+{
+	TransformStore* store = new (Memory::AllocateSingle<TransformStore>(alignof(TransformStore))) TransformStore();
+	TransformStreams* snapshot = Memory::AllocateSingle<TransformStreams>(alignof(TransformStreams));
+	uint64_t changedEpochs[TransformStreams::capacity];
+
+	SQT_Transform moved;
+	moved.q = DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+	moved.ts = DirectX::XMFLOAT4(1.0f, 2.0f, 3.0f, 1.0f);
+
+	// Snapshot 1 moves transform 3; the consumer never gets to it
+	store->Set(3, moved);
+	const uint64_t skipped = store->Publish(*snapshot, changedEpochs, 16);
+
+	// Snapshot 2 moves 12 & 13 through the batch path
+	store->Streams().tx[12] = 4.0f;
+	store->Streams().tx[13] = 5.0f;
+	store->MarkDirty(12, 2);
+	const uint64_t latest = store->Publish(*snapshot, changedEpochs, 16);
+	CHECK(latest == skipped + 1);
+
+	// Uploading from snapshot 2 against the last epoch actually uploaded still picks up transform 3
+	ChangedRuns runs = FindTestRuns(changedEpochs, 16, skipped - 1, 0, max_test_runs);
+	CHECK(runs.numRuns == 2);
+	CHECK(runs.first[0] == 3 && runs.counts[0] == 1);
+	CHECK(runs.first[1] == 12 && runs.counts[1] == 2);
+	CHECK(snapshot->Get(3).ts.y == 2.0f && snapshot->tx[13] == 5.0f);
+
+	// A consumer that did see snapshot 1 only gets what's new since
+	runs = FindTestRuns(changedEpochs, 16, skipped, 0, max_test_runs);
+	CHECK(runs.numRuns == 1);
+	CHECK(runs.first[0] == 12 && runs.counts[0] == 2);
+
+	// Publishing with nothing dirty stamps nothing
+	const uint64_t quiet = store->Publish(*snapshot, changedEpochs, 16);
+	CHECK(FindTestRuns(changedEpochs, 16, latest, 0, max_test_runs).numRuns == 0);
+	CHECK(quiet == latest + 1);
+}
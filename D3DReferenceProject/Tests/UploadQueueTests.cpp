@@ -0,0 +1,148 @@
+#include "TestHarness.h"
+#include "UploadQueue.h"
+#include "Memory.h"
+#include <cstring>
+#include <new>
+
+// Pack() only deals in handles & bytes, so these run without a device; handles here never resolve to anything
+
+struct UploadTestData
+{
+	UploadQueue queue;
+	UploadCopy* copies;
+	char staging[1024];
+};
+
+UploadTestData* NewUploadTestData(uint32_t maxQueuedUploads = 64, uint64_t maxQueuedBytes = 64 * 1024)
+{
+	UploadTestData* data = new (Memory::AllocateSingle<UploadTestData>(alignof(UploadTestData))) UploadTestData();
+	data->queue.Init(maxQueuedUploads, maxQueuedBytes);
+	data->copies = Memory::AllocateArray<UploadCopy>(UploadQueue::max_pieces_per_pack, alignof(UploadCopy));
+	return data;
+}
+
+D3DHandle UploadTestHandle(uint16_t index, uint16_t generation)
+{
+	return D3DHandle{ index, generation, D3D_OBJ_TYPES::BUFFER };
+}
+
+bool EnqueueFilled(UploadQueue& queue, D3DHandle dest, uint32_t destOffset, char value, uint32_t numBytes)
+{
+	char bytes[256];
+	memset(bytes, value, numBytes);
+	return queue.Enqueue(dest, destOffset, bytes, numBytes);
+}
+
+// True if [numBytes] of the copy's staged data, starting [at] bytes into it, are all [value]
+bool StagedAs(const UploadTestData& data, const UploadCopy& copy, uint32_t at, uint32_t numBytes, char value)
+{
+	bool matches = true;
+	for (uint32_t i = at; i < at + numBytes; i++)
+	{
+		matches &= (data.staging[copy.stagingOffset + i] == value);
+	}
+	return matches;
+}
+
+TEST_CASE(UploadQueueMergesOverlappingWrites)
+{
+	UploadTestData& data = *NewUploadTestData();
+	const D3DHandle a = UploadTestHandle(1, 1);
+	const D3DHandle b = UploadTestHandle(2, 1);
+
+	// Two overlapping writes (the later one wins the overlap), one past a gap, & one to another buffer; queued out of destination order
+	EnqueueFilled(data.queue, b, 0, 'd', 4);
+	EnqueueFilled(data.queue, a, 4, 'b', 8);
+	EnqueueFilled(data.queue, a, 20, 'c', 4);
+	EnqueueFilled(data.queue, a, 0, 'a', 8);
+	EnqueueFilled(data.queue, a, 6, 'e', 2);
+
+	const uint32_t numCopies = data.queue.Pack(data.staging, sizeof(data.staging), data.copies);
+	CHECK(numCopies == 3);
+	CHECK(data.queue.NumQueued() == 0);
+
+	const UploadCopy& merged = data.copies[0];
+	CHECK(merged.dest.index == 1 && merged.destOffset == 0 && merged.numBytes == 12);
+	CHECK(StagedAs(data, merged, 0, 6, 'a'));
+	CHECK(StagedAs(data, merged, 6, 2, 'e'));
+	CHECK(StagedAs(data, merged, 8, 4, 'b'));
+
+	CHECK(data.copies[1].dest.index == 1 && data.copies[1].destOffset == 20 && data.copies[1].numBytes == 4);
+	CHECK(StagedAs(data, data.copies[1], 0, 4, 'c'));
+	CHECK(data.copies[2].dest.index == 2 && data.copies[2].destOffset == 0 && data.copies[2].numBytes == 4);
+	CHECK(StagedAs(data, data.copies[2], 0, 4, 'd'));
+	data.queue.DeInit();
+}
+
+TEST_CASE(UploadQueueSplitsAcrossBudget)
+{
+	UploadTestData& data = *NewUploadTestData();
+	const D3DHandle a = UploadTestHandle(1, 1);
+	EnqueueFilled(data.queue, a, 0, 'a', 100);
+	EnqueueFilled(data.queue, a, 200, 'b', 100);
+
+	// The second write crosses the budget; its first half goes now, & the rest stays queued (at its original position in the queue)
+	uint32_t numCopies = data.queue.Pack(data.staging, 150, data.copies);
+	CHECK(numCopies == 2);
+	CHECK(data.queue.NumQueued() == 1);
+	CHECK(data.copies[0].destOffset == 0 && data.copies[0].numBytes == 100 && StagedAs(data, data.copies[0], 0, 100, 'a'));
+	CHECK(data.copies[1].destOffset == 200 && data.copies[1].numBytes == 50 && StagedAs(data, data.copies[1], 0, 50, 'b'));
+
+	numCopies = data.queue.Pack(data.staging, 150, data.copies);
+	CHECK(numCopies == 1);
+	CHECK(data.queue.NumQueued() == 0);
+	CHECK(data.copies[0].destOffset == 250 && data.copies[0].numBytes == 50 && StagedAs(data, data.copies[0], 0, 50, 'b'));
+
+	CHECK(data.queue.Pack(data.staging, 150, data.copies) == 0);
+	data.queue.DeInit();
+}
+
+TEST_CASE(UploadQueueKeepsReleasedDestinationsApart)
+{
+	// A write queued for a buffer that's since been released, then one for the buffer that took over its slot; they share an index but
+	// aren't the same destination, so neither may merge into (or overwrite) the other
+	UploadTestData& data = *NewUploadTestData();
+	const D3DHandle released = UploadTestHandle(3, 1);
+	const D3DHandle reused = UploadTestHandle(3, 2);
+	EnqueueFilled(data.queue, released, 0, 'r', 16);
+	EnqueueFilled(data.queue, reused, 8, 'n', 16);
+
+	const uint32_t numCopies = data.queue.Pack(data.staging, sizeof(data.staging), data.copies);
+	CHECK(numCopies == 2);
+
+	const UploadCopy& oldCopy = (data.copies[0].dest.generation == 1) ? data.copies[0] : data.copies[1];
+	const UploadCopy& newCopy = (data.copies[0].dest.generation == 1) ? data.copies[1] : data.copies[0];
+	CHECK(oldCopy.dest.generation == 1 && oldCopy.destOffset == 0 && oldCopy.numBytes == 16 && StagedAs(data, oldCopy, 0, 16, 'r'));
+	CHECK(newCopy.dest.generation == 2 && newCopy.destOffset == 8 && newCopy.numBytes == 16 && StagedAs(data, newCopy, 0, 16, 'n'));
+	data.queue.DeInit();
+}
+
+TEST_CASE(UploadQueueRefusesWritesWhenFull)
+{
+	// Out of entries: the third write is turned away without queueing anything, & fits again once a Pack() drains the first two
+	UploadTestData& data = *NewUploadTestData(2);
+	const D3DHandle a = UploadTestHandle(1, 1);
+	CHECK(EnqueueFilled(data.queue, a, 0, 'a', 16) && EnqueueFilled(data.queue, a, 16, 'b', 16));
+	CHECK(!EnqueueFilled(data.queue, a, 32, 'c', 16));
+	CHECK(data.queue.NumQueued() == 2);
+	CHECK(data.queue.Pack(data.staging, sizeof(data.staging), data.copies) == 1 && data.copies[0].numBytes == 32);
+	CHECK(EnqueueFilled(data.queue, a, 32, 'c', 16));
+	CHECK(data.queue.Pack(data.staging, sizeof(data.staging), data.copies) == 1 && StagedAs(data, data.copies[0], 0, 16, 'c'));
+	data.queue.DeInit();
+
+	// Out of data space: same again, & the refused write's bytes don't stay claimed
+	UploadTestData& small = *NewUploadTestData(64, 512);
+	uint32_t numQueued = 0;
+	while (numQueued < 4 && EnqueueFilled(small.queue, a, numQueued * 256, 'd', 256))
+	{
+		numQueued++;
+	}
+	CHECK(numQueued > 0 && numQueued < 4);
+	CHECK(small.queue.NumQueued() == numQueued);
+	CHECK(!EnqueueFilled(small.queue, a, 0, 'e', 256));
+
+	small.queue.Pack(small.staging, sizeof(small.staging), small.copies);
+	CHECK(small.queue.NumQueued() == 0);
+	CHECK(EnqueueFilled(small.queue, a, 0, 'e', 256));
+	small.queue.DeInit();
+}
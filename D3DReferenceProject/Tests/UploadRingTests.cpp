@@ -0,0 +1,98 @@
+#include "TestHarness.h"
+#include "UploadRing.h"
+
+// The ring only hands out offsets, so a plain frame counter stands in for GPU fences
+
+TEST_CASE(UploadRingAlignsOffsets)
+{
+	UploadRing ring;
+	ring.Init(4096);
+
+	uint32_t offset = 0xFFFFFFFF;
+	CHECK(ring.Allocate(10, 1, offset) && offset == 0);
+	CHECK(ring.Allocate(16, 256, offset) && offset == 256);
+	CHECK(ring.Allocate(4, 64, offset) && offset == 320);
+
+	// Padding skipped for alignment stays held until the frame retires
+	CHECK(ring.BytesInUse() == 324);
+}
+
+TEST_CASE(UploadRingWrapsOntoRetiredSpace)
+{
+	UploadRing ring;
+	ring.Init(1024);
+
+	uint32_t offset = 0xFFFFFFFF;
+	CHECK(ring.Allocate(600, 4, offset) && offset == 0);
+	ring.EndFrame(0);
+	CHECK(ring.Allocate(200, 4, offset) && offset == 600);
+	ring.EndFrame(1);
+
+	// Would straddle the end, so it skips to the start, which frame 0 still holds; a failed allocation leaves the ring as it was
+	CHECK(!ring.Allocate(600, 4, offset));
+	CHECK(ring.BytesInUse() == 800);
+
+	// Once frame 0 retires the same allocation wraps, & the skipped tail is held along with it
+	ring.Retire(1);
+	CHECK(ring.Allocate(600, 4, offset) && offset == 0);
+	CHECK(ring.BytesInUse() == 1024);
+	ring.EndFrame(2);
+
+	ring.Retire(2);
+	CHECK(ring.BytesInUse() == 824);
+	ring.Retire(3);
+	CHECK(ring.BytesInUse() == 0);
+
+	// An empty ring has nothing holding the bytes a wrap skips, so it can always hand out its full capacity
+	CHECK(ring.Allocate(1024, 4, offset) && offset == 0);
+}
+
+TEST_CASE(UploadRingRetiresFramesInOrder)
+{
+	UploadRing ring;
+	ring.Init(4096);
+
+	uint32_t offset = 0;
+	for (uint64_t frame = 0; frame < 4; frame++)
+	{
+		ring.Allocate(256, 4, offset);
+		ring.EndFrame(frame);
+	}
+	CHECK(ring.OldestPendingFrame() == 0);
+	CHECK(ring.BytesInUse() == 1024);
+
+	ring.Retire(2);
+	CHECK(ring.OldestPendingFrame() == 2);
+	CHECK(ring.BytesInUse() == 512);
+
+	// Frames that allocated nothing leave no mark behind
+	ring.Retire(4);
+	ring.EndFrame(4);
+	CHECK(ring.OldestPendingFrame() == ~0ull);
+	CHECK(ring.BytesInUse() == 0);
+}
+
+TEST_CASE(UploadRingMergesOverflowingMarks)
+{
+	UploadRing ring;
+	ring.Init(65536);
+
+	// Two frames past max_pending_frames; the last three all end up on the newest mark
+	constexpr uint64_t num_frames = UploadRing::max_pending_frames + 2;
+	uint32_t offset = 0;
+	for (uint64_t frame = 0; frame < num_frames; frame++)
+	{
+		ring.Allocate(256, 4, offset);
+		ring.EndFrame(frame);
+	}
+	CHECK(ring.BytesInUse() == num_frames * 256);
+
+	// Retiring up to the first merged frame frees everything before the merged mark, but the merged frames wait for the newest of them
+	ring.Retire(UploadRing::max_pending_frames);
+	CHECK(ring.BytesInUse() == 3 * 256);
+	CHECK(ring.OldestPendingFrame() == num_frames - 1);
+
+	ring.Retire(num_frames);
+	CHECK(ring.BytesInUse() == 0);
+	CHECK(ring.OldestPendingFrame() == ~0ull);
+}